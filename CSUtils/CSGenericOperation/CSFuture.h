@@ -0,0 +1,117 @@
+//
+//  CSFuture.h
+//  CSUtils
+//
+//  Created by Josip Bernat on 15/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class CSFuture;
+
+typedef id (^CSFutureMapBlock)(id value);
+typedef CSFuture * (^CSFutureThenBlock)(id value);
+typedef void (^CSFutureCompletionBlock)(id value, NSError *error);
+
+/**
+ *  Result of work which finishes later, either value or error. Futures are chained with map: and then: instead of nesting response blocks so no thread is blocked waiting for previous step. Errors skip continuations and are passed down the chain. Canceling future cancels work it was derived from. Thread safe.
+ *
+ *  Continuations are cheap so they run inline on thread which resolved future. When chain resolves deep recursively on one thread, continuations continue on CPU pool of CSOperationExecutor so stack stays bounded. Blocks doing expensive work should hop to their own queue.
+ */
+@interface CSFuture : NSObject
+
+/**
+ *  YES once future has value or error.
+ */
+@property (readonly) BOOL isResolved;
+
+/**
+ *  YES if future was canceled or resolved with cancellation error.
+ */
+@property (readonly) BOOL isCancelled;
+
+/**
+ *  Value of resolved future. Nil until future is resolved or if it failed.
+ */
+@property (readonly, strong) id value;
+
+/**
+ *  Error of resolved future. Nil until future is resolved or if it succeeded.
+ */
+@property (readonly, strong) NSError *error;
+
+#pragma mark - Class Methods
+
+/**
+ *  Creates future already resolved with value.
+ */
++ (CSFuture *)futureWithValue:(id)value;
+
+/**
+ *  Creates future already resolved with error.
+ */
++ (CSFuture *)futureWithError:(NSError *)error;
+
+/**
+ *  Creates future resolved with values of all given futures in same order. NSNull stands for nil values. Fails with first error and cancels futures which are still running. Future of empty array resolves with empty array.
+ *
+ *  @param futures Array of CSFuture objects.
+ */
++ (CSFuture *)all:(NSArray *)futures;
+
+/**
+ *  Creates future resolved with value of first future which succeeds and cancels other futures. Fails with error of last future if all of them fail. NSInvalidArgumentException is raised if array is empty.
+ *
+ *  @param futures Array of CSFuture objects.
+ */
++ (CSFuture *)any:(NSArray *)futures;
+
+/**
+ *  Error with which canceled futures are resolved. Has same domain and code as [CSMessage cancellationError].
+ */
++ (NSError *)cancellationError;
+
+#pragma mark - Resolving
+
+/**
+ *  Resolves future. Only first call has effect, later ones are ignored.
+ *
+ *  @param value Value of future. Ignored if error is not nil.
+ *  @param error Error of future.
+ *
+ *  @return YES if future was resolved by this call.
+ */
+- (BOOL)resolveWithValue:(id)value error:(NSError *)error;
+
+/**
+ *  Sets block called when future is canceled before it's resolved. Producer uses it to stop work behind future. Block is called immediately if future is already canceled.
+ */
+- (void)setCancellationHandler:(void (^)(void))cancellationHandler;
+
+/**
+ *  Resolves future with cancellationError and calls cancellation handler. Has no effect on resolved future.
+ */
+- (void)cancel;
+
+#pragma mark - Chaining
+
+/**
+ *  Creates future resolved with value returned by block. Block isn't called if this future fails.
+ */
+- (CSFuture *)map:(CSFutureMapBlock)block;
+
+/**
+ *  Creates future resolved with result of future returned by block. Block isn't called if this future fails. Nil returned by block resolves future with nil value.
+ */
+- (CSFuture *)then:(CSFutureThenBlock)block;
+
+/**
+ *  Calls block with value or error once future is resolved.
+ *
+ *  @param block Block object called with result.
+ *  @param queue Queue on which block is called. Main queue is used if nil.
+ */
+- (void)onComplete:(CSFutureCompletionBlock)block queue:(dispatch_queue_t)queue;
+
+@end
@@ -0,0 +1,381 @@
+//
+//  CSFuture.m
+//  CSUtils
+//
+//  Created by Josip Bernat on 15/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import "CSFuture.h"
+#import "CSOperationExecutor.h"
+#include <pthread.h>
+
+/**
+ *  Number of continuations which can run nested on one thread before rest of chain moves to executor.
+ */
+static uintptr_t const CSFutureMaxInlineDepth = 16;
+
+static pthread_key_t CSFutureDepthKey(void) {
+
+    static pthread_key_t key;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        pthread_key_create(&key, NULL);
+    });
+    return key;
+}
+
+/**
+ *  Runs continuation inline unless too many of them are already nested on current thread.
+ */
+static void CSFutureInvoke(dispatch_block_t block) {
+
+    pthread_key_t key = CSFutureDepthKey();
+    uintptr_t depth = (uintptr_t)pthread_getspecific(key);
+
+    if (depth >= CSFutureMaxInlineDepth) {
+        [[CSOperationExecutor sharedExecutor] addBlock:block
+                                              workload:CSOperationWorkloadCPU
+                                              priority:NSOperationQueuePriorityNormal];
+        return;
+    }
+
+    pthread_setspecific(key, (void *)(depth + 1));
+    block();
+    pthread_setspecific(key, (void *)depth);
+}
+
+@interface CSFuture () {
+
+    BOOL _isResolved;
+    id _value;
+    NSError *_error;
+    NSMutableArray *_completionBlocks;
+    void (^_cancellationHandler)(void);
+}
+
+@end
+
+@implementation CSFuture
+
+#pragma mark - Class Methods
+
++ (CSFuture *)futureWithValue:(id)value {
+
+    CSFuture *future = [[self alloc] init];
+    [future resolveWithValue:value error:nil];
+    return future;
+}
+
++ (CSFuture *)futureWithError:(NSError *)error {
+
+    CSFuture *future = [[self alloc] init];
+    [future resolveWithValue:nil error:error];
+    return future;
+}
+
++ (NSError *)cancellationError {
+
+    return [NSError errorWithDomain:NSURLErrorDomain
+                               code:NSURLErrorCancelled
+                           userInfo:@{NSLocalizedDescriptionKey : @"Future was canceled."}];
+}
+
++ (void)validateFutures:(NSArray *)futures {
+
+    for (id future in futures) {
+        if (![future isKindOfClass:[CSFuture class]]) {
+            [[NSException exceptionWithName:NSInvalidArgumentException
+                                     reason:@"futures must contain only CSFuture objects"
+                                   userInfo:nil] raise];
+        }
+    }
+}
+
++ (CSFuture *)all:(NSArray *)futures {
+
+    [self validateFutures:futures];
+    if (!futures.count) {
+        return [self futureWithValue:@[]];
+    }
+
+    NSArray *inputs = [futures copy];
+    CSFuture *future = [[self alloc] init];
+    [future setCancellationHandler:^{
+        [inputs makeObjectsPerformSelector:@selector(cancel)];
+    }];
+
+    NSMutableArray *values = [[NSMutableArray alloc] initWithCapacity:inputs.count];
+    for (NSUInteger i = 0; i < inputs.count; i++) {
+        [values addObject:[NSNull null]];
+    }
+    __block NSUInteger remainingCount = inputs.count;
+
+    [inputs enumerateObjectsUsingBlock:^(CSFuture *input, NSUInteger idx, BOOL *stop) {
+
+        [input addCompletionBlock:^(id value, NSError *error) {
+
+            if (error) {
+                if ([future resolveWithValue:nil error:error]) {
+                    [inputs makeObjectsPerformSelector:@selector(cancel)];
+                }
+                return;
+            }
+
+            BOOL completed = NO;
+            @synchronized(values) {
+                if (value) {
+                    values[idx] = value;
+                }
+                completed = (--remainingCount == 0);
+            }
+            if (completed) {
+                [future resolveWithValue:[values copy] error:nil];
+            }
+        }];
+    }];
+    return future;
+}
+
++ (CSFuture *)any:(NSArray *)futures {
+
+    if (!futures.count) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"futures can't be empty"
+                               userInfo:nil] raise];
+    }
+    [self validateFutures:futures];
+
+    NSArray *inputs = [futures copy];
+    CSFuture *future = [[self alloc] init];
+    [future setCancellationHandler:^{
+        [inputs makeObjectsPerformSelector:@selector(cancel)];
+    }];
+
+    NSObject *lock = [[NSObject alloc] init];
+    __block NSUInteger remainingCount = inputs.count;
+
+    for (CSFuture *input in inputs) {
+
+        [input addCompletionBlock:^(id value, NSError *error) {
+
+            if (!error) {
+                if ([future resolveWithValue:value error:nil]) {
+                    [inputs makeObjectsPerformSelector:@selector(cancel)];
+                }
+                return;
+            }
+
+            BOOL completed = NO;
+            @synchronized(lock) {
+                completed = (--remainingCount == 0);
+            }
+            if (completed) {
+                [future resolveWithValue:nil error:error];
+            }
+        }];
+    }
+    return future;
+}
+
+#pragma mark - Getters
+
+- (BOOL)isResolved {
+
+    @synchronized(self) {
+        return _isResolved;
+    }
+}
+
+- (BOOL)isCancelled {
+
+    NSError *error = self.error;
+    return (error.code == NSURLErrorCancelled && [error.domain isEqualToString:NSURLErrorDomain]);
+}
+
+- (id)value {
+
+    @synchronized(self) {
+        return _value;
+    }
+}
+
+- (NSError *)error {
+
+    @synchronized(self) {
+        return _error;
+    }
+}
+
+#pragma mark - Resolving
+
+- (BOOL)resolveWithValue:(id)value error:(NSError *)error {
+
+    NSArray *completionBlocks = nil;
+    @synchronized(self) {
+
+        if (_isResolved) {
+            return NO;
+        }
+        _isResolved = YES;
+        _value = (error ? nil : value);
+        _error = error;
+
+        completionBlocks = _completionBlocks;
+        _completionBlocks = nil;
+        _cancellationHandler = nil;
+    }
+
+    id resolvedValue = (error ? nil : value);
+    for (CSFutureCompletionBlock completionBlock in completionBlocks) {
+        CSFutureInvoke(^{
+            completionBlock(resolvedValue, error);
+        });
+    }
+    return YES;
+}
+
+- (void)setCancellationHandler:(void (^)(void))cancellationHandler {
+
+    @synchronized(self) {
+        if (!_isResolved) {
+            _cancellationHandler = [cancellationHandler copy];
+            return;
+        }
+    }
+
+    if (self.isCancelled && cancellationHandler) {
+        cancellationHandler();
+    }
+}
+
+- (void)cancel {
+
+    void (^cancellationHandler)(void) = nil;
+    @synchronized(self) {
+        if (_isResolved) {
+            return;
+        }
+        cancellationHandler = _cancellationHandler;
+    }
+
+    if ([self resolveWithValue:nil error:[[self class] cancellationError]] && cancellationHandler) {
+        cancellationHandler();
+    }
+}
+
+#pragma mark - Chaining
+
+/**
+ *  Adds block called inline once future is resolved. Block is called immediately if future is already resolved.
+ */
+- (void)addCompletionBlock:(CSFutureCompletionBlock)completionBlock {
+
+    id value = nil;
+    NSError *error = nil;
+    @synchronized(self) {
+
+        if (!_isResolved) {
+            if (!_completionBlocks) {
+                _completionBlocks = [[NSMutableArray alloc] initWithCapacity:1];
+            }
+            [_completionBlocks addObject:[completionBlock copy]];
+            return;
+        }
+        value = _value;
+        error = _error;
+    }
+
+    CSFutureInvoke(^{
+        completionBlock(value, error);
+    });
+}
+
+- (CSFuture *)map:(CSFutureMapBlock)block {
+
+    if (!block) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"block can't be nil"
+                               userInfo:nil] raise];
+    }
+
+    CSFuture *future = [[CSFuture alloc] init];
+    __weak CSFuture *weakSelf = self;
+    [future setCancellationHandler:^{
+        [weakSelf cancel];
+    }];
+
+    [self addCompletionBlock:^(id value, NSError *error) {
+
+        if (error) {
+            [future resolveWithValue:nil error:error];
+            return;
+        }
+        //derived future was canceled meanwhile
+        if (future.isResolved) {
+            return;
+        }
+        [future resolveWithValue:block(value) error:nil];
+    }];
+    return future;
+}
+
+- (CSFuture *)then:(CSFutureThenBlock)block {
+
+    if (!block) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"block can't be nil"
+                               userInfo:nil] raise];
+    }
+
+    CSFuture *future = [[CSFuture alloc] init];
+    __weak CSFuture *weakSelf = self;
+    [future setCancellationHandler:^{
+        [weakSelf cancel];
+    }];
+
+    [self addCompletionBlock:^(id value, NSError *error) {
+
+        if (error) {
+            [future resolveWithValue:nil error:error];
+            return;
+        }
+        if (future.isResolved) {
+            return;
+        }
+
+        CSFuture *innerFuture = block(value);
+        if (!innerFuture) {
+            [future resolveWithValue:nil error:nil];
+            return;
+        }
+
+        //from now on canceling derived future cancels inner one, immediately if it was canceled while block was running
+        __weak CSFuture *weakInnerFuture = innerFuture;
+        [future setCancellationHandler:^{
+            [weakInnerFuture cancel];
+        }];
+        [innerFuture addCompletionBlock:^(id innerValue, NSError *innerError) {
+            [future resolveWithValue:innerValue error:innerError];
+        }];
+    }];
+    return future;
+}
+
+- (void)onComplete:(CSFutureCompletionBlock)block queue:(dispatch_queue_t)queue {
+
+    if (!block) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"block can't be nil"
+                               userInfo:nil] raise];
+    }
+
+    dispatch_queue_t deliveryQueue = (queue ? queue : dispatch_get_main_queue());
+    [self addCompletionBlock:^(id value, NSError *error) {
+        dispatch_async(deliveryQueue, ^{
+            block(value, error);
+        });
+    }];
+}
+
+@end
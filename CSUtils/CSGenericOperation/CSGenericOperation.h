@@ -8,11 +8,26 @@
 
 #import <Foundation/Foundation.h>
 
+@class CSFuture;
+
+/**
+ *  Kind of work operation does. Used by CSOperationExecutor to pick pool operation runs on.
+ */
+typedef NS_ENUM(NSInteger, CSOperationWorkload) {
+    CSOperationWorkloadIO = 0,  //waits on network or disk, runs in wide pool
+    CSOperationWorkloadCPU      //keeps processor busy, runs in pool as wide as number of cores
+};
+
 /**
  *  Generic class suitable for creating concurrent operations. Subclass needs to overrid operationDidStart in order to start with the operation and must call operationDidFinish when it's done with operation in order to finish operation.
  */
 @interface CSGenericOperation : NSOperation
 
+/**
+ *  Kind of work operation does. Default is CSOperationWorkloadIO. Must be set before operation is added to CSOperationExecutor.
+ */
+@property (nonatomic, readwrite) CSOperationWorkload workload;
+
 /**
  *  This method is never called by system and should be called from subclass when it's done with job. If never called operation will never finish.
  */
@@ -23,4 +38,19 @@
  */
 - (void)operationDidStart;
 
+/**
+ *  Called when operation is canceled while executing or when canceled operation is started. Subclass should abort its job, release resources and call operationDidFinish. Default implementation calls operationDidFinish. Can be called on any thread.
+ */
+- (void)operationDidCancel;
+
+/**
+ *  Adds handler called once operation finishes, after isFinished is changed. Handlers are called in order they were added on thread which finished operation. Handler added to finished operation is called immediately. Unlike completionBlock any number of handlers can be added.
+ */
+- (void)addCompletionHandler:(void (^)(CSGenericOperation *operation))handler;
+
+/**
+ *  Future resolved with operation itself once it finishes or with [CSFuture cancellationError] if it was canceled. Canceling future cancels operation. Subclasses producing result override it to resolve future with that result. Same future is returned on every call.
+ */
+- (CSFuture *)future;
+
 @end
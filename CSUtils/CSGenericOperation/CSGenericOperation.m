@@ -7,13 +7,15 @@
 //
 
 #import "CSGenericOperation.h"
+#import "CSFuture.h"
+#import "CSOperationState.h"
 #import <UIKit/UIKit.h>
 
 @interface CSGenericOperation () {
 
-    BOOL _isCancelled;
-    BOOL _isFinished;
-    BOOL _isExecuting;
+    CSOperationState _state;
+    NSMutableArray *_completionHandlers;
+    CSFuture *_future;
 }
 
 @property (nonatomic) UIBackgroundTaskIdentifier backgroundTaskIdentifier;
@@ -22,20 +24,35 @@
 
 @implementation CSGenericOperation
 
+#pragma mark - Initialization
+
+- (id)init {
+    
+    if (self = [super init]) {
+        CSOperationStateInit(&_state);
+    }
+    return self;
+}
+
 #pragma mark - Operation Handling
 
 - (void)operationDidFinish {
 
-    if (!_isExecuting) return;
+    //only first call made while executing finishes operation
+    if (!CSOperationStateBeginFinishing(&_state)) {
+        return;
+    }
+    
     [self willChangeValueForKey:@"isExecuting"];
-    _isExecuting = NO;
+    CSOperationStateEndExecuting(&_state);
     [self didChangeValueForKey:@"isExecuting"];
     
     [self willChangeValueForKey:@"isFinished"];
-    _isFinished = YES;
+    CSOperationStateSetFinished(&_state);
     [self didChangeValueForKey:@"isFinished"];
     
     [self finish];
+    [self callCompletionHandlers];
 }
 
 - (void)operationDidStart {
@@ -44,6 +61,75 @@
     [self operationDidFinish];
 }
 
+- (void)operationDidCancel {
+    [self operationDidFinish];
+}
+
+#pragma mark - Completion Handlers
+
+- (void)addCompletionHandler:(void (^)(CSGenericOperation *operation))handler {
+    
+    if (!handler) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"handler can't be nil"
+                               userInfo:nil] raise];
+    }
+    
+    //finished flag is checked under same lock handlers are taken under so handler is called exactly once
+    @synchronized(self) {
+        if (!(CSOperationStateLoad(&_state) & CSOperationStateFinished)) {
+            if (!_completionHandlers) {
+                _completionHandlers = [[NSMutableArray alloc] init];
+            }
+            [_completionHandlers addObject:[handler copy]];
+            return;
+        }
+    }
+    handler(self);
+}
+
+- (void)callCompletionHandlers {
+    
+    NSArray *handlers = nil;
+    @synchronized(self) {
+        handlers = _completionHandlers;
+        _completionHandlers = nil;
+    }
+    
+    for (void (^handler)(CSGenericOperation *) in handlers) {
+        handler(self);
+    }
+}
+
+#pragma mark - Future
+
+- (CSFuture *)future {
+    
+    CSFuture *future = nil;
+    @synchronized(self) {
+        if (_future) {
+            return _future;
+        }
+        future = [[CSFuture alloc] init];
+        _future = future;
+    }
+    
+    __weak CSGenericOperation *this = self;
+    [future setCancellationHandler:^{
+        [this cancel];
+    }];
+    [self addCompletionHandler:^(CSGenericOperation *operation) {
+        
+        if (operation.isCancelled) {
+            [future resolveWithValue:nil error:[CSFuture cancellationError]];
+        }
+        else {
+            [future resolveWithValue:operation error:nil];
+        }
+    }];
+    return future;
+}
+
 #pragma mark - Background Task
 
 -(void) beginBackgroundTask {
@@ -71,26 +157,45 @@
 
 - (void)start {
     
-    _isExecuting = YES;
-    _isFinished = NO;
+    //observers see old value in willChange and new one in didChange, notifications are balanced even if operation was already started
+    [self willChangeValueForKey:@"isExecuting"];
+    CSOperationStartAction action = CSOperationStateStart(&_state);
+    [self didChangeValueForKey:@"isExecuting"];
     
-    [self operationDidStart];
+    //operation canceled before it started finishes without doing its job
+    if (action == CSOperationStartActionFinishCancelled) {
+        [self operationDidCancel];
+    }
+    else if (action == CSOperationStartActionRun) {
+        [self operationDidStart];
+    }
 }
 
 - (void)cancel {
-    _isCancelled = YES;
+    
+    [self willChangeValueForKey:@"isCancelled"];
+    BOOL mustFinish = CSOperationStateCancel(&_state);
+    [self didChangeValueForKey:@"isCancelled"];
+    
+    if (mustFinish) {
+        [self operationDidCancel];
+    }
 }
 
 - (BOOL)isConcurrent {
     return YES;
 }
 
+- (BOOL)isCancelled {
+    return ((CSOperationStateLoad(&_state) & CSOperationStateCancelled) != 0);
+}
+
 - (BOOL)isExecuting {
-    return _isExecuting;
+    return ((CSOperationStateLoad(&_state) & CSOperationStateExecuting) != 0);
 }
 
 - (BOOL)isFinished {
-    return _isFinished;
+    return ((CSOperationStateLoad(&_state) & CSOperationStateFinished) != 0);
 }
 
 @end
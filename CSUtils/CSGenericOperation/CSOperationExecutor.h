@@ -0,0 +1,77 @@
+//
+//  CSOperationExecutor.h
+//  CSUtils
+//
+//  Created by Josip Bernat on 14/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "CSGenericOperation.h"
+
+/**
+ *  Executor for operations and blocks backed by two CSWorkStealingPool thread pools, one for blocking I/O and one for CPU bound work. Each thread keeps its own deque of tasks, so work submitted from pool thread stays on it while idle threads steal from busy ones. Priority inside pool is taken from operation's queuePriority, waiting task of higher priority always runs before lower one. Thread safe.
+ *
+ *  Any NSOperation can be added without changes. Operation with unfinished dependencies is started once it becomes ready. Concurrent operations, like CSGenericOperation, occupy pool thread only while their start method runs. Pools don't limit how many operations of one kind run at once, components which need such limit admit operations themselves, like CSMessageCenter does, or keep their own NSOperationQueue, like CSLazyLoadController does for its blocking loads.
+ */
+@interface CSOperationExecutor : NSObject
+
+/**
+ *  Number of threads in I/O pool. Default is four times number of active processors but at least 8.
+ */
+@property (nonatomic, readonly) NSUInteger ioThreadsCount;
+
+/**
+ *  Number of threads in CPU pool. Default is number of active processors.
+ */
+@property (nonatomic, readonly) NSUInteger cpuThreadsCount;
+
+#pragma mark - Class Methods
+
+/**
+ *  Executor used by CSMessageCenter, CSMessage parsing and CSFuture continuations.
+ */
++ (CSOperationExecutor *)sharedExecutor;
+
+#pragma mark - Initialization
+
+/**
+ *  Creates executor and starts threads of both pools. Executor waits for all added work to finish when it's deallocated, so it must not be released from its own thread.
+ *
+ *  @param ioThreadsCount  Number of threads in I/O pool. NSInvalidArgumentException is raised if it's 0.
+ *  @param cpuThreadsCount Number of threads in CPU pool. NSInvalidArgumentException is raised if it's 0.
+ *
+ *  @return New executor or nil if threads couldn't be started.
+ */
+- (instancetype)initWithIOThreadsCount:(NSUInteger)ioThreadsCount
+                       cpuThreadsCount:(NSUInteger)cpuThreadsCount; //designated initializer
+
+#pragma mark - Executing
+
+/**
+ *  Adds operation to pool matching its workload. CSGenericOperation uses its workload property, any other operation runs in CPU pool. Operation must not be added anywhere else.
+ */
+- (void)addOperation:(NSOperation *)operation;
+
+/**
+ *  Adds operation to pool for given workload.
+ */
+- (void)addOperation:(NSOperation *)operation workload:(CSOperationWorkload)workload;
+
+/**
+ *  Wraps block into operation with given priority and adds it to pool for given workload.
+ *
+ *  @return Added operation which can be used for canceling.
+ */
+- (NSOperation *)addOperationWithBlock:(void (^)(void))block
+                              workload:(CSOperationWorkload)workload
+                              priority:(NSOperationQueuePriority)priority;
+
+/**
+ *  Runs block in pool for given workload. Cheaper than addOperationWithBlock:workload:priority: since no operation is created, but block can't be canceled.
+ */
+- (void)addBlock:(void (^)(void))block
+        workload:(CSOperationWorkload)workload
+        priority:(NSOperationQueuePriority)priority;
+
+@end
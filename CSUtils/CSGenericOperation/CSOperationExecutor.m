@@ -0,0 +1,299 @@
+//
+//  CSOperationExecutor.m
+//  CSUtils
+//
+//  Created by Josip Bernat on 14/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import "CSOperationExecutor.h"
+#import "CSWorkStealingPool.h"
+
+static void *CSOperationExecutorReadyContext = &CSOperationExecutorReadyContext;
+
+static CSWorkStealingPriority CSWorkStealingPriorityForQueuePriority(NSOperationQueuePriority priority) {
+
+    if (priority > NSOperationQueuePriorityNormal) {
+        return CSWorkStealingPriorityHigh;
+    }
+    if (priority < NSOperationQueuePriorityNormal) {
+        return CSWorkStealingPriorityLow;
+    }
+    return CSWorkStealingPriorityNormal;
+}
+
+static void CSOperationExecutorRunBlock(void *context) {
+
+    @autoreleasepool {
+        void (^block)(void) = (__bridge_transfer void (^)(void))context;
+        block();
+    }
+}
+
+#pragma mark - Entry
+
+/**
+ *  Keeps operation until it's started on pool thread. Operation which isn't ready yet is observed and submitted once its isReady changes.
+ */
+@interface CSOperationExecutorEntry : NSObject {
+
+    BOOL _observing;
+    BOOL _submitted;
+}
+
+@property (nonatomic, strong, readonly) NSOperation *operation;
+@property (nonatomic, readonly) CSWorkStealingPool *pool;
+@property (nonatomic, copy) void (^submitHandler)(CSOperationExecutorEntry *entry);
+
+- (instancetype)initWithOperation:(NSOperation *)operation pool:(CSWorkStealingPool *)pool;
+
+- (void)submitWhenReady;
+
+/**
+ *  Called on pool thread. Operation which was canceled or started elsewhere meanwhile isn't started again.
+ */
+- (void)startOperation;
+
+@end
+
+static void CSOperationExecutorRunEntry(void *context) {
+
+    @autoreleasepool {
+        CSOperationExecutorEntry *entry = (__bridge_transfer CSOperationExecutorEntry *)context;
+        [entry startOperation];
+    }
+}
+
+@implementation CSOperationExecutorEntry
+
+- (instancetype)initWithOperation:(NSOperation *)operation pool:(CSWorkStealingPool *)pool {
+
+    if (self = [super init]) {
+        _operation = operation;
+        _pool = pool;
+    }
+    return self;
+}
+
+- (void)submitWhenReady {
+
+    if (_operation.isReady) {
+        [self submit];
+        return;
+    }
+
+    //observer is removed under the same lock before operation starts so removal can't overtake adding
+    @synchronized(self) {
+        [_operation addObserver:self
+                     forKeyPath:@"isReady"
+                        options:0
+                        context:CSOperationExecutorReadyContext];
+        _observing = YES;
+    }
+
+    //operation could become ready before observer was added
+    if (_operation.isReady) {
+        [self submit];
+    }
+}
+
+- (void)submit {
+
+    @synchronized(self) {
+        if (_submitted) {
+            return;
+        }
+        _submitted = YES;
+    }
+
+    if (self.submitHandler) {
+        self.submitHandler(self);
+        self.submitHandler = nil;
+    }
+
+    CSWorkStealingPriority priority = CSWorkStealingPriorityForQueuePriority(_operation.queuePriority);
+    void *context = (__bridge_retained void *)self;
+    if (!CSWorkStealingPoolSubmit(_pool, CSOperationExecutorRunEntry, context, priority)) {
+        CFRelease(context);
+        [[NSException exceptionWithName:NSMallocException
+                                 reason:@"Unable to allocate task for operation"
+                               userInfo:nil] raise];
+    }
+}
+
+- (void)startOperation {
+
+    @synchronized(self) {
+        if (_observing) {
+            [_operation removeObserver:self forKeyPath:@"isReady" context:CSOperationExecutorReadyContext];
+            _observing = NO;
+        }
+    }
+
+    if (!_operation.isExecuting && !_operation.isFinished) {
+        [_operation start];
+    }
+}
+
+- (void)observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object change:(NSDictionary *)change context:(void *)context {
+
+    if (context != CSOperationExecutorReadyContext) {
+        [super observeValueForKeyPath:keyPath ofObject:object change:change context:context];
+        return;
+    }
+
+    if ([object isReady]) {
+        [self submit];
+    }
+}
+
+@end
+
+#pragma mark - Executor
+
+@interface CSOperationExecutor () {
+
+    CSWorkStealingPool *_ioPool;
+    CSWorkStealingPool *_cpuPool;
+}
+
+/**
+ *  Entries waiting for their operations to become ready.
+ */
+@property (nonatomic, strong) NSMutableSet *waitingEntries;
+
+@end
+
+@implementation CSOperationExecutor
+
++ (CSOperationExecutor *)sharedExecutor {
+
+    static dispatch_once_t onceToken;
+    static CSOperationExecutor *sharedInstance = nil;
+
+    dispatch_once(&onceToken, ^{
+        sharedInstance = [[self alloc] init];
+    });
+    return sharedInstance;
+}
+
+#pragma mark - Memory Management
+
+- (void)dealloc {
+
+    CSWorkStealingPoolDestroy(_ioPool);
+    CSWorkStealingPoolDestroy(_cpuPool);
+}
+
+#pragma mark - Initialization
+
+- (instancetype)init {
+
+    NSUInteger processorsCount = MAX([[NSProcessInfo processInfo] activeProcessorCount], (NSUInteger)1);
+    return [self initWithIOThreadsCount:MAX(processorsCount * 4, (NSUInteger)8)
+                        cpuThreadsCount:processorsCount];
+}
+
+- (instancetype)initWithIOThreadsCount:(NSUInteger)ioThreadsCount
+                       cpuThreadsCount:(NSUInteger)cpuThreadsCount {
+
+    if (!ioThreadsCount || !cpuThreadsCount) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"ioThreadsCount and cpuThreadsCount must be greater than 0"
+                               userInfo:nil] raise];
+    }
+
+    if (self = [super init]) {
+
+        _ioPool = CSWorkStealingPoolCreate((unsigned)ioThreadsCount, "com.clover-studio.CSOperationExecutor.io");
+        _cpuPool = CSWorkStealingPoolCreate((unsigned)cpuThreadsCount, "com.clover-studio.CSOperationExecutor.cpu");
+        if (!_ioPool || !_cpuPool) {
+            return nil;
+        }
+
+        _ioThreadsCount = ioThreadsCount;
+        _cpuThreadsCount = cpuThreadsCount;
+        _waitingEntries = [[NSMutableSet alloc] init];
+    }
+    return self;
+}
+
+#pragma mark - Executing
+
+- (CSWorkStealingPool *)poolForWorkload:(CSOperationWorkload)workload {
+    return (workload == CSOperationWorkloadCPU ? _cpuPool : _ioPool);
+}
+
+- (void)addOperation:(NSOperation *)operation {
+
+    CSOperationWorkload workload = CSOperationWorkloadCPU;
+    if ([operation isKindOfClass:[CSGenericOperation class]]) {
+        workload = [(CSGenericOperation *)operation workload];
+    }
+    [self addOperation:operation workload:workload];
+}
+
+- (void)addOperation:(NSOperation *)operation workload:(CSOperationWorkload)workload {
+
+    if (!operation) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"operation can't be nil"
+                               userInfo:nil] raise];
+    }
+
+    CSOperationExecutorEntry *entry = [[CSOperationExecutorEntry alloc] initWithOperation:operation
+                                                                                     pool:[self poolForWorkload:workload]];
+    if (!operation.isReady) {
+
+        //entry is kept alive until its operation becomes ready
+        @synchronized(self.waitingEntries) {
+            [self.waitingEntries addObject:entry];
+        }
+        __weak CSOperationExecutor *this = self;
+        entry.submitHandler = ^(CSOperationExecutorEntry *submittedEntry) {
+
+            __strong CSOperationExecutor *strongThis = this;
+            @synchronized(strongThis.waitingEntries) {
+                [strongThis.waitingEntries removeObject:submittedEntry];
+            }
+        };
+    }
+    [entry submitWhenReady];
+}
+
+- (NSOperation *)addOperationWithBlock:(void (^)(void))block
+                              workload:(CSOperationWorkload)workload
+                              priority:(NSOperationQueuePriority)priority {
+
+    if (!block) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"block can't be nil"
+                               userInfo:nil] raise];
+    }
+
+    NSBlockOperation *operation = [NSBlockOperation blockOperationWithBlock:block];
+    operation.queuePriority = priority;
+    [self addOperation:operation workload:workload];
+    return operation;
+}
+
+- (void)addBlock:(void (^)(void))block
+        workload:(CSOperationWorkload)workload
+        priority:(NSOperationQueuePriority)priority {
+
+    if (!block) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"block can't be nil"
+                               userInfo:nil] raise];
+    }
+
+    void *context = (__bridge_retained void *)[block copy];
+    if (!CSWorkStealingPoolSubmit([self poolForWorkload:workload], CSOperationExecutorRunBlock, context, CSWorkStealingPriorityForQueuePriority(priority))) {
+        CFRelease(context);
+        [[NSException exceptionWithName:NSMallocException
+                                 reason:@"Unable to allocate task for block"
+                               userInfo:nil] raise];
+    }
+}
+
+@end
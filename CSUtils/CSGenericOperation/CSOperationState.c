@@ -0,0 +1,59 @@
+//
+//  CSOperationState.c
+//  CSUtils
+//
+//  Created by Josip Bernat on 20/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#include "CSOperationState.h"
+
+#include <stddef.h>
+
+void CSOperationStateInit(CSOperationState *state) {
+    atomic_init(state, 0);
+}
+
+bool CSOperationStateTransition(CSOperationState *state, uint32_t required, uint32_t forbidden, uint32_t bits, uint32_t *previousState) {
+
+    uint32_t current = atomic_load_explicit(state, memory_order_acquire);
+    do {
+        if ((current & required) != required || (current & forbidden)) {
+            if (previousState) *previousState = current;
+            return false;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(state, &current, current | bits, memory_order_acq_rel, memory_order_acquire));
+
+    if (previousState) *previousState = current;
+    return true;
+}
+
+CSOperationStartAction CSOperationStateStart(CSOperationState *state) {
+
+    uint32_t previousState = 0;
+    if (!CSOperationStateTransition(state, 0, CSOperationStateStarted, CSOperationStateStarted | CSOperationStateExecuting, &previousState)) {
+        return CSOperationStartActionNone;
+    }
+    return ((previousState & CSOperationStateCancelled) ? CSOperationStartActionFinishCancelled : CSOperationStartActionRun);
+}
+
+bool CSOperationStateCancel(CSOperationState *state) {
+
+    uint32_t previousState = 0;
+    if (!CSOperationStateTransition(state, 0, CSOperationStateCancelled | CSOperationStateFinishing, CSOperationStateCancelled, &previousState)) {
+        return false;
+    }
+    return ((previousState & CSOperationStateStarted) != 0);
+}
+
+bool CSOperationStateBeginFinishing(CSOperationState *state) {
+    return CSOperationStateTransition(state, CSOperationStateExecuting, CSOperationStateFinishing, CSOperationStateFinishing, NULL);
+}
+
+void CSOperationStateEndExecuting(CSOperationState *state) {
+    atomic_fetch_and_explicit(state, ~(uint32_t)CSOperationStateExecuting, memory_order_acq_rel);
+}
+
+void CSOperationStateSetFinished(CSOperationState *state) {
+    atomic_fetch_or_explicit(state, CSOperationStateFinished, memory_order_acq_rel);
+}
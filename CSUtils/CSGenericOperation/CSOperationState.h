@@ -0,0 +1,94 @@
+//
+//  CSOperationState.h
+//  CSUtils
+//
+//  Created by Josip Bernat on 20/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#ifndef CSUtils_CSOperationState_h
+#define CSUtils_CSOperationState_h
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  Bits of operation state word. Operation goes ready -> started/executing -> finishing -> finished and can be canceled at any point before it finishes.
+ */
+typedef enum {
+    CSOperationStateStarted     = 1 << 0,
+    CSOperationStateExecuting   = 1 << 1,
+    CSOperationStateFinishing   = 1 << 2,
+    CSOperationStateFinished    = 1 << 3,
+    CSOperationStateCancelled   = 1 << 4
+} CSOperationStateBits;
+
+/**
+ *  Lock free state of operation which can be started, canceled and finished from any thread. Every function is a single atomic transition, so each of them wins at most once per operation.
+ */
+typedef _Atomic(uint32_t) CSOperationState;
+
+/**
+ *  What caller of CSOperationStateStart must do.
+ */
+typedef enum {
+    /**
+     *  Operation was already started by another call.
+     */
+    CSOperationStartActionNone = 0,
+    /**
+     *  Operation was started and its job must run.
+     */
+    CSOperationStartActionRun,
+    /**
+     *  Operation was canceled before it started, it must finish without doing its job.
+     */
+    CSOperationStartActionFinishCancelled
+} CSOperationStartAction;
+
+void CSOperationStateInit(CSOperationState *state);
+
+static inline uint32_t CSOperationStateLoad(CSOperationState *state) {
+    return atomic_load_explicit(state, memory_order_acquire);
+}
+
+/**
+ *  Sets bits in state word unless any of forbidden bits is set or any of required bits is missing.
+ *
+ *  @param previousState State before transition or state which prevented it. Can be NULL.
+ *
+ *  @return true if bits were set by this call.
+ */
+bool CSOperationStateTransition(CSOperationState *state, uint32_t required, uint32_t forbidden, uint32_t bits, uint32_t *previousState);
+
+/**
+ *  Marks operation as started and executing. Only the first call starts operation.
+ */
+CSOperationStartAction CSOperationStateStart(CSOperationState *state);
+
+/**
+ *  Marks operation as canceled unless it is already canceled or finishing.
+ *
+ *  @return true if operation was canceled while it was started, caller must finish it then. Operation canceled before start is finished by the call which starts it.
+ */
+bool CSOperationStateCancel(CSOperationState *state);
+
+/**
+ *  Begins finishing executing operation. Only the first call made while operation executes succeeds, caller must then call CSOperationStateEndExecuting and CSOperationStateSetFinished in this order.
+ */
+bool CSOperationStateBeginFinishing(CSOperationState *state);
+
+void CSOperationStateEndExecuting(CSOperationState *state);
+
+void CSOperationStateSetFinished(CSOperationState *state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
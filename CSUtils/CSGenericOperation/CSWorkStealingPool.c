@@ -0,0 +1,539 @@
+//
+//  CSWorkStealingPool.c
+//  CSUtils
+//
+//  Created by Josip Bernat on 16/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE
+#endif
+
+#include "CSWorkStealingPool.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CSWorkStealingCacheLineSize         64
+#define CSWorkStealingInitialCapacity       256
+
+/**
+ *  Every this many tasks thread checks injection queue before its own deque.
+ */
+#define CSWorkStealingInjectionInterval     61
+
+/**
+ *  Number of rounds idle thread looks for work, yielding between them, before it goes to sleep.
+ */
+#define CSWorkStealingIdleRoundsCount       64
+
+typedef struct CSWorkStealingTask {
+    CSWorkStealingFunction function;
+    void *context;
+    struct CSWorkStealingTask *next;
+} CSWorkStealingTask;
+
+/**
+ *  Circular array of deque. When it's full it's replaced by twice bigger copy. Replaced arrays can still be read by stealers so they are kept in list and released with deque.
+ */
+typedef struct CSWorkStealingArray {
+    int64_t capacity;
+    struct CSWorkStealingArray *previous;
+    _Atomic(CSWorkStealingTask *) slots[];
+} CSWorkStealingArray;
+
+/**
+ *  Chase-Lev deque. Owner pushes and takes at bottom, other threads steal at top. Memory orders follow Lê, Pop, Cohen and Zappa Nardelli, "Correct and Efficient Work-Stealing for Weak Memory Models".
+ */
+typedef struct CSWorkStealingDeque {
+    _Alignas(CSWorkStealingCacheLineSize) _Atomic(int64_t) top;
+    _Alignas(CSWorkStealingCacheLineSize) _Atomic(int64_t) bottom;
+    _Atomic(CSWorkStealingArray *) array;
+} CSWorkStealingDeque;
+
+typedef struct CSWorkStealingWorker {
+    CSWorkStealingDeque deques[CSWorkStealingPrioritiesCount];
+    CSWorkStealingPool *pool;
+    pthread_t thread;
+    uint64_t randomState;
+    unsigned index;
+    unsigned tasksCount;
+} CSWorkStealingWorker;
+
+struct CSWorkStealingPool {
+
+    CSWorkStealingWorker *workers;
+    unsigned threadsCount;
+    unsigned startedThreadsCount;
+    char name[32];
+
+    pthread_mutex_t injectionLock;
+    CSWorkStealingTask *injectedHeads[CSWorkStealingPrioritiesCount];
+    CSWorkStealingTask *injectedTails[CSWorkStealingPrioritiesCount];
+    _Atomic(int64_t) injectedCounts[CSWorkStealingPrioritiesCount];
+
+    /**
+     *  Tasks submitted and not taken yet. Incremented before task becomes visible and checked by thread going to sleep after it registers as sleeper, so wakeup can't be lost.
+     */
+    _Alignas(CSWorkStealingCacheLineSize) _Atomic(int64_t) pendingCount;
+    _Atomic(unsigned) sleepersCount;
+    _Atomic(bool) stopping;
+    _Atomic(uint64_t) stealsCount;
+    pthread_mutex_t sleepLock;
+    pthread_cond_t wakeCondition;
+};
+
+#pragma mark - Current Worker
+
+static pthread_key_t CSWorkStealingWorkerKey;
+static pthread_once_t CSWorkStealingWorkerKeyOnce = PTHREAD_ONCE_INIT;
+
+static void CSWorkStealingCreateWorkerKey(void) {
+    pthread_key_create(&CSWorkStealingWorkerKey, NULL);
+}
+
+static CSWorkStealingWorker *CSWorkStealingCurrentWorker(void) {
+
+    pthread_once(&CSWorkStealingWorkerKeyOnce, CSWorkStealingCreateWorkerKey);
+    return (CSWorkStealingWorker *)pthread_getspecific(CSWorkStealingWorkerKey);
+}
+
+static inline uint64_t CSWorkStealingRandom(uint64_t *state) {
+
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+#pragma mark - Deque
+
+static CSWorkStealingArray *CSWorkStealingArrayCreate(int64_t capacity, CSWorkStealingArray *previous) {
+
+    CSWorkStealingArray *array = malloc(sizeof(CSWorkStealingArray) + (size_t)capacity * sizeof(array->slots[0]));
+    if (!array) {
+        return NULL;
+    }
+    array->capacity = capacity;
+    array->previous = previous;
+    return array;
+}
+
+static bool CSWorkStealingDequeInit(CSWorkStealingDeque *deque) {
+
+    CSWorkStealingArray *array = CSWorkStealingArrayCreate(CSWorkStealingInitialCapacity, NULL);
+    if (!array) {
+        return false;
+    }
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+    atomic_init(&deque->array, array);
+    return true;
+}
+
+static void CSWorkStealingDequeFree(CSWorkStealingDeque *deque) {
+
+    CSWorkStealingArray *array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+    while (array) {
+        CSWorkStealingArray *previous = array->previous;
+        free(array);
+        array = previous;
+    }
+    atomic_store_explicit(&deque->array, NULL, memory_order_relaxed);
+}
+
+/**
+ *  Called only by owner.
+ */
+static bool CSWorkStealingDequePush(CSWorkStealingDeque *deque, CSWorkStealingTask *task) {
+
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    CSWorkStealingArray *array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+
+    if (bottom - top >= array->capacity) {
+
+        CSWorkStealingArray *grownArray = CSWorkStealingArrayCreate(array->capacity * 2, array);
+        if (!grownArray) {
+            return false;
+        }
+        for (int64_t i = top; i < bottom; i++) {
+            CSWorkStealingTask *movedTask = atomic_load_explicit(&array->slots[i & (array->capacity - 1)], memory_order_relaxed);
+            atomic_store_explicit(&grownArray->slots[i & (grownArray->capacity - 1)], movedTask, memory_order_relaxed);
+        }
+        atomic_store_explicit(&deque->array, grownArray, memory_order_release);
+        array = grownArray;
+    }
+
+    atomic_store_explicit(&array->slots[bottom & (array->capacity - 1)], task, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    return true;
+}
+
+/**
+ *  Called only by owner. Takes newest task.
+ */
+static CSWorkStealingTask *CSWorkStealingDequeTake(CSWorkStealingDeque *deque) {
+
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    CSWorkStealingArray *array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (top > bottom) {
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    CSWorkStealingTask *task = atomic_load_explicit(&array->slots[bottom & (array->capacity - 1)], memory_order_relaxed);
+    if (top == bottom) {
+
+        //last task, stealer can take it at the same time
+        if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed)) {
+            task = NULL;
+        }
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+/**
+ *  Called by other threads. Takes oldest task or returns NULL if deque is empty or another thread took it first.
+ */
+static CSWorkStealingTask *CSWorkStealingDequeSteal(CSWorkStealingDeque *deque) {
+
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+    if (top >= bottom) {
+        return NULL;
+    }
+
+    CSWorkStealingArray *array = atomic_load_explicit(&deque->array, memory_order_acquire);
+    CSWorkStealingTask *task = atomic_load_explicit(&array->slots[top & (array->capacity - 1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed)) {
+        return NULL;
+    }
+    return task;
+}
+
+#pragma mark - Injection Queue
+
+static void CSWorkStealingInject(CSWorkStealingPool *pool, CSWorkStealingTask *task, CSWorkStealingPriority priority) {
+
+    task->next = NULL;
+
+    pthread_mutex_lock(&pool->injectionLock);
+    if (pool->injectedTails[priority]) {
+        pool->injectedTails[priority]->next = task;
+    }
+    else {
+        pool->injectedHeads[priority] = task;
+    }
+    pool->injectedTails[priority] = task;
+    atomic_fetch_add_explicit(&pool->injectedCounts[priority], 1, memory_order_release);
+    pthread_mutex_unlock(&pool->injectionLock);
+}
+
+static CSWorkStealingTask *CSWorkStealingTakeInjected(CSWorkStealingPool *pool, unsigned priority) {
+
+    //lock is taken only when there is something to take
+    if (atomic_load_explicit(&pool->injectedCounts[priority], memory_order_acquire) <= 0) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&pool->injectionLock);
+    CSWorkStealingTask *task = pool->injectedHeads[priority];
+    if (task) {
+
+        pool->injectedHeads[priority] = task->next;
+        if (!task->next) {
+            pool->injectedTails[priority] = NULL;
+        }
+        atomic_fetch_sub_explicit(&pool->injectedCounts[priority], 1, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&pool->injectionLock);
+    return task;
+}
+
+#pragma mark - Workers
+
+static CSWorkStealingTask *CSWorkStealingStealFromOthers(CSWorkStealingPool *pool, CSWorkStealingWorker *worker, unsigned priority) {
+
+    unsigned threadsCount = pool->threadsCount;
+    if (threadsCount < 2) {
+        return NULL;
+    }
+
+    //victims are visited from random one so thieves spread over busy threads
+    unsigned first = (unsigned)(CSWorkStealingRandom(&worker->randomState) % threadsCount);
+    for (unsigned i = 0; i < threadsCount; i++) {
+
+        CSWorkStealingWorker *victim = &pool->workers[(first + i) % threadsCount];
+        if (victim == worker) {
+            continue;
+        }
+
+        CSWorkStealingTask *task = CSWorkStealingDequeSteal(&victim->deques[priority]);
+        if (task) {
+            atomic_fetch_add_explicit(&pool->stealsCount, 1, memory_order_relaxed);
+            return task;
+        }
+    }
+    return NULL;
+}
+
+/**
+ *  Looks for task of highest priority. Within priority own deque is tried first, then injection queue, then deques of other threads. Every CSWorkStealingInjectionInterval tasks injection queue goes first so tasks spawning tasks can't keep submitted work waiting.
+ */
+static CSWorkStealingTask *CSWorkStealingFindTask(CSWorkStealingPool *pool, CSWorkStealingWorker *worker) {
+
+    bool injectionFirst = (++worker->tasksCount % CSWorkStealingInjectionInterval == 0);
+
+    for (unsigned priority = 0; priority < CSWorkStealingPrioritiesCount; priority++) {
+
+        CSWorkStealingTask *task = NULL;
+        if (injectionFirst && (task = CSWorkStealingTakeInjected(pool, priority))) {
+            return task;
+        }
+        if ((task = CSWorkStealingDequeTake(&worker->deques[priority]))) {
+            return task;
+        }
+        if ((task = CSWorkStealingTakeInjected(pool, priority))) {
+            return task;
+        }
+        if ((task = CSWorkStealingStealFromOthers(pool, worker, priority))) {
+            return task;
+        }
+    }
+    return NULL;
+}
+
+/**
+ *  Puts thread to sleep until task is submitted.
+ *
+ *  @return false if pool is stopping and all tasks are done.
+ */
+static bool CSWorkStealingWaitForTask(CSWorkStealingPool *pool) {
+
+    pthread_mutex_lock(&pool->sleepLock);
+    atomic_fetch_add(&pool->sleepersCount, 1);
+
+    while (atomic_load(&pool->pendingCount) <= 0 && !atomic_load(&pool->stopping)) {
+        pthread_cond_wait(&pool->wakeCondition, &pool->sleepLock);
+    }
+
+    atomic_fetch_sub(&pool->sleepersCount, 1);
+    bool working = (atomic_load(&pool->pendingCount) > 0 || !atomic_load(&pool->stopping));
+    pthread_mutex_unlock(&pool->sleepLock);
+
+    return working;
+}
+
+static void CSWorkStealingSetThreadName(const char *name, unsigned index) {
+
+    char threadName[64];
+    snprintf(threadName, sizeof(threadName), "%s.%u", name, index);
+#if defined(__APPLE__)
+    pthread_setname_np(threadName);
+#elif defined(__linux__)
+    //Linux limits names to 16 bytes including terminating zero
+    threadName[15] = '\0';
+    pthread_setname_np(pthread_self(), threadName);
+#endif
+}
+
+static void *CSWorkStealingWorkerMain(void *argument) {
+
+    CSWorkStealingWorker *worker = (CSWorkStealingWorker *)argument;
+    CSWorkStealingPool *pool = worker->pool;
+
+    pthread_once(&CSWorkStealingWorkerKeyOnce, CSWorkStealingCreateWorkerKey);
+    pthread_setspecific(CSWorkStealingWorkerKey, worker);
+    CSWorkStealingSetThreadName(pool->name, worker->index);
+
+    unsigned idleRounds = 0;
+    while (true) {
+
+        CSWorkStealingTask *task = CSWorkStealingFindTask(pool, worker);
+        if (task) {
+
+            atomic_fetch_sub_explicit(&pool->pendingCount, 1, memory_order_relaxed);
+            task->function(task->context);
+            free(task);
+            idleRounds = 0;
+            continue;
+        }
+
+        //work often arrives right after thread runs out of it, short spin avoids sleeping and waking up
+        if (++idleRounds < CSWorkStealingIdleRoundsCount) {
+            sched_yield();
+            continue;
+        }
+        idleRounds = 0;
+
+        if (!CSWorkStealingWaitForTask(pool)) {
+            break;
+        }
+    }
+
+    pthread_setspecific(CSWorkStealingWorkerKey, NULL);
+    return NULL;
+}
+
+#pragma mark - Pool
+
+static void CSWorkStealingPoolFree(CSWorkStealingPool *pool) {
+
+    for (unsigned i = 0; i < pool->threadsCount; i++) {
+        for (unsigned priority = 0; priority < CSWorkStealingPrioritiesCount; priority++) {
+            CSWorkStealingDequeFree(&pool->workers[i].deques[priority]);
+        }
+    }
+
+    pthread_mutex_destroy(&pool->injectionLock);
+    pthread_mutex_destroy(&pool->sleepLock);
+    pthread_cond_destroy(&pool->wakeCondition);
+
+    free(pool->workers);
+    free(pool);
+}
+
+CSWorkStealingPool *CSWorkStealingPoolCreate(unsigned threadsCount, const char *name) {
+
+    if (!threadsCount) {
+        return NULL;
+    }
+
+    //deque indexes are aligned to cache lines so memory comes from posix_memalign
+    void *memory = NULL;
+    if (posix_memalign(&memory, CSWorkStealingCacheLineSize, sizeof(CSWorkStealingPool)) != 0) {
+        return NULL;
+    }
+    CSWorkStealingPool *pool = (CSWorkStealingPool *)memory;
+    memset(pool, 0, sizeof(CSWorkStealingPool));
+
+    memory = NULL;
+    if (posix_memalign(&memory, CSWorkStealingCacheLineSize, sizeof(CSWorkStealingWorker) * threadsCount) != 0) {
+        free(pool);
+        return NULL;
+    }
+    pool->workers = (CSWorkStealingWorker *)memory;
+    memset(pool->workers, 0, sizeof(CSWorkStealingWorker) * threadsCount);
+
+    snprintf(pool->name, sizeof(pool->name), "%s", (name ? name : "CSWorkStealingPool"));
+    pthread_mutex_init(&pool->injectionLock, NULL);
+    pthread_mutex_init(&pool->sleepLock, NULL);
+    pthread_cond_init(&pool->wakeCondition, NULL);
+
+    for (unsigned priority = 0; priority < CSWorkStealingPrioritiesCount; priority++) {
+        atomic_init(&pool->injectedCounts[priority], 0);
+    }
+    atomic_init(&pool->pendingCount, 0);
+    atomic_init(&pool->sleepersCount, 0);
+    atomic_init(&pool->stopping, false);
+    atomic_init(&pool->stealsCount, 0);
+
+    for (unsigned i = 0; i < threadsCount; i++) {
+
+        CSWorkStealingWorker *worker = &pool->workers[i];
+        for (unsigned priority = 0; priority < CSWorkStealingPrioritiesCount; priority++) {
+            if (!CSWorkStealingDequeInit(&worker->deques[priority])) {
+                pool->threadsCount = i + 1;
+                CSWorkStealingPoolFree(pool);
+                return NULL;
+            }
+        }
+        worker->pool = pool;
+        worker->index = i;
+        worker->randomState = UINT64_C(0x9E3779B97F4A7C15) * (i + 1);
+    }
+    pool->threadsCount = threadsCount;
+
+    for (unsigned i = 0; i < threadsCount; i++) {
+        if (pthread_create(&pool->workers[i].thread, NULL, CSWorkStealingWorkerMain, &pool->workers[i]) != 0) {
+            CSWorkStealingPoolDestroy(pool);
+            return NULL;
+        }
+        pool->startedThreadsCount++;
+    }
+    return pool;
+}
+
+void CSWorkStealingPoolDestroy(CSWorkStealingPool *pool) {
+
+    if (!pool) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->sleepLock);
+    atomic_store(&pool->stopping, true);
+    pthread_cond_broadcast(&pool->wakeCondition);
+    pthread_mutex_unlock(&pool->sleepLock);
+
+    for (unsigned i = 0; i < pool->startedThreadsCount; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    CSWorkStealingPoolFree(pool);
+}
+
+bool CSWorkStealingPoolSubmit(CSWorkStealingPool *pool, CSWorkStealingFunction function, void *context, CSWorkStealingPriority priority) {
+
+    if ((unsigned)priority >= CSWorkStealingPrioritiesCount) {
+        priority = CSWorkStealingPriorityNormal;
+    }
+
+    CSWorkStealingTask *task = malloc(sizeof(CSWorkStealingTask));
+    if (!task) {
+        return false;
+    }
+    task->function = function;
+    task->context = context;
+    task->next = NULL;
+
+    atomic_fetch_add(&pool->pendingCount, 1);
+
+    CSWorkStealingWorker *worker = CSWorkStealingCurrentWorker();
+    if (worker && worker->pool == pool) {
+
+        if (!CSWorkStealingDequePush(&worker->deques[priority], task)) {
+            atomic_fetch_sub(&pool->pendingCount, 1);
+            free(task);
+            return false;
+        }
+    }
+    else {
+        CSWorkStealingInject(pool, task, priority);
+    }
+
+    if (atomic_load(&pool->sleepersCount) > 0) {
+        pthread_mutex_lock(&pool->sleepLock);
+        pthread_cond_signal(&pool->wakeCondition);
+        pthread_mutex_unlock(&pool->sleepLock);
+    }
+    return true;
+}
+
+unsigned CSWorkStealingPoolThreadsCount(const CSWorkStealingPool *pool) {
+    return pool->threadsCount;
+}
+
+bool CSWorkStealingPoolIsCurrentThread(const CSWorkStealingPool *pool) {
+
+    CSWorkStealingWorker *worker = CSWorkStealingCurrentWorker();
+    return (worker && worker->pool == pool);
+}
+
+uint64_t CSWorkStealingPoolStealsCount(const CSWorkStealingPool *pool) {
+    return atomic_load_explicit(&((CSWorkStealingPool *)pool)->stealsCount, memory_order_relaxed);
+}
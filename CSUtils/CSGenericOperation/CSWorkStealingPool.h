@@ -0,0 +1,76 @@
+//
+//  CSWorkStealingPool.h
+//  CSUtils
+//
+//  Created by Josip Bernat on 16/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#ifndef CSUtils_CSWorkStealingPool_h
+#define CSUtils_CSWorkStealingPool_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  Priority of task. Waiting task of higher priority is always taken before waiting task of lower one, running tasks aren't preempted.
+ */
+typedef enum {
+    CSWorkStealingPriorityHigh = 0,
+    CSWorkStealingPriorityNormal,
+    CSWorkStealingPriorityLow
+} CSWorkStealingPriority;
+
+#define CSWorkStealingPrioritiesCount 3
+
+typedef void (*CSWorkStealingFunction)(void *context);
+
+/**
+ *  Fixed size pool of threads with work-stealing scheduler. Every thread owns one Chase-Lev deque per priority. Tasks submitted from pool thread are pushed to its own deque and taken back newest first, so task and the tasks it spawns stay on one core while they are hot in cache. Idle threads steal oldest tasks from deques of other threads. Tasks submitted from other threads go through shared FIFO injection queue, which threads also check every few tasks so outside work isn't starved by tasks spawning more tasks. Threads with no work sleep on condition variable. Portable C11 with POSIX threads.
+ */
+typedef struct CSWorkStealingPool CSWorkStealingPool;
+
+/**
+ *  Creates pool and starts its threads.
+ *
+ *  @param threadsCount Number of threads, must be greater than 0.
+ *  @param name         Name prefix of threads, used for debugging. Can be NULL.
+ *
+ *  @return New pool or NULL if threadsCount is 0 or threads couldn't be started.
+ */
+CSWorkStealingPool *CSWorkStealingPoolCreate(unsigned threadsCount, const char *name);
+
+/**
+ *  Runs all tasks already submitted, including tasks they submit meanwhile, then stops threads and releases pool. Must not be called from pool thread.
+ */
+void CSWorkStealingPoolDestroy(CSWorkStealingPool *pool);
+
+/**
+ *  Schedules function to be called with context on one of pool threads. Can be called from any thread, including pool threads.
+ *
+ *  @return false if memory couldn't be allocated, function isn't called then.
+ */
+bool CSWorkStealingPoolSubmit(CSWorkStealingPool *pool, CSWorkStealingFunction function, void *context, CSWorkStealingPriority priority);
+
+unsigned CSWorkStealingPoolThreadsCount(const CSWorkStealingPool *pool);
+
+/**
+ *  Returns true if called from one of pool threads.
+ */
+bool CSWorkStealingPoolIsCurrentThread(const CSWorkStealingPool *pool);
+
+/**
+ *  Number of tasks stolen from other threads since pool was created. Used to observe load balancing.
+ */
+uint64_t CSWorkStealingPoolStealsCount(const CSWorkStealingPool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -10,6 +10,7 @@
 
 @class CSLazyLoadController;
 @class CSURL;
+@class CSFuture;
 
 /**
  *  The delegate of a CSLazyLoadController object must adopt the CSLazyLoadControllerDelegate protocol. Methods of the protocol provide delegate feedback when image is loaded or when aditional info is required. All methods are optional since CSLazyLoadController object can be used just for reading cache without need to notify delegate when image is loaded.
@@ -59,6 +60,11 @@
  */
 @property (nonatomic, strong) NSDictionary *headerValues;
 
+/**
+ *  Timeout of image requests in seconds. Default is 20.
+ */
+@property (nonatomic, readwrite) NSTimeInterval timeoutInterval;
+
 /**
  *  Starts the image download if image is not present in cache. When image is founded delegate lazyLoadController:didReciveImage:fromURL:indexPath: method is called. You usually call this method after fastCacheImage: returns nil.
  *
@@ -85,4 +91,13 @@
  */
 - (UIImage *)fastCacheImage:(CSURL *)url;
 
+/**
+ *  Loads image from cache or downloads it without involving delegate. Image already in RAM cache resolves future immediately, otherwise disk cache is read and image downloaded on downloading queue. Downloaded image is cached. Canceling future cancels load if it hasn't started yet.
+ *
+ *  @param url URL object which contains image HTTP location. NSInvalidArgumentException is raised if it isn't CSURL.
+ *
+ *  @return Future resolved with UIImage object or with error if image couldn't be loaded.
+ */
+- (CSFuture *)imageFuture:(CSURL *)url;
+
 @end
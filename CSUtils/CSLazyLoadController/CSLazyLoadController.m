@@ -9,6 +9,8 @@
 #import "CSLazyLoadController.h"
 #import "CSCacheManager.h"
 #import "CSURL.h"
+#import "CSURLUtils.h"
+#import "CSFuture.h"
 
 static NSOperationQueue *_cacheOperationQueue = nil;
 static NSOperationQueue *_downloadingOperationQueue = nil;
@@ -74,6 +76,7 @@ static NSMutableSet   *_downloadingUrlsSet = nil;
     
     if (self = [super init]) {
         [CSCacheManager defaultCache];
+        self.timeoutInterval = 20.0;
     }
     
     return self;
@@ -183,6 +186,71 @@ static NSMutableSet   *_downloadingUrlsSet = nil;
     [[CSLazyLoadController sharedDownloadingOperationQueue] addOperation:operation];
 }
 
+- (CSFuture *)imageFuture:(CSURL *)url {
+    
+    if (![url isKindOfClass:[CSURL class]]) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"url argument must be CSURL kind"
+                               userInfo:nil] raise];
+    }
+    
+    UIImage *image = [self fastCacheImage:url];
+    if (image) {
+        return [CSFuture futureWithValue:image];
+    }
+    
+    CSFuture *future = [[CSFuture alloc] init];
+    
+    __weak id this = self;
+    NSBlockOperation *operation = [NSBlockOperation blockOperationWithBlock:^{
+        
+        if (future.isResolved) {
+            return;
+        }
+        
+        UIImage *image = [[CSCacheManager defaultCache] readCachedImage:url
+                                                               fromDisk:YES];
+        if (image) {
+            [future resolveWithValue:image error:nil];
+            return;
+        }
+        
+        __strong CSLazyLoadController *strongThis = this;
+        if (!strongThis) {
+            [future cancel];
+            return;
+        }
+        
+        NSURLResponse *response = nil;
+        NSError *error = nil;
+        NSData *data = [NSURLConnection sendSynchronousRequest:[strongThis urlRequestForURL:url]
+                                             returningResponse:&response
+                                                         error:&error];
+        
+        UIImage *downloadedImage = [UIImage imageWithData:data];
+        if (!downloadedImage) {
+            [future resolveWithValue:nil
+                               error:(error ? error : [NSError errorWithDomain:NSURLErrorDomain
+                                                                          code:NSURLErrorCannotDecodeContentData
+                                                                      userInfo:nil])];
+            return;
+        }
+        
+        [[CSCacheManager defaultCache] cacheImage:downloadedImage
+                                              url:url
+                                       saveToDisk:YES];
+        [future resolveWithValue:downloadedImage error:nil];
+    }];
+    
+    __weak NSOperation *weakOperation = operation;
+    [future setCancellationHandler:^{
+        [weakOperation cancel];
+    }];
+    
+    [[CSLazyLoadController sharedDownloadingOperationQueue] addOperation:operation];
+    return future;
+}
+
 - (NSMutableURLRequest *)urlRequestForURL:(CSURL *)url {
     
     NSAssert(([url isKindOfClass:[CSURL class]] || !url), @"url argument must be CSURL kind");
@@ -190,26 +258,12 @@ static NSMutableSet   *_downloadingUrlsSet = nil;
     
     NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:url.httpURL
                                                            cachePolicy:NSURLRequestReloadIgnoringCacheData
-                                                       timeoutInterval:20];
+                                                       timeoutInterval:self.timeoutInterval];
     [request setHTTPMethod:[url httpMethod]];
 
     if (![url.httpMethod isEqualToString:CSHTTPMethodGET] && url.parameters.count) {
         
-        NSMutableArray *parts = [[NSMutableArray alloc] init];
-        for (NSString *key in url.parameters) {
-            if (![key isKindOfClass:[NSString class]] || ![url.parameters[key] isKindOfClass:[NSString class]]) {
-                continue;
-            }
-            
-            NSString *encodedValue = [url.parameters[key] stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
-            NSString *encodedKey = [key stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
-            NSString *part = [NSString stringWithFormat:@"%@=%@", encodedKey, encodedValue];
-            [parts addObject:part];
-        }
-        
-        NSString *encodedDictionary = [parts componentsJoinedByString:@"&"];
-
-        NSData *httpBody = [encodedDictionary dataUsingEncoding:NSUTF8StringEncoding];
+        NSData *httpBody = [CSURLUtils formDataFromParameters:url.parameters];
         [request setHTTPBody:httpBody];
         
         [request setValue:[NSString stringWithFormat:@"%lu", (unsigned long)httpBody.length] forHTTPHeaderField:@"Content-Length"];
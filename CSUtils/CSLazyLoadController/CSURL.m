@@ -8,6 +8,7 @@
 
 #import "CSURL.h"
 #import <CommonCrypto/CommonDigest.h>
+#import "CSURLUtils.h"
 
 #pragma mark - Interface CSURL
 @interface CSURL ()
@@ -60,14 +61,9 @@
     if (self.httpMethod == CSHTTPMethodGET || !self.parameters.count) {
         return [self.stringURL sha256String];
     }
-    NSMutableString *string = [NSMutableString stringWithFormat:@"%@?", self.stringURL];
-    for (NSString *key in self.parameters.allKeys) {
-        if (![key isKindOfClass:[NSString class]] ||
-            ![self.parameters[key] isKindOfClass:[NSString class]]) {
-            continue;
-        }
-        [string appendFormat:@"%@=%@&", key, self.parameters[key]];
-    }
+    NSString *string = [NSString stringWithFormat:@"%@?%@",
+                        self.stringURL,
+                        [CSURLUtils queryStringFromParameters:self.parameters]];
     return [string sha256String];
 }
 
@@ -0,0 +1,180 @@
+//
+//  CSChunkedUpload.h
+//  CSUtils
+//
+//  Created by Josip Bernat on 14/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "CSGenericOperation.h"
+
+@class CSMessage;
+@class CSChunkedUpload;
+
+/**
+ *  String object identifing chunked upload error.
+ */
+extern NSString * const CSChunkedUploadErrorDomain;
+
+/**
+ *  Integer value defining error.code when file can't be opened or read.
+ */
+extern NSInteger const CSChunkedUploadErrorCodeFile;
+
+/**
+ *  Integer value defining error.code when server rejects part or commit. Status code is in userInfo under CSChunkedUploadStatusCodeKey.
+ */
+extern NSInteger const CSChunkedUploadErrorCodeStatus;
+
+/**
+ *  Key of HTTP status code in userInfo of CSChunkedUploadErrorCodeStatus errors.
+ */
+extern NSString * const CSChunkedUploadStatusCodeKey;
+
+/**
+ *  Describes upload protocol of server. Encoder configures action, method, parameters and headers of messages, CSChunkedUpload sets their body.
+ */
+@protocol CSChunkedUploadEncoder <NSObject>
+
+/**
+ *  Configures message uploading one part. Message bodyData is already set.
+ *
+ *  @param message   Part message.
+ *  @param partIndex Zero based index of part.
+ *  @param offset    Offset of part in file.
+ *  @param upload    Upload to which part belongs.
+ */
+- (void)configurePartMessage:(CSMessage *)message
+              forPartAtIndex:(NSUInteger)partIndex
+                      offset:(unsigned long long)offset
+                    ofUpload:(CSChunkedUpload *)upload;
+
+/**
+ *  Configures message sent after all parts are uploaded.
+ *
+ *  @param message       Commit message.
+ *  @param partResponses Parsed responses of part messages ordered by part index. NSNull is used for empty responses.
+ *  @param upload        Upload being committed.
+ */
+- (void)configureCommitMessage:(CSMessage *)message
+             withPartResponses:(NSArray *)partResponses
+                      ofUpload:(CSChunkedUpload *)upload;
+
+@end
+
+/**
+ *  Default encoder. Parts are sent as PUT requests to partAction with upload_id, part_number (one based) and offset in query string and Content-Range header. Commit is POST request to commitAction with upload_id, parts_count, length and file_name parameters. Upload parameters are added to every message.
+ */
+@interface CSDefaultChunkedUploadEncoder : NSObject <CSChunkedUploadEncoder>
+@end
+
+/**
+ *  CSChunkedUpload sends large file as fixed size parts, several at once, and finishes with commit message. Parts are read from disk just before they are sent into pool of at most maxConcurrentPartsCount buffers so memory use doesn't depend on file size. Only failed parts are sent again. Part and commit messages go through CSMessageCenter. Part messages have no deadline, only their idle timeout fails parts whose transfer stalls, so parts upload over slow links at any speed.
+ */
+@interface CSChunkedUpload : CSGenericOperation
+
+/**
+ *  Path of file being uploaded.
+ */
+@property (nonatomic, strong, readonly) NSString *filePath;
+
+/**
+ *  Identifier sent with every part and commit. Default is new UUID.
+ */
+@property (nonatomic, strong) NSString *uploadIdentifier;
+
+/**
+ *  NSURL object used as base URL of part and commit messages. If nil, URL registrated with CSMessage is used.
+ */
+@property (nonatomic, strong) NSURL *baseURL;
+
+/**
+ *  HTTP path to which parts are sent.
+ */
+@property (nonatomic, strong) NSString *partAction;
+
+/**
+ *  HTTP path to which commit is sent.
+ */
+@property (nonatomic, strong) NSString *commitAction;
+
+/**
+ *  Parameters sent with every part and commit.
+ */
+@property (nonatomic, strong) NSDictionary *parameters;
+
+/**
+ *  Additional HTTP header fields sent with every part and commit.
+ */
+@property (nonatomic, strong) NSDictionary *headerValues;
+
+/**
+ *  Size of single part in bytes. Last part can be smaller. NSInvalidArgumentException is raised if set to 0. Default is 4MB.
+ */
+@property (nonatomic, readwrite) NSUInteger partSize;
+
+/**
+ *  Number of parts uploaded at once and number of part buffers. NSInvalidArgumentException is raised if set to 0. Default is 3.
+ */
+@property (nonatomic, readwrite) NSUInteger maxConcurrentPartsCount;
+
+/**
+ *  Number of times failed part or commit is sent again before upload fails. Default is 3.
+ */
+@property (nonatomic, readwrite) NSUInteger maxRetriesCount;
+
+/**
+ *  Delay before first retry. Doubled for every following retry of same part. Default is 1 second.
+ */
+@property (nonatomic, readwrite) NSTimeInterval retryDelay;
+
+/**
+ *  Encoder describing upload protocol. Default is CSDefaultChunkedUploadEncoder.
+ */
+@property (nonatomic, strong) id<CSChunkedUploadEncoder> encoder;
+
+/**
+ *  Called with parsed commit response or error when upload finishes. Canceled upload finishes with [CSMessage cancellationError].
+ */
+@property (copy) CSResponseBlock responseBlock;
+
+/**
+ *  Called every time part is uploaded. bytesWritten is length of the part.
+ */
+@property (copy) CSUploadProgressBlock uploadProgressBlock;
+
+/**
+ *  Dispatch queue on which responseBlock and uploadProgressBlock are called. Default is main queue.
+ */
+@property (nonatomic, strong) dispatch_queue_t completionQueue;
+
+/**
+ *  Length of file. Available after upload starts.
+ */
+@property (nonatomic, readonly) unsigned long long fileLength;
+
+/**
+ *  Number of parts file is split into. Available after upload starts.
+ */
+@property (nonatomic, readonly) NSUInteger partsCount;
+
+#pragma mark - Initialization
+
+/**
+ *  Creates new upload.
+ *
+ *  @param filePath Path of file to upload. NSInvalidArgumentException is raised if filePath is nil.
+ *
+ *  @return New instance of CSChunkedUpload.
+ */
+- (instancetype)initWithFilePath:(NSString *)filePath; //designated initializer
+
+#pragma mark - Sending
+
+/**
+ *  Starts upload. Parts are sent asynchronously so this method returns immediately. Upload can also be added to NSOperationQueue instead.
+ */
+- (void)send;
+
+@end
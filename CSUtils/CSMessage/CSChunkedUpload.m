@@ -0,0 +1,508 @@
+//
+//  CSChunkedUpload.m
+//  CSUtils
+//
+//  Created by Josip Bernat on 14/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import "CSChunkedUpload.h"
+#import "CSMessage.h"
+#import "CSMessageCenter.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+NSString * const CSChunkedUploadErrorDomain        = @"CSChunkedUploadErrorDomain";
+NSInteger const CSChunkedUploadErrorCodeFile        = 901;
+NSInteger const CSChunkedUploadErrorCodeStatus      = 902;
+NSString * const CSChunkedUploadStatusCodeKey       = @"statusCode";
+
+#pragma mark - Implementation CSDefaultChunkedUploadEncoder
+
+@implementation CSDefaultChunkedUploadEncoder
+
+- (NSMutableDictionary *)parametersOfUpload:(CSChunkedUpload *)upload {
+    
+    NSMutableDictionary *parameters = (upload.parameters ? [upload.parameters mutableCopy] : [[NSMutableDictionary alloc] init]);
+    parameters[@"upload_id"] = upload.uploadIdentifier;
+    return parameters;
+}
+
+- (void)configurePartMessage:(CSMessage *)message
+              forPartAtIndex:(NSUInteger)partIndex
+                      offset:(unsigned long long)offset
+                    ofUpload:(CSChunkedUpload *)upload {
+    
+    NSMutableDictionary *parameters = [self parametersOfUpload:upload];
+    parameters[@"part_number"] = [NSString stringWithFormat:@"%lu", (unsigned long)partIndex + 1];
+    parameters[@"offset"] = [NSString stringWithFormat:@"%llu", offset];
+    
+    message.httpMethod = CSHTTPMethodPUT;
+    message.action = upload.partAction;
+    message.parameters = parameters;
+    
+    NSMutableDictionary *headerValues = (upload.headerValues ? [upload.headerValues mutableCopy] : [[NSMutableDictionary alloc] init]);
+    if (message.bodyData.length) {
+        headerValues[@"Content-Range"] = [NSString stringWithFormat:@"bytes %llu-%llu/%llu", offset, offset + message.bodyData.length - 1, upload.fileLength];
+    }
+    message.headerValues = headerValues;
+}
+
+- (void)configureCommitMessage:(CSMessage *)message
+             withPartResponses:(NSArray *)partResponses
+                      ofUpload:(CSChunkedUpload *)upload {
+    
+    NSMutableDictionary *parameters = [self parametersOfUpload:upload];
+    parameters[@"parts_count"] = [NSString stringWithFormat:@"%lu", (unsigned long)upload.partsCount];
+    parameters[@"length"] = [NSString stringWithFormat:@"%llu", upload.fileLength];
+    parameters[@"file_name"] = [upload.filePath lastPathComponent];
+    
+    message.httpMethod = CSHTTPMethodPOST;
+    message.action = upload.commitAction;
+    message.parameters = parameters;
+    message.headerValues = upload.headerValues;
+}
+
+@end
+
+#pragma mark - Implementation CSChunkedUpload
+
+/**
+ *  All state below is accessed only on queue. File is read on readQueue.
+ */
+@interface CSChunkedUpload () {
+    
+    int _fileDescriptor;
+    NSUInteger _nextPartIndex;
+    NSUInteger _uploadedPartsCount;
+    NSUInteger _commitAttemptsCount;
+    unsigned long long _uploadedLength;
+    BOOL _done;
+}
+
+@property (nonatomic, strong, readwrite) NSString *filePath;
+@property (nonatomic, readwrite) unsigned long long fileLength;
+@property (nonatomic, readwrite) NSUInteger partsCount;
+@property (nonatomic, strong) dispatch_queue_t queue;
+@property (nonatomic, strong) dispatch_queue_t readQueue;
+@property (nonatomic, strong) NSMutableArray *freeBuffers;
+@property (nonatomic, strong) NSMutableDictionary *partBuffers;
+@property (nonatomic, strong) NSMutableDictionary *partMessages;
+@property (nonatomic, strong) NSMutableDictionary *partAttempts;
+@property (nonatomic, strong) NSMutableArray *partResponses;
+@property (nonatomic, strong) CSMessage *commitMessage;
+
+@end
+
+@implementation CSChunkedUpload
+
+#pragma mark - Memory Management
+
+- (void)dealloc {
+    
+    if (_fileDescriptor >= 0) {
+        close(_fileDescriptor);
+    }
+}
+
+#pragma mark - Initialization
+
+- (id)init {
+    return [self initWithFilePath:nil];
+}
+
+- (instancetype)initWithFilePath:(NSString *)filePath {
+    
+    if (!filePath) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"filePath can't be nil"
+                               userInfo:nil] raise];
+    }
+    
+    if (self = [super init]) {
+        
+        _filePath = [filePath copy];
+        _fileDescriptor = -1;
+        _uploadIdentifier = [[NSUUID UUID] UUIDString];
+        _partSize = 4 * 1024 * 1024;
+        _maxConcurrentPartsCount = 3;
+        _maxRetriesCount = 3;
+        _retryDelay = 1.0;
+        _encoder = [[CSDefaultChunkedUploadEncoder alloc] init];
+        
+        _queue = dispatch_queue_create("com.clover-studio.CSChunkedUpload", DISPATCH_QUEUE_SERIAL);
+        _readQueue = dispatch_queue_create("com.clover-studio.CSChunkedUpload.read", DISPATCH_QUEUE_SERIAL);
+        
+        _freeBuffers = [[NSMutableArray alloc] init];
+        _partBuffers = [[NSMutableDictionary alloc] init];
+        _partMessages = [[NSMutableDictionary alloc] init];
+        _partAttempts = [[NSMutableDictionary alloc] init];
+    }
+    return self;
+}
+
+#pragma mark - Setters
+
+- (void)setPartSize:(NSUInteger)partSize {
+    
+    if (!partSize) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"partSize must be greater than 0"
+                               userInfo:nil] raise];
+    }
+    _partSize = partSize;
+}
+
+- (void)setMaxConcurrentPartsCount:(NSUInteger)maxConcurrentPartsCount {
+    
+    if (!maxConcurrentPartsCount) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"maxConcurrentPartsCount must be greater than 0"
+                               userInfo:nil] raise];
+    }
+    _maxConcurrentPartsCount = maxConcurrentPartsCount;
+}
+
+#pragma mark - Sending
+
+- (void)send {
+    [self start];
+}
+
+#pragma mark - Errors
+
++ (NSError *)fileErrorWithDescription:(NSString *)description {
+    
+    return [NSError errorWithDomain:CSChunkedUploadErrorDomain
+                               code:CSChunkedUploadErrorCodeFile
+                           userInfo:@{NSLocalizedDescriptionKey : description}];
+}
+
++ (NSError *)statusErrorWithStatusCode:(NSInteger)statusCode {
+    
+    return [NSError errorWithDomain:CSChunkedUploadErrorDomain
+                               code:CSChunkedUploadErrorCodeStatus
+                           userInfo:@{NSLocalizedDescriptionKey : [NSString stringWithFormat:@"Server responded with status %ld.", (long)statusCode],
+                                      CSChunkedUploadStatusCodeKey : @(statusCode)}];
+}
+
+/**
+ *  Returns error of finished message or nil if it succeeded.
+ */
++ (NSError *)errorOfMessage:(CSMessage *)message error:(NSError *)error {
+    
+    if (error) {
+        return error;
+    }
+    if (message.responseStatusCode < 200 || message.responseStatusCode >= 300) {
+        return [self statusErrorWithStatusCode:message.responseStatusCode];
+    }
+    return nil;
+}
+
+/**
+ *  Connection errors, server errors, timeouts and throttling are worth retrying, other rejections aren't.
+ */
++ (BOOL)isRetryableError:(NSError *)error {
+    
+    if (![error.domain isEqualToString:CSChunkedUploadErrorDomain]) {
+        return !([error.domain isEqualToString:NSURLErrorDomain] && error.code == NSURLErrorCancelled);
+    }
+    
+    NSInteger statusCode = [error.userInfo[CSChunkedUploadStatusCodeKey] integerValue];
+    return (statusCode >= 500 || statusCode == 408 || statusCode == 429);
+}
+
+#pragma mark - CSGennericOperation Override
+
+- (void)operationDidStart {
+    
+    dispatch_async(self.queue, ^{
+        
+        int fileDescriptor = open([self.filePath fileSystemRepresentation], O_RDONLY);
+        struct stat fileStat;
+        if (fileDescriptor < 0 || fstat(fileDescriptor, &fileStat) != 0) {
+            
+            if (fileDescriptor >= 0) {
+                close(fileDescriptor);
+            }
+            [self finishWithResponseObject:nil
+                                     error:[[self class] fileErrorWithDescription:[NSString stringWithFormat:@"Unable to open %@: %s", self.filePath, strerror(errno)]]];
+            return;
+        }
+        
+        _fileDescriptor = fileDescriptor;
+        self.fileLength = (unsigned long long)fileStat.st_size;
+        
+        //empty file is still sent as one empty part so server sees the upload
+        unsigned long long partsCount = (self.fileLength + self.partSize - 1) / self.partSize;
+        self.partsCount = (NSUInteger)MAX(partsCount, 1ULL);
+        
+        self.partResponses = [[NSMutableArray alloc] initWithCapacity:self.partsCount];
+        for (NSUInteger i = 0; i < self.partsCount; i++) {
+            [self.partResponses addObject:[NSNull null]];
+        }
+        
+        [self scheduleParts];
+    });
+}
+
+- (void)operationDidCancel {
+    
+    //part and commit messages are canceled too so their connections stop immediately
+    dispatch_async(self.queue, ^{
+        [self finishWithResponseObject:nil error:[CSMessage cancellationError]];
+    });
+}
+
+#pragma mark - Parts
+
+- (unsigned long long)offsetOfPartAtIndex:(NSUInteger)partIndex {
+    return (unsigned long long)partIndex * self.partSize;
+}
+
+- (NSUInteger)lengthOfPartAtIndex:(NSUInteger)partIndex {
+    
+    unsigned long long offset = [self offsetOfPartAtIndex:partIndex];
+    return (NSUInteger)MIN((unsigned long long)self.partSize, self.fileLength - offset);
+}
+
+/**
+ *  Starts parts while there are free buffers. Parts waiting for retry already own their buffers.
+ */
+- (void)scheduleParts {
+    
+    if (_done) {
+        return;
+    }
+    
+    while (_nextPartIndex < self.partsCount && self.partBuffers.count < self.maxConcurrentPartsCount) {
+        
+        NSMutableData *buffer = [self.freeBuffers lastObject];
+        if (buffer) {
+            [self.freeBuffers removeLastObject];
+        }
+        else {
+            buffer = [[NSMutableData alloc] initWithLength:self.partSize];
+        }
+        
+        NSUInteger partIndex = _nextPartIndex++;
+        self.partBuffers[@(partIndex)] = buffer;
+        [self readPartAtIndex:partIndex intoBuffer:buffer];
+    }
+    
+    if (_uploadedPartsCount == self.partsCount && !self.commitMessage) {
+        [self sendCommit];
+    }
+}
+
+- (void)readPartAtIndex:(NSUInteger)partIndex intoBuffer:(NSMutableData *)buffer {
+    
+    unsigned long long offset = [self offsetOfPartAtIndex:partIndex];
+    NSUInteger length = [self lengthOfPartAtIndex:partIndex];
+    int fileDescriptor = _fileDescriptor;
+    
+    dispatch_async(self.readQueue, ^{
+        
+        uint8_t *bytes = [buffer mutableBytes];
+        NSUInteger readLength = 0;
+        while (readLength < length) {
+            
+            ssize_t result = pread(fileDescriptor, bytes + readLength, length - readLength, (off_t)(offset + readLength));
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            if (result <= 0) {
+                break;
+            }
+            readLength += (NSUInteger)result;
+        }
+        
+        dispatch_async(self.queue, ^{
+            
+            if (readLength < length) {
+                [self finishWithResponseObject:nil
+                                         error:[[self class] fileErrorWithDescription:[NSString stringWithFormat:@"Unable to read %@", self.filePath]]];
+                return;
+            }
+            [self sendPartAtIndex:partIndex];
+        });
+    });
+}
+
+- (void)sendPartAtIndex:(NSUInteger)partIndex {
+    
+    NSMutableData *buffer = self.partBuffers[@(partIndex)];
+    if (_done || !buffer) {
+        [self.partBuffers removeObjectForKey:@(partIndex)];
+        return;
+    }
+    
+    //part gets no deadline, whole part can take any time on slow link as long as its transfer doesn't stall for timeoutInterval
+    CSMessage *message = [[CSMessage alloc] init];
+    message.baseURL = self.baseURL;
+    message.completionQueue = self.queue;
+    message.bodyData = [NSData dataWithBytesNoCopy:[buffer mutableBytes] length:[self lengthOfPartAtIndex:partIndex] freeWhenDone:NO];
+    [self.encoder configurePartMessage:message
+                        forPartAtIndex:partIndex
+                                offset:[self offsetOfPartAtIndex:partIndex]
+                              ofUpload:self];
+    
+    __weak CSMessage *weakMessage = message;
+    message.responseBlock = ^(id responseObject, NSError *error) {
+        [self partAtIndex:partIndex didFinishWithMessage:weakMessage responseObject:responseObject error:error];
+    };
+    
+    self.partMessages[@(partIndex)] = message;
+    [[CSMessageCenter defaultCenter] addMessage:message];
+}
+
+- (void)partAtIndex:(NSUInteger)partIndex
+didFinishWithMessage:(CSMessage *)message
+     responseObject:(id)responseObject
+              error:(NSError *)error {
+    
+    [self.partMessages removeObjectForKey:@(partIndex)];
+    if (_done) {
+        [self.partBuffers removeObjectForKey:@(partIndex)];
+        return;
+    }
+    
+    error = [[self class] errorOfMessage:message error:error];
+    if (error) {
+        
+        NSUInteger attemptsCount = [self.partAttempts[@(partIndex)] unsignedIntegerValue] + 1;
+        self.partAttempts[@(partIndex)] = @(attemptsCount);
+        
+        if (attemptsCount > self.maxRetriesCount || ![[self class] isRetryableError:error]) {
+            [self.partBuffers removeObjectForKey:@(partIndex)];
+            [self finishWithResponseObject:nil error:error];
+            return;
+        }
+        
+        //part keeps its buffer so it isn't read again
+        NSTimeInterval delay = self.retryDelay * pow(2.0, (double)(attemptsCount - 1));
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), self.queue, ^{
+            [self sendPartAtIndex:partIndex];
+        });
+        return;
+    }
+    
+    self.partResponses[partIndex] = (responseObject ? responseObject : [NSNull null]);
+    _uploadedPartsCount++;
+    
+    NSUInteger length = [self lengthOfPartAtIndex:partIndex];
+    _uploadedLength += length;
+    
+    //NSURLConnection is done with body so buffer can be reused
+    [self.freeBuffers addObject:self.partBuffers[@(partIndex)]];
+    [self.partBuffers removeObjectForKey:@(partIndex)];
+    
+    CSUploadProgressBlock uploadProgressBlock = self.uploadProgressBlock;
+    if (uploadProgressBlock) {
+        
+        long long uploadedLength = (long long)_uploadedLength;
+        long long fileLength = (long long)self.fileLength;
+        dispatch_async([self deliveryQueue], ^{
+            uploadProgressBlock((NSInteger)length, uploadedLength, fileLength);
+        });
+    }
+    
+    [self scheduleParts];
+}
+
+#pragma mark - Commit
+
+- (void)sendCommit {
+    
+    if (_done) {
+        return;
+    }
+    
+    //all parts are uploaded so buffers aren't needed anymore
+    [self.freeBuffers removeAllObjects];
+    
+    CSMessage *message = [[CSMessage alloc] init];
+    message.baseURL = self.baseURL;
+    message.completionQueue = self.queue;
+    [self.encoder configureCommitMessage:message withPartResponses:self.partResponses ofUpload:self];
+    
+    __weak CSMessage *weakMessage = message;
+    message.responseBlock = ^(id responseObject, NSError *error) {
+        [self commitDidFinishWithMessage:weakMessage responseObject:responseObject error:error];
+    };
+    
+    self.commitMessage = message;
+    [[CSMessageCenter defaultCenter] addMessage:message];
+}
+
+- (void)commitDidFinishWithMessage:(CSMessage *)message responseObject:(id)responseObject error:(NSError *)error {
+    
+    if (_done) {
+        return;
+    }
+    
+    error = [[self class] errorOfMessage:message error:error];
+    if (error && ++_commitAttemptsCount <= self.maxRetriesCount && [[self class] isRetryableError:error]) {
+        
+        NSTimeInterval delay = self.retryDelay * pow(2.0, (double)(_commitAttemptsCount - 1));
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), self.queue, ^{
+            [self sendCommit];
+        });
+        return;
+    }
+    
+    self.commitMessage = nil;
+    [self finishWithResponseObject:(error ? nil : responseObject) error:error];
+}
+
+#pragma mark - Finishing
+
+- (dispatch_queue_t)deliveryQueue {
+    return (self.completionQueue ? self.completionQueue : dispatch_get_main_queue());
+}
+
+/**
+ *  Releases file and buffers and delivers result. Must be called on queue.
+ */
+- (void)finishWithResponseObject:(id)responseObject error:(NSError *)error {
+    
+    if (_done) {
+        return;
+    }
+    _done = YES;
+    
+    if (_fileDescriptor >= 0) {
+        
+        //reads already queued finish before descriptor is closed
+        int fileDescriptor = _fileDescriptor;
+        _fileDescriptor = -1;
+        dispatch_async(self.readQueue, ^{
+            close(fileDescriptor);
+        });
+    }
+    
+    //buffers of started parts are released when their messages finish because connections may still be reading them
+    [self.freeBuffers removeAllObjects];
+    
+    NSArray *messages = [self.partMessages allValues];
+    if (self.commitMessage) {
+        messages = [messages arrayByAddingObject:self.commitMessage];
+        self.commitMessage = nil;
+    }
+    for (CSMessage *message in messages) {
+        [[CSMessageCenter defaultCenter] cancelMessage:message];
+    }
+    
+    CSResponseBlock responseBlock = self.responseBlock;
+    dispatch_async([self deliveryQueue], ^{
+        
+        if (responseBlock) {
+            responseBlock(responseObject, error);
+        }
+        [self operationDidFinish];
+    });
+}
+
+@end
@@ -0,0 +1,57 @@
+//
+//  CSGzip.c
+//  CSUtils
+//
+//  Created by Josip Bernat on 10/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#include "CSGzip.h"
+
+#include <limits.h>
+#include <zlib.h>
+
+/**
+ *  Window bits for deflateInit2. Adding 16 writes gzip header and trailer instead of zlib ones.
+ */
+#define CSGzipWindowBits (15 + 16)
+
+/**
+ *  Size of gzip header and trailer which deflateBound doesn't count for raw deflate streams.
+ */
+#define CSGzipWrapperLength 18
+
+bool CSGzipCompressBytes(CSByteBuffer *buffer, const uint8_t *bytes, size_t length, int level) {
+
+    if (length > UINT_MAX || level < 1 || level > 9) {
+        return false;
+    }
+    
+    z_stream stream;
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+    
+    if (deflateInit2(&stream, level, Z_DEFLATED, CSGzipWindowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    
+    size_t bound = (size_t)deflateBound(&stream, (uLong)length) + CSGzipWrapperLength;
+    if (bound > UINT_MAX || !CSByteBufferReserve(buffer, bound)) {
+        deflateEnd(&stream);
+        return false;
+    }
+    
+    stream.next_in = (Bytef *)bytes;
+    stream.avail_in = (uInt)length;
+    stream.next_out = buffer->bytes + buffer->length;
+    stream.avail_out = (uInt)bound;
+    
+    int result = deflate(&stream, Z_FINISH);
+    if (result == Z_STREAM_END) {
+        buffer->length += (size_t)stream.total_out;
+    }
+    deflateEnd(&stream);
+    
+    return (result == Z_STREAM_END);
+}
@@ -0,0 +1,36 @@
+//
+//  CSGzip.h
+//  CSUtils
+//
+//  Created by Josip Bernat on 10/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#ifndef CSUtils_CSGzip_h
+#define CSUtils_CSGzip_h
+
+#include "CSPercentEncoding.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  Default compression level, same as zlib default.
+ */
+#define CSGzipDefaultCompressionLevel 6
+
+/**
+ *  Compresses bytes into gzip format and appends result to buffer. Buffer is reserved once for zlib's upper bound so compression runs in single deflate call.
+ *
+ *  @param level Compression level from 1 to 9.
+ *
+ *  @return true on success, false if memory couldn't be allocated or zlib failed. Buffer length is left unchanged on failure.
+ */
+bool CSGzipCompressBytes(CSByteBuffer *buffer, const uint8_t *bytes, size_t length, int level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -17,6 +17,16 @@ extern CSHTTPMethod const CSHTTPMethodPOST;     ///HTTP POST method.
 extern CSHTTPMethod const CSHTTPMethodPUT;      ///HTTP PUT method.
 extern CSHTTPMethod const CSHTTPMethodDELETE;   ///HTTP DELETE method.
 
+/**
+ *  Digest algorithms which can be computed over response body.
+ */
+typedef NS_ENUM(NSInteger, CSDigestAlgorithm) {
+    CSDigestAlgorithmNone = 0,  ///No digest is computed.
+    CSDigestAlgorithmMD5,       ///MD5 digest.
+    CSDigestAlgorithmSHA1,      ///SHA-1 digest.
+    CSDigestAlgorithmSHA256     ///SHA-256 digest.
+};
+
 @interface CSHTTPAssistance : NSObject
 
 @end
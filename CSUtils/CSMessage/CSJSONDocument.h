@@ -0,0 +1,50 @@
+//
+//  CSJSONDocument.h
+//  CSUtils
+//
+//  Created by Josip Bernat on 03/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ *  String object identifing JSON parsing error.
+ */
+extern NSString * const CSJSONDocumentErrorDomain;
+
+/**
+ *  CSJSONDocument parses JSON data into compact read-only tape in single pass. Objects are not created while parsing. Root object and all nested containers are returned as immutable NSDictionary and NSArray objects which create their values from the tape only when they are accessed. Containers retain the document so they stay valid after the document object is released.
+ */
+@interface CSJSONDocument : NSObject
+
+/**
+ *  Root object of the document. Usually NSDictionary or NSArray.
+ */
+@property (nonatomic, strong, readonly) id rootObject;
+
+#pragma mark - Class Methods
+
+/**
+ *  Parses given data and returns its root object.
+ *
+ *  @param data  UTF-8 encoded JSON data.
+ *  @param error On return contains error with CSJSONDocumentErrorDomain domain if data is not valid JSON.
+ *
+ *  @return Root object of the document or nil if parsing failed.
+ */
++ (id)JSONObjectWithData:(NSData *)data error:(NSError **)error;
+
+#pragma mark - Initialization
+
+/**
+ *  Parses given data into new document.
+ *
+ *  @param data  UTF-8 encoded JSON data.
+ *  @param error On return contains error with CSJSONDocumentErrorDomain domain if data is not valid JSON.
+ *
+ *  @return New instance of CSJSONDocument or nil if parsing failed.
+ */
+- (instancetype)initWithData:(NSData *)data error:(NSError **)error; //designated initializer
+
+@end
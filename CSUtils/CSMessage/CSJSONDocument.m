@@ -0,0 +1,315 @@
+//
+//  CSJSONDocument.m
+//  CSUtils
+//
+//  Created by Josip Bernat on 03/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import "CSJSONDocument.h"
+#import "CSJSONTape.h"
+
+NSString * const CSJSONDocumentErrorDomain = @"CSJSONDocumentErrorDomain";
+
+@interface CSJSONDocument () {
+
+    CSJSONTape _tape;
+}
+
+- (const CSJSONTape *)tape;
+- (id)objectAtTapeIndex:(size_t)index;
+
+@end
+
+#pragma mark - Interface CSJSONLazyDictionary
+
+@interface CSJSONLazyDictionary : NSDictionary {
+
+    CSJSONDocument *_document;
+    size_t _tapeIndex;
+    NSUInteger _count;
+    NSDictionary *_valueIndexes;
+    NSMutableDictionary *_values;
+}
+
+- (instancetype)initWithDocument:(CSJSONDocument *)document tapeIndex:(size_t)tapeIndex;
+
+@end
+
+#pragma mark - Interface CSJSONLazyArray
+
+@interface CSJSONLazyArray : NSArray {
+
+    CSJSONDocument *_document;
+    size_t _tapeIndex;
+    NSUInteger _count;
+    size_t *_valueIndexes;
+    __strong id *_values;
+}
+
+- (instancetype)initWithDocument:(CSJSONDocument *)document tapeIndex:(size_t)tapeIndex;
+
+@end
+
+#pragma mark - Implementation CSJSONDocument
+
+@implementation CSJSONDocument
+
+@synthesize rootObject = _rootObject;
+
++ (id)JSONObjectWithData:(NSData *)data error:(NSError **)error {
+    return [[[self alloc] initWithData:data error:error] rootObject];
+}
+
+#pragma mark - Memory Management
+
+- (void)dealloc {
+    CSJSONTapeFree(&_tape);
+}
+
+#pragma mark - Initialization
+
+- (instancetype)initWithData:(NSData *)data error:(NSError **)error {
+
+    if (self = [super init]) {
+
+        CSJSONTapeInit(&_tape);
+
+        size_t errorOffset = 0;
+        CSJSONTapeError result = CSJSONTapeParse(&_tape, data.bytes, data.length, &errorOffset);
+        if (result != CSJSONTapeErrorNone) {
+
+            if (error) {
+                NSString *format = (result == CSJSONTapeErrorEncoding ? @"Unable to convert data to string around character %lu." : @"JSON text is not valid around character %lu.");
+                NSString *description = [NSString stringWithFormat:format, (unsigned long)errorOffset];
+                *error = [NSError errorWithDomain:CSJSONDocumentErrorDomain
+                                             code:result
+                                         userInfo:@{NSLocalizedDescriptionKey : description}];
+            }
+            return nil;
+        }
+    }
+    return self;
+}
+
+#pragma mark - Getters
+
+- (id)rootObject {
+
+    @synchronized(self) {
+        if (!_rootObject) {
+            _rootObject = [self objectAtTapeIndex:1];
+        }
+        return _rootObject;
+    }
+}
+
+- (const CSJSONTape *)tape {
+    return &_tape;
+}
+
+#pragma mark - Materializing Objects
+
+- (id)objectAtTapeIndex:(size_t)index {
+
+    switch (CSJSONTapeTypeAtIndex(&_tape, index)) {
+
+        case CSJSONTapeTypeObjectStart:
+            return [[CSJSONLazyDictionary alloc] initWithDocument:self tapeIndex:index];
+
+        case CSJSONTapeTypeArrayStart:
+            return [[CSJSONLazyArray alloc] initWithDocument:self tapeIndex:index];
+
+        case CSJSONTapeTypeString: {
+
+            size_t length = 0;
+            const char *bytes = CSJSONTapeStringAtIndex(&_tape, index, &length);
+            return [[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding];
+        }
+        case CSJSONTapeTypeInteger:
+            return [NSNumber numberWithLongLong:CSJSONTapeIntegerAtIndex(&_tape, index)];
+
+        case CSJSONTapeTypeDouble:
+            return [NSNumber numberWithDouble:CSJSONTapeDoubleAtIndex(&_tape, index)];
+
+        case CSJSONTapeTypeTrue:
+            return @YES;
+
+        case CSJSONTapeTypeFalse:
+            return @NO;
+
+        case CSJSONTapeTypeNull:
+            return [NSNull null];
+
+        default:
+            return nil;
+    }
+}
+
+@end
+
+#pragma mark - Implementation CSJSONLazyDictionary
+
+@implementation CSJSONLazyDictionary
+
+- (instancetype)initWithDocument:(CSJSONDocument *)document tapeIndex:(size_t)tapeIndex {
+
+    if (self = [super init]) {
+
+        _document = document;
+        _tapeIndex = tapeIndex;
+        _count = CSJSONTapeContainerCount([document tape], tapeIndex);
+    }
+    return self;
+}
+
+/**
+ *  Keys are materialized on first access, values only when they are asked for.
+ */
+- (NSDictionary *)valueIndexes {
+
+    if (_valueIndexes) {
+        return _valueIndexes;
+    }
+
+    const CSJSONTape *tape = [_document tape];
+    NSMutableDictionary *valueIndexes = [[NSMutableDictionary alloc] initWithCapacity:_count];
+
+    size_t index = _tapeIndex + 1;
+    for (NSUInteger i = 0; i < _count; i++) {
+
+        id key = [_document objectAtTapeIndex:index];
+        size_t valueIndex = index + 1;
+        if (key) {
+            valueIndexes[key] = @(valueIndex);
+        }
+        index = CSJSONTapeNextIndex(tape, valueIndex);
+    }
+
+    _valueIndexes = valueIndexes;
+    _values = [[NSMutableDictionary alloc] initWithCapacity:_count];
+
+    return _valueIndexes;
+}
+
+#pragma mark - NSDictionary Override
+
+- (NSUInteger)count {
+
+    @synchronized(self) {
+        //duplicate keys are collapsed, same as in NSJSONSerialization
+        return [self valueIndexes].count;
+    }
+}
+
+- (id)objectForKey:(id)aKey {
+
+    if (!aKey) {
+        return nil;
+    }
+
+    @synchronized(self) {
+
+        id value = _values[aKey];
+        if (value) {
+            return value;
+        }
+
+        NSNumber *valueIndex = [self valueIndexes][aKey];
+        if (!valueIndex) {
+            return nil;
+        }
+
+        value = [_document objectAtTapeIndex:[valueIndex unsignedLongValue]];
+        if (value) {
+            _values[aKey] = value;
+        }
+        return value;
+    }
+}
+
+- (NSEnumerator *)keyEnumerator {
+
+    @synchronized(self) {
+        return [[self valueIndexes] keyEnumerator];
+    }
+}
+
+@end
+
+#pragma mark - Implementation CSJSONLazyArray
+
+@implementation CSJSONLazyArray
+
+- (void)dealloc {
+
+    if (_values) {
+        for (NSUInteger i = 0; i < _count; i++) {
+            _values[i] = nil;
+        }
+        free(_values);
+    }
+    free(_valueIndexes);
+}
+
+- (instancetype)initWithDocument:(CSJSONDocument *)document tapeIndex:(size_t)tapeIndex {
+
+    if (self = [super init]) {
+
+        _document = document;
+        _tapeIndex = tapeIndex;
+        _count = CSJSONTapeContainerCount([document tape], tapeIndex);
+    }
+    return self;
+}
+
+- (void)prepareValueIndexes {
+
+    if (_valueIndexes) {
+        return;
+    }
+
+    _valueIndexes = malloc(_count * sizeof(size_t));
+    _values = (__strong id *)calloc(_count, sizeof(id));
+    if (!_valueIndexes || !_values) {
+        [[NSException exceptionWithName:NSMallocException
+                                 reason:@"Unable to allocate JSON array storage"
+                               userInfo:nil] raise];
+    }
+
+    const CSJSONTape *tape = [_document tape];
+    size_t index = _tapeIndex + 1;
+    for (NSUInteger i = 0; i < _count; i++) {
+        _valueIndexes[i] = index;
+        index = CSJSONTapeNextIndex(tape, index);
+    }
+}
+
+#pragma mark - NSArray Override
+
+- (NSUInteger)count {
+    return _count;
+}
+
+- (id)objectAtIndex:(NSUInteger)index {
+
+    if (index >= _count) {
+        [[NSException exceptionWithName:NSRangeException
+                                 reason:[NSString stringWithFormat:@"index %lu beyond bounds [0 .. %ld]", (unsigned long)index, (long)_count - 1]
+                               userInfo:nil] raise];
+    }
+
+    @synchronized(self) {
+
+        [self prepareValueIndexes];
+
+        id value = _values[index];
+        if (!value) {
+            value = [_document objectAtTapeIndex:_valueIndexes[index]];
+            _values[index] = value;
+        }
+        return value;
+    }
+}
+
+@end
@@ -0,0 +1,657 @@
+//
+//  CSJSONTape.c
+//  CSUtils
+//
+//  Created by Josip Bernat on 03/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#include "CSJSONTape.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct CSJSONTapeFrame {
+    size_t startIndex;
+    size_t count;
+    bool isObject;
+} CSJSONTapeFrame;
+
+typedef struct CSJSONTapeParser {
+    CSJSONTape *tape;
+    const uint8_t *bytes;
+    size_t length;
+    size_t position;
+    CSJSONTapeFrame frames[CSJSONTapeMaximumDepth];
+    size_t depth;
+} CSJSONTapeParser;
+
+#pragma mark - Storage
+
+void CSJSONTapeInit(CSJSONTape *tape) {
+    memset(tape, 0, sizeof(*tape));
+}
+
+void CSJSONTapeFree(CSJSONTape *tape) {
+
+    free(tape->entries);
+    free(tape->strings);
+    memset(tape, 0, sizeof(*tape));
+}
+
+static bool CSJSONTapeReserveEntries(CSJSONTape *tape, size_t additionalCount) {
+
+    size_t required = tape->count + additionalCount;
+    if (required <= tape->capacity) {
+        return true;
+    }
+
+    size_t capacity = (tape->capacity ? tape->capacity : 64);
+    while (capacity < required) {
+        capacity *= 2;
+    }
+    uint64_t *entries = realloc(tape->entries, capacity * sizeof(uint64_t));
+    if (!entries) {
+        return false;
+    }
+    tape->entries = entries;
+    tape->capacity = capacity;
+
+    return true;
+}
+
+static bool CSJSONTapeReserveStrings(CSJSONTape *tape, size_t additionalLength) {
+
+    size_t required = tape->stringsLength + additionalLength;
+    if (required <= tape->stringsCapacity) {
+        return true;
+    }
+
+    size_t capacity = (tape->stringsCapacity ? tape->stringsCapacity : 256);
+    while (capacity < required) {
+        capacity *= 2;
+    }
+    uint8_t *strings = realloc(tape->strings, capacity);
+    if (!strings) {
+        return false;
+    }
+    tape->strings = strings;
+    tape->stringsCapacity = capacity;
+
+    return true;
+}
+
+static inline size_t CSJSONTapeAppend(CSJSONTape *tape, CSJSONTapeType type, uint64_t payload) {
+
+    size_t index = tape->count++;
+    tape->entries[index] = ((uint64_t)type << 56) | (payload & CSJSONTapePayloadMask);
+    return index;
+}
+
+#pragma mark - Scanning
+
+static inline void CSJSONTapeSkipWhitespace(CSJSONTapeParser *parser) {
+
+    const uint8_t *bytes = parser->bytes;
+    size_t position = parser->position;
+
+    while (position < parser->length) {
+        uint8_t c = bytes[position];
+        if (c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+            break;
+        }
+        position++;
+    }
+    parser->position = position;
+}
+
+static inline int CSJSONTapeHexValue(uint8_t c) {
+
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool CSJSONTapeReadHex4(const uint8_t *bytes, uint32_t *value) {
+
+    uint32_t result = 0;
+    for (int i = 0; i < 4; i++) {
+        int digit = CSJSONTapeHexValue(bytes[i]);
+        if (digit < 0) {
+            return false;
+        }
+        result = (result << 4) | (uint32_t)digit;
+    }
+    *value = result;
+    return true;
+}
+
+static inline uint8_t *CSJSONTapeWriteUTF8(uint8_t *output, uint32_t codePoint) {
+
+    if (codePoint < 0x80) {
+        *output++ = (uint8_t)codePoint;
+    }
+    else if (codePoint < 0x800) {
+        *output++ = (uint8_t)(0xC0 | (codePoint >> 6));
+        *output++ = (uint8_t)(0x80 | (codePoint & 0x3F));
+    }
+    else if (codePoint < 0x10000) {
+        *output++ = (uint8_t)(0xE0 | (codePoint >> 12));
+        *output++ = (uint8_t)(0x80 | ((codePoint >> 6) & 0x3F));
+        *output++ = (uint8_t)(0x80 | (codePoint & 0x3F));
+    }
+    else {
+        *output++ = (uint8_t)(0xF0 | (codePoint >> 18));
+        *output++ = (uint8_t)(0x80 | ((codePoint >> 12) & 0x3F));
+        *output++ = (uint8_t)(0x80 | ((codePoint >> 6) & 0x3F));
+        *output++ = (uint8_t)(0x80 | (codePoint & 0x3F));
+    }
+    return output;
+}
+
+/**
+ *  Returns length of well-formed UTF-8 sequence starting with non-ASCII byte or 0 if it's malformed. Like in NSJSONSerialization overlong forms, surrogates, code points above U+10FFFF and truncated sequences are rejected.
+ */
+static inline size_t CSJSONTapeUTF8SequenceLength(const uint8_t *bytes, size_t available) {
+
+    uint8_t lead = bytes[0];
+    uint8_t minimum = 0x80;
+    uint8_t maximum = 0xBF;
+    size_t length = 0;
+
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+    }
+    else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        if (lead == 0xE0) minimum = 0xA0;
+        if (lead == 0xED) maximum = 0x9F;
+    }
+    else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        if (lead == 0xF0) minimum = 0x90;
+        if (lead == 0xF4) maximum = 0x8F;
+    }
+    else {
+        return 0;
+    }
+
+    if (length > available || bytes[1] < minimum || bytes[1] > maximum) {
+        return 0;
+    }
+    for (size_t i = 2; i < length; i++) {
+        if ((bytes[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+    }
+    return length;
+}
+
+#pragma mark - Values
+
+/**
+ *  Parses string starting at opening quote. Escapes never produce more bytes than they occupy in input so raw length is enough for decoded string.
+ */
+static CSJSONTapeError CSJSONTapeParseString(CSJSONTapeParser *parser) {
+
+    const uint8_t *bytes = parser->bytes;
+    size_t start = parser->position + 1;
+    size_t end = start;
+
+    while (end < parser->length && bytes[end] != '"') {
+        end += (bytes[end] == '\\' ? 2 : 1);
+    }
+    if (end >= parser->length) {
+        return CSJSONTapeErrorString;
+    }
+
+    CSJSONTape *tape = parser->tape;
+    if (!CSJSONTapeReserveStrings(tape, sizeof(uint32_t) + (end - start) + 1)) {
+        return CSJSONTapeErrorMemory;
+    }
+
+    size_t offset = tape->stringsLength;
+    uint8_t *output = tape->strings + offset + sizeof(uint32_t);
+    uint8_t *stringStart = output;
+    size_t position = start;
+
+    while (position < end) {
+
+        // copy run of plain characters at once, multibyte sequences are validated on the way
+        size_t runEnd = position;
+        while (runEnd < end) {
+
+            uint8_t c = bytes[runEnd];
+            if (c < 0x80) {
+                if (c == '\\' || c < 0x20) {
+                    break;
+                }
+                runEnd++;
+                continue;
+            }
+
+            size_t sequenceLength = CSJSONTapeUTF8SequenceLength(bytes + runEnd, end - runEnd);
+            if (!sequenceLength) {
+                parser->position = runEnd;
+                return CSJSONTapeErrorEncoding;
+            }
+            runEnd += sequenceLength;
+        }
+        memcpy(output, bytes + position, runEnd - position);
+        output += runEnd - position;
+        position = runEnd;
+
+        if (position >= end) {
+            break;
+        }
+        if (bytes[position] < 0x20) {
+            parser->position = position;
+            return CSJSONTapeErrorString;
+        }
+
+        uint8_t escape = bytes[position + 1];
+        position += 2;
+
+        switch (escape) {
+            case '"':  *output++ = '"'; break;
+            case '\\': *output++ = '\\'; break;
+            case '/':  *output++ = '/'; break;
+            case 'b':  *output++ = '\b'; break;
+            case 'f':  *output++ = '\f'; break;
+            case 'n':  *output++ = '\n'; break;
+            case 'r':  *output++ = '\r'; break;
+            case 't':  *output++ = '\t'; break;
+            case 'u': {
+
+                uint32_t codePoint = 0;
+                if (position + 4 > end || !CSJSONTapeReadHex4(bytes + position, &codePoint)) {
+                    parser->position = position;
+                    return CSJSONTapeErrorString;
+                }
+                position += 4;
+
+                if (codePoint >= 0xD800 && codePoint <= 0xDBFF) {
+
+                    uint32_t lowSurrogate = 0;
+                    if (position + 6 > end || bytes[position] != '\\' || bytes[position + 1] != 'u' ||
+                        !CSJSONTapeReadHex4(bytes + position + 2, &lowSurrogate) ||
+                        lowSurrogate < 0xDC00 || lowSurrogate > 0xDFFF) {
+                        parser->position = position;
+                        return CSJSONTapeErrorString;
+                    }
+                    position += 6;
+                    codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (lowSurrogate - 0xDC00);
+                }
+                else if (codePoint >= 0xDC00 && codePoint <= 0xDFFF) {
+                    parser->position = position;
+                    return CSJSONTapeErrorString;
+                }
+                output = CSJSONTapeWriteUTF8(output, codePoint);
+                break;
+            }
+            default:
+                parser->position = position;
+                return CSJSONTapeErrorString;
+        }
+    }
+
+    uint32_t stringLength = (uint32_t)(output - stringStart);
+    memcpy(tape->strings + offset, &stringLength, sizeof(uint32_t));
+    *output++ = 0;
+    tape->stringsLength = (size_t)(output - tape->strings);
+
+    CSJSONTapeAppend(tape, CSJSONTapeTypeString, offset);
+    parser->position = end + 1;
+
+    return CSJSONTapeErrorNone;
+}
+
+static CSJSONTapeError CSJSONTapeParseNumber(CSJSONTapeParser *parser) {
+
+    const uint8_t *bytes = parser->bytes;
+    size_t length = parser->length;
+    size_t start = parser->position;
+    size_t position = start;
+
+    bool negative = false;
+    if (position < length && bytes[position] == '-') {
+        negative = true;
+        position++;
+    }
+    if (position >= length || bytes[position] < '0' || bytes[position] > '9') {
+        return CSJSONTapeErrorNumber;
+    }
+
+    uint64_t mantissa = 0;
+    bool overflows = false;
+    if (bytes[position] == '0') {
+        position++;
+    }
+    else {
+        while (position < length && bytes[position] >= '0' && bytes[position] <= '9') {
+
+            unsigned digit = (unsigned)(bytes[position] - '0');
+            if (mantissa > (UINT64_MAX - digit) / 10) {
+                overflows = true;
+            }
+            else if (!overflows) {
+                mantissa = mantissa * 10 + digit;
+            }
+            position++;
+        }
+    }
+
+    bool isDouble = false;
+    if (position < length && bytes[position] == '.') {
+
+        isDouble = true;
+        position++;
+        size_t fractionStart = position;
+        while (position < length && bytes[position] >= '0' && bytes[position] <= '9') {
+            position++;
+        }
+        if (position == fractionStart) {
+            parser->position = position;
+            return CSJSONTapeErrorNumber;
+        }
+    }
+    if (position < length && (bytes[position] == 'e' || bytes[position] == 'E')) {
+
+        isDouble = true;
+        position++;
+        if (position < length && (bytes[position] == '+' || bytes[position] == '-')) {
+            position++;
+        }
+        size_t exponentStart = position;
+        while (position < length && bytes[position] >= '0' && bytes[position] <= '9') {
+            position++;
+        }
+        if (position == exponentStart) {
+            parser->position = position;
+            return CSJSONTapeErrorNumber;
+        }
+    }
+
+    CSJSONTape *tape = parser->tape;
+    parser->position = position;
+
+    // integers are kept exact as long as they fit into int64_t, only bigger ones fall back to double
+    uint64_t maximum = (negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX);
+    if (!isDouble && !overflows && mantissa <= maximum) {
+
+        int64_t value = (int64_t)mantissa;
+        if (negative) {
+            value = (mantissa == (uint64_t)INT64_MAX + 1 ? INT64_MIN : -(int64_t)mantissa);
+        }
+        CSJSONTapeAppend(tape, CSJSONTapeTypeInteger, 0);
+        tape->entries[tape->count++] = (uint64_t)value;
+        return CSJSONTapeErrorNone;
+    }
+
+    char stackBuffer[64];
+    size_t numberLength = position - start;
+    char *text = (numberLength < sizeof(stackBuffer) ? stackBuffer : malloc(numberLength + 1));
+    if (!text) {
+        return CSJSONTapeErrorMemory;
+    }
+    memcpy(text, bytes + start, numberLength);
+    text[numberLength] = 0;
+
+    double value = strtod(text, NULL);
+    if (text != stackBuffer) {
+        free(text);
+    }
+
+    // numbers out of double range can't be represented, NSJSONSerialization rejects them too
+    if (isinf(value)) {
+        parser->position = start;
+        return CSJSONTapeErrorNumber;
+    }
+
+    uint64_t rawValue = 0;
+    memcpy(&rawValue, &value, sizeof(double));
+    CSJSONTapeAppend(tape, CSJSONTapeTypeDouble, 0);
+    tape->entries[tape->count++] = rawValue;
+
+    return CSJSONTapeErrorNone;
+}
+
+static CSJSONTapeError CSJSONTapeParseLiteral(CSJSONTapeParser *parser, const char *literal, size_t literalLength, CSJSONTapeType type) {
+
+    if (parser->position + literalLength > parser->length ||
+        memcmp(parser->bytes + parser->position, literal, literalLength) != 0) {
+        return CSJSONTapeErrorSyntax;
+    }
+    parser->position += literalLength;
+    CSJSONTapeAppend(parser->tape, type, 0);
+
+    return CSJSONTapeErrorNone;
+}
+
+#pragma mark - Parsing
+
+static CSJSONTapeError CSJSONTapeParseDocument(CSJSONTapeParser *parser) {
+
+    CSJSONTape *tape = parser->tape;
+    const uint8_t *bytes = parser->bytes;
+
+    CSJSONTapeSkipWhitespace(parser);
+    if (parser->position >= parser->length) {
+        return CSJSONTapeErrorEmpty;
+    }
+
+    bool expectsValue = true;
+    for (;;) {
+
+        // every value takes at most 3 entries including end of enclosing container
+        if (!CSJSONTapeReserveEntries(tape, 3)) {
+            return CSJSONTapeErrorMemory;
+        }
+
+        if (expectsValue) {
+
+            CSJSONTapeSkipWhitespace(parser);
+            if (parser->position >= parser->length) {
+                return CSJSONTapeErrorSyntax;
+            }
+
+            CSJSONTapeError error = CSJSONTapeErrorNone;
+            uint8_t c = bytes[parser->position];
+
+            switch (c) {
+                case '{':
+                case '[': {
+
+                    if (parser->depth >= CSJSONTapeMaximumDepth) {
+                        return CSJSONTapeErrorDepth;
+                    }
+                    CSJSONTapeFrame *frame = &parser->frames[parser->depth++];
+                    frame->isObject = (c == '{');
+                    frame->count = 0;
+                    frame->startIndex = CSJSONTapeAppend(tape, (frame->isObject ? CSJSONTapeTypeObjectStart : CSJSONTapeTypeArrayStart), 0);
+                    parser->position++;
+
+                    CSJSONTapeSkipWhitespace(parser);
+                    if (parser->position < parser->length && bytes[parser->position] == (frame->isObject ? '}' : ']')) {
+                        expectsValue = false;
+                        continue;
+                    }
+                    if (frame->isObject) {
+                        expectsValue = false;
+                        goto parseKey;
+                    }
+                    continue;
+                }
+                case '"':
+                    error = CSJSONTapeParseString(parser);
+                    break;
+                case 't':
+                    error = CSJSONTapeParseLiteral(parser, "true", 4, CSJSONTapeTypeTrue);
+                    break;
+                case 'f':
+                    error = CSJSONTapeParseLiteral(parser, "false", 5, CSJSONTapeTypeFalse);
+                    break;
+                case 'n':
+                    error = CSJSONTapeParseLiteral(parser, "null", 4, CSJSONTapeTypeNull);
+                    break;
+                default:
+                    if (c == '-' || (c >= '0' && c <= '9')) {
+                        error = CSJSONTapeParseNumber(parser);
+                    }
+                    else {
+                        error = CSJSONTapeErrorSyntax;
+                    }
+                    break;
+            }
+            if (error != CSJSONTapeErrorNone) {
+                return error;
+            }
+            if (parser->depth == 0) {
+                return CSJSONTapeErrorNone;
+            }
+            parser->frames[parser->depth - 1].count++;
+            expectsValue = false;
+        }
+
+        // after value or right after opening of empty container
+        CSJSONTapeSkipWhitespace(parser);
+        if (parser->position >= parser->length) {
+            return CSJSONTapeErrorSyntax;
+        }
+
+        CSJSONTapeFrame *frame = &parser->frames[parser->depth - 1];
+        uint8_t c = bytes[parser->position];
+
+        if (c == (frame->isObject ? '}' : ']')) {
+
+            parser->position++;
+            size_t endIndex = CSJSONTapeAppend(tape, (frame->isObject ? CSJSONTapeTypeObjectEnd : CSJSONTapeTypeArrayEnd), frame->count);
+            tape->entries[frame->startIndex] |= (uint64_t)(endIndex + 1) & CSJSONTapePayloadMask;
+
+            parser->depth--;
+            if (parser->depth == 0) {
+                return CSJSONTapeErrorNone;
+            }
+            parser->frames[parser->depth - 1].count++;
+            continue;
+        }
+        if (c != ',') {
+            return CSJSONTapeErrorSyntax;
+        }
+        parser->position++;
+
+        if (!frame->isObject) {
+            expectsValue = true;
+            continue;
+        }
+
+    parseKey:
+        CSJSONTapeSkipWhitespace(parser);
+        if (parser->position >= parser->length || bytes[parser->position] != '"') {
+            return CSJSONTapeErrorSyntax;
+        }
+        CSJSONTapeError error = CSJSONTapeParseString(parser);
+        if (error != CSJSONTapeErrorNone) {
+            return error;
+        }
+        CSJSONTapeSkipWhitespace(parser);
+        if (parser->position >= parser->length || bytes[parser->position] != ':') {
+            return CSJSONTapeErrorSyntax;
+        }
+        parser->position++;
+        expectsValue = true;
+    }
+}
+
+CSJSONTapeError CSJSONTapeParse(CSJSONTape *tape, const uint8_t *bytes, size_t length, size_t *errorOffset) {
+
+    tape->count = 0;
+    tape->stringsLength = 0;
+
+    // numbers are the densest values, each needs two entries for at least two bytes of input
+    if (!CSJSONTapeReserveEntries(tape, length / 2 + 16)) {
+        return CSJSONTapeErrorMemory;
+    }
+
+    CSJSONTapeParser *parser = malloc(sizeof(CSJSONTapeParser));
+    if (!parser) {
+        return CSJSONTapeErrorMemory;
+    }
+    parser->tape = tape;
+    parser->bytes = bytes;
+    parser->length = length;
+    parser->position = 0;
+    parser->depth = 0;
+
+    // skip UTF-8 byte order mark
+    if (length >= 3 && bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF) {
+        parser->position = 3;
+    }
+
+    CSJSONTapeAppend(tape, CSJSONTapeTypeRoot, 0);
+    CSJSONTapeError error = CSJSONTapeParseDocument(parser);
+
+    if (error == CSJSONTapeErrorNone) {
+
+        CSJSONTapeSkipWhitespace(parser);
+        if (parser->position != length) {
+            error = CSJSONTapeErrorSyntax;
+        }
+        else {
+            tape->entries[0] |= (uint64_t)tape->count & CSJSONTapePayloadMask;
+        }
+    }
+    if (error != CSJSONTapeErrorNone && errorOffset) {
+        *errorOffset = parser->position;
+    }
+
+    free(parser);
+    return error;
+}
+
+#pragma mark - Reading Tape
+
+size_t CSJSONTapeNextIndex(const CSJSONTape *tape, size_t index) {
+
+    switch (CSJSONTapeTypeAtIndex(tape, index)) {
+        case CSJSONTapeTypeObjectStart:
+        case CSJSONTapeTypeArrayStart:
+            return (size_t)CSJSONTapePayloadAtIndex(tape, index);
+        case CSJSONTapeTypeInteger:
+        case CSJSONTapeTypeDouble:
+            return index + 2;
+        default:
+            return index + 1;
+    }
+}
+
+size_t CSJSONTapeContainerCount(const CSJSONTape *tape, size_t index) {
+
+    size_t endIndex = (size_t)CSJSONTapePayloadAtIndex(tape, index) - 1;
+    return (size_t)CSJSONTapePayloadAtIndex(tape, endIndex);
+}
+
+const char *CSJSONTapeStringAtIndex(const CSJSONTape *tape, size_t index, size_t *length) {
+
+    const uint8_t *string = tape->strings + CSJSONTapePayloadAtIndex(tape, index);
+    if (length) {
+        uint32_t stringLength = 0;
+        memcpy(&stringLength, string, sizeof(uint32_t));
+        *length = stringLength;
+    }
+    return (const char *)(string + sizeof(uint32_t));
+}
+
+int64_t CSJSONTapeIntegerAtIndex(const CSJSONTape *tape, size_t index) {
+    return (int64_t)tape->entries[index + 1];
+}
+
+double CSJSONTapeDoubleAtIndex(const CSJSONTape *tape, size_t index) {
+
+    double value = 0;
+    memcpy(&value, &tape->entries[index + 1], sizeof(double));
+    return value;
+}
@@ -0,0 +1,125 @@
+//
+//  CSJSONTape.h
+//  CSUtils
+//
+//  Created by Josip Bernat on 03/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#ifndef CSUtils_CSJSONTape_h
+#define CSUtils_CSJSONTape_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  Type of tape entry stored in the highest byte of each entry.
+ *
+ *  Containers are stored as start entry whose payload is index right after matching end entry, followed by their values and end entry whose payload is number of values (key-value pairs for objects). Object keys are string entries. String payload is offset into strings buffer where string length (uint32_t), UTF-8 bytes and terminating zero are stored. Integer and double entries are followed by one more entry holding the raw 64 bit value.
+ */
+typedef enum {
+    CSJSONTapeTypeRoot          = 'r',
+    CSJSONTapeTypeObjectStart   = '{',
+    CSJSONTapeTypeObjectEnd     = '}',
+    CSJSONTapeTypeArrayStart    = '[',
+    CSJSONTapeTypeArrayEnd      = ']',
+    CSJSONTapeTypeString        = '"',
+    CSJSONTapeTypeInteger       = 'l',
+    CSJSONTapeTypeDouble        = 'd',
+    CSJSONTapeTypeTrue          = 't',
+    CSJSONTapeTypeFalse         = 'f',
+    CSJSONTapeTypeNull          = 'n'
+} CSJSONTapeType;
+
+/**
+ *  Result of parsing.
+ */
+typedef enum {
+    CSJSONTapeErrorNone = 0,
+    CSJSONTapeErrorMemory,
+    CSJSONTapeErrorEmpty,
+    CSJSONTapeErrorSyntax,
+    CSJSONTapeErrorDepth,
+    CSJSONTapeErrorString,
+    CSJSONTapeErrorNumber,
+    CSJSONTapeErrorEncoding
+} CSJSONTapeError;
+
+/**
+ *  Compact read-only representation of parsed JSON document. First entry is root entry, root value starts at index 1.
+ */
+typedef struct CSJSONTape {
+    uint64_t *entries;
+    size_t count;
+    size_t capacity;
+    uint8_t *strings;
+    size_t stringsLength;
+    size_t stringsCapacity;
+} CSJSONTape;
+
+#define CSJSONTapeMaximumDepth 1024
+#define CSJSONTapePayloadMask ((UINT64_C(1) << 56) - 1)
+
+/**
+ *  Initializes empty tape.
+ */
+void CSJSONTapeInit(CSJSONTape *tape);
+
+/**
+ *  Releases tape storage.
+ */
+void CSJSONTapeFree(CSJSONTape *tape);
+
+/**
+ *  Parses UTF-8 JSON text into the tape. Existing tape content is replaced, storage is reused. Strings containing malformed UTF-8 and numbers out of double range fail the parse. Integers which fit into int64_t are stored exactly, bigger ones as doubles.
+ *
+ *  @param errorOffset On failure contains offset of byte at which parsing stopped. Can be NULL.
+ *
+ *  @return CSJSONTapeErrorNone on success.
+ */
+CSJSONTapeError CSJSONTapeParse(CSJSONTape *tape, const uint8_t *bytes, size_t length, size_t *errorOffset);
+
+#pragma mark - Reading Tape
+
+static inline CSJSONTapeType CSJSONTapeTypeAtIndex(const CSJSONTape *tape, size_t index) {
+    return (CSJSONTapeType)(tape->entries[index] >> 56);
+}
+
+static inline uint64_t CSJSONTapePayloadAtIndex(const CSJSONTape *tape, size_t index) {
+    return tape->entries[index] & CSJSONTapePayloadMask;
+}
+
+/**
+ *  Returns index of value following the value at given index.
+ */
+size_t CSJSONTapeNextIndex(const CSJSONTape *tape, size_t index);
+
+/**
+ *  Returns number of values in array or number of pairs in object starting at given index.
+ */
+size_t CSJSONTapeContainerCount(const CSJSONTape *tape, size_t index);
+
+/**
+ *  Returns zero terminated UTF-8 bytes of string at given index.
+ */
+const char *CSJSONTapeStringAtIndex(const CSJSONTape *tape, size_t index, size_t *length);
+
+/**
+ *  Returns value of integer entry at given index.
+ */
+int64_t CSJSONTapeIntegerAtIndex(const CSJSONTape *tape, size_t index);
+
+/**
+ *  Returns value of double entry at given index.
+ */
+double CSJSONTapeDoubleAtIndex(const CSJSONTape *tape, size_t index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,61 @@
+//
+//  CSLatencyTracker.h
+//  CSUtils
+//
+//  Created by Josip Bernat on 11/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ *  Keeps most recent latency samples for each key in fixed size ring and computes percentiles from them. Thread safe.
+ */
+@interface CSLatencyTracker : NSObject
+
+/**
+ *  Number of samples kept for each key.
+ */
+@property (nonatomic, readonly) NSUInteger capacity;
+
+/**
+ *  Minimum number of samples needed before percentiles are reported. Default is 20.
+ */
+@property (nonatomic, readwrite) NSUInteger minimumSamplesCount;
+
+#pragma mark - Class Methods
+
+/**
+ *  Tracker used by CSMessage. Samples are keyed by base URL and action.
+ */
++ (CSLatencyTracker *)sharedTracker;
+
+#pragma mark - Initialization
+
+/**
+ *  Creates new tracker.
+ *
+ *  @param capacity Number of samples kept for each key. NSInvalidArgumentException is raised if capacity is 0.
+ *
+ *  @return New instance of CSLatencyTracker.
+ */
+- (instancetype)initWithCapacity:(NSUInteger)capacity; //designated initializer
+
+#pragma mark - Samples
+
+/**
+ *  Saves latency sample for given key. Oldest sample is dropped when ring is full.
+ */
+- (void)recordLatency:(NSTimeInterval)latency forKey:(NSString *)key;
+
+/**
+ *  Computes latency at given percentile from samples saved for key.
+ *
+ *  @param percentile Percentile from 0.0 to 1.0.
+ *  @param key        Key under which samples were saved.
+ *
+ *  @return Latency or 0.0 if there are less than minimumSamplesCount samples.
+ */
+- (NSTimeInterval)latencyAtPercentile:(double)percentile forKey:(NSString *)key;
+
+@end
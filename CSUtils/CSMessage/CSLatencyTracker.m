@@ -0,0 +1,119 @@
+//
+//  CSLatencyTracker.m
+//  CSUtils
+//
+//  Created by Josip Bernat on 11/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import "CSLatencyTracker.h"
+
+/**
+ *  Ring of samples stored in NSMutableData. First NSUInteger is index of next sample, second is number of samples.
+ */
+typedef struct {
+    NSUInteger nextIndex;
+    NSUInteger count;
+    NSTimeInterval samples[];
+} CSLatencyRing;
+
+static int CSLatencyCompare(const void *first, const void *second) {
+    
+    NSTimeInterval a = *(const NSTimeInterval *)first;
+    NSTimeInterval b = *(const NSTimeInterval *)second;
+    return (a < b ? -1 : (a > b ? 1 : 0));
+}
+
+@interface CSLatencyTracker ()
+
+@property (nonatomic, readwrite) NSUInteger capacity;
+@property (nonatomic, strong) NSMutableDictionary *rings;
+
+@end
+
+@implementation CSLatencyTracker
+
++ (CSLatencyTracker *)sharedTracker {
+    
+    static dispatch_once_t onceToken;
+    static CSLatencyTracker *sharedInstance = nil;
+    
+    dispatch_once(&onceToken, ^{
+        sharedInstance = [[self alloc] initWithCapacity:64];
+    });
+    return sharedInstance;
+}
+
+#pragma mark - Initialization
+
+- (instancetype)init {
+    return [self initWithCapacity:64];
+}
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity {
+    
+    if (!capacity) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"capacity must be greater than 0"
+                               userInfo:nil] raise];
+    }
+    
+    if (self = [super init]) {
+        
+        self.capacity = capacity;
+        self.minimumSamplesCount = 20;
+        self.rings = [[NSMutableDictionary alloc] init];
+    }
+    return self;
+}
+
+#pragma mark - Samples
+
+- (void)recordLatency:(NSTimeInterval)latency forKey:(NSString *)key {
+    
+    if (!key) {
+        return;
+    }
+    
+    @synchronized(self) {
+        
+        NSMutableData *data = self.rings[key];
+        if (!data) {
+            data = [[NSMutableData alloc] initWithLength:sizeof(CSLatencyRing) + self.capacity * sizeof(NSTimeInterval)];
+            self.rings[key] = data;
+        }
+        
+        CSLatencyRing *ring = data.mutableBytes;
+        ring->samples[ring->nextIndex] = latency;
+        ring->nextIndex = (ring->nextIndex + 1) % self.capacity;
+        ring->count = MIN(ring->count + 1, self.capacity);
+    }
+}
+
+- (NSTimeInterval)latencyAtPercentile:(double)percentile forKey:(NSString *)key {
+    
+    if (!key) {
+        return 0.0;
+    }
+    
+    NSTimeInterval samples[self.capacity];
+    NSUInteger count = 0;
+    
+    @synchronized(self) {
+        
+        NSMutableData *data = self.rings[key];
+        const CSLatencyRing *ring = data.bytes;
+        if (!ring || ring->count < MAX(self.minimumSamplesCount, 1)) {
+            return 0.0;
+        }
+        count = ring->count;
+        memcpy(samples, ring->samples, count * sizeof(NSTimeInterval));
+    }
+    
+    qsort(samples, count, sizeof(NSTimeInterval), CSLatencyCompare);
+    
+    double rank = MIN(MAX(percentile, 0.0), 1.0) * (double)(count - 1);
+    return samples[(NSUInteger)ceil(rank)];
+}
+
+@end
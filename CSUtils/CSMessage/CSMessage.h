@@ -10,6 +10,9 @@
 #import "CSGenericOperation.h"
 #import "CSHTTPAssistance.h"
 
+@class CSResponseBuffer;
+@class CSMessageTimingRecord;
+
 /**
  *  Returns a string, replacing certain characters with the equivalent percent escape sequence based on the specified encoding.
  *
@@ -52,6 +55,38 @@ extern NSString * const CSMessageErrorUserInfoKey;
  */
 extern NSInteger const CSMessageErrorCodeInvalidArgument;
 
+/**
+ *  JSON parser used by default parseResponse: implementation.
+ */
+typedef NS_ENUM(NSInteger, CSJSONParser) {
+    /**
+     *  NSJSONSerialization. Whole object graph is created while parsing.
+     */
+    CSJSONParserFoundation = 0,
+    /**
+     *  CSJSONDocument. Response is parsed into compact tape and objects are created only when they are accessed. Faster for large responses from which only part is read.
+     */
+    CSJSONParserLazyDocument
+};
+
+/**
+ *  Scheduling class of message. CSMessageCenter admits messages of higher classes more often and reserves slots for interactive messages.
+ */
+typedef NS_ENUM(NSInteger, CSMessagePriority) {
+    /**
+     *  Messages user is waiting for. Can use reserved slots.
+     */
+    CSMessagePriorityInteractive = 0,
+    /**
+     *  Default scheduling class.
+     */
+    CSMessagePriorityDefault,
+    /**
+     *  Analytics, prefetching and syncing. Not admitted while interactive messages are waiting.
+     */
+    CSMessagePriorityBackground
+};
+
 /**
  *  CSMessage is a concurrent operation suitable for sending data over network. Subclassing can enable sending message to different queues then default one. For all other actions default implementation provides a lot of required options.
  */
@@ -62,6 +97,11 @@ extern NSInteger const CSMessageErrorCodeInvalidArgument;
  */
 @property (copy) CSResponseBlock responseBlock;
 
+/**
+ *  Dispatch queue on which responseBlock and progress blocks are called. Connection callbacks are executed on shared network thread and response parsing on CPU pool of shared CSOperationExecutor. Default is main queue.
+ */
+@property (nonatomic, strong) dispatch_queue_t completionQueue;
+
 /**
  *  Block object called when upload bytes state changes. Can be called multiply times during the request.
  */
@@ -77,11 +117,21 @@ extern NSInteger const CSMessageErrorCodeInvalidArgument;
  */
 @property (nonatomic, strong) NSDictionary *parameters;
 
+/**
+ *  Additional HTTP header fields sent with request. Keys and values must be NSString objects.
+ */
+@property (nonatomic, strong) NSDictionary *headerValues;
+
 /**
  *  Path of file to be sent.
  */
 @property (nonatomic, strong) NSString *filePath;
 
+/**
+ *  Raw request body. If set it's sent as is instead of parameters and file, parameters are sent in query string. Content-Type is application/octet-stream unless set in headerValues.
+ */
+@property (nonatomic, strong) NSData *bodyData;
+
 /**
  *  Name of field for file being sent. Default is file.
  */
@@ -102,6 +152,81 @@ extern NSInteger const CSMessageErrorCodeInvalidArgument;
  */
 @property (nonatomic, strong) CSHTTPMethod httpMethod;
 
+/**
+ *  Idle timeout of request in seconds. Request fails if no data is sent or received for this long, so long transfers which keep making progress aren't limited by it. Default is 60.
+ */
+@property (nonatomic, readwrite) NSTimeInterval timeoutInterval;
+
+/**
+ *  Date after which message fails with deadlineExceededError, no matter whether transfer is still making progress. Default is nil, whole transfer isn't limited. Set it to deadline of operation which started the message to propagate it. CSMessageCenter doesn't start messages whose deadline passed.
+ */
+@property (strong) NSDate *deadline;
+
+/**
+ *  If YES, GET request still waiting for response after p95 latency observed for its action is sent once more and whichever response arrives first is used. Hedged attempt takes token of host's CSTokenBucket like any other request and isn't sent while host's CSCircuitBreaker isn't closed. Default is NO.
+ */
+@property (nonatomic, readwrite) BOOL hedgesRequests;
+
+/**
+ *  Scheduling class used by CSMessageCenter. Default is CSMessagePriorityDefault.
+ */
+@property (nonatomic, readwrite) CSMessagePriority priority;
+
+/**
+ *  Path of file at which response body will be written. If set, response body is streamed to the file as it arrives instead of being kept in memory and responseBlock receives this path as responseObject.
+ */
+@property (nonatomic, strong) NSString *destinationPath;
+
+/**
+ *  Algorithm used for computing digest of response body written to destinationPath. Default is CSDigestAlgorithmNone.
+ */
+@property (nonatomic, readwrite) CSDigestAlgorithm responseDigestAlgorithm;
+
+/**
+ *  Lowercase hexadecimal digest of response body written to destinationPath. Available when responseBlock is called.
+ */
+@property (nonatomic, strong, readonly) NSString *responseDigest;
+
+/**
+ *  Buffer containing response body received so far. Created when response is received and released when operation finishes. Subclasses can read its segments directly from parseResponse: without joining them.
+ */
+@property (nonatomic, strong, readonly) CSResponseBuffer *responseBuffer;
+
+/**
+ *  HTTP status code of response or 0 if response wasn't received. Available when responseBlock is called.
+ */
+@property (nonatomic, readonly) NSInteger responseStatusCode;
+
+/**
+ *  Timestamps of message phases. Created when message is added to CSMessageCenter while CSMessageMetrics is enabled, nil otherwise. Complete when operation finishes.
+ */
+@property (nonatomic, strong, readonly) CSMessageTimingRecord *timingRecord;
+
+/**
+ *  If YES, GET responses are kept in shared CSMessageResponseCache according to their Cache-Control, ETag and Last-Modified header fields. Fresh responses are delivered without sending request, stale ones are revalidated with conditional request and 304 response delivers cached object without parsing it again. Default is NO.
+ */
+@property (nonatomic, readwrite) BOOL usesResponseCache;
+
+/**
+ *  If YES, request bodies of at least requestBodyCompressionThreshold bytes are sent gzip compressed with Content-Encoding header field set. Server must support compressed request bodies. Compression is done on CPU pool of shared CSOperationExecutor. Default is NO.
+ */
+@property (nonatomic, readwrite) BOOL compressesRequestBody;
+
+/**
+ *  Minimum length of request body which is compressed when compressesRequestBody is YES. Default is 1024.
+ */
+@property (nonatomic, readwrite) NSUInteger requestBodyCompressionThreshold;
+
+/**
+ *  If YES, message sent while internet is unavailable is saved to shared CSMessageOutbox and sent when internet becomes available instead of failing with internetUnavailableError. Must be set before send is called. Default is NO.
+ */
+@property (nonatomic, readwrite) BOOL persistsWhenOffline;
+
+/**
+ *  Parser used for JSON responses. Default is CSJSONParserFoundation.
+ */
+@property (nonatomic, readwrite) CSJSONParser JSONParser;
+
 #pragma mark - Class Methods
 
 /**
@@ -274,6 +399,20 @@ extern NSInteger const CSMessageErrorCodeInvalidArgument;
  */
 + (NSError *)invalidArgumentError:(NSString *)description;
 
+/**
+ *  Creates NSError object used when message deadline passes.
+ *
+ *  @return Error with NSURLErrorDomain domain and NSURLErrorTimedOut code.
+ */
++ (NSError *)deadlineExceededError;
+
+/**
+ *  Creates NSError object delivered to responseBlock when message is canceled.
+ *
+ *  @return Error with NSURLErrorDomain domain and NSURLErrorCancelled code.
+ */
++ (NSError *)cancellationError;
+
 #pragma mark - Connection
 
 /**
@@ -286,9 +425,9 @@ extern NSInteger const CSMessageErrorCodeInvalidArgument;
 #pragma mark - Response Operations
 
 /**
- *  Parses NSURLConnection response to readable format, usually JSON.
+ *  Parses NSURLConnection response to readable format, usually JSON. Default implementation joins CSResponseBuffer segments and parses them as JSON using JSONParser. Called on CPU pool of shared CSOperationExecutor, never on main thread, so it's safe to do expensive work here.
  *
- *  @param rawResponse Object received fron NSURLConnection. Usually it's a NSData object.
+ *  @param rawResponse Object received fron NSURLConnection. Usually it's a CSResponseBuffer object.
  *
  *  @return Parsed object, usually NSDictionary.
  */
@@ -302,6 +441,15 @@ extern NSInteger const CSMessageErrorCodeInvalidArgument;
  */
 - (void)receivedResponse:(id)result error:(NSError *)error;
 
+#pragma mark - Deduplication
+
+/**
+ *  Canonical key identifying request sent by message. Messages with equal keys are considered identical and CSMessageCenter can send only one of them when deduplicatesIdenticalRequests is enabled. Default implementation returns key built from class, HTTP method, URL, sorted parameters and header values for GET messages and nil for all other messages, as well as for messages with destinationPath set.
+ *
+ *  @return Key object or nil if message must not be deduplicated.
+ */
+- (NSString *)requestKey;
+
 #pragma mark - Message Controll
 
 /**
@@ -309,4 +457,9 @@ extern NSInteger const CSMessageErrorCodeInvalidArgument;
  */
 - (void)send;
 
+/**
+ *  Future resolved with same response object or error as responseBlock, on completionQueue (main queue if nil) right after responseBlock is called. Canceling future cancels message using CSMessageCenter. Message still needs to be sent. Same future is returned on every call.
+ */
+- (CSFuture *)future;
+
 @end
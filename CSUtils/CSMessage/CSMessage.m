@@ -10,9 +10,40 @@
 #import "CSUReachability.h"
 #import "CSMessageCenter.h"
 #import "CSURLUtils.h"
+#import "CSResponseBuffer.h"
+#import "CSResponseFileWriter.h"
+#import "CSJSONDocument.h"
+#import "CSMessageResponseCache.h"
+#import "CSMessageOutbox.h"
+#import "CSGzip.h"
+#import "CSLatencyTracker.h"
+#import "CSMessageMetrics.h"
+#import "CSMessageThrottle.h"
+#import "CSMultipartBody.h"
+#import "CSOperationExecutor.h"
+#import "CSFuture.h"
 
 //String Encoding
 NSString * CSURLEncodedStringFromStringWithEncoding(NSString *string, NSStringEncoding encoding) {
+    
+    if (string && encoding == NSUTF8StringEncoding) {
+        
+        CSByteBuffer buffer;
+        if (CSByteBufferInit(&buffer, string.length) && CSAppendURLEncodedString(&buffer, string)) {
+            
+            size_t length = 0;
+            uint8_t *bytes = CSByteBufferDetach(&buffer, &length);
+            if (!bytes) {
+                return @"";
+            }
+            return [[NSString alloc] initWithBytesNoCopy:bytes
+                                                  length:length
+                                                encoding:NSASCIIStringEncoding
+                                            freeWhenDone:YES];
+        }
+        CSByteBufferFree(&buffer);
+    }
+    
     static NSString * const kAFLegalCharactersToBeEscaped = @"?!@#$^&%*+=,:;'\"`<>()[]{}/\\|~ ";
     
 	return (NSString *)CFBridgingRelease(CFURLCreateStringByAddingPercentEscapes(kCFAllocatorDefault,
@@ -39,11 +70,50 @@ NSInteger const CSMessageErrorCodeInvalidArgument           = 701;
 @interface CSMessage () <NSURLConnectionDelegate, NSURLConnectionDataDelegate> {
 
     NSUInteger _bytesReceived;
-    unsigned long long _expectedContentLength;
+    long long _expectedContentLength;
 }
 
-@property (nonatomic, strong) NSMutableData *receivedData;
+@property (nonatomic, strong, readwrite) CSResponseBuffer *responseBuffer;
+@property (nonatomic, strong, readwrite) NSString *responseDigest;
+@property (nonatomic, strong) CSResponseFileWriter *fileWriter;
 @property (nonatomic, strong) NSURLConnection *connection;
+@property (nonatomic, strong) NSMutableArray *duplicateMessages;
+@property (nonatomic, readwrite) BOOL waitsForResponse;
+@property (nonatomic, readwrite) BOOL duplicateMessagesDetached;
+@property (nonatomic, readwrite) BOOL responseDelivered;
+@property (nonatomic, readwrite) BOOL connectionFinished;
+@property (nonatomic, strong) NSHTTPURLResponse *HTTPResponse;
+@property (nonatomic, strong) NSString *cacheKey;
+@property (strong) CSCachedResponse *cachedResponse;
+@property (nonatomic, readwrite) BOOL revalidatesInBackground;
+@property (nonatomic, readwrite) BOOL revalidationCompleted;
+@property (nonatomic, readwrite) BOOL responseDeliveryCompleted;
+@property (nonatomic, strong) NSURLConnection *hedgeConnection;
+@property (nonatomic, strong) NSTimer *hedgeTimer;
+@property (nonatomic, strong) NSTimer *deadlineTimer;
+@property (nonatomic, strong) NSDate *requestStartDate;
+@property (nonatomic, readwrite) BOOL connectionResponded;
+@property (nonatomic, strong, readwrite) CSMessageTimingRecord *timingRecord;
+@property (strong) CSCircuitBreaker *circuitBreaker;
+@property (nonatomic, readwrite) NSInteger responseStatusCode;
+@property (nonatomic, strong) CSMultipartBody *multipartBody;
+@property (nonatomic, strong) CSFuture *responseFuture;
+@property (nonatomic, strong) id deliveredResponseObject;
+@property (nonatomic, strong) NSError *deliveredError;
+
+@end
+
+@interface CSMessageCenter (CSMessageScheduling)
+
+/**
+ *  Schedules message without batching it and without changing its deadline.
+ */
+- (void)enqueueMessage:(CSMessage *)message;
+
+/**
+ *  Takes token for hedged attempt of message. Returns NO if attempt would exceed rate limit or circuit breaker of host isn't closed.
+ */
+- (BOOL)allowsHedgedRequestOfMessage:(CSMessage *)message;
 
 @end
 
@@ -283,9 +353,11 @@ static NSURL *_registratedBaseURL = nil;
 
 - (void)setup {
 
-    self.receivedData = [[NSMutableData alloc] init];
     self.httpMethod = CSHTTPMethodPOST;
     self.fileField = @"file";
+    self.priority = CSMessagePriorityDefault;
+    self.requestBodyCompressionThreshold = 1024;
+    self.timeoutInterval = 60.0;
     
     _bytesReceived = 0;
     _expectedContentLength = 0;
@@ -314,6 +386,20 @@ static NSURL *_registratedBaseURL = nil;
                            userInfo:@{CSMessageErrorUserInfoKey : description}];
 }
 
++ (NSError *)deadlineExceededError {
+    
+    return [NSError errorWithDomain:NSURLErrorDomain
+                               code:NSURLErrorTimedOut
+                           userInfo:@{NSLocalizedDescriptionKey : @"Message deadline exceeded."}];
+}
+
++ (NSError *)cancellationError {
+    
+    return [NSError errorWithDomain:NSURLErrorDomain
+                               code:NSURLErrorCancelled
+                           userInfo:@{NSLocalizedDescriptionKey : @"Message was canceled."}];
+}
+
 #pragma mark - Connection
 
 + (BOOL)isInternetAvailable {
@@ -325,12 +411,22 @@ static NSURL *_registratedBaseURL = nil;
 
 - (id)parseResponse:(id)rawResponse {
 
+    if ([rawResponse isKindOfClass:[CSResponseBuffer class]]) {
+        rawResponse = [(CSResponseBuffer *)rawResponse data];
+    }
+    
     if ([rawResponse isKindOfClass:[NSData class]]) {
         
         NSError *error = nil;
-        rawResponse = [NSJSONSerialization JSONObjectWithData:rawResponse
-                                                   options:0
-                                                     error:&error];
+        if (self.JSONParser == CSJSONParserLazyDocument) {
+            rawResponse = [CSJSONDocument JSONObjectWithData:rawResponse
+                                                       error:&error];
+        }
+        else {
+            rawResponse = [NSJSONSerialization JSONObjectWithData:rawResponse
+                                                          options:0
+                                                            error:&error];
+        }
 #ifdef DEBUG
         if(error) {
             CSLog(@"%@, %@",
@@ -345,19 +441,192 @@ static NSURL *_registratedBaseURL = nil;
     return rawResponse;
 }
 
+#pragma mark - Deduplication
+
+- (NSString *)requestKey {
+
+    if ([self httpMethod] != CSHTTPMethodGET || self.destinationPath || self.filePath || self.bodyData) {
+        return nil;
+    }
+    
+    NSMutableString *key = [NSMutableString stringWithFormat:@"%@ %@ %@%@ %ld",
+                            NSStringFromClass([self class]),
+                            [self httpMethod],
+                            [self.baseURL absoluteString],
+                            (self.action ? self.action : @""),
+                            (long)self.JSONParser];
+    
+    //parameters are encoded so separators can't appear in keys or values
+    NSArray *parameterKeys = [[self.parameters allKeys] sortedArrayUsingSelector:@selector(compare:)];
+    for (id parameterKey in parameterKeys) {
+        
+        id parameterValue = self.parameters[parameterKey];
+        if (![parameterKey isKindOfClass:[NSString class]] || ![parameterValue isKindOfClass:[NSString class]]) {
+            continue;
+        }
+        [key appendFormat:@"\n%@=%@",
+         CSURLEncodedStringFromStringWithEncoding(parameterKey, NSUTF8StringEncoding),
+         CSURLEncodedStringFromStringWithEncoding(parameterValue, NSUTF8StringEncoding)];
+    }
+    
+    NSMutableDictionary *headerValues = [[NSMutableDictionary alloc] initWithCapacity:self.headerValues.count];
+    [self.headerValues enumerateKeysAndObjectsUsingBlock:^(NSString *field, NSString *value, BOOL *stop) {
+        headerValues[[field lowercaseString]] = value;
+    }];
+    for (NSString *field in [[headerValues allKeys] sortedArrayUsingSelector:@selector(compare:)]) {
+        [key appendFormat:@"\n%@: %@", field, headerValues[field]];
+    }
+    
+    return key;
+}
+
+- (BOOL)attachDuplicateMessage:(CSMessage *)message {
+    
+    @synchronized(self) {
+        
+        if (self.duplicateMessagesDetached || self.isFinished || self.isCancelled) {
+            return NO;
+        }
+        if (!self.duplicateMessages) {
+            self.duplicateMessages = [[NSMutableArray alloc] init];
+        }
+        [self.duplicateMessages addObject:message];
+    }
+    
+    //duplicate isn't started until response is delivered to it so it can still be sent on its own
+    return YES;
+}
+
+- (BOOL)removeDuplicateMessage:(CSMessage *)message {
+    
+    @synchronized(self) {
+        
+        if ([self.duplicateMessages indexOfObjectIdenticalTo:message] == NSNotFound) {
+            return NO;
+        }
+        [self.duplicateMessages removeObjectIdenticalTo:message];
+        return YES;
+    }
+}
+
+- (NSArray *)removeAllDuplicateMessages {
+    
+    @synchronized(self) {
+        
+        NSArray *duplicateMessages = self.duplicateMessages;
+        self.duplicateMessages = nil;
+        return duplicateMessages;
+    }
+}
+
+- (void)startWaitingForResponse {
+    
+    //message is executing without sending request until another message delivers response to it
+    self.waitsForResponse = YES;
+    [self start];
+}
+
+- (void)finishWithoutRequestWithError:(NSError *)error {
+    
+    NSArray *duplicateMessages = [self detachDuplicateMessagesForError:error];
+    
+    [self startWaitingForResponse];
+    [self deliverResponseObject:nil error:error];
+    
+    for (CSMessage *message in duplicateMessages) {
+        [message startWaitingForResponse];
+        [message deliverResponseObject:nil error:error];
+    }
+}
+
+- (NSArray *)detachDuplicateMessages {
+    
+    @synchronized(self) {
+        
+        self.duplicateMessagesDetached = YES;
+        return [self removeAllDuplicateMessages];
+    }
+}
+
+/**
+ *  Detaches duplicates which should get response of receiver. Cancellation and passed deadline belong only to receiver, duplicates didn't ask for them, so on such error they are enqueued again and first of them is sent instead of receiver.
+ *
+ *  @return Duplicates to which response must be delivered.
+ */
+- (NSArray *)detachDuplicateMessagesForError:(NSError *)error {
+    
+    NSArray *duplicateMessages = [self detachDuplicateMessages];
+    if (!error || !duplicateMessages.count) {
+        return duplicateMessages;
+    }
+    
+    if ([self isCancelled] || (self.deadline && [self.deadline timeIntervalSinceNow] <= 0.0)) {
+        
+        CSMessageCenter *messageCenter = [CSMessageCenter defaultCenter];
+        for (CSMessage *message in duplicateMessages) {
+            [messageCenter enqueueMessage:message];
+        }
+        return nil;
+    }
+    return duplicateMessages;
+}
+
 #pragma mark - Message Controll
 
 - (void)send {
     
     if (![[self class] isInternetAvailable]) {
+        if (self.persistsWhenOffline && [[CSMessageOutbox sharedOutbox] addMessage:self]) {
+            return;
+        }
         if (self.responseBlock) {
-            self.responseBlock(nil, [[self class] internetUnavailableError]);
+            
+            NSError *error = [[self class] internetUnavailableError];
+            CSFuture *future = nil;
+            @synchronized(self) {
+                self.responseDelivered = YES;
+                self.deliveredError = error;
+                future = self.responseFuture;
+            }
+            self.responseBlock(nil, error);
+            [future resolveWithValue:nil error:error];
             return;
         }
     }
     [[CSMessageCenter defaultCenter] addMessage:self];
 }
 
+#pragma mark - Future
+
+- (CSFuture *)future {
+    
+    CSFuture *future = nil;
+    BOOL delivered = NO;
+    @synchronized(self) {
+        if (self.responseFuture) {
+            return self.responseFuture;
+        }
+        future = [[CSFuture alloc] init];
+        self.responseFuture = future;
+        delivered = self.responseDelivered;
+    }
+    
+    __weak CSMessage *this = self;
+    [future setCancellationHandler:^{
+        
+        __strong CSMessage *strongThis = this;
+        if (strongThis) {
+            [[CSMessageCenter defaultCenter] cancelMessage:strongThis];
+        }
+    }];
+    
+    //response is already on its way to responseBlock
+    if (delivered) {
+        [future resolveWithValue:self.deliveredResponseObject error:self.deliveredError];
+    }
+    return future;
+}
+
 #pragma mark - Getters
 
 - (NSURL *)baseURL {
@@ -370,140 +639,634 @@ static NSURL *_registratedBaseURL = nil;
 
 - (void)operationDidFinish {
     
-    _receivedData = nil;
+    _responseBuffer = nil;
+    _multipartBody = nil;
     _connection = nil;
+    _HTTPResponse = nil;
+    self.cachedResponse = nil;
+    
+    [_fileWriter discard];
+    _fileWriter = nil;
+    
+    if (_timingRecord) {
+        [[CSMessageMetrics sharedMetrics] addRecord:_timingRecord];
+    }
+    
+    //request didn't complete so its probe slot is freed without counting result
+    [self.circuitBreaker recordCancellation];
+    self.circuitBreaker = nil;
     
     [super operationDidFinish];
 }
 
 - (void)operationDidStart {
     
+    if (self.waitsForResponse) {
+        return;
+    }
+    
+    if (_timingRecord && !_timingRecord.startTime) {
+        _timingRecord.startTime = CFAbsoluteTimeGetCurrent();
+    }
+    
     /**
-     *  NSURLConnection must me called from main thread. Don't ask me why..
+     *  NSURLConnection needs a thread with running run loop. All connections are scheduled on shared network thread so delegate callbacks and parsing don't compete with UI work.
      */
-    if (![NSThread isMainThread]) {
-        [self performSelectorOnMainThread:@selector(operationDidStart)
-                               withObject:nil
-                            waitUntilDone:NO];
+    if ([NSThread currentThread] != [[self class] networkThread]) {
+        [self performSelector:@selector(operationDidStart)
+                     onThread:[[self class] networkThread]
+                   withObject:nil
+                waitUntilDone:NO
+                        modes:@[NSRunLoopCommonModes]];
+        return;
+    }
+    
+    //canceled while waiting for network thread, operationDidCancel finishes it
+    if ([self isCancelled]) {
         return;
     }
     [self executeRequest];
 }
 
+- (void)operationDidCancel {
+    
+    //message waiting for response of another message has nothing to abort
+    if (self.waitsForResponse) {
+        [self deliverResponseObject:nil error:[[self class] cancellationError]];
+        return;
+    }
+    
+    if ([NSThread currentThread] != [[self class] networkThread]) {
+        [self performSelector:@selector(operationDidCancel)
+                     onThread:[[self class] networkThread]
+                   withObject:nil
+                waitUntilDone:NO
+                        modes:@[NSRunLoopCommonModes]];
+        return;
+    }
+    
+    /**
+     *  Only connection which is still running is aborted. Response delivered from cache while revalidating doesn't stop cancellation of revalidation request.
+     */
+    if (self.connectionFinished || self.isFinished) {
+        return;
+    }
+    
+    [self.hedgeConnection cancel];
+    self.hedgeConnection = nil;
+    
+    //buffered body is released right away instead of when response is delivered
+    [self.connection cancel];
+    self.responseBuffer = nil;
+    
+    [self connection:self.connection didFailWithError:[[self class] cancellationError]];
+}
+
+#pragma mark - Network Thread
+
++ (void)networkThreadEntryPoint:(id)object {
+    
+    @autoreleasepool {
+        
+        [[NSThread currentThread] setName:@"com.clover-studio.CSMessage.network"];
+        
+        NSRunLoop *runLoop = [NSRunLoop currentRunLoop];
+        [runLoop addPort:[NSMachPort port] forMode:NSDefaultRunLoopMode];
+        [runLoop run];
+    }
+}
+
++ (NSThread *)networkThread {
+    
+    static NSThread *networkThread = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        networkThread = [[NSThread alloc] initWithTarget:[CSMessage class]
+                                                selector:@selector(networkThreadEntryPoint:)
+                                                  object:nil];
+        [networkThread start];
+    });
+    return networkThread;
+}
+
+#pragma mark - Parsing
+
+/**
+ *  Runs block on CPU pool of shared executor. Interactive messages are parsed before messages of lower priority waiting at the same time.
+ */
+- (void)addParsingBlock:(void (^)(void))block {
+    
+    NSOperationQueuePriority priority = NSOperationQueuePriorityNormal;
+    if (self.priority == CSMessagePriorityInteractive) {
+        priority = NSOperationQueuePriorityHigh;
+    }
+    else if (self.priority == CSMessagePriorityBackground) {
+        priority = NSOperationQueuePriorityLow;
+    }
+    
+    [[CSOperationExecutor sharedExecutor] addBlock:block
+                                          workload:CSOperationWorkloadCPU
+                                          priority:priority];
+}
+
+#pragma mark - Delivering Callbacks
+
+- (dispatch_queue_t)deliveryQueue {
+    return (self.completionQueue ? self.completionQueue : dispatch_get_main_queue());
+}
+
 #pragma mark - Executing Request
 
 - (void)executeRequest {
     
+    if (self.usesResponseCache && [self receivedCachedResponse]) {
+        return;
+    }
+    
     NSURL *targetPath = [self targetPath];
     
     NSMutableURLRequest *urlRequest = [NSMutableURLRequest requestWithURL:targetPath];
     [self configureRequest:urlRequest];
-
-    NSMutableData *httpBody = (self.httpMethod != CSHTTPMethodGET ? [[NSMutableData alloc] init] : nil);
     
-    NSString *boundary = [CSURLUtils generateBoundaryString];
-    [self appendParameters:httpBody boundary:boundary];
+    if (self.cachedResponse.entityTag) {
+        [urlRequest setValue:self.cachedResponse.entityTag forHTTPHeaderField:@"If-None-Match"];
+    }
+    if (self.cachedResponse.lastModified) {
+        [urlRequest setValue:self.cachedResponse.lastModified forHTTPHeaderField:@"If-Modified-Since"];
+    }
+
+    //file is streamed from segments of multipart body instead of being loaded and concatenated
+    if (!self.bodyData && self.filePath && [self httpMethod] == CSHTTPMethodPOST) {
+        
+        NSError *error = nil;
+        CSMultipartBody *multipartBody = [self multipartBodyWithError:&error];
+        if (!multipartBody) {
+            [self connection:self.connection didFailWithError:error];
+            return;
+        }
+        
+        self.multipartBody = multipartBody;
+        [urlRequest setValue:multipartBody.contentType forHTTPHeaderField:@"Content-Type"];
+        [urlRequest setValue:[NSString stringWithFormat:@"%llu", multipartBody.contentLength] forHTTPHeaderField:@"Content-Length"];
+        [urlRequest setHTTPBodyStream:[multipartBody inputStream]];
+        
+        [self executeConnectionWithRequest:urlRequest];
+        return;
+    }
     
-    if (self.filePath && [self httpMethod] == CSHTTPMethodPOST) {
-        [self appendFile:httpBody boundary:boundary request:urlRequest];
+    NSData *httpBody = self.bodyData;
+    if (!httpBody && self.httpMethod != CSHTTPMethodGET) {
+        httpBody = [self formBody];
     }
     
     [urlRequest setHTTPBody:httpBody];
     
+    if (self.compressesRequestBody && httpBody.length >= self.requestBodyCompressionThreshold) {
+        [self compressBodyOfRequest:urlRequest];
+        return;
+    }
     [self executeConnectionWithRequest:urlRequest];
 }
 
+/**
+ *  Compresses request body on CPU pool of shared executor so large bodies don't hold up other connections on network thread and starts connection back on network thread. Body is sent uncompressed if compression fails or doesn't make it smaller.
+ */
+- (void)compressBodyOfRequest:(NSMutableURLRequest *)urlRequest {
+    
+    [self addParsingBlock:^{
+        
+        NSData *httpBody = [urlRequest HTTPBody];
+        
+        CSByteBuffer buffer;
+        if (CSByteBufferInit(&buffer, 0) &&
+            CSGzipCompressBytes(&buffer, httpBody.bytes, httpBody.length, CSGzipDefaultCompressionLevel) &&
+            buffer.length < httpBody.length) {
+            
+            size_t length = 0;
+            uint8_t *bytes = CSByteBufferDetach(&buffer, &length);
+            [urlRequest setHTTPBody:[NSData dataWithBytesNoCopy:bytes length:length freeWhenDone:YES]];
+            [urlRequest setValue:@"gzip" forHTTPHeaderField:@"Content-Encoding"];
+        }
+        CSByteBufferFree(&buffer);
+        
+        [self performSelector:@selector(executeConnectionWithRequest:)
+                     onThread:[[self class] networkThread]
+                   withObject:urlRequest
+                waitUntilDone:NO
+                        modes:@[NSRunLoopCommonModes]];
+    }];
+}
+
+#pragma mark - Response Cache
+
+/**
+ *  Looks up cached response. Fresh response is delivered and request isn't sent. Stale response which can be used while revalidating is delivered and request is sent only to update cache.
+ *
+ *  @return YES if request must not be sent.
+ */
+- (BOOL)receivedCachedResponse {
+    
+    self.cacheKey = [self requestKey];
+    if (!self.cacheKey) {
+        return NO;
+    }
+    
+    CSMessageResponseCache *cache = [CSMessageResponseCache sharedCache];
+    CSCachedResponse *cachedResponse = [cache cachedResponseForKey:self.cacheKey];
+    self.cachedResponse = cachedResponse;
+    
+    if (!cachedResponse) {
+        [cache recordMiss];
+        return NO;
+    }
+    
+    if ([cachedResponse isFresh]) {
+        
+        [cache recordHitForCachedResponse:cachedResponse fresh:YES];
+        [self receivedResponse:cachedResponse.data error:nil];
+        return YES;
+    }
+    
+    if ([cachedResponse isUsableWhileRevalidating]) {
+        
+        [cache recordHitForCachedResponse:cachedResponse fresh:NO];
+        
+        NSArray *duplicateMessages = [self detachDuplicateMessages];
+        self.revalidatesInBackground = YES;
+        
+        //stale response is delivered like any other, operation finishes once revalidation request completes as well
+        [self addParsingBlock:^{
+            
+            CSMessageTimingRecord *timingRecord = self.timingRecord;
+            timingRecord.parseStartTime = CFAbsoluteTimeGetCurrent();
+            id responseObject = [self responseObjectForResult:cachedResponse.data
+                                               cachedResponse:cachedResponse];
+            timingRecord.parseEndTime = CFAbsoluteTimeGetCurrent();
+            
+            [self deliverResponseObject:responseObject error:nil];
+            
+            for (CSMessage *message in duplicateMessages) {
+                [message startWaitingForResponse];
+                [message deliverResponseObject:responseObject error:nil];
+            }
+        }];
+    }
+    return NO;
+}
+
+/**
+ *  Updates shared cache with received response.
+ *
+ *  @return Body which should be parsed. Cached body if server responded with 304 Not Modified.
+ */
+- (id)resultByUpdatingResponseCache:(CSResponseBuffer *)responseBuffer {
+    
+    if (!self.cacheKey || !self.HTTPResponse) {
+        return responseBuffer;
+    }
+    
+    CSMessageResponseCache *cache = [CSMessageResponseCache sharedCache];
+    CSCachedResponse *cachedResponse = self.cachedResponse;
+    NSInteger statusCode = self.HTTPResponse.statusCode;
+    
+    if (statusCode == 304 && cachedResponse) {
+        
+        [cachedResponse updateWithNotModifiedResponse:self.HTTPResponse];
+        [cache recordRevalidationForCachedResponse:cachedResponse];
+        return cachedResponse.data;
+    }
+    
+    self.cachedResponse = nil;
+    if (statusCode == 200) {
+        
+        cachedResponse = [[CSCachedResponse alloc] initWithResponse:self.HTTPResponse data:[responseBuffer data]];
+        [cache storeCachedResponse:cachedResponse forKey:self.cacheKey];
+        self.cachedResponse = cachedResponse;
+    }
+    return responseBuffer;
+}
+
+/**
+ *  Parses result unless it's body of cached response which was already parsed.
+ */
+- (id)responseObjectForResult:(id)result cachedResponse:(CSCachedResponse *)cachedResponse {
+    
+    if (!cachedResponse) {
+        return [self parseResponse:result];
+    }
+    
+    id responseObject = cachedResponse.responseObject;
+    if (!responseObject) {
+        
+        responseObject = [self parseResponse:result];
+        cachedResponse.responseObject = responseObject;
+    }
+    return responseObject;
+}
+
 #pragma mark - Request Configuration
 
 - (void)configureRequest:(NSMutableURLRequest *)urlRequest {
 
     [urlRequest setHTTPMethod:[self httpMethod]];
-    [urlRequest setTimeoutInterval:60.0];
-    [urlRequest setValue:@"application/x-www-form-urlencoded" forHTTPHeaderField:@"Content-Type"];
+    
+    //idle timeout never outlasts deadline, deadline timer limits whole transfer
+    NSTimeInterval timeoutInterval = self.timeoutInterval;
+    if (self.deadline) {
+        timeoutInterval = MIN(timeoutInterval, MAX([self.deadline timeIntervalSinceNow], 1.0));
+    }
+    [urlRequest setTimeoutInterval:timeoutInterval];
+    [urlRequest setValue:(self.bodyData ? @"application/octet-stream" : @"application/x-www-form-urlencoded") forHTTPHeaderField:@"Content-Type"];
     [urlRequest setCachePolicy:NSURLRequestReloadIgnoringLocalCacheData];
     [urlRequest setHTTPShouldHandleCookies:NO];
+    
+    //NSURLConnection inflates compressed responses while they arrive so didReceiveData: gets decoded bytes
+    [urlRequest setValue:@"gzip, deflate" forHTTPHeaderField:@"Accept-Encoding"];
+    
+    [self.headerValues enumerateKeysAndObjectsUsingBlock:^(NSString *field, NSString *value, BOOL *stop) {
+        [urlRequest setValue:value forHTTPHeaderField:field];
+    }];
 }
 
-- (void)appendParameters:(NSMutableData *)httpBody
-                boundary:(NSString *)boundary {
+- (NSData *)formBody {
 
-    if (!self.parameters || !self.parameters.count || self.httpMethod == CSHTTPMethodGET) {
+    if (!self.parameters || !self.parameters.count) {
+        return [NSData data];
+    }
+    return [CSURLUtils formDataFromParameters:self.parameters];
+}
+
+/**
+ *  Builds multipart body with parameters followed by file. File is read while body is being sent.
+ */
+- (CSMultipartBody *)multipartBodyWithError:(NSError **)error {
+    
+    CSMultipartBody *multipartBody = [[CSMultipartBody alloc] initWithBoundary:[CSURLUtils generateBoundaryString]];
+    [multipartBody appendParameters:self.parameters];
+    
+    BOOL appended = [multipartBody appendFileAtPath:self.filePath
+                                           withName:(self.fileField ? self.fileField : @"file")
+                                           fileName:[self.filePath lastPathComponent]
+                                           mimeType:[CSURLUtils mimeTypeForPath:self.filePath]
+                                              error:error];
+    return (appended ? multipartBody : nil);
+}
+
+#pragma mark - Executing Requests
+
+- (void)executeConnectionWithRequest:(NSURLRequest *)request {
+    
+    //canceled while request body was being compressed
+    if ([self isCancelled]) {
         return;
     }
-    if (!self.filePath) {
+
+    self.requestStartDate = [NSDate date];
+    self.connectionResponded = NO;
+    _timingRecord.requestTime = CFAbsoluteTimeGetCurrent();
+    self.connection = [self startConnectionWithRequest:request];
+    
+    //NSURLRequest timeout is idle timeout, deadline limits whole transfer
+    if (self.deadline) {
         
-        NSInteger count = self.parameters.allKeys.count;
-        __block NSInteger current = 0;
+        self.deadlineTimer = [NSTimer timerWithTimeInterval:MAX([self.deadline timeIntervalSinceNow], 0.0)
+                                                     target:self
+                                                   selector:@selector(deadlineTimerDidFire:)
+                                                   userInfo:nil
+                                                    repeats:NO];
+        [[NSRunLoop currentRunLoop] addTimer:self.deadlineTimer forMode:NSRunLoopCommonModes];
+    }
+    
+    if (self.hedgesRequests && [self httpMethod] == CSHTTPMethodGET && !self.destinationPath) {
         
-         NSMutableString *dataString = [NSMutableString string];
-        __weak id this = self;
-        [self.parameters enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
+        NSTimeInterval hedgeDelay = [[CSLatencyTracker sharedTracker] latencyAtPercentile:0.95 forKey:[self latencyKey]];
+        if (hedgeDelay > 0.0 && (!self.deadline || [self.deadline timeIntervalSinceNow] > hedgeDelay)) {
             
-            __strong CSMessage *strongThis = this;
-            [dataString appendString:[NSString stringWithFormat:@"%@=%@",
-                                      CSURLEncodedStringFromStringWithEncoding(key, NSUTF8StringEncoding),
-                                      CSURLEncodedStringFromStringWithEncoding(strongThis.parameters[key], NSUTF8StringEncoding)]];
-            current++;
-            if (current < count) {
-                [dataString appendString:@"&"];
-            }
-        }];
-        [httpBody appendData:[dataString dataUsingEncoding:NSUTF8StringEncoding]];
-    }
-    else {
-        [self.parameters enumerateKeysAndObjectsUsingBlock:^(NSString *parameterKey, NSString *parameterValue, BOOL *stop) {
-            [httpBody appendData:[[NSString stringWithFormat:@"--%@\r\n", boundary] dataUsingEncoding:NSUTF8StringEncoding]];
-            [httpBody appendData:[[NSString stringWithFormat:@"Content-Disposition: form-data; name=\"%@\"\r\n\r\n", parameterKey] dataUsingEncoding:NSUTF8StringEncoding]];
-            [httpBody appendData:[[NSString stringWithFormat:@"%@\r\n", parameterValue] dataUsingEncoding:NSUTF8StringEncoding]];
-        }];
+            self.hedgeTimer = [NSTimer timerWithTimeInterval:hedgeDelay
+                                                      target:self
+                                                    selector:@selector(hedgeTimerDidFire:)
+                                                    userInfo:request
+                                                     repeats:NO];
+            [[NSRunLoop currentRunLoop] addTimer:self.hedgeTimer forMode:NSRunLoopCommonModes];
+        }
     }
 }
 
-- (void)appendFile:(NSMutableData *)httpBody
-          boundary:(NSString *)boundary
-           request:(NSMutableURLRequest *)urlRequest {
+- (NSURLConnection *)startConnectionWithRequest:(NSURLRequest *)request {
+    
+    NSURLConnection *connection = [[NSURLConnection alloc] initWithRequest:request
+                                                                  delegate:self
+                                                          startImmediately:NO];
+    [connection scheduleInRunLoop:[NSRunLoop currentRunLoop]
+                          forMode:NSRunLoopCommonModes];
+    [connection start];
+    
+    return connection;
+}
+
+#pragma mark - Deadline And Hedging
 
-    // set content type
-    NSString *contentType = [NSString stringWithFormat:@"multipart/form-data; boundary=%@", boundary];
-    [urlRequest setValue:contentType forHTTPHeaderField: @"Content-Type"];
+/**
+ *  Creates timing record when metrics are enabled. Called by CSMessageCenter when message is added.
+ */
+- (void)beginTimingRecord {
     
-    //configure filename
-    NSString *filename = [self.filePath lastPathComponent];
-    [httpBody appendData:[[NSString stringWithFormat:@"--%@\r\n", boundary] dataUsingEncoding:NSUTF8StringEncoding]];
-    [httpBody appendData:[[NSString stringWithFormat:@"Content-Disposition: form-data; name=\"%@\"; filename=\"%@\"\r\n", self.fileField, filename] dataUsingEncoding:NSUTF8StringEncoding]];
+    if (![[CSMessageMetrics sharedMetrics] isEnabled] || _timingRecord) {
+        return;
+    }
     
-    //configure mime
-    NSString *mimetype = [CSURLUtils mimeTypeForPath:self.filePath];
-    [httpBody appendData:[[NSString stringWithFormat:@"Content-Type: %@\r\n\r\n", mimetype] dataUsingEncoding:NSUTF8StringEncoding]];
+    CSMessageTimingRecord *timingRecord = [[CSMessageTimingRecord alloc] init];
+    timingRecord.key = [self latencyKey];
+    timingRecord.enqueueTime = CFAbsoluteTimeGetCurrent();
+    _timingRecord = timingRecord;
+}
+
+- (NSString *)latencyKey {
+    return [NSString stringWithFormat:@"%@ %@%@", [self httpMethod], [self.baseURL absoluteString], (self.action ? self.action : @"")];
+}
+
+- (void)deadlineTimerDidFire:(NSTimer *)timer {
     
-    //attach data
-    NSData *data = [NSData dataWithContentsOfFile:self.filePath];
-    [httpBody appendData:data];
+    self.deadlineTimer = nil;
     
-    //finish boundary
-    [httpBody appendData:[@"\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
+    [self.hedgeConnection cancel];
+    self.hedgeConnection = nil;
     
-    [httpBody appendData:[[NSString stringWithFormat:@"--%@--\r\n", boundary] dataUsingEncoding:NSUTF8StringEncoding]];
+    [self.connection cancel];
+    [self connection:self.connection didFailWithError:[[self class] deadlineExceededError]];
 }
 
-#pragma mark - Executing Requests
+- (void)hedgeTimerDidFire:(NSTimer *)timer {
+    
+    self.hedgeTimer = nil;
+    if (self.connectionResponded || self.hedgeConnection) {
+        return;
+    }
+    if (![[CSMessageCenter defaultCenter] allowsHedgedRequestOfMessage:self]) {
+        return;
+    }
+    self.hedgeConnection = [self startConnectionWithRequest:timer.userInfo];
+}
 
-- (void)executeConnectionWithRequest:(NSURLRequest *)request {
+/**
+ *  Makes connection which responded first the only one used and cancels the other one.
+ *
+ *  @return NO if connection was already canceled.
+ */
+- (BOOL)promoteConnection:(NSURLConnection *)connection {
+    
+    if (connection == self.hedgeConnection) {
+        
+        [self.connection cancel];
+        self.connection = connection;
+    }
+    else if (connection == self.connection) {
+        [self.hedgeConnection cancel];
+    }
+    else {
+        return NO;
+    }
+    
+    self.hedgeConnection = nil;
+    self.connectionResponded = YES;
+    
+    [self.hedgeTimer invalidate];
+    self.hedgeTimer = nil;
+    
+    return YES;
+}
 
-    self.connection = [[NSURLConnection alloc] initWithRequest:request
-                                                      delegate:self
-                                              startImmediately:NO];
-    [self.connection scheduleInRunLoop:[NSRunLoop currentRunLoop]
-                               forMode:NSRunLoopCommonModes];
-    [self.connection start];
+/**
+ *  Reports result of request to circuit breaker of its host. Canceled requests don't count as failures.
+ */
+- (void)reportResultToCircuitBreakerWithError:(NSError *)error {
+    
+    CSCircuitBreaker *circuitBreaker = self.circuitBreaker;
+    if (!circuitBreaker) {
+        return;
+    }
+    self.circuitBreaker = nil;
+    
+    if ([error.domain isEqualToString:NSURLErrorDomain] && error.code == NSURLErrorCancelled) {
+        [circuitBreaker recordCancellation];
+    }
+    else if (error || self.HTTPResponse.statusCode >= 500) {
+        [circuitBreaker recordFailure];
+    }
+    else {
+        [circuitBreaker recordSuccessWithDuration:-[self.requestStartDate timeIntervalSinceNow]];
+    }
+}
+
+/**
+ *  Timers retain message so they are invalidated as soon as connection is done. Must be called on network thread.
+ */
+- (void)invalidateTimers {
+    
+    [self.deadlineTimer invalidate];
+    self.deadlineTimer = nil;
+    
+    [self.hedgeTimer invalidate];
+    self.hedgeTimer = nil;
 }
 
 - (void)receivedResponse:(id)result error:(NSError *)error {
     
-    if (self.responseBlock) {
-        self.responseBlock([self parseResponse:result], error);
+    self.connectionFinished = YES;
+    
+    //response was delivered from cache, request only updated it
+    if (self.revalidatesInBackground) {
+        
+        BOOL delivered = NO;
+        @synchronized(self) {
+            self.revalidationCompleted = YES;
+            delivered = self.responseDeliveryCompleted;
+        }
+        if (delivered) {
+            [self operationDidFinish];
+        }
+        return;
+    }
+    
+    CSFuture *future = nil;
+    @synchronized(self) {
+        future = self.responseFuture;
+    }
+    
+    NSArray *duplicateMessages = [self detachDuplicateMessagesForError:error];
+    if (!self.responseBlock && !future && !duplicateMessages.count) {
+        [self operationDidFinish];
+        return;
+    }
+    
+    /**
+     *  Response is parsed only once and same object is delivered to all duplicate messages.
+     */
+    CSCachedResponse *cachedResponse = (error ? nil : self.cachedResponse);
+    void (^deliverResponse)(void) = ^{
+        
+        CSMessageTimingRecord *timingRecord = self.timingRecord;
+        timingRecord.parseStartTime = CFAbsoluteTimeGetCurrent();
+        id responseObject = [self responseObjectForResult:result cachedResponse:cachedResponse];
+        timingRecord.parseEndTime = CFAbsoluteTimeGetCurrent();
+        
+        [self deliverResponseObject:responseObject error:error];
+        
+        for (CSMessage *message in duplicateMessages) {
+            [message startWaitingForResponse];
+            [message deliverResponseObject:responseObject error:error];
+        }
+    };
+    
+    /**
+     *  Response bodies are parsed on CPU pool of shared executor so large responses don't block network thread nor completion queue. Other results are delivered directly.
+     */
+    if (![result isKindOfClass:[CSResponseBuffer class]] && ![result isKindOfClass:[NSData class]]) {
+        deliverResponse();
+        return;
     }
-    [self operationDidFinish];
+    [self addParsingBlock:deliverResponse];
+}
+
+/**
+ *  Calls responseBlock, resolves future and records delivery time on delivery queue. Only first response is delivered. Operation finishes after delivery, unless stale response from cache was delivered and revalidation request is still running.
+ */
+- (void)deliverResponseObject:(id)responseObject error:(NSError *)error {
+    
+    //canceled message waiting for another message already got its error
+    CSFuture *future = nil;
+    @synchronized(self) {
+        if (self.responseDelivered) {
+            return;
+        }
+        self.responseDelivered = YES;
+        self.deliveredResponseObject = responseObject;
+        self.deliveredError = error;
+        future = self.responseFuture;
+    }
+    
+    CSResponseBlock responseBlock = self.responseBlock;
+    dispatch_async([self deliveryQueue], ^{
+        
+        if (responseBlock) {
+            responseBlock(responseObject, error);
+        }
+        [future resolveWithValue:responseObject error:error];
+        
+        CSMessageTimingRecord *timingRecord = self.timingRecord;
+        timingRecord.deliveryTime = CFAbsoluteTimeGetCurrent();
+        timingRecord.failed = (error != nil);
+        
+        //response delivered from cache while revalidating finishes operation only if revalidation request already completed
+        BOOL finishes = YES;
+        @synchronized(self) {
+            self.responseDeliveryCompleted = YES;
+            finishes = (!self.revalidatesInBackground || self.revalidationCompleted);
+        }
+        if (finishes) {
+            [self operationDidFinish];
+        }
+    });
 }
 
 #pragma mark - NSURLConnectionDelegate
@@ -511,32 +1274,155 @@ static NSURL *_registratedBaseURL = nil;
 - (void)connection:(NSURLConnection *)connection
   didFailWithError:(NSError *)error {
     
+    if (connection != self.connection) {
+        if (connection == self.hedgeConnection) {
+            self.hedgeConnection = nil;
+        }
+        return;
+    }
+    
+    //first attempt failed before responding, hedged attempt continues
+    if (self.hedgeConnection && !self.connectionResponded) {
+        
+        self.connection = self.hedgeConnection;
+        self.hedgeConnection = nil;
+        return;
+    }
+    
+    [self invalidateTimers];
+    
+    _timingRecord.finishTime = CFAbsoluteTimeGetCurrent();
+    _timingRecord.receivedLength = _bytesReceived;
+    
+    [self reportResultToCircuitBreakerWithError:error];
+    
+    [self.fileWriter discard];
+    self.fileWriter = nil;
+    
     [self receivedResponse:nil error:error];
 }
 
 #pragma mark - NSURLConnectionDataDelegate
 
 - (void)connectionDidFinishLoading:(NSURLConnection *)connection {
-    [self receivedResponse:_receivedData error:nil];
+    
+    if (connection != self.connection) {
+        return;
+    }
+    
+    [self invalidateTimers];
+    
+    _timingRecord.finishTime = CFAbsoluteTimeGetCurrent();
+    _timingRecord.receivedLength = _bytesReceived;
+    
+    [self reportResultToCircuitBreakerWithError:nil];
+    
+    if ([self httpMethod] == CSHTTPMethodGET && self.HTTPResponse.statusCode < 500) {
+        [[CSLatencyTracker sharedTracker] recordLatency:-[self.requestStartDate timeIntervalSinceNow]
+                                                 forKey:[self latencyKey]];
+    }
+    
+    if (self.fileWriter) {
+        
+        NSError *error = nil;
+        BOOL finished = [self.fileWriter finish:&error];
+        self.responseDigest = self.fileWriter.digest;
+        self.fileWriter = nil;
+        
+        [self receivedResponse:(finished ? self.destinationPath : nil) error:error];
+        return;
+    }
+    
+    CSResponseBuffer *responseBuffer = (_responseBuffer ? _responseBuffer : [[CSResponseBuffer alloc] init]);
+    [self receivedResponse:(self.usesResponseCache ? [self resultByUpdatingResponseCache:responseBuffer] : responseBuffer)
+                     error:nil];
 }
 
 - (void)connection:(NSURLConnection *)connection
     didReceiveData:(NSData *)data {
     
-    [self.receivedData appendData:data];
+    if (connection != self.connection) {
+        return;
+    }
+    
+    if (self.fileWriter) {
+        
+        NSError *error = nil;
+        if (![self.fileWriter appendData:data error:&error]) {
+            
+            [connection cancel];
+            [self connection:connection didFailWithError:error];
+            return;
+        }
+    }
+    else {
+        [self.responseBuffer appendData:data];
+    }
     
     _bytesReceived += [data length];
     if(_expectedContentLength != NSURLResponseUnknownLength) {
-        if (self.downloadProgressBlock) {
-            self.downloadProgressBlock(_bytesReceived, _expectedContentLength, _expectedContentLength);
+        CSDownloadProgressBlock downloadProgressBlock = self.downloadProgressBlock;
+        if (downloadProgressBlock) {
+            
+            NSUInteger bytesReceived = _bytesReceived;
+            long long expectedContentLength = _expectedContentLength;
+            dispatch_async([self deliveryQueue], ^{
+                downloadProgressBlock(bytesReceived, expectedContentLength, expectedContentLength);
+            });
         }
     }
 }
 
 - (void)connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response {
-    [self.receivedData setLength:0];
+    
+    if (![self promoteConnection:connection]) {
+        return;
+    }
     
     _expectedContentLength = [response expectedContentLength];
+    _bytesReceived = 0;
+    
+    self.HTTPResponse = ([response isKindOfClass:[NSHTTPURLResponse class]] ? (NSHTTPURLResponse *)response : nil);
+    
+    self.responseStatusCode = self.HTTPResponse.statusCode;
+    _timingRecord.responseTime = CFAbsoluteTimeGetCurrent();
+    _timingRecord.statusCode = self.HTTPResponse.statusCode;
+    
+    //expected length of compressed response is length of encoded body, decoded length is unknown
+    NSString *contentEncoding = [[self.HTTPResponse allHeaderFields][@"Content-Encoding"] lowercaseString];
+    if ([contentEncoding isEqualToString:@"gzip"] || [contentEncoding isEqualToString:@"deflate"]) {
+        _expectedContentLength = NSURLResponseUnknownLength;
+    }
+    
+    if (self.destinationPath) {
+        
+        [self.fileWriter discard];
+        
+        NSError *error = nil;
+        self.fileWriter = [[CSResponseFileWriter alloc] initWithDestinationPath:self.destinationPath
+                                                                digestAlgorithm:self.responseDigestAlgorithm
+                                                                          error:&error];
+        if (!self.fileWriter) {
+            
+            [connection cancel];
+            [self connection:connection didFailWithError:error];
+        }
+        return;
+    }
+    
+    if (self.responseBuffer) {
+        [self.responseBuffer resetWithExpectedLength:_expectedContentLength];
+    }
+    else {
+        self.responseBuffer = [[CSResponseBuffer alloc] initWithExpectedLength:_expectedContentLength];
+    }
+}
+
+/**
+ *  Called when body has to be sent again, for example after redirect. Streamed multipart body is read again from the beginning.
+ */
+- (NSInputStream *)connection:(NSURLConnection *)connection needNewBodyStream:(NSURLRequest *)request {
+    return [self.multipartBody inputStream];
 }
 
 - (void)connection:(NSURLConnection *)connection
@@ -544,8 +1430,15 @@ static NSURL *_registratedBaseURL = nil;
  totalBytesWritten:(NSInteger)totalBytesWritten
 totalBytesExpectedToWrite:(NSInteger)totalBytesExpectedToWrite {
 
-    if (self.uploadProgressBlock) {
-        self.uploadProgressBlock(bytesWritten, totalBytesWritten, totalBytesExpectedToWrite);
+    if (connection != self.connection) {
+        return;
+    }
+    
+    CSUploadProgressBlock uploadProgressBlock = self.uploadProgressBlock;
+    if (uploadProgressBlock) {
+        dispatch_async([self deliveryQueue], ^{
+            uploadProgressBlock(bytesWritten, totalBytesWritten, totalBytesExpectedToWrite);
+        });
     }
 }
 
@@ -559,21 +1452,12 @@ totalBytesExpectedToWrite:(NSInteger)totalBytesExpectedToWrite {
                                    [NSMutableString stringWithFormat:@"%@%@", [self.baseURL absoluteString], [self action]] :
                                    [[self.baseURL absoluteString] mutableCopy]);
     
-    if ([self httpMethod] == CSHTTPMethodGET && self.parameters.count) {
+    if (([self httpMethod] == CSHTTPMethodGET || self.bodyData) && self.parameters.count) {
         
         if (![targetPath hasSuffix:@"?"]) {
             [targetPath appendString:@"?"];
         }
-        for (NSString *key in [self.parameters allKeys]) {
-            
-            id value = self.parameters[key];
-            if (![value isKindOfClass:[NSString class]]) {
-                continue;
-            }
-            NSString *encodedValue = CSURLEncodedStringFromStringWithEncoding(value, NSUTF8StringEncoding);
-            NSString *encodedKey = CSURLEncodedStringFromStringWithEncoding(key, NSUTF8StringEncoding);
-            [targetPath appendString:[NSString stringWithFormat:@"%@=%@&", encodedKey, encodedValue]];
-        }
+        [targetPath appendString:[CSURLUtils queryStringFromParameters:self.parameters]];
     }
     
     return [NSURL URLWithString:targetPath];
@@ -0,0 +1,85 @@
+//
+//  CSMessageBatch.h
+//  CSUtils
+//
+//  Created by Josip Bernat on 05/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class CSMessage;
+
+/**
+ *  Object encoding multiple messages into single batch message and splitting batch response back into responses of individual messages.
+ */
+@protocol CSMessageBatchEncoder <NSObject>
+
+/**
+ *  Configures batch message which is sent instead of given messages. Batch message has baseURL, action and httpMethod already set.
+ *
+ *  @param batchMessage Message to be sent.
+ *  @param messages     Batched messages in order in which they were added.
+ */
+- (void)configureBatchMessage:(CSMessage *)batchMessage
+                 withMessages:(NSArray *)messages;
+
+/**
+ *  Splits parsed batch response into responses of individual messages.
+ *
+ *  @param responseObject Batch response parsed by batch message.
+ *  @param messages       Batched messages in order in which they were added.
+ *  @param error          On return contains error if response can't be split.
+ *
+ *  @return Array containing one object for every message, in same order. NSNull is delivered to message as nil response.
+ */
+- (NSArray *)responseObjectsFromBatchResponse:(id)responseObject
+                                     messages:(NSArray *)messages
+                                        error:(NSError **)error;
+
+@end
+
+/**
+ *  Default batch encoder. Sends JSON array of {"action": ..., "parameters": {...}} objects in "requests" parameter and expects JSON array with response for every message, or JSON object with such array under "responses" key.
+ */
+@interface CSJSONMessageBatchEncoder : NSObject <CSMessageBatchEncoder>
+
+@end
+
+/**
+ *  Describes how messages for single action are batched by CSMessageCenter.
+ */
+@interface CSMessageBatchConfiguration : NSObject
+
+/**
+ *  HTTP path to which batch messages are sent.
+ */
+@property (nonatomic, strong) NSString *batchAction;
+
+/**
+ *  Batch is sent as soon as it contains this many messages. Default is 20.
+ */
+@property (nonatomic, readwrite) NSUInteger maximumBatchSize;
+
+/**
+ *  Maximum time first message of batch waits for other messages. Default is 0.05 seconds.
+ */
+@property (nonatomic, readwrite) NSTimeInterval maximumDelay;
+
+/**
+ *  Encoder used for batch messages. Default is CSJSONMessageBatchEncoder.
+ */
+@property (nonatomic, strong) id<CSMessageBatchEncoder> encoder;
+
+#pragma mark - Initialization
+
+/**
+ *  Creates new configuration with default values.
+ *
+ *  @param batchAction HTTP path to which batch messages are sent. NSInvalidArgumentException is raised if batchAction is nil.
+ *
+ *  @return New instance of CSMessageBatchConfiguration.
+ */
++ (instancetype)configurationWithBatchAction:(NSString *)batchAction;
+
+@end
@@ -0,0 +1,86 @@
+//
+//  CSMessageBatch.m
+//  CSUtils
+//
+//  Created by Josip Bernat on 05/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import "CSMessageBatch.h"
+#import "CSMessage.h"
+
+@implementation CSJSONMessageBatchEncoder
+
+#pragma mark - CSMessageBatchEncoder
+
+- (void)configureBatchMessage:(CSMessage *)batchMessage
+                 withMessages:(NSArray *)messages {
+
+    NSMutableArray *requests = [[NSMutableArray alloc] initWithCapacity:messages.count];
+    for (CSMessage *message in messages) {
+        
+        //only string pairs are sent, same as for single message
+        NSMutableDictionary *parameters = [[NSMutableDictionary alloc] initWithCapacity:message.parameters.count];
+        [message.parameters enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stop) {
+            if ([key isKindOfClass:[NSString class]] && [value isKindOfClass:[NSString class]]) {
+                parameters[key] = value;
+            }
+        }];
+        
+        [requests addObject:@{@"action" : (message.action ? message.action : @""),
+                              @"parameters" : parameters}];
+    }
+    
+    NSData *data = [NSJSONSerialization dataWithJSONObject:requests options:0 error:nil];
+    batchMessage.parameters = @{@"requests" : [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding]};
+}
+
+- (NSArray *)responseObjectsFromBatchResponse:(id)responseObject
+                                     messages:(NSArray *)messages
+                                        error:(NSError **)error {
+
+    if ([responseObject isKindOfClass:[NSDictionary class]]) {
+        responseObject = responseObject[@"responses"];
+    }
+    
+    if (![responseObject isKindOfClass:[NSArray class]] || [responseObject count] != messages.count) {
+        
+        if (error) {
+            *error = [CSMessage invalidArgumentError:@"Batch response doesn't contain response for every batched message."];
+        }
+        return nil;
+    }
+    return responseObject;
+}
+
+@end
+
+@implementation CSMessageBatchConfiguration
+
++ (instancetype)configurationWithBatchAction:(NSString *)batchAction {
+
+    if (!batchAction) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"batchAction can't be nil"
+                               userInfo:nil] raise];
+    }
+    
+    CSMessageBatchConfiguration *configuration = [[self alloc] init];
+    configuration.batchAction = batchAction;
+    return configuration;
+}
+
+#pragma mark - Initialization
+
+- (instancetype)init {
+
+    if (self = [super init]) {
+        
+        self.maximumBatchSize = 20;
+        self.maximumDelay = 0.05;
+        self.encoder = [[CSJSONMessageBatchEncoder alloc] init];
+    }
+    return self;
+}
+
+@end
@@ -9,17 +9,45 @@
 #import <Foundation/Foundation.h>
 
 @class CSMessage;
+@class CSMessageBatchConfiguration;
+@class CSTokenBucket;
+@class CSCircuitBreaker;
 
 /**
- *  CSMessageCenter class handles sending messages using NSOperationQueue.
+ *  CSMessageCenter class handles sending messages. Admitted messages run on I/O pool of shared CSOperationExecutor, center itself limits how many of them run at once. Messages wait in pending queue of their priority class until there is free slot. Classes are served in weighted fair order (interactive 4, default 2, background 1) so lower classes are delayed but never starved, except background class which is not admitted while interactive messages are waiting.
  */
 @interface CSMessageCenter : NSObject
 
 /**
- *  Number of concurrent messages in queue.
+ *  Number of messages admitted to executor at once. Default is 5.
  */
 @property (nonatomic, readwrite) NSInteger maxConcurrentMessagesCount;
 
+/**
+ *  Number of slots which can be used only by messages with CSMessagePriorityInteractive priority. Must be lower than maxConcurrentMessagesCount. Default is 1.
+ */
+@property (nonatomic, readwrite) NSInteger reservedInteractiveMessagesCount;
+
+/**
+ *  If YES, message whose requestKey is equal to key of message already being sent isn't sent. Its responseBlock is called with response of message being sent, parsed only once. If message being sent is canceled or its deadline passes, messages attached to it are sent on their own instead of getting its error. Default is NO.
+ */
+@property (nonatomic, readwrite) BOOL deduplicatesIdenticalRequests;
+
+/**
+ *  Number of messages which were not sent because identical request was already in flight.
+ */
+@property (nonatomic, readonly) NSUInteger deduplicatedMessagesCount;
+
+/**
+ *  Number of messages waiting to be started.
+ */
+@property (nonatomic, readonly) NSUInteger pendingMessagesCount;
+
+/**
+ *  Number of messages started and not finished yet.
+ */
+@property (nonatomic, readonly) NSUInteger runningMessagesCount;
+
 /**
  *  If the default center does not exist yet, it is created.
  *
@@ -30,23 +58,71 @@
 #pragma mark - Adding Messages
 
 /**
- *  Adds message to messages queue.
+ *  Adds message to pending queue of its priority class. Message is added to messages queue when it's scheduled.
  *
  *  @param message Message object to be sent.
  */
 - (void)addMessage:(CSMessage *)message;
 
+#pragma mark - Batching
+
+/**
+ *  Enables batching of POST messages sent to given action. Messages are collected until batch is full or maximumDelay passes and then sent as single message to configuration.batchAction. Batch response is split by configuration.encoder and delivered to responseBlock of each message. Messages with filePath, bodyData or destinationPath are never batched.
+ *
+ *  @param configuration Batch configuration. Pass nil to disable batching for action.
+ *  @param action        HTTP path of batched messages. NSInvalidArgumentException is raised if action is nil.
+ */
+- (void)setBatchConfiguration:(CSMessageBatchConfiguration *)configuration
+                    forAction:(NSString *)action;
+
+/**
+ *  Returns batch configuration for given action or nil if action isn't batched.
+ */
+- (CSMessageBatchConfiguration *)batchConfigurationForAction:(NSString *)action;
+
+/**
+ *  Sends all collected batches immediately.
+ */
+- (void)flushBatches;
+
+#pragma mark - Throttling
+
+/**
+ *  Limits rate at which messages are started for given host and action. Messages over limit wait aside until token becomes available while other messages are started. Bucket for action is used instead of bucket for host when both are set.
+ *
+ *  @param tokenBucket Token bucket limiting rate. Pass nil to remove limit.
+ *  @param host        Host of message baseURL. NSInvalidArgumentException is raised if host is nil.
+ *  @param action      HTTP path of messages or nil to limit all messages sent to host.
+ */
+- (void)setTokenBucket:(CSTokenBucket *)tokenBucket
+               forHost:(NSString *)host
+                action:(NSString *)action;
+
+/**
+ *  Sets circuit breaker used for messages sent to given host. While circuit is open messages finish with [CSCircuitBreaker circuitOpenError] without being sent.
+ *
+ *  @param circuitBreaker Circuit breaker. Pass nil to remove it.
+ *  @param host           Host of message baseURL. NSInvalidArgumentException is raised if host is nil.
+ */
+- (void)setCircuitBreaker:(CSCircuitBreaker *)circuitBreaker
+                  forHost:(NSString *)host;
+
+/**
+ *  Returns circuit breaker for given host or nil if host doesn't have one.
+ */
+- (CSCircuitBreaker *)circuitBreakerForHost:(NSString *)host;
+
 #pragma mark - Canceling Messages
 
 /**
- *  Calls cancel on given message. Message will be removed from NSOperationQueue if possible.
+ *  Calls cancel on given message. Pending message is removed from queue, running message aborts its connection. Either way message releases its buffers and finishes with [CSMessage cancellationError]. Messages waiting for response of canceled identical message get the same error.
  *
  *  @param message Message object to be canceled.
  */
 - (void)cancelMessage:(CSMessage *)message;
 
 /**
- *  Sends cancel message to all messages in queue.
+ *  Removes all pending messages and sends cancel message to all messages in queue. All messages finish with [CSMessage cancellationError].
  */
 - (void)cancelAllMessages;
 
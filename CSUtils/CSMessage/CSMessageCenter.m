@@ -8,11 +8,85 @@
 
 #import "CSMessageCenter.h"
 #import "CSMessage.h"
+#import "CSMessageBatch.h"
 #import "CSUReachability.h"
+#import "CSMessageMetrics.h"
+#import "CSMessageThrottle.h"
+#import "CSOperationExecutor.h"
 
-@interface CSMessageCenter ()
+#define CSMessagePriorityCount      3
+#define CSMessageSchedulerStride1   (1 << 20)
 
-@property (nonatomic, strong) NSOperationQueue *messagesQueue;
+static void * CSMessageCenterFinishedContext = &CSMessageCenterFinishedContext;
+
+/**
+ *  Relative share of slots each class gets while all classes have pending messages.
+ */
+static NSUInteger const CSMessagePriorityWeights[CSMessagePriorityCount] = {4, 2, 1};
+
+@interface CSMessage (CSMessageCenterScheduling)
+
+/**
+ *  Attaches given message to receiver so it gets receiver's response. Returns NO if receiver already received response. Attached message isn't started until response is delivered to it.
+ */
+- (BOOL)attachDuplicateMessage:(CSMessage *)message;
+
+/**
+ *  Detaches message attached to receiver. Returns NO if message isn't attached.
+ */
+- (BOOL)removeDuplicateMessage:(CSMessage *)message;
+
+/**
+ *  Detaches all messages attached to receiver.
+ */
+- (NSArray *)removeAllDuplicateMessages;
+
+/**
+ *  Starts message without sending request. Message finishes when deliverResponseObject:error: is called.
+ */
+- (void)startWaitingForResponse;
+
+/**
+ *  Calls responseBlock and resolves future on message's completion queue and finishes message.
+ */
+- (void)deliverResponseObject:(id)responseObject error:(NSError *)error;
+
+/**
+ *  Finishes message and its duplicates with given error without sending request.
+ */
+- (void)finishWithoutRequestWithError:(NSError *)error;
+
+/**
+ *  Creates timingRecord with enqueue time if CSMessageMetrics is enabled.
+ */
+- (void)beginTimingRecord;
+
+/**
+ *  Circuit breaker to which result of request is reported.
+ */
+- (void)setCircuitBreaker:(CSCircuitBreaker *)circuitBreaker;
+
+@end
+
+@interface CSMessageCenter () {
+
+    NSMutableArray *_pendingMessages[CSMessagePriorityCount];
+    uint64_t _pass[CSMessagePriorityCount];
+    uint64_t _globalPass;
+    NSInteger _runningCount;
+    NSInteger _runningInteractiveCount;
+}
+
+@property (nonatomic, strong) NSHashTable *runningMessages;
+@property (nonatomic, strong) NSMutableDictionary *messagesByRequestKey;
+@property (nonatomic, readwrite) NSUInteger deduplicatedMessagesCount;
+@property (nonatomic, strong) NSMutableDictionary *batchConfigurations;
+@property (nonatomic, strong) NSMutableDictionary *pendingBatches;
+@property (nonatomic, strong) NSMutableDictionary *batchGenerations;
+@property (nonatomic, strong) dispatch_queue_t batchQueue;
+@property (nonatomic, strong) NSMutableDictionary *tokenBuckets;
+@property (nonatomic, strong) NSMutableDictionary *circuitBreakers;
+@property (nonatomic, strong) NSHashTable *deferredMessages;
 
 @end
 
@@ -32,7 +106,11 @@
 #pragma mark - Memory Management
 
 - (void)dealloc {
-    [_messagesQueue cancelAllOperations];
+    
+    for (CSMessage *message in _runningMessages) {
+        [message removeObserver:self forKeyPath:@"isFinished" context:CSMessageCenterFinishedContext];
+        [message cancel];
+    }
 }
 
 #pragma mark - Initialization
@@ -41,28 +119,712 @@
 
     if (self = [super init]) {
         
-        _messagesQueue = [[NSOperationQueue alloc] init];
-        _messagesQueue.maxConcurrentOperationCount = 5;
+        for (NSUInteger i = 0; i < CSMessagePriorityCount; i++) {
+            _pendingMessages[i] = [[NSMutableArray alloc] init];
+            _pass[i] = 0;
+        }
+        _globalPass = 0;
+        
+        _runningMessages = [NSHashTable hashTableWithOptions:NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPointerPersonality];
+        _messagesByRequestKey = [[NSMutableDictionary alloc] init];
+        
+        _batchConfigurations = [[NSMutableDictionary alloc] init];
+        _pendingBatches = [[NSMutableDictionary alloc] init];
+        _batchGenerations = [[NSMutableDictionary alloc] init];
+        _batchQueue = dispatch_queue_create("com.clover-studio.CSMessageCenter.batch", DISPATCH_QUEUE_SERIAL);
+        
+        _tokenBuckets = [[NSMutableDictionary alloc] init];
+        _circuitBreakers = [[NSMutableDictionary alloc] init];
+        _deferredMessages = [NSHashTable hashTableWithOptions:NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPointerPersonality];
+        _maxConcurrentMessagesCount = 5;
+        _reservedInteractiveMessagesCount = 1;
     }
     
     return self;
 }
 
+#pragma mark - Setters
+
+- (void)setMaxConcurrentMessagesCount:(NSInteger)maxConcurrentMessagesCount {
+    
+    if (maxConcurrentMessagesCount < 1) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"maxConcurrentMessagesCount must be greater than 0"
+                               userInfo:nil] raise];
+    }
+    
+    @synchronized(self) {
+        _maxConcurrentMessagesCount = maxConcurrentMessagesCount;
+        [self scheduleMessages];
+    }
+}
+
+- (void)setReservedInteractiveMessagesCount:(NSInteger)reservedInteractiveMessagesCount {
+    
+    @synchronized(self) {
+        _reservedInteractiveMessagesCount = MAX(reservedInteractiveMessagesCount, 0);
+        [self scheduleMessages];
+    }
+}
+
+#pragma mark - Getters
+
+- (NSUInteger)pendingMessagesCount {
+    
+    @synchronized(self) {
+        
+        NSUInteger count = 0;
+        for (NSUInteger i = 0; i < CSMessagePriorityCount; i++) {
+            count += _pendingMessages[i].count;
+        }
+        return count + _deferredMessages.count;
+    }
+}
+
+- (NSUInteger)runningMessagesCount {
+    
+    @synchronized(self) {
+        return (NSUInteger)_runningCount;
+    }
+}
+
 #pragma mark - Adding Messages
 
 - (void)addMessage:(CSMessage *)message {
-    [_messagesQueue addOperation:message];
+    
+    if (!message) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"message can't be nil"
+                               userInfo:nil] raise];
+    }
+    
+    [message beginTimingRecord];
+    
+    if ([self batchMessage:message]) {
+        return;
+    }
+    [self enqueueMessage:message];
+}
+
+- (void)enqueueMessage:(CSMessage *)message {
+    
+    @synchronized(self) {
+        
+        if (_deduplicatesIdenticalRequests && [self deduplicateMessage:message]) {
+            return;
+        }
+        
+        NSUInteger priority = [self priorityClassOfMessage:message];
+        
+        //class which was idle starts from current pass so it can't claim slots for time it had nothing to send
+        if (!_pendingMessages[priority].count && _pass[priority] < _globalPass) {
+            _pass[priority] = _globalPass;
+        }
+        [_pendingMessages[priority] addObject:message];
+        
+        [self scheduleMessages];
+    }
+}
+
+#pragma mark - Deduplication
+
+/**
+ *  Attaches message to identical message which is pending or running. Otherwise message becomes the one to which following identical messages are attached. Must be called while synchronized on self.
+ *
+ *  @return YES if message was attached and must not be scheduled.
+ */
+- (BOOL)deduplicateMessage:(CSMessage *)message {
+    
+    NSString *requestKey = [message requestKey];
+    if (!requestKey) {
+        return NO;
+    }
+    
+    CSMessage *primaryMessage = _messagesByRequestKey[requestKey];
+    if (primaryMessage && primaryMessage != message && [primaryMessage attachDuplicateMessage:message]) {
+        
+        _deduplicatedMessagesCount++;
+        return YES;
+    }
+    
+    _messagesByRequestKey[requestKey] = message;
+    return NO;
+}
+
+- (void)removeRequestKeyOfMessage:(CSMessage *)message {
+    
+    NSArray *requestKeys = [_messagesByRequestKey allKeysForObject:message];
+    if (requestKeys.count) {
+        [_messagesByRequestKey removeObjectsForKeys:requestKeys];
+    }
+}
+
+#pragma mark - Batching
+
+- (void)setBatchConfiguration:(CSMessageBatchConfiguration *)configuration
+                    forAction:(NSString *)action {
+    
+    if (!action) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"action can't be nil"
+                               userInfo:nil] raise];
+    }
+    
+    @synchronized(self) {
+        if (configuration) {
+            _batchConfigurations[action] = configuration;
+        }
+        else {
+            [_batchConfigurations removeObjectForKey:action];
+        }
+    }
+    
+    if (!configuration) {
+        [self sendBatchForAction:action generation:nil];
+    }
+}
+
+- (CSMessageBatchConfiguration *)batchConfigurationForAction:(NSString *)action {
+    
+    if (!action) {
+        return nil;
+    }
+    @synchronized(self) {
+        return _batchConfigurations[action];
+    }
+}
+
+- (void)flushBatches {
+    
+    NSArray *actions = nil;
+    @synchronized(self) {
+        actions = [_pendingBatches allKeys];
+    }
+    for (NSString *action in actions) {
+        [self sendBatchForAction:action generation:nil];
+    }
+}
+
+/**
+ *  Adds message to pending batch of its action if batching is enabled for it.
+ *
+ *  @return YES if message was added to batch.
+ */
+- (BOOL)batchMessage:(CSMessage *)message {
+    
+    if (message.httpMethod != CSHTTPMethodPOST || message.filePath || message.bodyData || message.destinationPath || !message.action) {
+        return NO;
+    }
+    
+    BOOL sendsBatch = NO;
+    NSNumber *generation = nil;
+    NSTimeInterval delay = 0.0;
+    
+    @synchronized(self) {
+        
+        CSMessageBatchConfiguration *configuration = _batchConfigurations[message.action];
+        if (!configuration) {
+            return NO;
+        }
+        
+        NSMutableArray *messages = _pendingBatches[message.action];
+        if (!messages) {
+            
+            messages = [[NSMutableArray alloc] init];
+            _pendingBatches[message.action] = messages;
+            
+            //each batch has its own generation so timer of already sent batch doesn't send next one too early
+            generation = @([_batchGenerations[message.action] unsignedIntegerValue] + 1);
+            _batchGenerations[message.action] = generation;
+            delay = configuration.maximumDelay;
+        }
+        [messages addObject:message];
+        
+        sendsBatch = (messages.count >= MAX(configuration.maximumBatchSize, 1));
+    }
+    
+    if (sendsBatch) {
+        [self sendBatchForAction:message.action generation:nil];
+    }
+    else if (generation) {
+        
+        __weak CSMessageCenter *this = self;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), _batchQueue, ^{
+            [this sendBatchForAction:message.action generation:generation];
+        });
+    }
+    return YES;
+}
+
+/**
+ *  Sends pending batch of given action. If generation is set batch is sent only if it's still the same batch.
+ */
+- (void)sendBatchForAction:(NSString *)action generation:(NSNumber *)generation {
+    
+    NSArray *messages = nil;
+    CSMessageBatchConfiguration *configuration = nil;
+    
+    @synchronized(self) {
+        
+        if (generation && ![_batchGenerations[action] isEqualToNumber:generation]) {
+            return;
+        }
+        
+        messages = _pendingBatches[action];
+        [_pendingBatches removeObjectForKey:action];
+        configuration = _batchConfigurations[action];
+    }
+    
+    if (!messages.count) {
+        return;
+    }
+    
+    //single message and messages of disabled batch are sent as they are
+    if (messages.count == 1 || !configuration) {
+        for (CSMessage *message in messages) {
+            [self enqueueMessage:message];
+        }
+        return;
+    }
+    
+    CSMessage *firstMessage = messages[0];
+    id<CSMessageBatchEncoder> encoder = configuration.encoder;
+    
+    CSMessage *batchMessage = [[CSMessage alloc] init];
+    batchMessage.baseURL = firstMessage.baseURL;
+    batchMessage.action = configuration.batchAction;
+    batchMessage.httpMethod = CSHTTPMethodPOST;
+    batchMessage.headerValues = firstMessage.headerValues;
+    batchMessage.completionQueue = _batchQueue;
+    
+    //batch is limited by earliest deadline of its messages, if any of them has one
+    CSMessagePriority priority = CSMessagePriorityBackground;
+    NSDate *deadline = nil;
+    for (CSMessage *message in messages) {
+        priority = MIN(priority, message.priority);
+        if (message.deadline) {
+            deadline = (deadline ? [deadline earlierDate:message.deadline] : message.deadline);
+        }
+    }
+    batchMessage.priority = priority;
+    batchMessage.deadline = deadline;
+    
+    [encoder configureBatchMessage:batchMessage withMessages:messages];
+    
+    batchMessage.responseBlock = ^(id responseObject, NSError *error) {
+        
+        NSArray *responseObjects = nil;
+        if (!error) {
+            responseObjects = [encoder responseObjectsFromBatchResponse:responseObject
+                                                               messages:messages
+                                                                  error:&error];
+        }
+        
+        [messages enumerateObjectsUsingBlock:^(CSMessage *message, NSUInteger idx, BOOL *stop) {
+            
+            id messageResponse = (error ? nil : responseObjects[idx]);
+            if (messageResponse == [NSNull null]) {
+                messageResponse = nil;
+            }
+            if (messageResponse) {
+                messageResponse = [message parseResponse:messageResponse];
+            }
+            [message deliverResponseObject:messageResponse error:error];
+        }];
+    };
+    
+    for (CSMessage *message in messages) {
+        [message startWaitingForResponse];
+    }
+    
+    //batch message is enqueued directly so it's never batched again
+    [batchMessage beginTimingRecord];
+    [self enqueueMessage:batchMessage];
+}
+
+#pragma mark - Throttling
+
+- (NSString *)throttleKeyForHost:(NSString *)host action:(NSString *)action {
+    
+    host = [host lowercaseString];
+    return (action ? [NSString stringWithFormat:@"%@ %@", host, action] : host);
+}
+
+- (void)setTokenBucket:(CSTokenBucket *)tokenBucket
+               forHost:(NSString *)host
+                action:(NSString *)action {
+    
+    if (!host) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"host can't be nil"
+                               userInfo:nil] raise];
+    }
+    
+    @synchronized(self) {
+        
+        NSString *key = [self throttleKeyForHost:host action:action];
+        if (tokenBucket) {
+            _tokenBuckets[key] = tokenBucket;
+        }
+        else {
+            [_tokenBuckets removeObjectForKey:key];
+        }
+    }
+}
+
+- (void)setCircuitBreaker:(CSCircuitBreaker *)circuitBreaker
+                  forHost:(NSString *)host {
+    
+    if (!host) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"host can't be nil"
+                               userInfo:nil] raise];
+    }
+    
+    @synchronized(self) {
+        
+        NSString *key = [self throttleKeyForHost:host action:nil];
+        if (circuitBreaker) {
+            _circuitBreakers[key] = circuitBreaker;
+        }
+        else {
+            [_circuitBreakers removeObjectForKey:key];
+        }
+    }
+}
+
+- (CSCircuitBreaker *)circuitBreakerForHost:(NSString *)host {
+    
+    if (!host) {
+        return nil;
+    }
+    
+    @synchronized(self) {
+        return _circuitBreakers[[self throttleKeyForHost:host action:nil]];
+    }
+}
+
+/**
+ *  Takes token from bucket of message's host and action. Must be called while synchronized on self.
+ *
+ *  @return 0.0 if message can be started, otherwise time until token becomes available.
+ */
+- (NSTimeInterval)throttleDelayOfMessage:(CSMessage *)message {
+    
+    if (!_tokenBuckets.count) {
+        return 0.0;
+    }
+    
+    NSString *host = [message.baseURL host];
+    if (!host) {
+        return 0.0;
+    }
+    
+    CSTokenBucket *tokenBucket = (message.action ? _tokenBuckets[[self throttleKeyForHost:host action:message.action]] : nil);
+    if (!tokenBucket) {
+        tokenBucket = _tokenBuckets[[self throttleKeyForHost:host action:nil]];
+    }
+    return (tokenBucket ? [tokenBucket acquireToken] : 0.0);
+}
+
+- (CSCircuitBreaker *)circuitBreakerOfMessage:(CSMessage *)message {
+    
+    if (!_circuitBreakers.count) {
+        return nil;
+    }
+    
+    NSString *host = [message.baseURL host];
+    return (host ? _circuitBreakers[[self throttleKeyForHost:host action:nil]] : nil);
+}
+
+/**
+ *  Hedged attempt is one more request to the same host so it takes token like any other request and isn't sent if it would have to wait for one. It's sent only while circuit breaker of host is closed so probe requests of half open circuit aren't duplicated.
+ */
+- (BOOL)allowsHedgedRequestOfMessage:(CSMessage *)message {
+    
+    @synchronized(self) {
+        
+        CSCircuitBreaker *circuitBreaker = [self circuitBreakerOfMessage:message];
+        if (circuitBreaker && circuitBreaker.state != CSCircuitBreakerStateClosed) {
+            return NO;
+        }
+        return ([self throttleDelayOfMessage:message] <= 0.0);
+    }
+}
+
+/**
+ *  Puts message aside until its token becomes available. Must be called while synchronized on self.
+ */
+- (void)deferMessage:(CSMessage *)message delay:(NSTimeInterval)delay {
+    
+    [_deferredMessages addObject:message];
+    
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [self resumeDeferredMessage:message];
+    });
+}
+
+- (void)resumeDeferredMessage:(CSMessage *)message {
+    
+    @synchronized(self) {
+        
+        //message was canceled while waiting
+        if (![_deferredMessages containsObject:message]) {
+            return;
+        }
+        [_deferredMessages removeObject:message];
+        
+        NSUInteger priority = [self priorityClassOfMessage:message];
+        if (!_pendingMessages[priority].count && _pass[priority] < _globalPass) {
+            _pass[priority] = _globalPass;
+        }
+        //message keeps its place ahead of messages added while it waited
+        [_pendingMessages[priority] insertObject:message atIndex:0];
+        
+        [self scheduleMessages];
+    }
+}
+
+#pragma mark - Scheduling
+
+- (NSUInteger)priorityClassOfMessage:(CSMessage *)message {
+    
+    NSInteger priority = message.priority;
+    return (NSUInteger)MIN(MAX(priority, CSMessagePriorityInteractive), CSMessagePriorityBackground);
+}
+
+- (BOOL)canAdmitPriorityClass:(NSUInteger)priority {
+    
+    if (!_pendingMessages[priority].count) {
+        return NO;
+    }
+    
+    if (priority == CSMessagePriorityInteractive) {
+        return YES;
+    }
+    
+    //reserved slots are counted as free only while they aren't used by interactive messages
+    NSInteger reservedFree = MAX(MIN(_reservedInteractiveMessagesCount, _maxConcurrentMessagesCount - 1) - _runningInteractiveCount, 0);
+    if (_runningCount + reservedFree >= _maxConcurrentMessagesCount) {
+        return NO;
+    }
+    
+    if (priority == CSMessagePriorityBackground && _pendingMessages[CSMessagePriorityInteractive].count) {
+        return NO;
+    }
+    return YES;
+}
+
+/**
+ *  Stride scheduling. Each class advances its pass by stride inversely proportional to its weight every time it's admitted and class with lowest pass is served next. Must be called while synchronized on self.
+ */
+- (void)scheduleMessages {
+    
+    while (_runningCount < _maxConcurrentMessagesCount) {
+        
+        NSInteger selected = -1;
+        for (NSUInteger i = 0; i < CSMessagePriorityCount; i++) {
+            
+            if (![self canAdmitPriorityClass:i]) {
+                continue;
+            }
+            if (selected < 0 || _pass[i] < _pass[selected]) {
+                selected = (NSInteger)i;
+            }
+        }
+        
+        if (selected < 0) {
+            break;
+        }
+        
+        CSMessage *message = _pendingMessages[selected][0];
+        [_pendingMessages[selected] removeObjectAtIndex:0];
+        
+        //message which waited past its deadline is dropped without taking a slot
+        if (message.deadline && [message.deadline timeIntervalSinceNow] <= 0.0) {
+            
+            [self removeRequestKeyOfMessage:message];
+            [message finishWithoutRequestWithError:[CSMessage deadlineExceededError]];
+            continue;
+        }
+        
+        //message over rate limit waits aside so messages to other hosts aren't blocked behind it
+        NSTimeInterval throttleDelay = [self throttleDelayOfMessage:message];
+        if (throttleDelay > 0.0) {
+            
+            [self deferMessage:message delay:throttleDelay];
+            continue;
+        }
+        
+        CSCircuitBreaker *circuitBreaker = [self circuitBreakerOfMessage:message];
+        if (circuitBreaker && ![circuitBreaker allowRequest]) {
+            
+            [self removeRequestKeyOfMessage:message];
+            [message finishWithoutRequestWithError:[CSCircuitBreaker circuitOpenError]];
+            continue;
+        }
+        [message setCircuitBreaker:circuitBreaker];
+        
+        _globalPass = _pass[selected];
+        _pass[selected] += CSMessageSchedulerStride1 / CSMessagePriorityWeights[selected];
+        
+        [self admitMessage:message priorityClass:(NSUInteger)selected];
+    }
+    
+    CSMessageMetrics *metrics = [CSMessageMetrics sharedMetrics];
+    if ([metrics isEnabled]) {
+        [metrics updatePendingCount:[self pendingMessagesCount] runningCount:(NSUInteger)_runningCount];
+    }
+}
+
+- (void)admitMessage:(CSMessage *)message priorityClass:(NSUInteger)priority {
+    
+    _runningCount++;
+    if (priority == CSMessagePriorityInteractive) {
+        _runningInteractiveCount++;
+    }
+    [_runningMessages addObject:message];
+    
+    switch (priority) {
+        case CSMessagePriorityInteractive:
+            message.queuePriority = NSOperationQueuePriorityHigh;
+            break;
+        case CSMessagePriorityBackground:
+            message.queuePriority = NSOperationQueuePriorityLow;
+            break;
+        default:
+            message.queuePriority = NSOperationQueuePriorityNormal;
+            break;
+    }
+    
+    [message addObserver:self
+              forKeyPath:@"isFinished"
+                 options:0
+                 context:CSMessageCenterFinishedContext];
+    
+    //slots are counted above, so executor only runs admitted messages and doesn't need width of its own
+    [[CSOperationExecutor sharedExecutor] addOperation:message workload:CSOperationWorkloadIO];
+}
+
+- (void)messageDidFinish:(CSMessage *)message {
+    
+    @synchronized(self) {
+        
+        if (![_runningMessages containsObject:message]) {
+            return;
+        }
+        
+        [message removeObserver:self forKeyPath:@"isFinished" context:CSMessageCenterFinishedContext];
+        [_runningMessages removeObject:message];
+        [self removeRequestKeyOfMessage:message];
+        
+        _runningCount--;
+        if ([self priorityClassOfMessage:message] == CSMessagePriorityInteractive) {
+            _runningInteractiveCount--;
+        }
+        
+        [self scheduleMessages];
+    }
+}
+
+#pragma mark - Key Value Observing
+
+- (void)observeValueForKeyPath:(NSString *)keyPath
+                      ofObject:(id)object
+                        change:(NSDictionary *)change
+                       context:(void *)context {
+    
+    if (context == CSMessageCenterFinishedContext) {
+        
+        if ([object isFinished]) {
+            [self messageDidFinish:object];
+        }
+        return;
+    }
+    [super observeValueForKeyPath:keyPath ofObject:object change:change context:context];
 }
 
 #pragma mark - Canceling Messages
 
 - (void)cancelMessage:(CSMessage *)message {
 
+    BOOL pending = NO;
+    @synchronized(self) {
+        
+        for (NSMutableArray *messages in [_pendingBatches allValues]) {
+            if ([messages indexOfObjectIdenticalTo:message] != NSNotFound) {
+                [messages removeObjectIdenticalTo:message];
+                pending = YES;
+            }
+        }
+        for (NSUInteger i = 0; i < CSMessagePriorityCount; i++) {
+            if ([_pendingMessages[i] indexOfObjectIdenticalTo:message] != NSNotFound) {
+                [_pendingMessages[i] removeObjectIdenticalTo:message];
+                pending = YES;
+            }
+        }
+        if ([_deferredMessages containsObject:message]) {
+            [_deferredMessages removeObject:message];
+            pending = YES;
+        }
+        
+        //duplicate is detached so message it's attached to keeps running for its other callers
+        NSString *requestKey = (_deduplicatesIdenticalRequests ? [message requestKey] : nil);
+        CSMessage *primaryMessage = (requestKey ? _messagesByRequestKey[requestKey] : nil);
+        if (primaryMessage && primaryMessage != message && [primaryMessage removeDuplicateMessage:message]) {
+            pending = YES;
+        }
+        [self removeRequestKeyOfMessage:message];
+    }
+    
     [message cancel];
+    if (pending) {
+        [self finishCanceledMessages:@[message]];
+    }
 }
 
 - (void)cancelAllMessages {
-    [_messagesQueue cancelAllOperations];
+    
+    NSMutableArray *pendingMessages = [[NSMutableArray alloc] init];
+    NSArray *runningMessages = nil;
+    @synchronized(self) {
+        runningMessages = [_runningMessages allObjects];
+        for (NSUInteger i = 0; i < CSMessagePriorityCount; i++) {
+            [pendingMessages addObjectsFromArray:_pendingMessages[i]];
+            [_pendingMessages[i] removeAllObjects];
+        }
+        for (NSArray *messages in [_pendingBatches allValues]) {
+            [pendingMessages addObjectsFromArray:messages];
+        }
+        [pendingMessages addObjectsFromArray:[_deferredMessages allObjects]];
+        [_deferredMessages removeAllObjects];
+        [_pendingBatches removeAllObjects];
+        
+        //duplicates are canceled too instead of being sent again when messages they are attached to are canceled
+        for (CSMessage *message in [_messagesByRequestKey allValues]) {
+            NSArray *duplicateMessages = [message removeAllDuplicateMessages];
+            if (duplicateMessages) {
+                [pendingMessages addObjectsFromArray:duplicateMessages];
+            }
+        }
+        [_messagesByRequestKey removeAllObjects];
+    }
+    [pendingMessages makeObjectsPerformSelector:@selector(cancel)];
+    [self finishCanceledMessages:pendingMessages];
+    
+    //admitted messages finish themselves, ones executor hasn't started yet finish when it starts them
+    [runningMessages makeObjectsPerformSelector:@selector(cancel)];
+}
+
+/**
+ *  Messages which were never admitted, including detached duplicates, aren't started by executor so they are finished here.
+ */
+- (void)finishCanceledMessages:(NSArray *)messages {
+    
+    NSError *error = [CSMessage cancellationError];
+    for (CSMessage *message in messages) {
+        [message finishWithoutRequestWithError:error];
+    }
 }
 
 @end
@@ -0,0 +1,161 @@
+//
+//  CSMessageMetrics.h
+//  CSUtils
+//
+//  Created by Josip Bernat on 12/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ *  Phases of message lifetime measured by CSMessageMetrics.
+ */
+typedef NS_ENUM(NSInteger, CSMessagePhase) {
+    /**
+     *  From adding message to CSMessageCenter until operation starts.
+     */
+    CSMessagePhaseQueueWait = 0,
+    /**
+     *  From starting connection until response is received. NSURLConnection doesn't report DNS, connect and TLS times separately so they are included here.
+     */
+    CSMessagePhaseTimeToFirstByte,
+    /**
+     *  From receiving response until last byte of body.
+     */
+    CSMessagePhaseTransfer,
+    /**
+     *  Parsing of response.
+     */
+    CSMessagePhaseParse,
+    /**
+     *  From parsed response until responseBlock returns.
+     */
+    CSMessagePhaseDelivery,
+    /**
+     *  From adding message to CSMessageCenter until responseBlock returns.
+     */
+    CSMessagePhaseTotal,
+    CSMessagePhaseCount
+};
+
+/**
+ *  Timestamps of single message. Values are CFAbsoluteTime, 0 if phase didn't happen.
+ */
+@interface CSMessageTimingRecord : NSObject
+
+/**
+ *  Base URL, action and method of message. Records with same key are aggregated together.
+ */
+@property (nonatomic, strong) NSString *key;
+
+@property (nonatomic, readwrite) CFAbsoluteTime enqueueTime;
+@property (nonatomic, readwrite) CFAbsoluteTime startTime;
+@property (nonatomic, readwrite) CFAbsoluteTime requestTime;
+@property (nonatomic, readwrite) CFAbsoluteTime responseTime;
+@property (nonatomic, readwrite) CFAbsoluteTime finishTime;
+@property (nonatomic, readwrite) CFAbsoluteTime parseStartTime;
+@property (nonatomic, readwrite) CFAbsoluteTime parseEndTime;
+@property (nonatomic, readwrite) CFAbsoluteTime deliveryTime;
+
+/**
+ *  Number of response body bytes received.
+ */
+@property (nonatomic, readwrite) unsigned long long receivedLength;
+
+/**
+ *  HTTP status code or 0 if no response was received.
+ */
+@property (nonatomic, readwrite) NSInteger statusCode;
+
+/**
+ *  YES if message finished with error.
+ */
+@property (nonatomic, readwrite) BOOL failed;
+
+/**
+ *  Returns duration of given phase or -1.0 if it wasn't measured.
+ */
+- (NSTimeInterval)durationOfPhase:(CSMessagePhase)phase;
+
+/**
+ *  Dictionary representation suitable for JSON serialization.
+ */
+- (NSDictionary *)dictionaryRepresentation;
+
+@end
+
+/**
+ *  CSMessageMetrics collects timing records of finished messages, keeps log2 bucket histograms of every phase for each key and samples CSMessageCenter queue depth and running messages count. Nothing is measured while enabled is NO, messages only check single flag.
+ */
+@interface CSMessageMetrics : NSObject
+
+/**
+ *  Turns collecting on and off. Default is NO.
+ */
+@property (nonatomic, readwrite, getter = isEnabled) BOOL enabled;
+
+/**
+ *  Number of most recent timing records kept. Default is 256.
+ */
+@property (nonatomic, readwrite) NSUInteger recentRecordsCapacity;
+
+/**
+ *  Histograms are restarted after this interval. Previous window is kept and included in snapshots so they always cover between one and two intervals. Default is 300 seconds.
+ */
+@property (nonatomic, readwrite) NSTimeInterval windowInterval;
+
+#pragma mark - Class Methods
+
+/**
+ *  If the shared metrics object does not exist yet, it is created.
+ *
+ *  @return The shared metrics instance used by CSMessage and CSMessageCenter.
+ */
++ (CSMessageMetrics *)sharedMetrics;
+
+#pragma mark - Recording
+
+/**
+ *  Adds record of finished message.
+ */
+- (void)addRecord:(CSMessageTimingRecord *)record;
+
+/**
+ *  Samples queue gauges. Called by CSMessageCenter whenever messages are added, started or finished.
+ *
+ *  @param pendingCount Number of messages waiting in CSMessageCenter.
+ *  @param runningCount Number of messages being sent.
+ */
+- (void)updatePendingCount:(NSUInteger)pendingCount runningCount:(NSUInteger)runningCount;
+
+/**
+ *  Removes all records, histograms and gauges.
+ */
+- (void)reset;
+
+#pragma mark - Reading
+
+/**
+ *  Returns most recent timing records, oldest first.
+ */
+- (NSArray *)recentRecords;
+
+/**
+ *  Returns approximate duration at given percentile of given phase for key. Value is upper bound of histogram bucket.
+ *
+ *  @return Duration or -1.0 if nothing was measured.
+ */
+- (NSTimeInterval)durationAtPercentile:(double)percentile ofPhase:(CSMessagePhase)phase forKey:(NSString *)key;
+
+/**
+ *  Dictionary with "gauges" (current and maximum pending and running counts) and "keys" (count, p50, p90, p99 and buckets of every phase for every key).
+ */
+- (NSDictionary *)snapshot;
+
+/**
+ *  Snapshot including recent records serialized as JSON.
+ */
+- (NSData *)JSONData;
+
+@end
@@ -0,0 +1,446 @@
+//
+//  CSMessageMetrics.m
+//  CSUtils
+//
+//  Created by Josip Bernat on 12/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import "CSMessageMetrics.h"
+
+/**
+ *  Bucket i holds durations below 2^i microseconds, last bucket holds everything longer.
+ */
+#define CSMessageMetricsBucketsCount 40
+
+typedef struct CSMessageHistogram {
+    uint32_t buckets[CSMessageMetricsBucketsCount];
+    uint32_t count;
+} CSMessageHistogram;
+
+static NSString * const CSMessagePhaseNames[CSMessagePhaseCount] = {
+    @"queueWait", @"timeToFirstByte", @"transfer", @"parse", @"delivery", @"total"
+};
+
+static inline NSUInteger CSMessageHistogramBucket(NSTimeInterval duration) {
+
+    uint64_t microseconds = (uint64_t)(duration * 1000000.0);
+    if (!microseconds) {
+        return 0;
+    }
+    NSUInteger bucket = 64 - __builtin_clzll(microseconds);
+    return MIN(bucket, CSMessageMetricsBucketsCount - 1);
+}
+
+static inline NSTimeInterval CSMessageHistogramBucketUpperBound(NSUInteger bucket) {
+    return (double)(1ULL << bucket) / 1000000.0;
+}
+
+#pragma mark - Implementation CSMessageTimingRecord
+
+@implementation CSMessageTimingRecord
+
+- (NSTimeInterval)durationOfPhase:(CSMessagePhase)phase {
+
+    CFAbsoluteTime start = 0.0;
+    CFAbsoluteTime end = 0.0;
+
+    switch (phase) {
+        case CSMessagePhaseQueueWait:
+            start = _enqueueTime;
+            end = _startTime;
+            break;
+
+        case CSMessagePhaseTimeToFirstByte:
+            start = _requestTime;
+            end = _responseTime;
+            break;
+
+        case CSMessagePhaseTransfer:
+            start = _responseTime;
+            end = _finishTime;
+            break;
+
+        case CSMessagePhaseParse:
+            start = _parseStartTime;
+            end = _parseEndTime;
+            break;
+
+        case CSMessagePhaseDelivery:
+            start = _parseEndTime ? _parseEndTime : _finishTime;
+            end = _deliveryTime;
+            break;
+
+        case CSMessagePhaseTotal:
+            start = _enqueueTime ? _enqueueTime : _startTime;
+            end = _deliveryTime;
+            break;
+
+        default:
+            break;
+    }
+
+    if (!start || !end || end < start) {
+        return -1.0;
+    }
+    return end - start;
+}
+
+- (NSDictionary *)dictionaryRepresentation {
+
+    NSMutableDictionary *dictionary = [[NSMutableDictionary alloc] init];
+    dictionary[@"key"] = (_key ? _key : @"");
+    dictionary[@"statusCode"] = @(_statusCode);
+    dictionary[@"receivedLength"] = @(_receivedLength);
+    dictionary[@"failed"] = @(_failed);
+
+    for (NSInteger phase = 0; phase < CSMessagePhaseCount; phase++) {
+
+        NSTimeInterval duration = [self durationOfPhase:phase];
+        if (duration >= 0.0) {
+            dictionary[CSMessagePhaseNames[phase]] = @(duration);
+        }
+    }
+    return dictionary;
+}
+
+@end
+
+#pragma mark - Interface CSMessageKeyMetrics
+
+/**
+ *  Histograms of one key. Current window is swapped into previous one when it expires.
+ */
+@interface CSMessageKeyMetrics : NSObject {
+@public
+    CSMessageHistogram _current[CSMessagePhaseCount];
+    CSMessageHistogram _previous[CSMessagePhaseCount];
+    CFAbsoluteTime _windowStart;
+}
+
+@end
+
+@implementation CSMessageKeyMetrics
+@end
+
+#pragma mark - Implementation CSMessageMetrics
+
+@interface CSMessageMetrics () {
+
+    volatile BOOL _enabled;
+    NSMutableDictionary *_keyMetrics;
+    NSMutableArray *_recentRecords;
+    NSUInteger _recentRecordsStart;
+
+    NSUInteger _pendingCount;
+    NSUInteger _runningCount;
+    NSUInteger _maximumPendingCount;
+    NSUInteger _maximumRunningCount;
+}
+
+@end
+
+@implementation CSMessageMetrics
+
+@synthesize recentRecordsCapacity = _recentRecordsCapacity;
+@synthesize windowInterval = _windowInterval;
+
+#pragma mark - Class Methods
+
++ (CSMessageMetrics *)sharedMetrics {
+
+    static CSMessageMetrics *metrics = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        metrics = [[CSMessageMetrics alloc] init];
+    });
+    return metrics;
+}
+
+#pragma mark - Initialization
+
+- (id)init {
+
+    if (self = [super init]) {
+
+        _enabled = NO;
+        _recentRecordsCapacity = 256;
+        _windowInterval = 300.0;
+        _keyMetrics = [[NSMutableDictionary alloc] init];
+        _recentRecords = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+#pragma mark - Setters
+
+- (void)setEnabled:(BOOL)enabled {
+    _enabled = enabled;
+}
+
+- (BOOL)isEnabled {
+    return _enabled;
+}
+
+- (void)setRecentRecordsCapacity:(NSUInteger)recentRecordsCapacity {
+
+    @synchronized(self) {
+        _recentRecordsCapacity = recentRecordsCapacity;
+        NSArray *records = [self recentRecordsUnlocked];
+        NSUInteger keep = MIN(records.count, recentRecordsCapacity);
+        _recentRecords = [[records subarrayWithRange:NSMakeRange(records.count - keep, keep)] mutableCopy];
+        _recentRecordsStart = 0;
+    }
+}
+
+- (NSUInteger)recentRecordsCapacity {
+
+    @synchronized(self) {
+        return _recentRecordsCapacity;
+    }
+}
+
+- (void)setWindowInterval:(NSTimeInterval)windowInterval {
+
+    if (windowInterval <= 0.0) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"windowInterval must be greater than zero"
+                               userInfo:nil] raise];
+    }
+
+    @synchronized(self) {
+        _windowInterval = windowInterval;
+    }
+}
+
+- (NSTimeInterval)windowInterval {
+
+    @synchronized(self) {
+        return _windowInterval;
+    }
+}
+
+#pragma mark - Recording
+
+- (CSMessageKeyMetrics *)metricsForKey:(NSString *)key now:(CFAbsoluteTime)now {
+
+    CSMessageKeyMetrics *metrics = _keyMetrics[key];
+    if (!metrics) {
+        metrics = [[CSMessageKeyMetrics alloc] init];
+        metrics->_windowStart = now;
+        _keyMetrics[key] = metrics;
+        return metrics;
+    }
+
+    if (now - metrics->_windowStart >= _windowInterval) {
+
+        //if more than two windows passed previous window is stale too
+        if (now - metrics->_windowStart >= 2.0 * _windowInterval) {
+            memset(metrics->_previous, 0, sizeof(metrics->_previous));
+        }
+        else {
+            memcpy(metrics->_previous, metrics->_current, sizeof(metrics->_current));
+        }
+        memset(metrics->_current, 0, sizeof(metrics->_current));
+        metrics->_windowStart = now;
+    }
+    return metrics;
+}
+
+- (void)addRecord:(CSMessageTimingRecord *)record {
+
+    if (!_enabled || !record) {
+        return;
+    }
+
+    NSString *key = (record.key ? record.key : @"");
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+
+    @synchronized(self) {
+
+        CSMessageKeyMetrics *metrics = [self metricsForKey:key now:now];
+        for (NSInteger phase = 0; phase < CSMessagePhaseCount; phase++) {
+
+            NSTimeInterval duration = [record durationOfPhase:phase];
+            if (duration < 0.0) {
+                continue;
+            }
+            CSMessageHistogram *histogram = &metrics->_current[phase];
+            histogram->buckets[CSMessageHistogramBucket(duration)]++;
+            histogram->count++;
+        }
+
+        if (!_recentRecordsCapacity) {
+            return;
+        }
+
+        if (_recentRecords.count < _recentRecordsCapacity) {
+            [_recentRecords addObject:record];
+        }
+        else {
+            _recentRecords[_recentRecordsStart] = record;
+            _recentRecordsStart = (_recentRecordsStart + 1) % _recentRecordsCapacity;
+        }
+    }
+}
+
+- (void)updatePendingCount:(NSUInteger)pendingCount runningCount:(NSUInteger)runningCount {
+
+    if (!_enabled) {
+        return;
+    }
+
+    @synchronized(self) {
+
+        _pendingCount = pendingCount;
+        _runningCount = runningCount;
+        _maximumPendingCount = MAX(_maximumPendingCount, pendingCount);
+        _maximumRunningCount = MAX(_maximumRunningCount, runningCount);
+    }
+}
+
+- (void)reset {
+
+    @synchronized(self) {
+
+        [_keyMetrics removeAllObjects];
+        [_recentRecords removeAllObjects];
+        _recentRecordsStart = 0;
+        _maximumPendingCount = _pendingCount;
+        _maximumRunningCount = _runningCount;
+    }
+}
+
+#pragma mark - Reading
+
+- (NSArray *)recentRecordsUnlocked {
+
+    if (!_recentRecordsStart) {
+        return [_recentRecords copy];
+    }
+
+    NSRange head = NSMakeRange(_recentRecordsStart, _recentRecords.count - _recentRecordsStart);
+    NSMutableArray *records = [[_recentRecords subarrayWithRange:head] mutableCopy];
+    [records addObjectsFromArray:[_recentRecords subarrayWithRange:NSMakeRange(0, _recentRecordsStart)]];
+    return records;
+}
+
+- (NSArray *)recentRecords {
+
+    @synchronized(self) {
+        return [self recentRecordsUnlocked];
+    }
+}
+
+- (CSMessageHistogram)histogramOfPhase:(CSMessagePhase)phase metrics:(CSMessageKeyMetrics *)metrics {
+
+    CSMessageHistogram histogram = metrics->_current[phase];
+    for (NSUInteger i = 0; i < CSMessageMetricsBucketsCount; i++) {
+        histogram.buckets[i] += metrics->_previous[phase].buckets[i];
+    }
+    histogram.count += metrics->_previous[phase].count;
+    return histogram;
+}
+
+- (NSTimeInterval)durationAtPercentile:(double)percentile histogram:(const CSMessageHistogram *)histogram {
+
+    if (!histogram->count) {
+        return -1.0;
+    }
+
+    uint64_t rank = (uint64_t)ceil(MAX(0.0, MIN(1.0, percentile)) * histogram->count);
+    rank = MAX(rank, 1);
+
+    uint64_t seen = 0;
+    for (NSUInteger i = 0; i < CSMessageMetricsBucketsCount; i++) {
+
+        seen += histogram->buckets[i];
+        if (seen >= rank) {
+            return CSMessageHistogramBucketUpperBound(i);
+        }
+    }
+    return CSMessageHistogramBucketUpperBound(CSMessageMetricsBucketsCount - 1);
+}
+
+- (NSTimeInterval)durationAtPercentile:(double)percentile ofPhase:(CSMessagePhase)phase forKey:(NSString *)key {
+
+    if (phase < 0 || phase >= CSMessagePhaseCount) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"phase is out of range"
+                               userInfo:nil] raise];
+    }
+
+    @synchronized(self) {
+
+        CSMessageKeyMetrics *metrics = _keyMetrics[(key ? key : @"")];
+        if (!metrics) {
+            return -1.0;
+        }
+
+        CSMessageHistogram histogram = [self histogramOfPhase:phase metrics:metrics];
+        return [self durationAtPercentile:percentile histogram:&histogram];
+    }
+}
+
+- (NSDictionary *)snapshot {
+
+    @synchronized(self) {
+
+        NSMutableDictionary *keys = [[NSMutableDictionary alloc] initWithCapacity:_keyMetrics.count];
+        [_keyMetrics enumerateKeysAndObjectsUsingBlock:^(NSString *key, CSMessageKeyMetrics *metrics, BOOL *stop) {
+
+            NSMutableDictionary *phases = [[NSMutableDictionary alloc] init];
+            for (NSInteger phase = 0; phase < CSMessagePhaseCount; phase++) {
+
+                CSMessageHistogram histogram = [self histogramOfPhase:phase metrics:metrics];
+                if (!histogram.count) {
+                    continue;
+                }
+
+                //buckets are exported sparse as upper bound in seconds -> count
+                NSMutableDictionary *buckets = [[NSMutableDictionary alloc] init];
+                for (NSUInteger i = 0; i < CSMessageMetricsBucketsCount; i++) {
+                    if (histogram.buckets[i]) {
+                        NSString *bound = [NSString stringWithFormat:@"%g", CSMessageHistogramBucketUpperBound(i)];
+                        buckets[bound] = @(histogram.buckets[i]);
+                    }
+                }
+
+                phases[CSMessagePhaseNames[phase]] = @{@"count" : @(histogram.count),
+                                                       @"p50" : @([self durationAtPercentile:0.5 histogram:&histogram]),
+                                                       @"p90" : @([self durationAtPercentile:0.9 histogram:&histogram]),
+                                                       @"p99" : @([self durationAtPercentile:0.99 histogram:&histogram]),
+                                                       @"buckets" : buckets};
+            }
+            keys[key] = phases;
+        }];
+
+        NSDictionary *gauges = @{@"pendingCount" : @(_pendingCount),
+                                 @"runningCount" : @(_runningCount),
+                                 @"maximumPendingCount" : @(_maximumPendingCount),
+                                 @"maximumRunningCount" : @(_maximumRunningCount)};
+
+        return @{@"gauges" : gauges, @"keys" : keys};
+    }
+}
+
+- (NSData *)JSONData {
+
+    NSMutableDictionary *dictionary = [[self snapshot] mutableCopy];
+
+    NSArray *records = [self recentRecords];
+    NSMutableArray *representations = [[NSMutableArray alloc] initWithCapacity:records.count];
+    for (CSMessageTimingRecord *record in records) {
+        [representations addObject:[record dictionaryRepresentation]];
+    }
+    dictionary[@"records"] = representations;
+
+    NSError *error = nil;
+    NSData *data = [NSJSONSerialization dataWithJSONObject:dictionary options:0 error:&error];
+    if (error) {
+        CSLog(@"Unable to serialize metrics: %@", error);
+    }
+    return data;
+}
+
+@end
@@ -0,0 +1,83 @@
+//
+//  CSMessageOutbox.h
+//  CSUtils
+//
+//  Created by Josip Bernat on 07/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class CSMessage;
+
+/**
+ *  CSMessageOutbox keeps messages which couldn't be sent because internet was unavailable and sends them again, in order in which they were added, when CSMessageInternerDidBecomeAvailableNotification is posted. Messages are saved to append-only journal so they survive application restart. Records added within commitInterval are written and synced to disk together.
+ *
+ *  Message class, baseURL, action, httpMethod, parameters, headerValues and priority are saved. Parameters and header values must be property list objects. Messages replayed after restart don't have responseBlock.
+ */
+@interface CSMessageOutbox : NSObject
+
+/**
+ *  Maximum number of messages sent at the same time while replaying. Default is 2.
+ */
+@property (nonatomic, readwrite) NSInteger maxConcurrentReplaysCount;
+
+/**
+ *  Time during which journal records are collected before they are written and synced to disk. Default is 0.01 seconds.
+ */
+@property (nonatomic, readwrite) NSTimeInterval commitInterval;
+
+/**
+ *  Number of messages waiting to be sent.
+ */
+@property (nonatomic, readonly) NSUInteger pendingMessagesCount;
+
+/**
+ *  Path of journal file.
+ */
+@property (nonatomic, strong, readonly) NSString *path;
+
+#pragma mark - Class Methods
+
+/**
+ *  If the shared outbox does not exist yet, it is created. Shared outbox keeps its journal in application's Library/Caches directory.
+ *
+ *  @return The shared outbox instance.
+ */
++ (CSMessageOutbox *)sharedOutbox;
+
+#pragma mark - Initialization
+
+/**
+ *  Creates new outbox and loads messages saved in journal at given path.
+ *
+ *  @param path Path of journal file. NSInvalidArgumentException is raised if path is nil.
+ *
+ *  @return New instance of CSMessageOutbox.
+ */
+- (instancetype)initWithPath:(NSString *)path; //designated initializer
+
+#pragma mark - Adding Messages
+
+/**
+ *  Saves message to journal. Message is sent when internet becomes available.
+ *
+ *  @param message Message to be saved. Messages with filePath, bodyData or destinationPath can't be saved.
+ *
+ *  @return NO if message can't be saved.
+ */
+- (BOOL)addMessage:(CSMessage *)message;
+
+#pragma mark - Replaying Messages
+
+/**
+ *  Starts sending saved messages. Called automatically when CSMessageInternerDidBecomeAvailableNotification is posted. Replay stops when message fails because of network error.
+ */
+- (void)replayMessages;
+
+/**
+ *  Writes and syncs all collected journal records. Returns when they are on disk.
+ */
+- (void)synchronize;
+
+@end
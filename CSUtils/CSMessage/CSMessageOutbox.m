@@ -0,0 +1,526 @@
+//
+//  CSMessageOutbox.m
+//  CSUtils
+//
+//  Created by Josip Bernat on 07/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import "CSMessageOutbox.h"
+#import "CSMessage.h"
+#import "CSMessageCenter.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+//Record Keys
+static NSString * const CSMessageOutboxIdentifierKey    = @"id";
+static NSString * const CSMessageOutboxOperationKey     = @"op";
+static NSString * const CSMessageOutboxClassKey         = @"class";
+static NSString * const CSMessageOutboxBaseURLKey       = @"baseURL";
+static NSString * const CSMessageOutboxActionKey        = @"action";
+static NSString * const CSMessageOutboxMethodKey        = @"method";
+static NSString * const CSMessageOutboxParametersKey    = @"parameters";
+static NSString * const CSMessageOutboxHeaderValuesKey  = @"headers";
+static NSString * const CSMessageOutboxPriorityKey      = @"priority";
+
+//Operations
+static NSString * const CSMessageOutboxOperationAdd     = @"add";
+static NSString * const CSMessageOutboxOperationRemove  = @"remove";
+
+/**
+ *  Journal is compacted when it contains more remove records than this and more than there are pending messages.
+ */
+static NSUInteger const CSMessageOutboxCompactionThreshold = 64;
+
+@interface CSMessageOutbox () {
+
+    int _fileDescriptor;
+    dispatch_queue_t _queue;
+    
+    NSMutableData *_uncommittedData;
+    BOOL _commitScheduled;
+    
+    NSMutableArray *_pendingRecords;
+    NSMutableDictionary *_responseBlocks;
+    NSMutableDictionary *_completionQueues;
+    NSMutableSet *_replayingIdentifiers;
+    NSUInteger _removedRecordsCount;
+    NSInteger _runningReplaysCount;
+    BOOL _replaying;
+}
+
+@property (nonatomic, strong, readwrite) NSString *path;
+
+@end
+
+@implementation CSMessageOutbox
+
++ (CSMessageOutbox *)sharedOutbox {
+    
+    static dispatch_once_t onceToken;
+    static CSMessageOutbox *sharedInstance = nil;
+    
+    dispatch_once(&onceToken, ^{
+        
+        NSString *directory = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) firstObject];
+        sharedInstance = [[self alloc] initWithPath:[directory stringByAppendingPathComponent:@"CSMessageOutbox.journal"]];
+    });
+    return sharedInstance;
+}
+
+#pragma mark - Memory Management
+
+- (void)dealloc {
+    
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+    
+    if (_fileDescriptor >= 0) {
+        close(_fileDescriptor);
+    }
+}
+
+#pragma mark - Initialization
+
+- (instancetype)init {
+    return [self initWithPath:nil];
+}
+
+- (instancetype)initWithPath:(NSString *)path {
+    
+    if (!path) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"path can't be nil"
+                               userInfo:nil] raise];
+    }
+    
+    if (self = [super init]) {
+        
+        self.path = path;
+        self.maxConcurrentReplaysCount = 2;
+        self.commitInterval = 0.01;
+        
+        _queue = dispatch_queue_create("com.clover-studio.CSMessageOutbox", DISPATCH_QUEUE_SERIAL);
+        _uncommittedData = [[NSMutableData alloc] init];
+        _pendingRecords = [[NSMutableArray alloc] init];
+        _responseBlocks = [[NSMutableDictionary alloc] init];
+        _completionQueues = [[NSMutableDictionary alloc] init];
+        _replayingIdentifiers = [[NSMutableSet alloc] init];
+        
+        [[NSFileManager defaultManager] createDirectoryAtPath:[path stringByDeletingLastPathComponent]
+                                  withIntermediateDirectories:YES
+                                                   attributes:nil
+                                                        error:nil];
+        [self loadJournal];
+        
+        [[NSNotificationCenter defaultCenter] addObserver:self
+                                                 selector:@selector(internetDidBecomeAvailable:)
+                                                     name:CSMessageInternerDidBecomeAvailableNotification
+                                                   object:nil];
+    }
+    return self;
+}
+
+#pragma mark - Getters
+
+- (NSUInteger)pendingMessagesCount {
+    
+    __block NSUInteger count = 0;
+    dispatch_sync(_queue, ^{
+        count = _pendingRecords.count;
+    });
+    return count;
+}
+
+#pragma mark - Journal
+
+/**
+ *  Reads all records and keeps add records which don't have matching remove record. Incomplete record at the end, left by crash while writing, is cut off.
+ */
+- (void)loadJournal {
+    
+    NSData *journal = [NSData dataWithContentsOfFile:self.path options:NSDataReadingMappedIfSafe error:nil];
+    const uint8_t *bytes = journal.bytes;
+    NSUInteger length = journal.length;
+    NSUInteger offset = 0;
+    
+    NSMutableDictionary *recordsByIdentifier = [[NSMutableDictionary alloc] init];
+    
+    while (offset + sizeof(uint32_t) <= length) {
+        
+        uint32_t recordLength = 0;
+        memcpy(&recordLength, bytes + offset, sizeof(uint32_t));
+        recordLength = CFSwapInt32BigToHost(recordLength);
+        
+        if (recordLength > length - offset - sizeof(uint32_t)) {
+            break;
+        }
+        
+        NSData *data = [NSData dataWithBytesNoCopy:(void *)(bytes + offset + sizeof(uint32_t))
+                                            length:recordLength
+                                      freeWhenDone:NO];
+        NSDictionary *record = [NSPropertyListSerialization propertyListWithData:data
+                                                                         options:NSPropertyListImmutable
+                                                                          format:NULL
+                                                                           error:nil];
+        NSString *identifier = ([record isKindOfClass:[NSDictionary class]] ? record[CSMessageOutboxIdentifierKey] : nil);
+        if (!identifier) {
+            break;
+        }
+        
+        if ([record[CSMessageOutboxOperationKey] isEqualToString:CSMessageOutboxOperationRemove]) {
+            
+            if (recordsByIdentifier[identifier]) {
+                [_pendingRecords removeObject:recordsByIdentifier[identifier]];
+                [recordsByIdentifier removeObjectForKey:identifier];
+            }
+            _removedRecordsCount++;
+        }
+        else {
+            recordsByIdentifier[identifier] = record;
+            [_pendingRecords addObject:record];
+        }
+        
+        offset += sizeof(uint32_t) + recordLength;
+    }
+    
+    _fileDescriptor = open([self.path fileSystemRepresentation], O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (_fileDescriptor >= 0 && offset < length) {
+        ftruncate(_fileDescriptor, (off_t)offset);
+    }
+}
+
+/**
+ *  Adds record to uncommitted data and schedules commit. Must be called on queue.
+ */
+- (void)appendRecord:(NSDictionary *)record {
+    
+    NSData *data = [NSPropertyListSerialization dataWithPropertyList:record
+                                                              format:NSPropertyListBinaryFormat_v1_0
+                                                             options:0
+                                                               error:nil];
+    if (!data) {
+        return;
+    }
+    
+    uint32_t recordLength = CFSwapInt32HostToBig((uint32_t)data.length);
+    [_uncommittedData appendBytes:&recordLength length:sizeof(uint32_t)];
+    [_uncommittedData appendData:data];
+    
+    if (!_commitScheduled) {
+        
+        _commitScheduled = YES;
+        __weak CSMessageOutbox *this = self;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.commitInterval * NSEC_PER_SEC)), _queue, ^{
+            [this commit];
+        });
+    }
+}
+
+/**
+ *  Writes all uncommitted records with single sync. Must be called on queue.
+ */
+- (void)commit {
+    
+    _commitScheduled = NO;
+    if (!_uncommittedData.length || _fileDescriptor < 0) {
+        return;
+    }
+    
+    if (![self writeData:_uncommittedData toFileDescriptor:_fileDescriptor]) {
+        CSLog(@"Unable to write outbox journal: %s", strerror(errno));
+    }
+    [_uncommittedData setLength:0];
+    [self syncFileDescriptor:_fileDescriptor];
+    
+    if (_removedRecordsCount > CSMessageOutboxCompactionThreshold && _removedRecordsCount > _pendingRecords.count) {
+        [self compact];
+    }
+}
+
+/**
+ *  Rewrites journal so it contains only pending messages. New journal replaces old one atomically.
+ */
+- (void)compact {
+    
+    NSString *temporaryPath = [self.path stringByAppendingPathExtension:@"tmp"];
+    int fileDescriptor = open([temporaryPath fileSystemRepresentation], O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fileDescriptor < 0) {
+        return;
+    }
+    
+    NSMutableData *data = [[NSMutableData alloc] init];
+    for (NSDictionary *record in _pendingRecords) {
+        
+        NSData *recordData = [NSPropertyListSerialization dataWithPropertyList:record
+                                                                        format:NSPropertyListBinaryFormat_v1_0
+                                                                       options:0
+                                                                         error:nil];
+        uint32_t recordLength = CFSwapInt32HostToBig((uint32_t)recordData.length);
+        [data appendBytes:&recordLength length:sizeof(uint32_t)];
+        [data appendData:recordData];
+    }
+    
+    if (![self writeData:data toFileDescriptor:fileDescriptor] || ![self syncFileDescriptor:fileDescriptor] ||
+        rename([temporaryPath fileSystemRepresentation], [self.path fileSystemRepresentation]) != 0) {
+        
+        close(fileDescriptor);
+        unlink([temporaryPath fileSystemRepresentation]);
+        return;
+    }
+    
+    close(_fileDescriptor);
+    _fileDescriptor = fileDescriptor;
+    _removedRecordsCount = 0;
+}
+
+- (BOOL)writeData:(NSData *)data toFileDescriptor:(int)fileDescriptor {
+    
+    const uint8_t *bytes = data.bytes;
+    size_t remaining = data.length;
+    
+    while (remaining) {
+        
+        ssize_t written = write(fileDescriptor, bytes, remaining);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return NO;
+        }
+        bytes += written;
+        remaining -= (size_t)written;
+    }
+    return YES;
+}
+
+- (BOOL)syncFileDescriptor:(int)fileDescriptor {
+    
+#ifdef F_FULLFSYNC
+    //fsync on Darwin doesn't flush drive cache
+    if (fcntl(fileDescriptor, F_FULLFSYNC) == 0) {
+        return YES;
+    }
+#endif
+    return (fsync(fileDescriptor) == 0);
+}
+
+- (void)synchronize {
+    
+    dispatch_sync(_queue, ^{
+        [self commit];
+    });
+}
+
+#pragma mark - Adding Messages
+
+- (BOOL)addMessage:(CSMessage *)message {
+    
+    if (!message || message.filePath || message.bodyData || message.destinationPath) {
+        return NO;
+    }
+    
+    NSString *identifier = [[NSUUID UUID] UUIDString];
+    NSMutableDictionary *record = [[NSMutableDictionary alloc] init];
+    record[CSMessageOutboxIdentifierKey] = identifier;
+    record[CSMessageOutboxOperationKey] = CSMessageOutboxOperationAdd;
+    record[CSMessageOutboxClassKey] = NSStringFromClass([message class]);
+    record[CSMessageOutboxBaseURLKey] = [message.baseURL absoluteString];
+    record[CSMessageOutboxMethodKey] = message.httpMethod;
+    record[CSMessageOutboxPriorityKey] = @(message.priority);
+    
+    if (message.action) {
+        record[CSMessageOutboxActionKey] = message.action;
+    }
+    if (message.parameters) {
+        record[CSMessageOutboxParametersKey] = message.parameters;
+    }
+    if (message.headerValues) {
+        record[CSMessageOutboxHeaderValuesKey] = message.headerValues;
+    }
+    
+    if (![NSPropertyListSerialization propertyList:record isValidForFormat:NSPropertyListBinaryFormat_v1_0]) {
+        return NO;
+    }
+    
+    CSResponseBlock responseBlock = message.responseBlock;
+    dispatch_queue_t completionQueue = message.completionQueue;
+    
+    dispatch_async(_queue, ^{
+        
+        [_pendingRecords addObject:record];
+        if (responseBlock) {
+            _responseBlocks[identifier] = responseBlock;
+        }
+        if (completionQueue) {
+            _completionQueues[identifier] = completionQueue;
+        }
+        [self appendRecord:record];
+        
+        if (_replaying) {
+            [self replayNextMessages];
+        }
+    });
+    return YES;
+}
+
+#pragma mark - Replaying Messages
+
+- (void)internetDidBecomeAvailable:(NSNotification *)notification {
+    [self replayMessages];
+}
+
+- (void)replayMessages {
+    
+    dispatch_async(_queue, ^{
+        
+        _replaying = YES;
+        [self replayNextMessages];
+    });
+}
+
+/**
+ *  Sends pending messages in order until maxConcurrentReplaysCount messages are being sent. Must be called on queue.
+ */
+- (void)replayNextMessages {
+    
+    NSInteger maxConcurrentReplaysCount = MAX(self.maxConcurrentReplaysCount, 1);
+    NSUInteger index = 0;
+    
+    while (_replaying && _runningReplaysCount < maxConcurrentReplaysCount) {
+        
+        NSDictionary *record = nil;
+        for (; index < _pendingRecords.count; index++) {
+            
+            if (![_replayingIdentifiers containsObject:_pendingRecords[index][CSMessageOutboxIdentifierKey]]) {
+                record = _pendingRecords[index];
+                break;
+            }
+        }
+        
+        if (!record) {
+            if (!_runningReplaysCount) {
+                _replaying = NO;
+            }
+            return;
+        }
+        
+        CSMessage *message = [self messageForRecord:record];
+        if (!message) {
+            [self removeRecord:record];
+            continue;
+        }
+        
+        _runningReplaysCount++;
+        [_replayingIdentifiers addObject:record[CSMessageOutboxIdentifierKey]];
+        
+        [[CSMessageCenter defaultCenter] addMessage:message];
+    }
+}
+
+- (CSMessage *)messageForRecord:(NSDictionary *)record {
+    
+    Class messageClass = NSClassFromString(record[CSMessageOutboxClassKey]);
+    if (![messageClass isSubclassOfClass:[CSMessage class]]) {
+        messageClass = [CSMessage class];
+    }
+    
+    NSString *identifier = record[CSMessageOutboxIdentifierKey];
+    NSString *baseURL = record[CSMessageOutboxBaseURLKey];
+    
+    CSMessage *message = [[messageClass alloc] initWithParameters:record[CSMessageOutboxParametersKey]];
+    if (baseURL) {
+        message.baseURL = [NSURL URLWithString:baseURL];
+    }
+    if (record[CSMessageOutboxActionKey]) {
+        message.action = record[CSMessageOutboxActionKey];
+    }
+    message.headerValues = record[CSMessageOutboxHeaderValuesKey];
+    message.priority = [record[CSMessageOutboxPriorityKey] integerValue];
+    message.completionQueue = _completionQueues[identifier];
+    
+    //methods are compared by pointer so saved string must be mapped to constant
+    NSString *method = record[CSMessageOutboxMethodKey];
+    for (CSHTTPMethod httpMethod in @[CSHTTPMethodGET, CSHTTPMethodPOST, CSHTTPMethodPUT, CSHTTPMethodDELETE]) {
+        if ([httpMethod isEqualToString:method]) {
+            message.httpMethod = httpMethod;
+        }
+    }
+    
+    CSResponseBlock responseBlock = _responseBlocks[identifier];
+    __weak CSMessageOutbox *this = self;
+    message.responseBlock = ^(id responseObject, NSError *error) {
+        
+        //message failed because of network is kept and sent on next replay
+        BOOL retries = [CSMessageOutbox isNetworkError:error];
+        if (!retries && responseBlock) {
+            responseBlock(responseObject, error);
+        }
+        
+        CSMessageOutbox *strongThis = this;
+        if (strongThis) {
+            dispatch_async(strongThis->_queue, ^{
+                [strongThis replayedRecord:record retries:retries];
+            });
+        }
+    };
+    
+    return message;
+}
+
+/**
+ *  Called on queue when replayed message finishes.
+ */
+- (void)replayedRecord:(NSDictionary *)record retries:(BOOL)retries {
+    
+    _runningReplaysCount--;
+    [_replayingIdentifiers removeObject:record[CSMessageOutboxIdentifierKey]];
+    
+    if (retries) {
+        //don't keep sending while network is gone, next notification starts replay again
+        _replaying = NO;
+        return;
+    }
+    
+    [self removeRecord:record];
+    [self replayNextMessages];
+}
+
+- (void)removeRecord:(NSDictionary *)record {
+    
+    NSString *identifier = record[CSMessageOutboxIdentifierKey];
+    
+    [_pendingRecords removeObjectIdenticalTo:record];
+    [_responseBlocks removeObjectForKey:identifier];
+    [_completionQueues removeObjectForKey:identifier];
+    
+    [self appendRecord:@{CSMessageOutboxIdentifierKey : identifier,
+                         CSMessageOutboxOperationKey : CSMessageOutboxOperationRemove}];
+    _removedRecordsCount++;
+}
+
++ (BOOL)isNetworkError:(NSError *)error {
+    
+    if ([error.domain isEqualToString:CSMessageErrorDomainInternetUnavailable]) {
+        return YES;
+    }
+    if (![error.domain isEqualToString:NSURLErrorDomain]) {
+        return NO;
+    }
+    
+    switch (error.code) {
+        case NSURLErrorNotConnectedToInternet:
+        case NSURLErrorNetworkConnectionLost:
+        case NSURLErrorTimedOut:
+        case NSURLErrorCannotFindHost:
+        case NSURLErrorCannotConnectToHost:
+        case NSURLErrorDNSLookupFailed:
+        case NSURLErrorInternationalRoamingOff:
+        case NSURLErrorDataNotAllowed:
+            return YES;
+        default:
+            return NO;
+    }
+}
+
+@end
@@ -0,0 +1,170 @@
+//
+//  CSMessageResponseCache.h
+//  CSUtils
+//
+//  Created by Josip Bernat on 06/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ *  Cached response body with its validators and freshness information.
+ */
+@interface CSCachedResponse : NSObject
+
+/**
+ *  Response body.
+ */
+@property (nonatomic, strong, readonly) NSData *data;
+
+/**
+ *  Value of ETag header field. Sent as If-None-Match when response is revalidated.
+ */
+@property (strong, readonly) NSString *entityTag;
+
+/**
+ *  Value of Last-Modified header field. Sent as If-Modified-Since when response is revalidated.
+ */
+@property (strong, readonly) NSString *lastModified;
+
+/**
+ *  Date until which response can be used without revalidation.
+ */
+@property (strong, readonly) NSDate *expirationDate;
+
+/**
+ *  Date until which stale response can be used while it's being revalidated.
+ */
+@property (strong, readonly) NSDate *staleExpirationDate;
+
+/**
+ *  Object parsed from data. Set by message which parsed response so following hits don't parse data again.
+ */
+@property (strong) id responseObject;
+
+#pragma mark - Initialization
+
+/**
+ *  Creates new cached response from given HTTP response.
+ *
+ *  @param response HTTP response whose Cache-Control, ETag and Last-Modified header fields are used.
+ *  @param data     Response body.
+ *
+ *  @return New instance of CSCachedResponse or nil if response must not be cached.
+ */
+- (instancetype)initWithResponse:(NSHTTPURLResponse *)response data:(NSData *)data; //designated initializer
+
+#pragma mark - Freshness
+
+/**
+ *  Checks whether response can be used without revalidation.
+ */
+- (BOOL)isFresh;
+
+/**
+ *  Checks whether response can be used while it's being revalidated.
+ */
+- (BOOL)isUsableWhileRevalidating;
+
+/**
+ *  Updates validators and freshness from response to conditional request.
+ *
+ *  @param response HTTP response with 304 status code.
+ */
+- (void)updateWithNotModifiedResponse:(NSHTTPURLResponse *)response;
+
+@end
+
+/**
+ *  In-memory cache of CSMessage GET responses keyed by CSMessage requestKey. Messages with usesResponseCache set use shared cache. Cache is thread safe.
+ */
+@interface CSMessageResponseCache : NSObject
+
+/**
+ *  Maximum number of body bytes kept in cache. Default is 8MB.
+ */
+@property (nonatomic, readwrite) NSUInteger maximumLength;
+
+/**
+ *  Number of responses used without sending request.
+ */
+@property (readonly) NSUInteger hitCount;
+
+/**
+ *  Number of stale responses used while they were revalidated.
+ */
+@property (readonly) NSUInteger staleHitCount;
+
+/**
+ *  Number of conditional requests answered with 304 Not Modified.
+ */
+@property (readonly) NSUInteger revalidatedCount;
+
+/**
+ *  Number of requests for which no response was cached.
+ */
+@property (readonly) NSUInteger missCount;
+
+/**
+ *  Number of body bytes which weren't downloaded because of hits and 304 responses.
+ */
+@property (readonly) unsigned long long savedLength;
+
+#pragma mark - Class Methods
+
+/**
+ *  If the shared cache does not exist yet, it is created.
+ *
+ *  @return Shared cache instance.
+ */
++ (CSMessageResponseCache *)sharedCache;
+
+#pragma mark - Caching Responses
+
+/**
+ *  Returns cached response for given key or nil if there is no response cached.
+ */
+- (CSCachedResponse *)cachedResponseForKey:(NSString *)key;
+
+/**
+ *  Saves response under given key. NSInvalidArgumentException is raised if key is nil.
+ */
+- (void)storeCachedResponse:(CSCachedResponse *)cachedResponse forKey:(NSString *)key;
+
+/**
+ *  Removes response cached under given key.
+ */
+- (void)removeCachedResponseForKey:(NSString *)key;
+
+/**
+ *  Removes all cached responses.
+ */
+- (void)removeAllCachedResponses;
+
+#pragma mark - Statistics
+
+/**
+ *  Called by CSMessage when cached response is used.
+ *
+ *  @param cachedResponse Response which was used.
+ *  @param fresh          YES if response was used without revalidation, NO if it was used while being revalidated.
+ */
+- (void)recordHitForCachedResponse:(CSCachedResponse *)cachedResponse fresh:(BOOL)fresh;
+
+/**
+ *  Called by CSMessage when conditional request is answered with 304 Not Modified.
+ */
+- (void)recordRevalidationForCachedResponse:(CSCachedResponse *)cachedResponse;
+
+/**
+ *  Called by CSMessage when no response was cached.
+ */
+- (void)recordMiss;
+
+/**
+ *  Resets all statistic values to zero.
+ */
+- (void)resetStatistics;
+
+@end
@@ -0,0 +1,246 @@
+//
+//  CSMessageResponseCache.m
+//  CSUtils
+//
+//  Created by Josip Bernat on 06/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import "CSMessageResponseCache.h"
+
+@interface CSCachedResponse ()
+
+@property (nonatomic, strong, readwrite) NSData *data;
+@property (strong, readwrite) NSString *entityTag;
+@property (strong, readwrite) NSString *lastModified;
+@property (strong, readwrite) NSDate *expirationDate;
+@property (strong, readwrite) NSDate *staleExpirationDate;
+
+@end
+
+@implementation CSCachedResponse
+
+#pragma mark - Initialization
+
+- (instancetype)initWithResponse:(NSHTTPURLResponse *)response data:(NSData *)data {
+
+    if (self = [super init]) {
+        
+        NSDictionary *headerFields = [response allHeaderFields];
+        if (![self updateFreshnessWithHeaderFields:headerFields]) {
+            return nil;
+        }
+        
+        self.data = (data ? data : [NSData data]);
+        self.entityTag = [self valueForHeaderField:@"ETag" inHeaderFields:headerFields];
+        self.lastModified = [self valueForHeaderField:@"Last-Modified" inHeaderFields:headerFields];
+        
+        //response without validators which is already stale can never be used
+        if (!self.entityTag && !self.lastModified && ![self isFresh] && ![self isUsableWhileRevalidating]) {
+            return nil;
+        }
+    }
+    return self;
+}
+
+#pragma mark - Header Fields
+
+- (NSString *)valueForHeaderField:(NSString *)field inHeaderFields:(NSDictionary *)headerFields {
+    
+    NSString *value = headerFields[field];
+    if (value) {
+        return value;
+    }
+    
+    for (NSString *key in headerFields) {
+        if ([key caseInsensitiveCompare:field] == NSOrderedSame) {
+            return headerFields[key];
+        }
+    }
+    return nil;
+}
+
+/**
+ *  Reads max-age, stale-while-revalidate, no-cache and no-store directives of Cache-Control header field.
+ *
+ *  @return NO if response must not be stored.
+ */
+- (BOOL)updateFreshnessWithHeaderFields:(NSDictionary *)headerFields {
+    
+    NSTimeInterval maxAge = 0.0;
+    NSTimeInterval staleWhileRevalidate = 0.0;
+    
+    NSString *cacheControl = [self valueForHeaderField:@"Cache-Control" inHeaderFields:headerFields];
+    for (NSString *component in [cacheControl componentsSeparatedByString:@","]) {
+        
+        NSString *directive = [[component stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]] lowercaseString];
+        if ([directive isEqualToString:@"no-store"]) {
+            return NO;
+        }
+        else if ([directive isEqualToString:@"no-cache"]) {
+            maxAge = 0.0;
+            staleWhileRevalidate = 0.0;
+            break;
+        }
+        else if ([directive hasPrefix:@"max-age="]) {
+            maxAge = MAX([[directive substringFromIndex:8] doubleValue], 0.0);
+        }
+        else if ([directive hasPrefix:@"stale-while-revalidate="]) {
+            staleWhileRevalidate = MAX([[directive substringFromIndex:23] doubleValue], 0.0);
+        }
+    }
+    
+    NSDate *now = [NSDate date];
+    self.expirationDate = [now dateByAddingTimeInterval:maxAge];
+    self.staleExpirationDate = [self.expirationDate dateByAddingTimeInterval:staleWhileRevalidate];
+    
+    return YES;
+}
+
+#pragma mark - Freshness
+
+- (BOOL)isFresh {
+    return ([self.expirationDate timeIntervalSinceNow] > 0.0);
+}
+
+- (BOOL)isUsableWhileRevalidating {
+    return ([self.staleExpirationDate timeIntervalSinceNow] > 0.0);
+}
+
+- (void)updateWithNotModifiedResponse:(NSHTTPURLResponse *)response {
+    
+    NSDictionary *headerFields = [response allHeaderFields];
+    [self updateFreshnessWithHeaderFields:headerFields];
+    
+    NSString *entityTag = [self valueForHeaderField:@"ETag" inHeaderFields:headerFields];
+    if (entityTag) {
+        self.entityTag = entityTag;
+    }
+    NSString *lastModified = [self valueForHeaderField:@"Last-Modified" inHeaderFields:headerFields];
+    if (lastModified) {
+        self.lastModified = lastModified;
+    }
+}
+
+@end
+
+@interface CSMessageResponseCache ()
+
+@property (nonatomic, strong) NSCache *cache;
+@property (readwrite) NSUInteger hitCount;
+@property (readwrite) NSUInteger staleHitCount;
+@property (readwrite) NSUInteger revalidatedCount;
+@property (readwrite) NSUInteger missCount;
+@property (readwrite) unsigned long long savedLength;
+
+@end
+
+@implementation CSMessageResponseCache
+
++ (CSMessageResponseCache *)sharedCache {
+    
+    static dispatch_once_t onceToken;
+    static CSMessageResponseCache *sharedInstance = nil;
+    
+    dispatch_once(&onceToken, ^{
+        sharedInstance = [[self alloc] init];
+    });
+    return sharedInstance;
+}
+
+#pragma mark - Initialization
+
+- (instancetype)init {
+
+    if (self = [super init]) {
+        
+        _cache = [[NSCache alloc] init];
+        _cache.name = @"com.clover-studio.CSMessageResponseCache";
+        self.maximumLength = 8 * 1024 * 1024;
+    }
+    return self;
+}
+
+#pragma mark - Setters
+
+- (void)setMaximumLength:(NSUInteger)maximumLength {
+    
+    _maximumLength = maximumLength;
+    _cache.totalCostLimit = maximumLength;
+}
+
+#pragma mark - Caching Responses
+
+- (CSCachedResponse *)cachedResponseForKey:(NSString *)key {
+    return (key ? [_cache objectForKey:key] : nil);
+}
+
+- (void)storeCachedResponse:(CSCachedResponse *)cachedResponse forKey:(NSString *)key {
+    
+    if (!key) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"key can't be nil"
+                               userInfo:nil] raise];
+    }
+    
+    if (!cachedResponse) {
+        [self removeCachedResponseForKey:key];
+        return;
+    }
+    [_cache setObject:cachedResponse forKey:key cost:cachedResponse.data.length];
+}
+
+- (void)removeCachedResponseForKey:(NSString *)key {
+    
+    if (key) {
+        [_cache removeObjectForKey:key];
+    }
+}
+
+- (void)removeAllCachedResponses {
+    [_cache removeAllObjects];
+}
+
+#pragma mark - Statistics
+
+- (void)recordHitForCachedResponse:(CSCachedResponse *)cachedResponse fresh:(BOOL)fresh {
+    
+    @synchronized(self) {
+        
+        if (fresh) {
+            self.hitCount++;
+            self.savedLength += cachedResponse.data.length;
+        }
+        else {
+            self.staleHitCount++;
+        }
+    }
+}
+
+- (void)recordRevalidationForCachedResponse:(CSCachedResponse *)cachedResponse {
+    
+    @synchronized(self) {
+        self.revalidatedCount++;
+        self.savedLength += cachedResponse.data.length;
+    }
+}
+
+- (void)recordMiss {
+    
+    @synchronized(self) {
+        self.missCount++;
+    }
+}
+
+- (void)resetStatistics {
+    
+    @synchronized(self) {
+        self.hitCount = 0;
+        self.staleHitCount = 0;
+        self.revalidatedCount = 0;
+        self.missCount = 0;
+        self.savedLength = 0;
+    }
+}
+
+@end
@@ -0,0 +1,158 @@
+//
+//  CSMessageThrottle.h
+//  CSUtils
+//
+//  Created by Josip Bernat on 13/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ *  String object identifing error of message which wasn't sent because circuit breaker of its host is open.
+ */
+extern NSString * const CSCircuitBreakerErrorDomain;
+
+/**
+ *  Integer value defining error.code when domain is CSCircuitBreakerErrorDomain.
+ */
+extern NSInteger const CSCircuitBreakerErrorCodeOpen;
+
+/**
+ *  Token bucket limiting rate of requests. Implemented as generic cell rate algorithm so whole state is single atomic word updated with compare and swap. Thread safe and lock free.
+ */
+@interface CSTokenBucket : NSObject
+
+/**
+ *  Tokens added per second.
+ */
+@property (nonatomic, readonly) double rate;
+
+/**
+ *  Maximum number of tokens bucket can hold.
+ */
+@property (nonatomic, readonly) NSUInteger burst;
+
+#pragma mark - Initialization
+
+/**
+ *  Creates full bucket.
+ *
+ *  @param rate  Tokens added per second. NSInvalidArgumentException is raised if rate isn't greater than 0.
+ *  @param burst Maximum number of tokens. NSInvalidArgumentException is raised if burst is 0.
+ *
+ *  @return New instance of CSTokenBucket.
+ */
+- (instancetype)initWithRate:(double)rate burst:(NSUInteger)burst; //designated initializer
+
+#pragma mark - Tokens
+
+/**
+ *  Takes one token if available.
+ *
+ *  @return 0.0 if token was taken, otherwise time until next token becomes available.
+ */
+- (NSTimeInterval)acquireToken;
+
+@end
+
+/**
+ *  State of CSCircuitBreaker.
+ */
+typedef NS_ENUM(NSInteger, CSCircuitBreakerState) {
+    /**
+     *  Requests are sent and their results counted.
+     */
+    CSCircuitBreakerStateClosed = 0,
+    /**
+     *  Requests fail immediately until openInterval passes.
+     */
+    CSCircuitBreakerStateOpen,
+    /**
+     *  Limited number of probe requests is sent. Circuit closes when probe succeeds and opens again when it fails.
+     */
+    CSCircuitBreakerStateHalfOpen
+};
+
+/**
+ *  Circuit breaker opens when too many requests to its host fail or are slow within window and fails requests locally while open. Thread safe and lock free. Configuration properties should be set before breaker is registered with CSMessageCenter.
+ */
+@interface CSCircuitBreaker : NSObject
+
+/**
+ *  Current state.
+ */
+@property (nonatomic, readonly) CSCircuitBreakerState state;
+
+/**
+ *  Ratio of failed requests in window at which circuit opens. Failed requests are connection errors and responses with status code 500 or greater. Default is 0.5.
+ */
+@property (nonatomic, readwrite) double failureRateThreshold;
+
+/**
+ *  Requests taking longer than this are counted as slow. Default is 5 seconds.
+ */
+@property (nonatomic, readwrite) NSTimeInterval slowRequestDuration;
+
+/**
+ *  Ratio of slow requests in window at which circuit opens. Default is 1.0 which opens circuit only if all requests are slow.
+ */
+@property (nonatomic, readwrite) double slowRequestRateThreshold;
+
+/**
+ *  Minimum number of requests in window before rates are evaluated. Default is 10.
+ */
+@property (nonatomic, readwrite) NSUInteger minimumRequestsCount;
+
+/**
+ *  Length of window in which results are counted. Default is 10 seconds.
+ */
+@property (nonatomic, readwrite) NSTimeInterval windowInterval;
+
+/**
+ *  Time circuit stays open before probe requests are allowed. Default is 5 seconds.
+ */
+@property (nonatomic, readwrite) NSTimeInterval openInterval;
+
+/**
+ *  Number of probe requests allowed at once while half open. Default is 1.
+ */
+@property (nonatomic, readwrite) NSUInteger probeRequestsCount;
+
+#pragma mark - Class Methods
+
+/**
+ *  Error messages finish with while circuit is open.
+ */
++ (NSError *)circuitOpenError;
+
+#pragma mark - Requests
+
+/**
+ *  Asks breaker whether request can be sent. Moves open breaker to half open state when openInterval passes. If YES is returned while half open, result of request must be recorded.
+ */
+- (BOOL)allowRequest;
+
+/**
+ *  Records request which received response with status code lower than 500.
+ *
+ *  @param duration Time from sending request to receiving whole response.
+ */
+- (void)recordSuccessWithDuration:(NSTimeInterval)duration;
+
+/**
+ *  Records request which failed or received response with status code 500 or greater.
+ */
+- (void)recordFailure;
+
+/**
+ *  Records request which was canceled before its result was known. Frees its probe slot if it was probe request.
+ */
+- (void)recordCancellation;
+
+/**
+ *  Closes circuit and clears counted results.
+ */
+- (void)reset;
+
+@end
@@ -0,0 +1,340 @@
+//
+//  CSMessageThrottle.m
+//  CSUtils
+//
+//  Created by Josip Bernat on 13/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import "CSMessageThrottle.h"
+#include <stdatomic.h>
+#include <mach/mach_time.h>
+
+NSString * const CSCircuitBreakerErrorDomain       = @"CSCircuitBreakerErrorDomain";
+NSInteger const CSCircuitBreakerErrorCodeOpen       = 801;
+
+/**
+ *  Monotonic time in microseconds.
+ */
+static uint64_t CSThrottleNow(void) {
+    
+    static mach_timebase_info_data_t timebase;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        mach_timebase_info(&timebase);
+    });
+    return mach_absolute_time() * timebase.numer / timebase.denom / 1000;
+}
+
+static inline uint64_t CSThrottleMicroseconds(NSTimeInterval interval) {
+    return (uint64_t)(MAX(interval, 0.0) * 1000000.0);
+}
+
+#pragma mark - Implementation CSTokenBucket
+
+@interface CSTokenBucket () {
+    
+    /**
+     *  Time at which bucket would be full again. Bucket has tokens while it's less than emission interval times burst ahead of now.
+     */
+    _Atomic(uint64_t) _theoreticalArrivalTime;
+    uint64_t _emissionInterval;
+    uint64_t _tolerance;
+}
+
+@end
+
+@implementation CSTokenBucket
+
+@synthesize rate = _rate;
+@synthesize burst = _burst;
+
+#pragma mark - Initialization
+
+- (instancetype)init {
+    return [self initWithRate:1.0 burst:1];
+}
+
+- (instancetype)initWithRate:(double)rate burst:(NSUInteger)burst {
+    
+    if (!(rate > 0.0)) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"rate must be greater than 0"
+                               userInfo:nil] raise];
+    }
+    if (!burst) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"burst must be greater than 0"
+                               userInfo:nil] raise];
+    }
+    
+    if (self = [super init]) {
+        
+        _rate = rate;
+        _burst = burst;
+        _emissionInterval = MAX(CSThrottleMicroseconds(1.0 / rate), 1);
+        _tolerance = _emissionInterval * (burst - 1);
+        atomic_init(&_theoreticalArrivalTime, 0);
+    }
+    return self;
+}
+
+#pragma mark - Tokens
+
+- (NSTimeInterval)acquireToken {
+    
+    uint64_t now = CSThrottleNow();
+    uint64_t arrivalTime = atomic_load_explicit(&_theoreticalArrivalTime, memory_order_relaxed);
+    
+    while (YES) {
+        
+        uint64_t start = MAX(arrivalTime, now);
+        if (start - now > _tolerance) {
+            return (double)(start - now - _tolerance) / 1000000.0;
+        }
+        
+        if (atomic_compare_exchange_weak_explicit(&_theoreticalArrivalTime, &arrivalTime, start + _emissionInterval,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+            return 0.0;
+        }
+    }
+}
+
+@end
+
+#pragma mark - Implementation CSCircuitBreaker
+
+/**
+ *  State and time at which circuit opened share one word, state in lowest two bits, so they always change together.
+ */
+#define CSCircuitBreakerStateBits 2
+#define CSCircuitBreakerStateMask ((UINT64_C(1) << CSCircuitBreakerStateBits) - 1)
+
+static inline CSCircuitBreakerState CSCircuitBreakerStateOfWord(uint64_t word) {
+    return (CSCircuitBreakerState)(word & CSCircuitBreakerStateMask);
+}
+
+static inline uint64_t CSCircuitBreakerOpenedTimeOfWord(uint64_t word) {
+    return (word >> CSCircuitBreakerStateBits);
+}
+
+static inline uint64_t CSCircuitBreakerWord(CSCircuitBreakerState state, uint64_t openedTime) {
+    return ((openedTime << CSCircuitBreakerStateBits) | (uint64_t)state);
+}
+
+@interface CSCircuitBreaker () {
+    
+    _Atomic(uint64_t) _state;
+    _Atomic(uint32_t) _probesCount;
+    
+    /**
+     *  Counters are reset by whichever thread moves window start. Results recorded during reset can be lost which is fine for rates.
+     */
+    _Atomic(uint64_t) _windowStartTime;
+    _Atomic(uint32_t) _requestsCount;
+    _Atomic(uint32_t) _failuresCount;
+    _Atomic(uint32_t) _slowRequestsCount;
+}
+
+@end
+
+@implementation CSCircuitBreaker
+
+#pragma mark - Class Methods
+
++ (NSError *)circuitOpenError {
+    
+    return [NSError errorWithDomain:CSCircuitBreakerErrorDomain
+                               code:CSCircuitBreakerErrorCodeOpen
+                           userInfo:@{NSLocalizedDescriptionKey : @"Request wasn't sent because server is failing."}];
+}
+
+#pragma mark - Initialization
+
+- (instancetype)init {
+    
+    if (self = [super init]) {
+        
+        _failureRateThreshold = 0.5;
+        _slowRequestDuration = 5.0;
+        _slowRequestRateThreshold = 1.0;
+        _minimumRequestsCount = 10;
+        _windowInterval = 10.0;
+        _openInterval = 5.0;
+        _probeRequestsCount = 1;
+        
+        atomic_init(&_state, CSCircuitBreakerWord(CSCircuitBreakerStateClosed, 0));
+        atomic_init(&_probesCount, 0);
+        atomic_init(&_windowStartTime, CSThrottleNow());
+        atomic_init(&_requestsCount, 0);
+        atomic_init(&_failuresCount, 0);
+        atomic_init(&_slowRequestsCount, 0);
+    }
+    return self;
+}
+
+#pragma mark - Getters
+
+- (CSCircuitBreakerState)state {
+    return CSCircuitBreakerStateOfWord(atomic_load(&_state));
+}
+
+#pragma mark - State Transitions
+
+- (void)resetWindowAtTime:(uint64_t)now {
+    
+    atomic_store(&_windowStartTime, now);
+    atomic_store(&_requestsCount, 0);
+    atomic_store(&_failuresCount, 0);
+    atomic_store(&_slowRequestsCount, 0);
+}
+
+/**
+ *  Opening time is written by the same compare and swap which opens circuit, so thread which loses the race can't move it and thread which sees open state never reads older one.
+ */
+- (BOOL)openFromState:(CSCircuitBreakerState)state atTime:(uint64_t)now {
+    
+    uint64_t expected = atomic_load(&_state);
+    while (CSCircuitBreakerStateOfWord(expected) == state) {
+        if (atomic_compare_exchange_weak(&_state, &expected, CSCircuitBreakerWord(CSCircuitBreakerStateOpen, now))) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+- (void)closeFromHalfOpenAtTime:(uint64_t)now {
+    
+    uint64_t expected = atomic_load(&_state);
+    while (CSCircuitBreakerStateOfWord(expected) == CSCircuitBreakerStateHalfOpen) {
+        if (atomic_compare_exchange_weak(&_state, &expected, CSCircuitBreakerWord(CSCircuitBreakerStateClosed, 0))) {
+            [self resetWindowAtTime:now];
+            return;
+        }
+    }
+}
+
+/**
+ *  Result of request sent before circuit became half open can arrive while it is, so counter never goes below zero.
+ */
+- (void)releaseProbe {
+    
+    uint32_t probesCount = atomic_load(&_probesCount);
+    while (probesCount && !atomic_compare_exchange_weak(&_probesCount, &probesCount, probesCount - 1)) {
+    }
+}
+
+#pragma mark - Requests
+
+- (BOOL)allowRequest {
+    
+    uint64_t word = atomic_load(&_state);
+    CSCircuitBreakerState state = CSCircuitBreakerStateOfWord(word);
+    if (state == CSCircuitBreakerStateClosed) {
+        return YES;
+    }
+    
+    if (state == CSCircuitBreakerStateOpen) {
+        
+        uint64_t openedTime = CSCircuitBreakerOpenedTimeOfWord(word);
+        if (CSThrottleNow() - openedTime < CSThrottleMicroseconds(_openInterval)) {
+            return NO;
+        }
+        
+        //nobody takes probes while open so counter can be cleared before state changes, circuit opened again meanwhile isn't touched
+        atomic_store(&_probesCount, 0);
+        uint64_t expected = word;
+        if (!atomic_compare_exchange_strong(&_state, &expected, CSCircuitBreakerWord(CSCircuitBreakerStateHalfOpen, openedTime)) &&
+            CSCircuitBreakerStateOfWord(expected) != CSCircuitBreakerStateHalfOpen) {
+            return (CSCircuitBreakerStateOfWord(expected) == CSCircuitBreakerStateClosed);
+        }
+    }
+    
+    uint32_t probesCount = atomic_fetch_add(&_probesCount, 1);
+    if (probesCount < _probeRequestsCount) {
+        return YES;
+    }
+    atomic_fetch_sub(&_probesCount, 1);
+    return NO;
+}
+
+- (void)recordSuccessWithDuration:(NSTimeInterval)duration {
+    
+    uint64_t now = CSThrottleNow();
+    CSCircuitBreakerState state = self.state;
+    
+    if (state == CSCircuitBreakerStateHalfOpen) {
+        
+        [self releaseProbe];
+        [self closeFromHalfOpenAtTime:now];
+        return;
+    }
+    if (state == CSCircuitBreakerStateOpen) {
+        //request was sent before circuit opened
+        return;
+    }
+    
+    [self countResultAtTime:now failed:NO slow:(duration >= _slowRequestDuration)];
+}
+
+- (void)recordFailure {
+    
+    uint64_t now = CSThrottleNow();
+    CSCircuitBreakerState state = self.state;
+    
+    if (state == CSCircuitBreakerStateHalfOpen) {
+        
+        [self releaseProbe];
+        [self openFromState:CSCircuitBreakerStateHalfOpen atTime:now];
+        return;
+    }
+    if (state == CSCircuitBreakerStateOpen) {
+        return;
+    }
+    
+    [self countResultAtTime:now failed:YES slow:NO];
+}
+
+- (void)recordCancellation {
+    
+    if (self.state == CSCircuitBreakerStateHalfOpen) {
+        [self releaseProbe];
+    }
+}
+
+- (void)countResultAtTime:(uint64_t)now failed:(BOOL)failed slow:(BOOL)slow {
+    
+    uint64_t windowStartTime = atomic_load(&_windowStartTime);
+    if (now - windowStartTime >= CSThrottleMicroseconds(_windowInterval) &&
+        atomic_compare_exchange_strong(&_windowStartTime, &windowStartTime, now)) {
+        
+        atomic_store(&_requestsCount, 0);
+        atomic_store(&_failuresCount, 0);
+        atomic_store(&_slowRequestsCount, 0);
+    }
+    
+    uint32_t requestsCount = atomic_fetch_add(&_requestsCount, 1) + 1;
+    uint32_t failuresCount = (failed ? atomic_fetch_add(&_failuresCount, 1) + 1 : atomic_load(&_failuresCount));
+    uint32_t slowRequestsCount = (slow ? atomic_fetch_add(&_slowRequestsCount, 1) + 1 : atomic_load(&_slowRequestsCount));
+    
+    if (requestsCount < _minimumRequestsCount) {
+        return;
+    }
+    
+    if (failuresCount >= _failureRateThreshold * requestsCount ||
+        slowRequestsCount >= _slowRequestRateThreshold * requestsCount) {
+        
+        if ([self openFromState:CSCircuitBreakerStateClosed atTime:now]) {
+            CSLog(@"Circuit opened after %u failed and %u slow of %u requests", failuresCount, slowRequestsCount, requestsCount);
+        }
+    }
+}
+
+- (void)reset {
+    
+    atomic_store(&_state, CSCircuitBreakerWord(CSCircuitBreakerStateClosed, 0));
+    atomic_store(&_probesCount, 0);
+    [self resetWindowAtTime:CSThrottleNow()];
+}
+
+@end
@@ -0,0 +1,87 @@
+//
+//  CSMultipartBody.h
+//  CSUtils
+//
+//  Created by Josip Bernat on 15/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ *  CSMultipartBody builds multipart/form-data body without concatenating it. Part headers and short values are rendered into single arena buffer, body is list of segments pointing into arena, data objects and file ranges. Body is sent from inputStream which copies segments straight into buffer of the connection and reads files only while they are being sent.
+ */
+@interface CSMultipartBody : NSObject
+
+/**
+ *  Boundary separating parts.
+ */
+@property (nonatomic, strong, readonly) NSString *boundary;
+
+/**
+ *  Value of Content-Type header including boundary.
+ */
+@property (nonatomic, strong, readonly) NSString *contentType;
+
+/**
+ *  Total length of body including closing boundary.
+ */
+@property (nonatomic, readonly) unsigned long long contentLength;
+
+/**
+ *  Number of segments body consists of.
+ */
+@property (nonatomic, readonly) NSUInteger segmentsCount;
+
+#pragma mark - Initialization
+
+/**
+ *  Creates empty body.
+ *
+ *  @param boundary Boundary separating parts. NSInvalidArgumentException is raised if boundary is nil.
+ *
+ *  @return New instance of CSMultipartBody.
+ */
+- (instancetype)initWithBoundary:(NSString *)boundary; //designated initializer
+
+#pragma mark - Appending Parts
+
+/**
+ *  Appends text field.
+ */
+- (void)appendParameterWithName:(NSString *)name value:(NSString *)value;
+
+/**
+ *  Appends all string keys and values of given dictionary as text fields. Other pairs are skipped.
+ */
+- (void)appendParameters:(NSDictionary *)parameters;
+
+/**
+ *  Appends file field with given data. Data is referenced, not copied.
+ */
+- (void)appendData:(NSData *)data
+          withName:(NSString *)name
+          fileName:(NSString *)fileName
+          mimeType:(NSString *)mimeType;
+
+/**
+ *  Appends file field whose content is read from file while body is being sent.
+ *
+ *  @param error On return contains error if file doesn't exist or can't be read.
+ *
+ *  @return NO if file can't be appended.
+ */
+- (BOOL)appendFileAtPath:(NSString *)filePath
+                withName:(NSString *)name
+                fileName:(NSString *)fileName
+                mimeType:(NSString *)mimeType
+                   error:(NSError **)error;
+
+#pragma mark - Sending
+
+/**
+ *  Returns new stream reading body from the beginning. Closing boundary is added the first time stream is created and no parts can be appended after it.
+ */
+- (NSInputStream *)inputStream;
+
+@end
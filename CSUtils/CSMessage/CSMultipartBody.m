@@ -0,0 +1,535 @@
+//
+//  CSMultipartBody.m
+//  CSUtils
+//
+//  Created by Josip Bernat on 15/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import "CSMultipartBody.h"
+#import "CSPercentEncoding.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/**
+ *  Values up to this length are copied into arena together with their headers, longer ones are referenced.
+ */
+#define CSMultipartInlineValueLength 1024
+
+#define CSMultipartAppendLiteral(body, literal) [body appendArenaBytes:literal length:sizeof(literal) - 1]
+
+typedef enum {
+    CSMultipartSegmentTypeArena = 0,
+    CSMultipartSegmentTypeData,
+    CSMultipartSegmentTypeFile
+} CSMultipartSegmentType;
+
+/**
+ *  Arena segments store offset into arena because arena can move while body is built. Data and file segments store index of their object.
+ */
+typedef struct {
+    CSMultipartSegmentType type;
+    NSUInteger objectIndex;
+    unsigned long long offset;
+    unsigned long long length;
+} CSMultipartSegment;
+
+@interface CSMultipartBody () {
+    
+    CSByteBuffer _arena;
+    CSMultipartSegment *_segments;
+    NSUInteger _segmentsCapacity;
+    BOOL _finished;
+}
+
+@property (nonatomic, strong, readwrite) NSString *boundary;
+@property (nonatomic, readwrite) unsigned long long contentLength;
+@property (nonatomic, readwrite) NSUInteger segmentsCount;
+@property (nonatomic, strong) NSData *boundaryLine;
+@property (nonatomic, strong) NSMutableArray *objects;
+
+- (const CSMultipartSegment *)segmentAtIndex:(NSUInteger)index;
+- (const uint8_t *)arenaBytes;
+- (id)objectAtIndex:(NSUInteger)index;
+
+@end
+
+#pragma mark - Interface CSMultipartBodyStream
+
+/**
+ *  Stream sending segments of body. NSURLConnection reads it synchronously from its own thread so stream never sends events.
+ */
+@interface CSMultipartBodyStream : NSInputStream {
+    
+    CSMultipartBody *_body;
+    NSUInteger _segmentIndex;
+    unsigned long long _segmentOffset;
+    int _fileDescriptor;
+    NSStreamStatus _streamStatus;
+    NSError *_streamError;
+    __weak id<NSStreamDelegate> _delegate;
+}
+
+- (instancetype)initWithBody:(CSMultipartBody *)body;
+
+@end
+
+#pragma mark - Implementation CSMultipartBody
+
+@implementation CSMultipartBody
+
+#pragma mark - Memory Management
+
+- (void)dealloc {
+    
+    CSByteBufferFree(&_arena);
+    free(_segments);
+}
+
+#pragma mark - Initialization
+
+- (id)init {
+    return [self initWithBoundary:nil];
+}
+
+- (instancetype)initWithBoundary:(NSString *)boundary {
+    
+    if (!boundary) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"boundary can't be nil"
+                               userInfo:nil] raise];
+    }
+    
+    if (self = [super init]) {
+        
+        _boundary = [boundary copy];
+        _objects = [[NSMutableArray alloc] init];
+        
+        //boundary is encoded once, first part skips leading line break
+        _boundaryLine = [[NSString stringWithFormat:@"\r\n--%@", boundary] dataUsingEncoding:NSUTF8StringEncoding];
+        
+        if (!CSByteBufferInit(&_arena, 1024)) {
+            [[NSException exceptionWithName:NSMallocException
+                                     reason:@"Unable to allocate multipart arena"
+                                   userInfo:nil] raise];
+        }
+    }
+    return self;
+}
+
+#pragma mark - Getters
+
+- (NSString *)contentType {
+    return [NSString stringWithFormat:@"multipart/form-data; boundary=%@", self.boundary];
+}
+
+- (const CSMultipartSegment *)segmentAtIndex:(NSUInteger)index {
+    return &_segments[index];
+}
+
+- (const uint8_t *)arenaBytes {
+    return _arena.bytes;
+}
+
+- (id)objectAtIndex:(NSUInteger)index {
+    return self.objects[index];
+}
+
+#pragma mark - Segments
+
+- (CSMultipartSegment *)addSegmentOfType:(CSMultipartSegmentType)type length:(unsigned long long)length {
+    
+    if (_segmentsCount == _segmentsCapacity) {
+        
+        NSUInteger capacity = MAX(_segmentsCapacity * 2, 16);
+        CSMultipartSegment *segments = realloc(_segments, capacity * sizeof(CSMultipartSegment));
+        if (!segments) {
+            [[NSException exceptionWithName:NSMallocException
+                                     reason:@"Unable to allocate multipart segments"
+                                   userInfo:nil] raise];
+        }
+        _segments = segments;
+        _segmentsCapacity = capacity;
+    }
+    
+    CSMultipartSegment *segment = &_segments[_segmentsCount++];
+    segment->type = type;
+    segment->objectIndex = 0;
+    segment->offset = 0;
+    segment->length = length;
+    
+    _contentLength += length;
+    return segment;
+}
+
+/**
+ *  Copies bytes into arena. Bytes following previous arena segment extend it so consecutive headers are single segment.
+ */
+- (void)appendArenaBytes:(const void *)bytes length:(size_t)length {
+    
+    if (!length) {
+        return;
+    }
+    
+    if (_finished) {
+        [[NSException exceptionWithName:NSInternalInconsistencyException
+                                 reason:@"Parts can't be appended after inputStream was created"
+                               userInfo:nil] raise];
+    }
+    
+    size_t offset = _arena.length;
+    if (!CSByteBufferAppend(&_arena, bytes, length)) {
+        [[NSException exceptionWithName:NSMallocException
+                                 reason:@"Unable to grow multipart arena"
+                               userInfo:nil] raise];
+    }
+    
+    CSMultipartSegment *lastSegment = (_segmentsCount ? &_segments[_segmentsCount - 1] : NULL);
+    if (lastSegment && lastSegment->type == CSMultipartSegmentTypeArena && lastSegment->offset + lastSegment->length == offset) {
+        
+        lastSegment->length += length;
+        _contentLength += length;
+        return;
+    }
+    
+    CSMultipartSegment *segment = [self addSegmentOfType:CSMultipartSegmentTypeArena length:length];
+    segment->offset = offset;
+}
+
+- (void)appendArenaString:(NSString *)string {
+    
+    const char *bytes = [string UTF8String];
+    if (bytes) {
+        [self appendArenaBytes:bytes length:strlen(bytes)];
+    }
+}
+
+- (void)appendObject:(id)object type:(CSMultipartSegmentType)type length:(unsigned long long)length {
+    
+    if (!length) {
+        return;
+    }
+    
+    CSMultipartSegment *segment = [self addSegmentOfType:type length:length];
+    segment->objectIndex = self.objects.count;
+    [self.objects addObject:object];
+}
+
+- (void)appendHeadersWithName:(NSString *)name fileName:(NSString *)fileName mimeType:(NSString *)mimeType {
+    
+    NSUInteger skip = (_contentLength ? 0 : 2);
+    [self appendArenaBytes:(const uint8_t *)self.boundaryLine.bytes + skip length:self.boundaryLine.length - skip];
+    
+    CSMultipartAppendLiteral(self, "\r\nContent-Disposition: form-data; name=\"");
+    [self appendArenaString:name];
+    CSMultipartAppendLiteral(self, "\"");
+    
+    if (fileName) {
+        CSMultipartAppendLiteral(self, "; filename=\"");
+        [self appendArenaString:fileName];
+        CSMultipartAppendLiteral(self, "\"");
+    }
+    CSMultipartAppendLiteral(self, "\r\n");
+    
+    if (mimeType) {
+        CSMultipartAppendLiteral(self, "Content-Type: ");
+        [self appendArenaString:mimeType];
+        CSMultipartAppendLiteral(self, "\r\n");
+    }
+    CSMultipartAppendLiteral(self, "\r\n");
+}
+
+#pragma mark - Appending Parts
+
+- (void)appendParameterWithName:(NSString *)name value:(NSString *)value {
+    
+    if (!name || !value) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"name and value can't be nil"
+                               userInfo:nil] raise];
+    }
+    
+    [self appendHeadersWithName:name fileName:nil mimeType:nil];
+    
+    const char *bytes = [value UTF8String];
+    size_t length = (bytes ? strlen(bytes) : 0);
+    if (length <= CSMultipartInlineValueLength) {
+        [self appendArenaBytes:bytes length:length];
+    }
+    else {
+        [self appendObject:[NSData dataWithBytes:bytes length:length] type:CSMultipartSegmentTypeData length:length];
+    }
+}
+
+- (void)appendParameters:(NSDictionary *)parameters {
+    
+    [parameters enumerateKeysAndObjectsUsingBlock:^(id name, id value, BOOL *stop) {
+        if ([name isKindOfClass:[NSString class]] && [value isKindOfClass:[NSString class]]) {
+            [self appendParameterWithName:name value:value];
+        }
+    }];
+}
+
+- (void)appendData:(NSData *)data
+          withName:(NSString *)name
+          fileName:(NSString *)fileName
+          mimeType:(NSString *)mimeType {
+    
+    if (!data || !name) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"data and name can't be nil"
+                               userInfo:nil] raise];
+    }
+    
+    [self appendHeadersWithName:name fileName:fileName mimeType:mimeType];
+    [self appendObject:data type:CSMultipartSegmentTypeData length:data.length];
+}
+
+- (BOOL)appendFileAtPath:(NSString *)filePath
+                withName:(NSString *)name
+                fileName:(NSString *)fileName
+                mimeType:(NSString *)mimeType
+                   error:(NSError **)error {
+    
+    if (!filePath || !name) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"filePath and name can't be nil"
+                               userInfo:nil] raise];
+    }
+    
+    struct stat fileStat;
+    if (stat([filePath fileSystemRepresentation], &fileStat) != 0 || !S_ISREG(fileStat.st_mode)) {
+        
+        if (error) {
+            *error = [NSError errorWithDomain:NSPOSIXErrorDomain
+                                         code:(errno ? errno : EINVAL)
+                                     userInfo:@{NSFilePathErrorKey : filePath}];
+        }
+        return NO;
+    }
+    
+    [self appendHeadersWithName:name fileName:fileName mimeType:mimeType];
+    [self appendObject:[filePath copy] type:CSMultipartSegmentTypeFile length:(unsigned long long)fileStat.st_size];
+    return YES;
+}
+
+#pragma mark - Sending
+
+- (NSInputStream *)inputStream {
+    
+    @synchronized(self) {
+        
+        if (!_finished) {
+            
+            NSUInteger skip = (_contentLength ? 0 : 2);
+            [self appendArenaBytes:(const uint8_t *)self.boundaryLine.bytes + skip length:self.boundaryLine.length - skip];
+            CSMultipartAppendLiteral(self, "--\r\n");
+            _finished = YES;
+        }
+    }
+    return [[CSMultipartBodyStream alloc] initWithBody:self];
+}
+
+@end
+
+#pragma mark - Implementation CSMultipartBodyStream
+
+@implementation CSMultipartBodyStream
+
+#pragma mark - Memory Management
+
+- (void)dealloc {
+    
+    if (_fileDescriptor >= 0) {
+        close(_fileDescriptor);
+    }
+}
+
+#pragma mark - Initialization
+
+- (instancetype)initWithBody:(CSMultipartBody *)body {
+    
+    if (self = [super init]) {
+        
+        _body = body;
+        _fileDescriptor = -1;
+        _streamStatus = NSStreamStatusNotOpen;
+    }
+    return self;
+}
+
+#pragma mark - Reading Segments
+
+- (void)closeFile {
+    
+    if (_fileDescriptor >= 0) {
+        close(_fileDescriptor);
+        _fileDescriptor = -1;
+    }
+}
+
+- (void)failWithErrno {
+    
+    _streamError = [NSError errorWithDomain:NSPOSIXErrorDomain code:(errno ? errno : EIO) userInfo:nil];
+    _streamStatus = NSStreamStatusError;
+    [self closeFile];
+}
+
+/**
+ *  Reads up to length bytes of current segment into buffer.
+ *
+ *  @return Number of bytes read or -1 on error.
+ */
+- (NSInteger)readSegment:(const CSMultipartSegment *)segment intoBuffer:(uint8_t *)buffer length:(NSUInteger)length {
+    
+    switch (segment->type) {
+            
+        case CSMultipartSegmentTypeArena:
+            memcpy(buffer, [_body arenaBytes] + segment->offset + _segmentOffset, length);
+            return (NSInteger)length;
+            
+        case CSMultipartSegmentTypeData: {
+            
+            NSData *data = [_body objectAtIndex:segment->objectIndex];
+            memcpy(buffer, (const uint8_t *)data.bytes + _segmentOffset, length);
+            return (NSInteger)length;
+        }
+        case CSMultipartSegmentTypeFile: {
+            
+            if (_fileDescriptor < 0) {
+                _fileDescriptor = open([[_body objectAtIndex:segment->objectIndex] fileSystemRepresentation], O_RDONLY);
+                if (_fileDescriptor < 0) {
+                    return -1;
+                }
+            }
+            
+            ssize_t result;
+            do {
+                result = pread(_fileDescriptor, buffer, length, (off_t)_segmentOffset);
+            } while (result < 0 && errno == EINTR);
+            
+            //file got shorter after it was appended
+            if (result == 0) {
+                errno = EIO;
+                return -1;
+            }
+            return result;
+        }
+    }
+    return -1;
+}
+
+#pragma mark - NSInputStream Override
+
+- (NSInteger)read:(uint8_t *)buffer maxLength:(NSUInteger)length {
+    
+    if (_streamStatus != NSStreamStatusOpen) {
+        return (_streamStatus == NSStreamStatusAtEnd ? 0 : -1);
+    }
+    
+    NSUInteger totalLength = 0;
+    NSUInteger segmentsCount = _body.segmentsCount;
+    
+    while (totalLength < length && _segmentIndex < segmentsCount) {
+        
+        const CSMultipartSegment *segment = [_body segmentAtIndex:_segmentIndex];
+        unsigned long long remaining = segment->length - _segmentOffset;
+        NSUInteger chunkLength = (NSUInteger)MIN(remaining, (unsigned long long)(length - totalLength));
+        
+        NSInteger result = [self readSegment:segment intoBuffer:buffer + totalLength length:chunkLength];
+        if (result < 0) {
+            [self failWithErrno];
+            return -1;
+        }
+        
+        totalLength += (NSUInteger)result;
+        _segmentOffset += (unsigned long long)result;
+        
+        if (_segmentOffset == segment->length) {
+            
+            if (segment->type == CSMultipartSegmentTypeFile) {
+                [self closeFile];
+            }
+            _segmentIndex++;
+            _segmentOffset = 0;
+        }
+    }
+    
+    if (_segmentIndex == segmentsCount) {
+        _streamStatus = NSStreamStatusAtEnd;
+    }
+    return (NSInteger)totalLength;
+}
+
+- (BOOL)getBuffer:(uint8_t **)buffer length:(NSUInteger *)length {
+    return NO;
+}
+
+- (BOOL)hasBytesAvailable {
+    return (_streamStatus == NSStreamStatusOpen);
+}
+
+#pragma mark - NSStream Override
+
+- (void)open {
+    
+    if (_streamStatus == NSStreamStatusNotOpen) {
+        _streamStatus = (_body.segmentsCount ? NSStreamStatusOpen : NSStreamStatusAtEnd);
+    }
+}
+
+- (void)close {
+    
+    [self closeFile];
+    _streamStatus = NSStreamStatusClosed;
+}
+
+- (NSStreamStatus)streamStatus {
+    return _streamStatus;
+}
+
+- (NSError *)streamError {
+    return _streamError;
+}
+
+- (id<NSStreamDelegate>)delegate {
+    return _delegate;
+}
+
+- (void)setDelegate:(id<NSStreamDelegate>)delegate {
+    _delegate = delegate;
+}
+
+- (id)propertyForKey:(NSString *)key {
+    return nil;
+}
+
+- (BOOL)setProperty:(id)property forKey:(NSString *)key {
+    return NO;
+}
+
+- (void)scheduleInRunLoop:(NSRunLoop *)aRunLoop forMode:(NSString *)mode {
+}
+
+- (void)removeFromRunLoop:(NSRunLoop *)aRunLoop forMode:(NSString *)mode {
+}
+
+#pragma mark - CFReadStream Bridging
+
+/**
+ *  NSURLConnection schedules body stream through CFReadStream functions which call these methods on NSInputStream subclasses.
+ */
+- (void)_scheduleInCFRunLoop:(CFRunLoopRef)runLoop forMode:(CFStringRef)mode {
+}
+
+- (void)_unscheduleFromCFRunLoop:(CFRunLoopRef)runLoop forMode:(CFStringRef)mode {
+}
+
+- (BOOL)_setCFClientFlags:(CFOptionFlags)flags
+                 callback:(CFReadStreamClientCallBack)callback
+                  context:(CFStreamClientContext *)context {
+    return NO;
+}
+
+@end
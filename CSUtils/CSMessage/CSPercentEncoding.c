@@ -0,0 +1,228 @@
+//
+//  CSPercentEncoding.c
+//  CSUtils
+//
+//  Created by Josip Bernat on 24/02/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#include "CSPercentEncoding.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#   include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#   include <arm_neon.h>
+#endif
+
+/**
+ *  1 for bytes which are copied as they are, 0 for bytes which are escaped. Matches characters left unescaped by CSURLEncodedStringFromStringWithEncoding.
+ */
+static const uint8_t CSPercentEncodingUnreservedTable[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0,  // - .
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,  // 0-9
+    0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // A-O
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 1,  // P-Z _
+    0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // a-o
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0,  // p-z
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+static const char CSPercentEncodingHexDigits[16] = {
+    '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'
+};
+
+#pragma mark - Byte Buffer
+
+bool CSByteBufferInit(CSByteBuffer *buffer, size_t capacity) {
+
+    buffer->bytes = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+
+    return CSByteBufferReserve(buffer, capacity);
+}
+
+bool CSByteBufferReserve(CSByteBuffer *buffer, size_t additionalLength) {
+
+    if (additionalLength > SIZE_MAX - buffer->length) {
+        return false;
+    }
+
+    size_t requiredCapacity = buffer->length + additionalLength;
+    if (requiredCapacity <= buffer->capacity) {
+        return true;
+    }
+
+    size_t capacity = (buffer->capacity ? buffer->capacity : 64);
+    while (capacity < requiredCapacity) {
+        capacity = (capacity > SIZE_MAX / 2 ? requiredCapacity : capacity * 2);
+    }
+
+    uint8_t *bytes = realloc(buffer->bytes, capacity);
+    if (!bytes) {
+        return false;
+    }
+    buffer->bytes = bytes;
+    buffer->capacity = capacity;
+
+    return true;
+}
+
+bool CSByteBufferAppend(CSByteBuffer *buffer, const void *bytes, size_t length) {
+
+    if (!length) {
+        return true;
+    }
+    if (!CSByteBufferReserve(buffer, length)) {
+        return false;
+    }
+    memcpy(buffer->bytes + buffer->length, bytes, length);
+    buffer->length += length;
+
+    return true;
+}
+
+void CSByteBufferReset(CSByteBuffer *buffer) {
+    buffer->length = 0;
+}
+
+void CSByteBufferFree(CSByteBuffer *buffer) {
+
+    free(buffer->bytes);
+    buffer->bytes = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+}
+
+uint8_t *CSByteBufferDetach(CSByteBuffer *buffer, size_t *length) {
+
+    uint8_t *bytes = buffer->bytes;
+    if (length) {
+        *length = buffer->length;
+    }
+
+    buffer->bytes = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+
+    return bytes;
+}
+
+#pragma mark - Unreserved Runs
+
+#if defined(__SSE2__)
+
+/**
+ *  Returns 16 bit mask with bit set for every byte in block which is copied without escaping.
+ */
+static inline unsigned CSPercentEncodingUnreservedMask(__m128i block) {
+
+    // unsigned (value - low) <= span is same as low <= value <= low + span
+    __m128i lower = _mm_or_si128(block, _mm_set1_epi8(0x20));
+    __m128i alpha = _mm_sub_epi8(lower, _mm_set1_epi8('a'));
+    alpha = _mm_cmpeq_epi8(_mm_min_epu8(alpha, _mm_set1_epi8(25)), alpha);
+
+    __m128i digit = _mm_sub_epi8(block, _mm_set1_epi8('0'));
+    digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+
+    __m128i dash = _mm_sub_epi8(block, _mm_set1_epi8('-'));
+    dash = _mm_cmpeq_epi8(_mm_min_epu8(dash, _mm_set1_epi8(1)), dash);
+
+    __m128i underscore = _mm_cmpeq_epi8(block, _mm_set1_epi8('_'));
+
+    __m128i unreserved = _mm_or_si128(_mm_or_si128(alpha, digit), _mm_or_si128(dash, underscore));
+    return (unsigned)_mm_movemask_epi8(unreserved);
+}
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+static inline bool CSPercentEncodingIsUnreservedBlock(uint8x16_t block) {
+
+    uint8x16_t lower = vorrq_u8(block, vdupq_n_u8(0x20));
+    uint8x16_t alpha = vcleq_u8(vsubq_u8(lower, vdupq_n_u8('a')), vdupq_n_u8(25));
+    uint8x16_t digit = vcleq_u8(vsubq_u8(block, vdupq_n_u8('0')), vdupq_n_u8(9));
+    uint8x16_t dash = vcleq_u8(vsubq_u8(block, vdupq_n_u8('-')), vdupq_n_u8(1));
+    uint8x16_t underscore = vceqq_u8(block, vdupq_n_u8('_'));
+
+    uint8x16_t unreserved = vorrq_u8(vorrq_u8(alpha, digit), vorrq_u8(dash, underscore));
+    return (vminvq_u8(unreserved) == 0xFF);
+}
+
+#endif
+
+size_t CSPercentEncodingUnreservedPrefixLength(const uint8_t *bytes, size_t length) {
+
+    size_t index = 0;
+
+#if defined(__SSE2__)
+    while (index + 16 <= length) {
+
+        unsigned mask = CSPercentEncodingUnreservedMask(_mm_loadu_si128((const __m128i *)(bytes + index)));
+        if (mask != 0xFFFF) {
+            return index + (size_t)__builtin_ctz(~mask);
+        }
+        index += 16;
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    while (index + 16 <= length && CSPercentEncodingIsUnreservedBlock(vld1q_u8(bytes + index))) {
+        index += 16;
+    }
+#endif
+
+    while (index < length && CSPercentEncodingUnreservedTable[bytes[index]]) {
+        index++;
+    }
+    return index;
+}
+
+#pragma mark - Encoding
+
+bool CSPercentEncodeBytes(CSByteBuffer *buffer, const uint8_t *bytes, size_t length) {
+
+    if (!length) {
+        return true;
+    }
+
+    // worst case every byte is escaped, reserve once and write without further checks
+    if (length > SIZE_MAX / 3 || !CSByteBufferReserve(buffer, length * 3)) {
+        return false;
+    }
+
+    uint8_t *output = buffer->bytes + buffer->length;
+    size_t index = 0;
+
+    while (index < length) {
+
+        size_t runLength = CSPercentEncodingUnreservedPrefixLength(bytes + index, length - index);
+        if (runLength) {
+            memcpy(output, bytes + index, runLength);
+            output += runLength;
+            index += runLength;
+        }
+
+        // escape following reserved bytes, usually there are only a few in a row
+        while (index < length && !CSPercentEncodingUnreservedTable[bytes[index]]) {
+
+            uint8_t byte = bytes[index++];
+            output[0] = '%';
+            output[1] = (uint8_t)CSPercentEncodingHexDigits[byte >> 4];
+            output[2] = (uint8_t)CSPercentEncodingHexDigits[byte & 0x0F];
+            output += 3;
+        }
+    }
+
+    buffer->length = (size_t)(output - buffer->bytes);
+    return true;
+}
@@ -0,0 +1,83 @@
+//
+//  CSPercentEncoding.h
+//  CSUtils
+//
+//  Created by Josip Bernat on 24/02/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#ifndef CSUtils_CSPercentEncoding_h
+#define CSUtils_CSPercentEncoding_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  Growable byte buffer used as output of percent encoding functions. Buffer can be reused by resetting its length.
+ */
+typedef struct CSByteBuffer {
+    uint8_t *bytes;
+    size_t length;
+    size_t capacity;
+} CSByteBuffer;
+
+/**
+ *  Initializes buffer with given capacity. Capacity can be 0.
+ *
+ *  @return true if storage was allocated, otherwise false.
+ */
+bool CSByteBufferInit(CSByteBuffer *buffer, size_t capacity);
+
+/**
+ *  Makes sure buffer can hold additionalLength more bytes without reallocation.
+ *
+ *  @return true if buffer has enough capacity, otherwise false.
+ */
+bool CSByteBufferReserve(CSByteBuffer *buffer, size_t additionalLength);
+
+/**
+ *  Appends bytes to the end of the buffer without encoding.
+ *
+ *  @return true if bytes were appended, otherwise false.
+ */
+bool CSByteBufferAppend(CSByteBuffer *buffer, const void *bytes, size_t length);
+
+/**
+ *  Sets buffer length to 0 and keeps allocated storage for reuse.
+ */
+void CSByteBufferReset(CSByteBuffer *buffer);
+
+/**
+ *  Releases buffer storage. Buffer can be initialized again.
+ */
+void CSByteBufferFree(CSByteBuffer *buffer);
+
+/**
+ *  Takes ownership of buffer storage. Returned pointer must be released with free(). Buffer is left empty.
+ *
+ *  @return Pointer to buffer bytes or NULL if buffer is empty.
+ */
+uint8_t *CSByteBufferDetach(CSByteBuffer *buffer, size_t *length);
+
+/**
+ *  Appends percent encoded UTF-8 bytes to the buffer. Only ALPHA, DIGIT, '-', '.' and '_' are left unescaped, everything else is written as %XX with uppercase hex digits.
+ *
+ *  @return true if bytes were appended, otherwise false.
+ */
+bool CSPercentEncodeBytes(CSByteBuffer *buffer, const uint8_t *bytes, size_t length);
+
+/**
+ *  Returns number of leading bytes which can be copied without escaping.
+ */
+size_t CSPercentEncodingUnreservedPrefixLength(const uint8_t *bytes, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,79 @@
+//
+//  CSResponseBuffer.h
+//  CSUtils
+//
+//  Created by Josip Bernat on 17/02/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ *  Block object used to enumerate buffer segments. Bytes are valid only during the block invocation.
+ */
+typedef void (^CSResponseBufferSegmentBlock)(const void *bytes, NSRange byteRange, BOOL *stop);
+
+/**
+ *  CSResponseBuffer collects response body chunks received from NSURLConnection. When expected content length is known storage is allocated once up front, otherwise received chunks are kept as a list of segments and joined only when contiguous bytes are requested. CSResponseBuffer is not thread safe.
+ */
+@interface CSResponseBuffer : NSObject
+
+/**
+ *  Number of bytes appended to the buffer.
+ */
+@property (nonatomic, readonly) NSUInteger length;
+
+/**
+ *  Number of bytes copied by the buffer while appending or joining segments. Useful for measuring buffering overhead.
+ */
+@property (nonatomic, readonly) unsigned long long copiedLength;
+
+/**
+ *  Number of bytes allocated by the buffer for its own storage. Segments retained without copying are not included.
+ */
+@property (nonatomic, readonly) unsigned long long allocatedLength;
+
+#pragma mark - Initialization
+
+/**
+ *  Creates new buffer ready for given content length.
+ *
+ *  @param expectedLength Expected length of response body, usually NSURLResponse expectedContentLength. Pass NSURLResponseUnknownLength if length is not known.
+ *
+ *  @return New instance of CSResponseBuffer.
+ */
+- (instancetype)initWithExpectedLength:(long long)expectedLength; //designated initializer
+
+#pragma mark - Appending Data
+
+/**
+ *  Appends given data to the end of the buffer. Buffer can't be appended to after its content was returned by data method until it's reset.
+ *
+ *  @param data Data object received from NSURLConnection.
+ */
+- (void)appendData:(NSData *)data;
+
+/**
+ *  Removes all bytes from the buffer and prepares it for given content length.
+ *
+ *  @param expectedLength Expected length of response body or NSURLResponseUnknownLength.
+ */
+- (void)resetWithExpectedLength:(long long)expectedLength;
+
+#pragma mark - Reading Data
+
+/**
+ *  Returns buffer content as contiguous bytes. Preallocated storage is handed over without copying, more than one segment is joined once. The same immutable object is returned for following calls and buffer doesn't accept more data until it's reset.
+ *
+ *  @return Immutable data object containing all appended bytes.
+ */
+- (NSData *)data;
+
+/**
+ *  Enumerates buffer segments in order without joining them. Suitable for incremental parsers.
+ *
+ *  @param block Block object called for each segment. byteRange location is an offset of the segment in the buffer.
+ */
+- (void)enumerateSegmentsUsingBlock:(CSResponseBufferSegmentBlock)block;
+
+@end
@@ -0,0 +1,166 @@
+//
+//  CSResponseBuffer.m
+//  CSUtils
+//
+//  Created by Josip Bernat on 17/02/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import "CSResponseBuffer.h"
+#import "CSSegmentBuffer.h"
+
+static void CSResponseBufferReleaseData(void *owner) {
+    CFRelease(owner);
+}
+
+@interface CSResponseBuffer () {
+
+    CSSegmentBuffer _buffer;
+
+    /**
+     *  Content returned by data method. Buffer doesn't accept more data while it's set.
+     */
+    NSData *_data;
+}
+
+@end
+
+@implementation CSResponseBuffer
+
+#pragma mark - Memory Management
+
+- (void)dealloc {
+    CSSegmentBufferFree(&_buffer);
+}
+
+#pragma mark - Initialization
+
+- (instancetype)init {
+    return [self initWithExpectedLength:NSURLResponseUnknownLength];
+}
+
+- (instancetype)initWithExpectedLength:(long long)expectedLength {
+
+    if (self = [super init]) {
+
+        CSSegmentBufferInit(&_buffer, CSResponseBufferReleaseData);
+        [self resetWithExpectedLength:expectedLength];
+    }
+    return self;
+}
+
+- (void)resetWithExpectedLength:(long long)expectedLength {
+
+    _data = nil;
+    CSSegmentBufferReset(&_buffer, expectedLength);
+}
+
+#pragma mark - Properties
+
+- (NSUInteger)length {
+    return (_data ? _data.length : _buffer.length);
+}
+
+- (unsigned long long)copiedLength {
+    return _buffer.copiedLength;
+}
+
+- (unsigned long long)allocatedLength {
+    return _buffer.allocatedLength;
+}
+
+#pragma mark - Appending Data
+
+- (void)appendData:(NSData *)data {
+
+    if (_data) {
+        [[NSException exceptionWithName:NSInternalInconsistencyException
+                                 reason:@"Data can't be appended after buffer content was returned, reset the buffer first"
+                               userInfo:nil] raise];
+    }
+
+    if (!data.length) {
+        return;
+    }
+
+    //copy of immutable data object is just retained, segment keeps it alive
+    NSData *segment = [data copy];
+    if (!CSSegmentBufferAppend(&_buffer, segment.bytes, segment.length, (__bridge_retained void *)segment)) {
+        [[NSException exceptionWithName:NSMallocException
+                                 reason:@"Unable to allocate response buffer storage"
+                               userInfo:nil] raise];
+    }
+}
+
+#pragma mark - Reading Data
+
+- (NSData *)data {
+
+    if (_data) {
+        return _data;
+    }
+
+    if (!CSSegmentBufferJoin(&_buffer)) {
+        [[NSException exceptionWithName:NSMallocException
+                                 reason:@"Unable to allocate response buffer storage"
+                               userInfo:nil] raise];
+    }
+
+    if (_buffer.isContiguous) {
+
+        size_t length = 0;
+        uint8_t *bytes = CSSegmentBufferDetach(&_buffer, &length);
+        _data = (bytes ? [NSData dataWithBytesNoCopy:bytes length:length freeWhenDone:YES] : [NSData data]);
+    }
+    else if (_buffer.segmentsCount == 1) {
+        //only segment is immutable copy of received data, segment still keeps it alive
+        _data = (__bridge NSData *)_buffer.segments[0].owner;
+    }
+    else {
+        _data = [NSData data];
+    }
+    return _data;
+}
+
+- (void)enumerateSegmentsUsingBlock:(CSResponseBufferSegmentBlock)block {
+
+    if (!block) {
+        return;
+    }
+
+    BOOL stop = NO;
+    if (_data) {
+        if (_data.length) {
+            block(_data.bytes, NSMakeRange(0, _data.length), &stop);
+        }
+        return;
+    }
+
+    if (_buffer.isContiguous) {
+        if (_buffer.length) {
+            block(_buffer.contiguous.bytes, NSMakeRange(0, _buffer.length), &stop);
+        }
+        return;
+    }
+
+    NSUInteger offset = 0;
+    for (size_t i = 0; i < _buffer.segmentsCount && !stop; i++) {
+
+        CSSegmentBufferSegment segment = _buffer.segments[i];
+        block(segment.bytes, NSMakeRange(offset, segment.length), &stop);
+        offset += segment.length;
+    }
+}
+
+#pragma mark - Description
+
+- (NSString *)description {
+
+    return [NSString stringWithFormat:@"<%@: %p> length: %lu, segments: %lu",
+            NSStringFromClass([self class]),
+            self,
+            (unsigned long)self.length,
+            (unsigned long)(_data || _buffer.isContiguous ? 1 : _buffer.segmentsCount)];
+}
+
+@end
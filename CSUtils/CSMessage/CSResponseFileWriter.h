@@ -0,0 +1,73 @@
+//
+//  CSResponseFileWriter.h
+//  CSUtils
+//
+//  Created by Josip Bernat on 19/02/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "CSHTTPAssistance.h"
+
+/**
+ *  CSResponseFileWriter writes response body to temporary file as chunks arrive and moves it to destination path when response is complete. Digest of written bytes can be computed along the way.
+ */
+@interface CSResponseFileWriter : NSObject
+
+/**
+ *  Path at which file will be placed when writer finishes.
+ */
+@property (nonatomic, strong, readonly) NSString *destinationPath;
+
+/**
+ *  Number of bytes written to file.
+ */
+@property (nonatomic, readonly) unsigned long long length;
+
+/**
+ *  Lowercase hexadecimal digest of written bytes. Nil until writer finishes or if digest algorithm is CSDigestAlgorithmNone.
+ */
+@property (nonatomic, strong, readonly) NSString *digest;
+
+#pragma mark - Initialization
+
+/**
+ *  Creates new writer and opens temporary file next to destination path.
+ *
+ *  @param path            Path at which file will be placed when writer finishes. Existing file is replaced.
+ *  @param digestAlgorithm Algorithm used for computing digest of written bytes.
+ *  @param error           On return contains error if temporary file could not be opened.
+ *
+ *  @return New instance of CSResponseFileWriter or nil if file could not be opened.
+ */
+- (instancetype)initWithDestinationPath:(NSString *)path
+                        digestAlgorithm:(CSDigestAlgorithm)digestAlgorithm
+                                  error:(NSError **)error;
+
+#pragma mark - Writing
+
+/**
+ *  Writes given data to the end of the temporary file and updates digest.
+ *
+ *  @param data  Data object to be written.
+ *  @param error On return contains error if writing failed.
+ *
+ *  @return YES if all bytes are written, otherwise NO.
+ */
+- (BOOL)appendData:(NSData *)data error:(NSError **)error;
+
+/**
+ *  Closes temporary file, finishes digest and moves file to destination path.
+ *
+ *  @param error On return contains error if file could not be moved.
+ *
+ *  @return YES if file is placed at destination path, otherwise NO.
+ */
+- (BOOL)finish:(NSError **)error;
+
+/**
+ *  Closes and removes temporary file. Destination path is not touched.
+ */
+- (void)discard;
+
+@end
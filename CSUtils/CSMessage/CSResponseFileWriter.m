@@ -0,0 +1,184 @@
+//
+//  CSResponseFileWriter.m
+//  CSUtils
+//
+//  Created by Josip Bernat on 19/02/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import "CSResponseFileWriter.h"
+#import <CommonCrypto/CommonDigest.h>
+
+@interface CSResponseFileWriter () {
+
+    CSDigestAlgorithm _digestAlgorithm;
+    union {
+        CC_MD5_CTX md5;
+        CC_SHA1_CTX sha1;
+        CC_SHA256_CTX sha256;
+    } _digestContext;
+}
+
+@property (nonatomic, strong, readwrite) NSString *destinationPath;
+@property (nonatomic, strong, readwrite) NSString *digest;
+@property (nonatomic, strong) NSString *temporaryPath;
+@property (nonatomic, strong) NSOutputStream *outputStream;
+
+@end
+
+@implementation CSResponseFileWriter
+
+#pragma mark - Memory Management
+
+- (void)dealloc {
+    [_outputStream close];
+}
+
+#pragma mark - Initialization
+
+- (instancetype)initWithDestinationPath:(NSString *)path
+                        digestAlgorithm:(CSDigestAlgorithm)digestAlgorithm
+                                  error:(NSError **)error {
+
+    if (!path) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"path argument cannot be nil!"
+                               userInfo:nil] raise];
+    }
+
+    if (self = [super init]) {
+
+        self.destinationPath = path;
+        self.temporaryPath = [path stringByAppendingPathExtension:@"download"];
+
+        _digestAlgorithm = digestAlgorithm;
+        [self beginDigest];
+
+        self.outputStream = [NSOutputStream outputStreamToFileAtPath:self.temporaryPath append:NO];
+        [self.outputStream open];
+
+        if (self.outputStream.streamStatus == NSStreamStatusError) {
+            if (error) {
+                *error = self.outputStream.streamError;
+            }
+            return nil;
+        }
+    }
+    return self;
+}
+
+#pragma mark - Writing
+
+- (BOOL)appendData:(NSData *)data error:(NSError **)error {
+
+    const uint8_t *bytes = data.bytes;
+    NSUInteger remaining = data.length;
+
+    while (remaining > 0) {
+
+        NSInteger written = [self.outputStream write:bytes maxLength:remaining];
+        if (written <= 0) {
+            if (error) {
+                *error = self.outputStream.streamError;
+            }
+            return NO;
+        }
+        bytes += written;
+        remaining -= written;
+    }
+
+    [self updateDigest:data];
+    _length += data.length;
+
+    return YES;
+}
+
+- (BOOL)finish:(NSError **)error {
+
+    [self.outputStream close];
+    self.outputStream = nil;
+
+    self.digest = [self finishDigest];
+
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    [fileManager removeItemAtPath:self.destinationPath error:nil];
+
+    return [fileManager moveItemAtPath:self.temporaryPath
+                                toPath:self.destinationPath
+                                 error:error];
+}
+
+- (void)discard {
+
+    [self.outputStream close];
+    self.outputStream = nil;
+
+    [[NSFileManager defaultManager] removeItemAtPath:self.temporaryPath error:nil];
+}
+
+#pragma mark - Digest
+
+- (void)beginDigest {
+
+    switch (_digestAlgorithm) {
+        case CSDigestAlgorithmMD5:
+            CC_MD5_Init(&_digestContext.md5);
+            break;
+        case CSDigestAlgorithmSHA1:
+            CC_SHA1_Init(&_digestContext.sha1);
+            break;
+        case CSDigestAlgorithmSHA256:
+            CC_SHA256_Init(&_digestContext.sha256);
+            break;
+        default:
+            break;
+    }
+}
+
+- (void)updateDigest:(NSData *)data {
+
+    switch (_digestAlgorithm) {
+        case CSDigestAlgorithmMD5:
+            CC_MD5_Update(&_digestContext.md5, data.bytes, (CC_LONG)data.length);
+            break;
+        case CSDigestAlgorithmSHA1:
+            CC_SHA1_Update(&_digestContext.sha1, data.bytes, (CC_LONG)data.length);
+            break;
+        case CSDigestAlgorithmSHA256:
+            CC_SHA256_Update(&_digestContext.sha256, data.bytes, (CC_LONG)data.length);
+            break;
+        default:
+            break;
+    }
+}
+
+- (NSString *)finishDigest {
+
+    uint8_t digest[CC_SHA256_DIGEST_LENGTH];
+    NSUInteger digestLength = 0;
+
+    switch (_digestAlgorithm) {
+        case CSDigestAlgorithmMD5:
+            CC_MD5_Final(digest, &_digestContext.md5);
+            digestLength = CC_MD5_DIGEST_LENGTH;
+            break;
+        case CSDigestAlgorithmSHA1:
+            CC_SHA1_Final(digest, &_digestContext.sha1);
+            digestLength = CC_SHA1_DIGEST_LENGTH;
+            break;
+        case CSDigestAlgorithmSHA256:
+            CC_SHA256_Final(digest, &_digestContext.sha256);
+            digestLength = CC_SHA256_DIGEST_LENGTH;
+            break;
+        default:
+            return nil;
+    }
+
+    NSMutableString *output = [NSMutableString stringWithCapacity:digestLength * 2];
+    for (NSUInteger i = 0; i < digestLength; i++) {
+        [output appendFormat:@"%02x", digest[i]];
+    }
+    return output;
+}
+
+@end
@@ -0,0 +1,172 @@
+//
+//  CSSegmentBuffer.c
+//  CSUtils
+//
+//  Created by Josip Bernat on 17/02/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#include "CSSegmentBuffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#pragma mark - Helpers
+
+static inline void CSSegmentBufferReleaseOwner(CSSegmentBuffer *buffer, void *owner) {
+
+    if (owner && buffer->releaseFunction) {
+        buffer->releaseFunction(owner);
+    }
+}
+
+static void CSSegmentBufferReleaseSegments(CSSegmentBuffer *buffer) {
+
+    for (size_t i = 0; i < buffer->segmentsCount; i++) {
+        CSSegmentBufferReleaseOwner(buffer, buffer->segments[i].owner);
+    }
+    buffer->segmentsCount = 0;
+}
+
+/**
+ *  Makes contiguous storage hold at least capacity bytes. Storage is allocated with exact capacity because length is known, kept bytes aren't copied.
+ */
+static bool CSSegmentBufferAllocateContiguous(CSSegmentBuffer *buffer, size_t capacity) {
+
+    if (buffer->contiguous.capacity >= capacity) {
+        return true;
+    }
+
+    uint8_t *bytes = malloc(capacity);
+    if (!bytes) {
+        return false;
+    }
+    free(buffer->contiguous.bytes);
+    buffer->contiguous.bytes = bytes;
+    buffer->contiguous.capacity = capacity;
+    buffer->allocatedLength += capacity;
+    return true;
+}
+
+#pragma mark - Lifecycle
+
+void CSSegmentBufferInit(CSSegmentBuffer *buffer, CSSegmentBufferReleaseFunction releaseFunction) {
+
+    memset(buffer, 0, sizeof(CSSegmentBuffer));
+    buffer->releaseFunction = releaseFunction;
+}
+
+void CSSegmentBufferReset(CSSegmentBuffer *buffer, long long expectedLength) {
+
+    CSSegmentBufferReleaseSegments(buffer);
+    CSByteBufferReset(&buffer->contiguous);
+    buffer->length = 0;
+
+    //without storage for whole body chunks are kept as segments
+    buffer->isContiguous = (expectedLength > 0 && expectedLength <= CSSegmentBufferMaximumPreallocatedLength &&
+                            CSSegmentBufferAllocateContiguous(buffer, (size_t)expectedLength));
+}
+
+void CSSegmentBufferFree(CSSegmentBuffer *buffer) {
+
+    CSSegmentBufferReleaseSegments(buffer);
+    free(buffer->segments);
+    buffer->segments = NULL;
+    buffer->segmentsCapacity = 0;
+
+    CSByteBufferFree(&buffer->contiguous);
+    buffer->isContiguous = false;
+    buffer->length = 0;
+}
+
+#pragma mark - Appending
+
+bool CSSegmentBufferAppend(CSSegmentBuffer *buffer, const uint8_t *bytes, size_t length, void *owner) {
+
+    if (!length) {
+        CSSegmentBufferReleaseOwner(buffer, owner);
+        return true;
+    }
+
+    if (buffer->isContiguous) {
+
+        //body longer than announced grows storage, reallocation may copy bytes received so far
+        size_t capacity = buffer->contiguous.capacity;
+        if (!CSByteBufferAppend(&buffer->contiguous, bytes, length)) {
+            CSSegmentBufferReleaseOwner(buffer, owner);
+            return false;
+        }
+        if (buffer->contiguous.capacity != capacity) {
+            buffer->allocatedLength += buffer->contiguous.capacity;
+            buffer->copiedLength += buffer->length;
+        }
+
+        buffer->copiedLength += length;
+        buffer->length += length;
+        CSSegmentBufferReleaseOwner(buffer, owner);
+        return true;
+    }
+
+    if (buffer->segmentsCount == buffer->segmentsCapacity) {
+
+        size_t capacity = (buffer->segmentsCapacity ? buffer->segmentsCapacity * 2 : 16);
+        CSSegmentBufferSegment *segments = realloc(buffer->segments, capacity * sizeof(CSSegmentBufferSegment));
+        if (!segments) {
+            CSSegmentBufferReleaseOwner(buffer, owner);
+            return false;
+        }
+        buffer->segments = segments;
+        buffer->segmentsCapacity = capacity;
+        buffer->allocatedLength += capacity * sizeof(CSSegmentBufferSegment);
+    }
+
+    buffer->segments[buffer->segmentsCount++] = (CSSegmentBufferSegment){bytes, length, owner};
+    buffer->length += length;
+    return true;
+}
+
+#pragma mark - Reading
+
+bool CSSegmentBufferJoin(CSSegmentBuffer *buffer) {
+
+    if (buffer->isContiguous || buffer->segmentsCount <= 1) {
+        return true;
+    }
+
+    CSByteBufferReset(&buffer->contiguous);
+    if (!CSSegmentBufferAllocateContiguous(buffer, buffer->length)) {
+        return false;
+    }
+
+    size_t offset = 0;
+    for (size_t i = 0; i < buffer->segmentsCount; i++) {
+        memcpy(buffer->contiguous.bytes + offset, buffer->segments[i].bytes, buffer->segments[i].length);
+        offset += buffer->segments[i].length;
+    }
+    buffer->contiguous.length = offset;
+    buffer->copiedLength += offset;
+
+    CSSegmentBufferReleaseSegments(buffer);
+    buffer->isContiguous = true;
+    return true;
+}
+
+uint8_t *CSSegmentBufferDetach(CSSegmentBuffer *buffer, size_t *length) {
+
+    *length = 0;
+    if (!buffer->isContiguous) {
+        return NULL;
+    }
+
+    size_t detachedLength = 0;
+    uint8_t *bytes = CSByteBufferDetach(&buffer->contiguous, &detachedLength);
+    buffer->isContiguous = false;
+    buffer->length = 0;
+
+    if (!detachedLength) {
+        free(bytes);
+        return NULL;
+    }
+    *length = detachedLength;
+    return bytes;
+}
@@ -0,0 +1,106 @@
+//
+//  CSSegmentBuffer.h
+//  CSUtils
+//
+//  Created by Josip Bernat on 17/02/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#ifndef CSUtils_CSSegmentBuffer_h
+#define CSUtils_CSSegmentBuffer_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "CSPercentEncoding.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  Bodies announcing larger length are kept as segments instead of reserving memory up front, servers can announce any content length.
+ */
+#define CSSegmentBufferMaximumPreallocatedLength (32 * 1024 * 1024)
+
+/**
+ *  Releases owner of segment bytes, e.g. data object received from connection.
+ */
+typedef void (*CSSegmentBufferReleaseFunction)(void *owner);
+
+/**
+ *  Received chunk kept without copying. Bytes stay valid until owner is released.
+ */
+typedef struct CSSegmentBufferSegment {
+    const uint8_t *bytes;
+    size_t length;
+    void *owner;
+} CSSegmentBufferSegment;
+
+/**
+ *  Response body storage. When expected length is known storage is allocated once and chunks are copied into it, otherwise chunks are kept as list of segments and joined only when contiguous bytes are needed. Counts bytes it copies and allocates so buffering overhead can be measured. Not thread safe.
+ */
+typedef struct CSSegmentBuffer {
+    /**
+     *  Contiguous storage, used when length was known or after segments were joined. Segments are empty while it's used.
+     */
+    CSByteBuffer contiguous;
+    bool isContiguous;
+
+    CSSegmentBufferSegment *segments;
+    size_t segmentsCount;
+    size_t segmentsCapacity;
+
+    size_t length;
+    CSSegmentBufferReleaseFunction releaseFunction;
+
+    uint64_t copiedLength;
+    uint64_t allocatedLength;
+} CSSegmentBuffer;
+
+/**
+ *  Initializes empty buffer.
+ *
+ *  @param releaseFunction Called for owner of every segment buffer doesn't need anymore. Can be NULL if owners don't need to be released.
+ */
+void CSSegmentBufferInit(CSSegmentBuffer *buffer, CSSegmentBufferReleaseFunction releaseFunction);
+
+/**
+ *  Removes all bytes, releases segments and prepares buffer for given length. Counters aren't reset.
+ *
+ *  @param expectedLength Expected length of body or negative number if it isn't known.
+ */
+void CSSegmentBufferReset(CSSegmentBuffer *buffer, long long expectedLength);
+
+/**
+ *  Releases segments and storage. Buffer can be initialized again.
+ */
+void CSSegmentBufferFree(CSSegmentBuffer *buffer);
+
+/**
+ *  Appends chunk. Ownership of owner is always taken, owner is released right away when bytes are copied into contiguous storage.
+ *
+ *  @return false if memory couldn't be allocated, owner is released then and buffer is unchanged.
+ */
+bool CSSegmentBufferAppend(CSSegmentBuffer *buffer, const uint8_t *bytes, size_t length, void *owner);
+
+/**
+ *  Joins segments into contiguous storage. Does nothing if there is at most one segment or storage is already contiguous.
+ *
+ *  @return false if memory couldn't be allocated, buffer is unchanged then.
+ */
+bool CSSegmentBufferJoin(CSSegmentBuffer *buffer);
+
+/**
+ *  Takes ownership of contiguous storage, which must be released with free(). Buffer is left empty.
+ *
+ *  @return Pointer to bytes or NULL if storage isn't contiguous or is empty.
+ */
+uint8_t *CSSegmentBufferDetach(CSSegmentBuffer *buffer, size_t *length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -7,6 +7,27 @@
 //
 
 #import <Foundation/Foundation.h>
+#import "CSPercentEncoding.h"
+
+/**
+ *  Appends UTF-8 bytes of given string percent encoded to the buffer.
+ *
+ *  @param buffer Buffer to which encoded bytes are appended.
+ *  @param string The string to URL encode.
+ *
+ *  @return YES if string was appended, otherwise NO.
+ */
+extern BOOL CSAppendURLEncodedString(CSByteBuffer *buffer, NSString *string);
+
+/**
+ *  Appends parameters as percent encoded key=value pairs joined with '&' to the buffer. If either the key or value for a key-value pair is not a subclass of NSString, the key-value pair is skipped.
+ *
+ *  @param buffer     Buffer to which encoded pairs are appended.
+ *  @param parameters Dictionary object containing parameters to encode.
+ *
+ *  @return YES if all pairs were appended, otherwise NO.
+ */
+extern BOOL CSAppendURLEncodedParameters(CSByteBuffer *buffer, NSDictionary *parameters);
 
 @interface CSURLUtils : NSObject
 
@@ -18,6 +39,26 @@
  */
 + (NSString *)generateBoundaryString;
 
+#pragma mark - Parameters
+
+/**
+ *  Generates URL query string from given parameters. Query doesn't contain leading '?'.
+ *
+ *  @param parameters Dictionary object containing NSString keys and values.
+ *
+ *  @return String object containing percent encoded parameters.
+ */
++ (NSString *)queryStringFromParameters:(NSDictionary *)parameters;
+
+/**
+ *  Generates application/x-www-form-urlencoded body from given parameters.
+ *
+ *  @param parameters Dictionary object containing NSString keys and values.
+ *
+ *  @return Data object containing percent encoded parameters.
+ */
++ (NSData *)formDataFromParameters:(NSDictionary *)parameters;
+
 #pragma mark - Mime
 /**
  *  Generates mimeType string depending on file that is path pointing on.
@@ -9,6 +9,56 @@
 #import "CSURLUtils.h"
 #import <MobileCoreServices/MobileCoreServices.h>
 
+#pragma mark - Percent Encoding
+
+BOOL CSAppendURLEncodedString(CSByteBuffer *buffer, NSString *string) {
+    
+    //most strings expose their UTF-8 storage directly
+    const char *utf8String = CFStringGetCStringPtr((__bridge CFStringRef)string, kCFStringEncodingUTF8);
+    if (utf8String) {
+        return CSPercentEncodeBytes(buffer, (const uint8_t *)utf8String, strlen(utf8String));
+    }
+    
+    uint8_t chunk[256];
+    NSRange remainingRange = NSMakeRange(0, string.length);
+    while (remainingRange.length) {
+        
+        NSUInteger usedLength = 0;
+        BOOL converted = [string getBytes:chunk
+                                maxLength:sizeof(chunk)
+                               usedLength:&usedLength
+                                 encoding:NSUTF8StringEncoding
+                                  options:NSStringEncodingConversionAllowLossy
+                                    range:remainingRange
+                           remainingRange:&remainingRange];
+        
+        if (!converted || !usedLength || !CSPercentEncodeBytes(buffer, chunk, usedLength)) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+BOOL CSAppendURLEncodedParameters(CSByteBuffer *buffer, NSDictionary *parameters) {
+    
+    __block BOOL appended = YES;
+    __block BOOL first = YES;
+    [parameters enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
+        
+        if (![key isKindOfClass:[NSString class]] || ![obj isKindOfClass:[NSString class]]) {
+            return;
+        }
+        
+        appended = ((first || CSByteBufferAppend(buffer, "&", 1)) &&
+                    CSAppendURLEncodedString(buffer, key) &&
+                    CSByteBufferAppend(buffer, "=", 1) &&
+                    CSAppendURLEncodedString(buffer, obj));
+        first = NO;
+        *stop = !appended;
+    }];
+    return appended;
+}
+
 @implementation CSURLUtils
 
 #pragma mark - Boundary
@@ -33,6 +83,47 @@
     return [NSString stringWithFormat:@"Boundary-%@", uuidStr];
 }
 
+#pragma mark - Parameters
+
++ (NSString *)queryStringFromParameters:(NSDictionary *)parameters {
+    
+    size_t length = 0;
+    uint8_t *bytes = [self encodedParameters:parameters length:&length];
+    if (!bytes) {
+        return @"";
+    }
+    return [[NSString alloc] initWithBytesNoCopy:bytes
+                                          length:length
+                                        encoding:NSASCIIStringEncoding
+                                    freeWhenDone:YES];
+}
+
++ (NSData *)formDataFromParameters:(NSDictionary *)parameters {
+    
+    size_t length = 0;
+    uint8_t *bytes = [self encodedParameters:parameters length:&length];
+    if (!bytes) {
+        return [NSData data];
+    }
+    return [NSData dataWithBytesNoCopy:bytes length:length freeWhenDone:YES];
+}
+
++ (uint8_t *)encodedParameters:(NSDictionary *)parameters length:(size_t *)length {
+    
+    CSByteBuffer buffer;
+    if (!parameters.count || !CSByteBufferInit(&buffer, 32 * parameters.count)) {
+        return NULL;
+    }
+    
+    if (!CSAppendURLEncodedParameters(&buffer, parameters) || !buffer.length) {
+        CSByteBufferFree(&buffer);
+        return NULL;
+    }
+    
+    //storage is handed over to the caller without copying it
+    return CSByteBufferDetach(&buffer, length);
+}
+
 #pragma mark - Mime
 
 + (NSString *)mimeTypeForPath:(NSString *)path {
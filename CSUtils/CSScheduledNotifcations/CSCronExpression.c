@@ -0,0 +1,467 @@
+//
+//  CSCronExpression.c
+//  CSUtils
+//
+//  Created by Josip Bernat on 17/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#include "CSCronExpression.h"
+
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+
+typedef struct CSCronField {
+    unsigned minimum;
+    unsigned maximum;
+    const char *const *names;
+    unsigned namesOffset;
+} CSCronField;
+
+static const char *const CSCronMonthNames[] = {
+    "jan", "feb", "mar", "apr", "may", "jun", "jul", "aug", "sep", "oct", "nov", "dec", NULL
+};
+
+static const char *const CSCronDayNames[] = {
+    "sun", "mon", "tue", "wed", "thu", "fri", "sat", NULL
+};
+
+static const CSCronField CSCronFields[5] = {
+    {0, 59, NULL, 0},
+    {0, 23, NULL, 0},
+    {1, 31, NULL, 0},
+    {1, 12, CSCronMonthNames, 1},
+    {0, 7, CSCronDayNames, 0}
+};
+
+static const struct {
+    const char *name;
+    const char *expression;
+} CSCronMacros[] = {
+    {"yearly", "0 0 1 1 *"},
+    {"annually", "0 0 1 1 *"},
+    {"monthly", "0 0 1 * *"},
+    {"weekly", "0 0 * * 0"},
+    {"daily", "0 0 * * *"},
+    {"midnight", "0 0 * * *"},
+    {"hourly", "0 * * * *"}
+};
+
+#pragma mark - Parsing
+
+static inline bool CSCronIsSeparator(char character) {
+    return (character == ' ' || character == '\t' || character == '\0');
+}
+
+static inline void CSCronSkipSpaces(const char **cursor) {
+    while (**cursor == ' ' || **cursor == '\t') {
+        (*cursor)++;
+    }
+}
+
+static bool CSCronParseNumber(const char **cursor, unsigned *value) {
+
+    if (!isdigit((unsigned char)**cursor)) {
+        return false;
+    }
+
+    unsigned number = 0;
+    for (unsigned digits = 0; isdigit((unsigned char)**cursor); digits++, (*cursor)++) {
+        if (digits == 3) {
+            return false;
+        }
+        number = number * 10 + (unsigned)(**cursor - '0');
+    }
+    *value = number;
+    return true;
+}
+
+static bool CSCronParseValue(const char **cursor, const CSCronField *field, unsigned *value) {
+
+    unsigned number = 0;
+    if (CSCronParseNumber(cursor, &number)) {
+        *value = number;
+        return (number >= field->minimum && number <= field->maximum);
+    }
+
+    if (!field->names) {
+        return false;
+    }
+
+    for (unsigned i = 0; field->names[i]; i++) {
+        if (!strncasecmp(*cursor, field->names[i], 3) && !isalpha((unsigned char)(*cursor)[3])) {
+            *cursor += 3;
+            *value = i + field->namesOffset;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool CSCronParseField(const char **cursor, const CSCronField *field, uint64_t *mask, bool *isAny) {
+
+    *mask = 0;
+    *isAny = (**cursor == '*');
+
+    for (;;) {
+
+        unsigned first = field->minimum;
+        unsigned last = field->maximum;
+        bool isSingleValue = false;
+
+        if (**cursor == '*') {
+            (*cursor)++;
+        }
+        else {
+            if (!CSCronParseValue(cursor, field, &first)) {
+                return false;
+            }
+            last = first;
+            isSingleValue = true;
+
+            if (**cursor == '-') {
+                (*cursor)++;
+                if (!CSCronParseValue(cursor, field, &last) || last < first) {
+                    return false;
+                }
+                isSingleValue = false;
+            }
+        }
+
+        unsigned step = 1;
+        if (**cursor == '/') {
+            (*cursor)++;
+            if (!CSCronParseNumber(cursor, &step) || !step) {
+                return false;
+            }
+            //"n/step" means from n to the end of range
+            if (isSingleValue) {
+                last = field->maximum;
+            }
+        }
+
+        for (unsigned value = first; value <= last; value += step) {
+            *mask |= (UINT64_C(1) << value);
+        }
+
+        if (**cursor != ',') {
+            break;
+        }
+        (*cursor)++;
+    }
+
+    return CSCronIsSeparator(**cursor);
+}
+
+bool CSCronExpressionParse(CSCronExpression *expression, const char *string, size_t *errorOffset) {
+
+    const char *cursor = string;
+    CSCronSkipSpaces(&cursor);
+
+    if (*cursor == '@') {
+
+        const char *name = cursor + 1;
+        size_t length = 0;
+        while (!CSCronIsSeparator(name[length])) {
+            length++;
+        }
+
+        for (size_t i = 0; i < sizeof(CSCronMacros) / sizeof(CSCronMacros[0]); i++) {
+
+            if (strlen(CSCronMacros[i].name) != length || strncasecmp(name, CSCronMacros[i].name, length)) {
+                continue;
+            }
+
+            const char *end = name + length;
+            CSCronSkipSpaces(&end);
+            if (*end) {
+                if (errorOffset) *errorOffset = (size_t)(end - string);
+                return false;
+            }
+            return CSCronExpressionParse(expression, CSCronMacros[i].expression, NULL);
+        }
+
+        if (errorOffset) *errorOffset = (size_t)(cursor - string);
+        return false;
+    }
+
+    uint64_t masks[5];
+    bool isAny[5];
+
+    for (size_t i = 0; i < 5; i++) {
+
+        CSCronSkipSpaces(&cursor);
+        if (!*cursor || !CSCronParseField(&cursor, &CSCronFields[i], &masks[i], &isAny[i])) {
+            if (errorOffset) *errorOffset = (size_t)(cursor - string);
+            return false;
+        }
+    }
+
+    CSCronSkipSpaces(&cursor);
+    if (*cursor) {
+        if (errorOffset) *errorOffset = (size_t)(cursor - string);
+        return false;
+    }
+
+    //day of week 7 is Sunday
+    if (masks[4] & (UINT64_C(1) << 7)) {
+        masks[4] = (masks[4] | 1) & ~(UINT64_C(1) << 7);
+    }
+
+    expression->minutes = masks[0];
+    expression->hours = (uint32_t)masks[1];
+    expression->daysOfMonth = (uint32_t)masks[2];
+    expression->months = (uint16_t)masks[3];
+    expression->daysOfWeek = (uint8_t)masks[4];
+    expression->flags = (uint8_t)((isAny[2] ? CSCronExpressionFlagAnyDayOfMonth : 0) | (isAny[4] ? CSCronExpressionFlagAnyDayOfWeek : 0));
+    return true;
+}
+
+#pragma mark - Calendar
+
+static inline int64_t CSCronFloorDivide(int64_t value, int64_t divisor) {
+    return (value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor));
+}
+
+/**
+ *  Converts days since 1970-01-01 to proleptic Gregorian date.
+ */
+static void CSCronDateFromDays(int64_t days, int64_t *year, unsigned *month, unsigned *day) {
+
+    days += 719468;
+    int64_t era = CSCronFloorDivide(days, 146097);
+    unsigned dayOfEra = (unsigned)(days - era * 146097);
+    unsigned yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    unsigned dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    unsigned shiftedMonth = (5 * dayOfYear + 2) / 153;
+
+    *day = dayOfYear - (153 * shiftedMonth + 2) / 5 + 1;
+    *month = (shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9);
+    *year = (int64_t)yearOfEra + era * 400 + (*month <= 2 ? 1 : 0);
+}
+
+/**
+ *  Converts proleptic Gregorian date to days since 1970-01-01.
+ */
+static int64_t CSCronDaysFromDate(int64_t year, unsigned month, unsigned day) {
+
+    year -= (month <= 2 ? 1 : 0);
+    int64_t era = CSCronFloorDivide(year, 400);
+    unsigned yearOfEra = (unsigned)(year - era * 400);
+    unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + (int64_t)dayOfEra - 719468;
+}
+
+static unsigned CSCronDaysInMonth(int64_t year, unsigned month) {
+
+    static const unsigned daysInMonth[13] = {0, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if (month == 2 && (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0))) {
+        return 29;
+    }
+    return daysInMonth[month];
+}
+
+static inline bool CSCronDayMatches(const CSCronExpression *expression, unsigned day, unsigned weekday) {
+
+    bool dayOfMonthMatches = ((expression->daysOfMonth >> day) & 1);
+    bool dayOfWeekMatches = ((expression->daysOfWeek >> weekday) & 1);
+
+    //field starting with '*', also "*/2", restricts day together with the other field like in cron
+    if (expression->flags & (CSCronExpressionFlagAnyDayOfMonth | CSCronExpressionFlagAnyDayOfWeek)) {
+        return (dayOfMonthMatches && dayOfWeekMatches);
+    }
+    return (dayOfMonthMatches || dayOfWeekMatches);
+}
+
+#pragma mark - Evaluating
+
+bool CSCronExpressionNextTime(const CSCronExpression *expression, int64_t time, int64_t *nextTime) {
+
+    if (!expression->minutes || !expression->hours || !expression->months) {
+        return false;
+    }
+
+    int64_t minute = CSCronFloorDivide(time, 60) + 1;
+    int64_t days = CSCronFloorDivide(minute, 1440);
+    unsigned minuteOfDay = (unsigned)(minute - days * 1440);
+    unsigned hour = minuteOfDay / 60;
+    unsigned minuteOfHour = minuteOfDay % 60;
+
+    int64_t year = 0;
+    unsigned month = 0;
+    unsigned day = 0;
+    CSCronDateFromDays(days, &year, &month, &day);
+
+    //February 29 on given day of week can be 8 years away
+    int64_t lastYear = year + 8;
+
+    while (year <= lastYear) {
+
+        if (!((expression->months >> month) & 1)) {
+
+            uint32_t followingMonths = expression->months & ~((UINT32_C(2) << month) - 1);
+            if (followingMonths) {
+                month = (unsigned)__builtin_ctz(followingMonths);
+            }
+            else {
+                year++;
+                month = (unsigned)__builtin_ctz(expression->months);
+            }
+            day = 1;
+            hour = 0;
+            minuteOfHour = 0;
+            continue;
+        }
+
+        if (day > CSCronDaysInMonth(year, month)) {
+
+            if (++month > 12) {
+                month = 1;
+                year++;
+            }
+            day = 1;
+            hour = 0;
+            minuteOfHour = 0;
+            continue;
+        }
+
+        days = CSCronDaysFromDate(year, month, day);
+        unsigned weekday = (unsigned)((days % 7 + 11) % 7);
+
+        uint32_t followingHours = expression->hours & ~((UINT32_C(1) << hour) - 1);
+        if (!CSCronDayMatches(expression, day, weekday) || !followingHours) {
+            day++;
+            hour = 0;
+            minuteOfHour = 0;
+            continue;
+        }
+
+        unsigned nextHour = (unsigned)__builtin_ctz(followingHours);
+        if (nextHour != hour) {
+            hour = nextHour;
+            minuteOfHour = 0;
+        }
+
+        uint64_t followingMinutes = expression->minutes & ~((UINT64_C(1) << minuteOfHour) - 1);
+        if (!followingMinutes) {
+            minuteOfHour = 0;
+            if (++hour == 24) {
+                hour = 0;
+                day++;
+            }
+            continue;
+        }
+
+        minuteOfHour = (unsigned)__builtin_ctzll(followingMinutes);
+        *nextTime = ((days * 24 + hour) * 60 + minuteOfHour) * 60;
+        return true;
+    }
+    return false;
+}
+
+#pragma mark - Local Time
+
+/**
+ *  Offsets sampled a day before and after local time are offsets on both sides of a transition near it, time zones don't change offset twice a day.
+ */
+static const int64_t CSCronTransitionDistance = 86400;
+
+/**
+ *  Number of candidate local times which can resolve to instants before given time. Only happens while search goes through repeated hour, at most one per minute.
+ */
+static const unsigned CSCronMaximumSkippedCandidates = 2 * 1440;
+
+/**
+ *  Finds instants at which local time occurs.
+ *
+ *  @return Number of instants: 1 normally, 2 for repeated local time with earlier instant first. Skipped local time resolves to the first instant after transition.
+ */
+static unsigned CSCronResolveLocalTime(int64_t localTime, CSCronOffsetFunction offsetFunction, void *context, int64_t instants[2]) {
+
+    int64_t offsetBefore = offsetFunction(localTime - CSCronTransitionDistance, context);
+    int64_t offsetAfter = offsetFunction(localTime + CSCronTransitionDistance, context);
+
+    int64_t instantBefore = localTime - offsetBefore;
+    int64_t instantAfter = localTime - offsetAfter;
+    bool isBeforeValid = (offsetFunction(instantBefore, context) == offsetBefore);
+    bool isAfterValid = (offsetFunction(instantAfter, context) == offsetAfter);
+
+    if (isBeforeValid && isAfterValid && instantBefore != instantAfter) {
+        instants[0] = (instantBefore < instantAfter ? instantBefore : instantAfter);
+        instants[1] = (instantBefore < instantAfter ? instantAfter : instantBefore);
+        return 2;
+    }
+    if (isBeforeValid || isAfterValid) {
+        instants[0] = (isBeforeValid ? instantBefore : instantAfter);
+        return 1;
+    }
+
+    if (offsetAfter > offsetBefore) {
+
+        //local time is in the gap, transition is between instant computed with later offset and instant computed with earlier one
+        int64_t low = instantAfter;
+        int64_t high = instantBefore;
+        while (high - low > 1) {
+            int64_t middle = low + (high - low) / 2;
+            if (offsetFunction(middle, context) == offsetBefore) {
+                low = middle;
+            }
+            else {
+                high = middle;
+            }
+        }
+        instants[0] = high;
+        return 1;
+    }
+
+    //offset changed more than once around local time, use offset valid at the time it would have without change
+    instants[0] = localTime - offsetFunction(instantBefore, context);
+    return 1;
+}
+
+bool CSCronExpressionNextFireTime(const CSCronExpression *expression, int64_t time, CSCronOffsetFunction offsetFunction, void *context, int64_t *fireTime) {
+
+    //local time goes back when clock moves back, so search starts from the lower of local times valid around given time
+    int64_t offset = offsetFunction(time, context);
+    int64_t laterOffset = offsetFunction(time + CSCronTransitionDistance, context);
+    int64_t search = time + (laterOffset < offset ? laterOffset : offset) - 1;
+
+    bool firesEveryHour = ((expression->hours & 0xffffff) == 0xffffff);
+    int64_t bestTime = INT64_MAX;
+
+    for (unsigned candidate = 0; candidate <= CSCronMaximumSkippedCandidates; candidate++) {
+
+        int64_t localTime = 0;
+        if (!CSCronExpressionNextTime(expression, search, &localTime)) {
+            break;
+        }
+
+        int64_t instants[2];
+        unsigned instantsCount = CSCronResolveLocalTime(localTime, offsetFunction, context, instants);
+        if (instantsCount == 2 && !firesEveryHour) {
+            instantsCount = 1;
+        }
+
+        //first instants grow with local time, so later local times can't fire sooner
+        if (instants[0] >= bestTime) {
+            break;
+        }
+        if (instants[0] > time) {
+            bestTime = instants[0];
+            break;
+        }
+        //second pass of repeated hour, first pass of following local times may still come before it
+        if (instantsCount == 2 && instants[1] > time && instants[1] < bestTime) {
+            bestTime = instants[1];
+        }
+        search = localTime;
+    }
+
+    if (bestTime == INT64_MAX) {
+        return false;
+    }
+    *fireTime = bestTime;
+    return true;
+}
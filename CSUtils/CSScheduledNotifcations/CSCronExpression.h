@@ -0,0 +1,73 @@
+//
+//  CSCronExpression.h
+//  CSUtils
+//
+//  Created by Josip Bernat on 17/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#ifndef CSUtils_CSCronExpression_h
+#define CSUtils_CSCronExpression_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  Set when day of month or day of week field starts with '*'. Like in cron, day must match both fields when either of them starts with '*', otherwise it matches if either field matches.
+ */
+typedef enum {
+    CSCronExpressionFlagAnyDayOfMonth   = 1 << 0,
+    CSCronExpressionFlagAnyDayOfWeek    = 1 << 1
+} CSCronExpressionFlag;
+
+/**
+ *  Parsed five field cron expression stored as bit masks. Bit n of each mask is set if value n is allowed. Sunday is day of week 0.
+ */
+typedef struct CSCronExpression {
+    uint64_t minutes;
+    uint32_t hours;
+    uint32_t daysOfMonth;
+    uint16_t months;
+    uint8_t daysOfWeek;
+    uint8_t flags;
+} CSCronExpression;
+
+/**
+ *  Parses expression "minute hour day-of-month month day-of-week". Fields accept '*', numbers, ranges "a-b", lists "a,b" and steps "x/n". Months and days of week can be given by English three letter names, day of week 7 is Sunday. Macros @yearly, @annually, @monthly, @weekly, @daily, @midnight and @hourly are supported.
+ *
+ *  @param errorOffset On failure contains offset of character at which parsing stopped. Can be NULL.
+ *
+ *  @return true on success.
+ */
+bool CSCronExpressionParse(CSCronExpression *expression, const char *string, size_t *errorOffset);
+
+/**
+ *  Finds first minute matching expression strictly after given time. Times are seconds since 1970 in local time, so they are UTC times shifted by time zone offset.
+ *
+ *  @return false if expression doesn't match any minute within next 8 years, for example February 30.
+ */
+bool CSCronExpressionNextTime(const CSCronExpression *expression, int64_t time, int64_t *nextTime);
+
+/**
+ *  Returns offset of local time from UTC in seconds at given UTC time in seconds since 1970.
+ */
+typedef int64_t (*CSCronOffsetFunction)(int64_t time, void *context);
+
+/**
+ *  Finds first fire time strictly after given time. Times are UTC seconds since 1970, expression is evaluated in local time given by offset function.
+ *  Local times skipped when clock moves forward fire once, at the first instant after the transition. Local times repeated when clock moves back fire only at their first occurrence, except for expressions matching every hour which fire in both passes of the repeated hour, so they keep firing every elapsed hour.
+ *
+ *  @return false if expression doesn't match any minute within next 8 years.
+ */
+bool CSCronExpressionNextFireTime(const CSCronExpression *expression, int64_t time, CSCronOffsetFunction offsetFunction, void *context, int64_t *fireTime);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
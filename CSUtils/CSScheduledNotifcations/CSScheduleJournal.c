@@ -0,0 +1,327 @@
+//
+//  CSScheduleJournal.c
+//  CSUtils
+//
+//  Created by Josip Bernat on 18/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#include "CSScheduleJournal.h"
+
+#include <math.h>
+#include <string.h>
+
+/**
+ *  Restore decodes every saved notification at launch, on little endian hosts integers and doubles are copied as they are.
+ */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define CSScheduleJournalLittleEndian 1
+#else
+#define CSScheduleJournalLittleEndian 0
+#endif
+
+#pragma mark - Encoding
+
+static inline bool CSScheduleJournalAppendUInt8(CSByteBuffer *buffer, uint8_t value) {
+    return CSByteBufferAppend(buffer, &value, sizeof(value));
+}
+
+static inline bool CSScheduleJournalAppendUInt16(CSByteBuffer *buffer, uint16_t value) {
+
+    uint8_t bytes[2] = {(uint8_t)value, (uint8_t)(value >> 8)};
+    return CSByteBufferAppend(buffer, bytes, sizeof(bytes));
+}
+
+static inline bool CSScheduleJournalAppendUInt32(CSByteBuffer *buffer, uint32_t value) {
+
+    uint8_t bytes[4];
+    for (size_t i = 0; i < sizeof(bytes); i++) {
+        bytes[i] = (uint8_t)(value >> (8 * i));
+    }
+    return CSByteBufferAppend(buffer, bytes, sizeof(bytes));
+}
+
+static inline bool CSScheduleJournalAppendDouble(CSByteBuffer *buffer, double value) {
+
+    uint64_t bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint8_t bytes[8];
+    for (size_t i = 0; i < sizeof(bytes); i++) {
+        bytes[i] = (uint8_t)(bits >> (8 * i));
+    }
+    return CSByteBufferAppend(buffer, bytes, sizeof(bytes));
+}
+
+static bool CSScheduleJournalAppendString(CSByteBuffer *buffer, CSScheduleJournalBytes string) {
+
+    if (string.length > UINT16_MAX) {
+        return false;
+    }
+    return (CSScheduleJournalAppendUInt16(buffer, (uint16_t)string.length) &&
+            (!string.length || CSByteBufferAppend(buffer, string.bytes, string.length)));
+}
+
+static inline size_t CSScheduleJournalBeginRecord(CSByteBuffer *buffer, CSScheduleJournalRecordType type, CSScheduleJournalBytes name, bool *encoded) {
+
+    size_t start = buffer->length;
+    *encoded = (CSScheduleJournalAppendUInt32(buffer, 0) &&
+                CSScheduleJournalAppendUInt8(buffer, (uint8_t)type) &&
+                CSScheduleJournalAppendString(buffer, name));
+    return start;
+}
+
+/**
+ *  Writes length of record which starts at given offset or removes the record if it couldn't be encoded.
+ */
+static bool CSScheduleJournalEndRecord(CSByteBuffer *buffer, size_t start, bool encoded) {
+
+    size_t length = buffer->length - start - sizeof(uint32_t);
+    if (!encoded || length > UINT32_MAX) {
+        buffer->length = start;
+        return false;
+    }
+
+    for (size_t i = 0; i < sizeof(uint32_t); i++) {
+        buffer->bytes[start + i] = (uint8_t)(length >> (8 * i));
+    }
+    return true;
+}
+
+bool CSScheduleJournalAppendHeader(CSByteBuffer *buffer) {
+    return (CSScheduleJournalAppendUInt32(buffer, CSScheduleJournalMagic) && CSScheduleJournalAppendUInt32(buffer, CSScheduleJournalVersion));
+}
+
+bool CSScheduleJournalAppendAdd(CSByteBuffer *buffer, CSScheduleJournalBytes name, const CSScheduleJournalNotification *notification) {
+
+    bool encoded = false;
+    size_t start = CSScheduleJournalBeginRecord(buffer, CSScheduleJournalRecordTypeAdd, name, &encoded);
+    encoded = (encoded &&
+               CSScheduleJournalAppendDouble(buffer, notification->fireDate) &&
+               CSScheduleJournalAppendDouble(buffer, notification->lastFireDate) &&
+               CSScheduleJournalAppendUInt8(buffer, (uint8_t)notification->ruleType));
+
+    switch (notification->ruleType) {
+        case CSScheduleJournalRuleTypeNone:
+            break;
+        case CSScheduleJournalRuleTypeInterval:
+            encoded = (encoded &&
+                       CSScheduleJournalAppendDouble(buffer, notification->ruleInterval) &&
+                       CSScheduleJournalAppendDouble(buffer, notification->ruleStartDate));
+            break;
+        case CSScheduleJournalRuleTypeCalendar:
+            encoded = (encoded &&
+                       CSScheduleJournalAppendString(buffer, notification->ruleExpression) &&
+                       CSScheduleJournalAppendString(buffer, notification->ruleTimeZoneName));
+            break;
+        default:
+            encoded = false;
+            break;
+    }
+
+    encoded = (encoded &&
+               notification->userInfo.length <= UINT32_MAX &&
+               CSScheduleJournalAppendUInt32(buffer, (uint32_t)notification->userInfo.length) &&
+               (!notification->userInfo.length || CSByteBufferAppend(buffer, notification->userInfo.bytes, notification->userInfo.length)) &&
+               CSScheduleJournalAppendDouble(buffer, notification->tolerance));
+
+    return CSScheduleJournalEndRecord(buffer, start, encoded);
+}
+
+bool CSScheduleJournalAppendUpdate(CSByteBuffer *buffer, CSScheduleJournalBytes name, double fireDate, double lastFireDate) {
+
+    bool encoded = false;
+    size_t start = CSScheduleJournalBeginRecord(buffer, CSScheduleJournalRecordTypeUpdate, name, &encoded);
+    encoded = (encoded &&
+               CSScheduleJournalAppendDouble(buffer, fireDate) &&
+               CSScheduleJournalAppendDouble(buffer, lastFireDate));
+
+    return CSScheduleJournalEndRecord(buffer, start, encoded);
+}
+
+bool CSScheduleJournalAppendRemove(CSByteBuffer *buffer, CSScheduleJournalBytes name) {
+
+    bool encoded = false;
+    size_t start = CSScheduleJournalBeginRecord(buffer, CSScheduleJournalRecordTypeRemove, name, &encoded);
+    return CSScheduleJournalEndRecord(buffer, start, encoded);
+}
+
+#pragma mark - Decoding
+
+static inline const uint8_t *CSScheduleJournalRead(CSScheduleJournalReader *reader, size_t length) {
+
+    if (length > reader->length - reader->offset) {
+        return NULL;
+    }
+
+    const uint8_t *bytes = reader->bytes + reader->offset;
+    reader->offset += length;
+    return bytes;
+}
+
+static inline bool CSScheduleJournalReadUInt8(CSScheduleJournalReader *reader, uint8_t *value) {
+
+    const uint8_t *bytes = CSScheduleJournalRead(reader, sizeof(uint8_t));
+    if (!bytes) {
+        return false;
+    }
+    *value = *bytes;
+    return true;
+}
+
+static inline bool CSScheduleJournalReadUInt16(CSScheduleJournalReader *reader, uint16_t *value) {
+
+    const uint8_t *bytes = CSScheduleJournalRead(reader, sizeof(uint16_t));
+    if (!bytes) {
+        return false;
+    }
+    *value = (uint16_t)(bytes[0] | (bytes[1] << 8));
+    return true;
+}
+
+static inline bool CSScheduleJournalReadUInt32(CSScheduleJournalReader *reader, uint32_t *value) {
+
+    const uint8_t *bytes = CSScheduleJournalRead(reader, sizeof(uint32_t));
+    if (!bytes) {
+        return false;
+    }
+#if CSScheduleJournalLittleEndian
+    memcpy(value, bytes, sizeof(uint32_t));
+#else
+    *value = (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+#endif
+    return true;
+}
+
+static inline bool CSScheduleJournalReadDouble(CSScheduleJournalReader *reader, double *value) {
+
+    const uint8_t *bytes = CSScheduleJournalRead(reader, sizeof(uint64_t));
+    if (!bytes) {
+        return false;
+    }
+
+#if CSScheduleJournalLittleEndian
+    memcpy(value, bytes, sizeof(double));
+#else
+    uint64_t bits = 0;
+    for (size_t i = 0; i < sizeof(bits); i++) {
+        bits |= (uint64_t)bytes[i] << (8 * i);
+    }
+    memcpy(value, &bits, sizeof(bits));
+#endif
+    return true;
+}
+
+static inline bool CSScheduleJournalReadString(CSScheduleJournalReader *reader, CSScheduleJournalBytes *string) {
+
+    uint16_t length = 0;
+    const uint8_t *bytes = NULL;
+    if (!CSScheduleJournalReadUInt16(reader, &length) || !(bytes = CSScheduleJournalRead(reader, length))) {
+        return false;
+    }
+    string->bytes = bytes;
+    string->length = length;
+    return true;
+}
+
+bool CSScheduleJournalReaderInit(CSScheduleJournalReader *reader, const uint8_t *bytes, size_t length) {
+
+    reader->bytes = bytes;
+    reader->length = length;
+    reader->offset = 0;
+
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    if (!CSScheduleJournalReadUInt32(reader, &magic) || !CSScheduleJournalReadUInt32(reader, &version) ||
+        magic != CSScheduleJournalMagic || version != CSScheduleJournalVersion) {
+        reader->offset = 0;
+        return false;
+    }
+    return true;
+}
+
+bool CSScheduleJournalReadRecord(CSScheduleJournalReader *reader, CSScheduleJournalRecord *record) {
+
+    size_t start = reader->offset;
+    uint32_t length = 0;
+    const uint8_t *bytes = NULL;
+    if (!CSScheduleJournalReadUInt32(reader, &length) || !(bytes = CSScheduleJournalRead(reader, length))) {
+        reader->offset = start;
+        return false;
+    }
+
+    CSScheduleJournalReader content = {bytes, length, 0};
+    uint8_t type = 0;
+    if (!CSScheduleJournalReadUInt8(&content, &type) || !CSScheduleJournalReadString(&content, &record->name) ||
+        type < CSScheduleJournalRecordTypeAdd || type > CSScheduleJournalRecordTypeRemove) {
+        reader->offset = start;
+        return false;
+    }
+
+    record->type = (CSScheduleJournalRecordType)type;
+    record->body.bytes = bytes + content.offset;
+    record->body.length = length - content.offset;
+    return true;
+}
+
+static bool CSScheduleJournalReadRule(CSScheduleJournalReader *reader, CSScheduleJournalNotification *notification) {
+
+    size_t start = reader->offset;
+    uint8_t type = 0;
+    if (!CSScheduleJournalReadUInt8(reader, &type)) {
+        return false;
+    }
+
+    switch (type) {
+        case CSScheduleJournalRuleTypeNone:
+            break;
+
+        case CSScheduleJournalRuleTypeInterval:
+            if (!CSScheduleJournalReadDouble(reader, &notification->ruleInterval) || !CSScheduleJournalReadDouble(reader, &notification->ruleStartDate) ||
+                !(notification->ruleInterval > 0.0) || isnan(notification->ruleStartDate)) {
+                return false;
+            }
+            break;
+
+        case CSScheduleJournalRuleTypeCalendar:
+            if (!CSScheduleJournalReadString(reader, &notification->ruleExpression) || !CSScheduleJournalReadString(reader, &notification->ruleTimeZoneName)) {
+                return false;
+            }
+            break;
+
+        default:
+            return false;
+    }
+
+    notification->ruleType = (CSScheduleJournalRuleType)type;
+    notification->rule.bytes = reader->bytes + start;
+    notification->rule.length = reader->offset - start;
+    return true;
+}
+
+bool CSScheduleJournalDecodeAdd(CSScheduleJournalBytes body, CSScheduleJournalNotification *notification) {
+
+    memset(notification, 0, sizeof(CSScheduleJournalNotification));
+
+    CSScheduleJournalReader reader = {body.bytes, body.length, 0};
+    uint32_t userInfoLength = 0;
+    if (!CSScheduleJournalReadDouble(&reader, &notification->fireDate) || !CSScheduleJournalReadDouble(&reader, &notification->lastFireDate) ||
+        !CSScheduleJournalReadRule(&reader, notification) || !CSScheduleJournalReadUInt32(&reader, &userInfoLength) ||
+        !(notification->userInfo.bytes = CSScheduleJournalRead(&reader, userInfoLength))) {
+        return false;
+    }
+    notification->userInfo.length = userInfoLength;
+
+    //records written before tolerance was saved end after user info
+    if (reader.offset < reader.length &&
+        (!CSScheduleJournalReadDouble(&reader, &notification->tolerance) || !(notification->tolerance >= 0.0))) {
+        return false;
+    }
+    return true;
+}
+
+bool CSScheduleJournalDecodeUpdate(CSScheduleJournalBytes body, double *fireDate, double *lastFireDate) {
+
+    CSScheduleJournalReader reader = {body.bytes, body.length, 0};
+    return (CSScheduleJournalReadDouble(&reader, fireDate) && CSScheduleJournalReadDouble(&reader, lastFireDate));
+}
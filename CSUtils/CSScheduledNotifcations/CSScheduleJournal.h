@@ -0,0 +1,139 @@
+//
+//  CSScheduleJournal.h
+//  CSUtils
+//
+//  Created by Josip Bernat on 18/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#ifndef CSUtils_CSScheduleJournal_h
+#define CSUtils_CSScheduleJournal_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "CSPercentEncoding.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  Journal starts with magic and version, followed by records. Each record is uint32 length, record type, uint16 name length and UTF-8 name. Add record continues with fire date, last fire date, rule, user info and tolerance, update record with fire date and last fire date. Integers are little endian, dates are seconds since reference date stored as doubles where NaN is missing date.
+ */
+#define CSScheduleJournalMagic          UINT32_C(0x4e535343) //"CSSN"
+#define CSScheduleJournalVersion        UINT32_C(1)
+#define CSScheduleJournalHeaderLength   8
+
+typedef enum {
+    CSScheduleJournalRecordTypeAdd = 1,
+    CSScheduleJournalRecordTypeUpdate,
+    CSScheduleJournalRecordTypeRemove
+} CSScheduleJournalRecordType;
+
+typedef enum {
+    CSScheduleJournalRuleTypeNone = 0,
+    CSScheduleJournalRuleTypeInterval,
+    CSScheduleJournalRuleTypeCalendar
+} CSScheduleJournalRuleType;
+
+/**
+ *  Bytes which aren't owned. Strings are UTF-8 without terminating zero and at most UINT16_MAX bytes long.
+ */
+typedef struct CSScheduleJournalBytes {
+    const uint8_t *bytes;
+    size_t length;
+} CSScheduleJournalBytes;
+
+/**
+ *  Content of add record. When decoded, all bytes point into journal.
+ */
+typedef struct CSScheduleJournalNotification {
+    double fireDate;
+    double lastFireDate;
+    CSScheduleJournalRuleType ruleType;
+    double ruleInterval;
+    double ruleStartDate;
+    CSScheduleJournalBytes ruleExpression;
+    CSScheduleJournalBytes ruleTimeZoneName;
+    /**
+     *  Encoded rule, set only when decoding. Equal rules have equal bytes so they can be used as cache key.
+     */
+    CSScheduleJournalBytes rule;
+    /**
+     *  Binary property list or empty.
+     */
+    CSScheduleJournalBytes userInfo;
+    double tolerance;
+} CSScheduleJournalNotification;
+
+/**
+ *  Record read from journal. Body is part of record after name.
+ */
+typedef struct CSScheduleJournalRecord {
+    CSScheduleJournalRecordType type;
+    CSScheduleJournalBytes name;
+    CSScheduleJournalBytes body;
+} CSScheduleJournalRecord;
+
+/**
+ *  Cursor over journal bytes, usually memory mapped file.
+ */
+typedef struct CSScheduleJournalReader {
+    const uint8_t *bytes;
+    size_t length;
+    size_t offset;
+} CSScheduleJournalReader;
+
+#pragma mark - Writing
+
+/**
+ *  Appends magic and version which start every journal.
+ */
+bool CSScheduleJournalAppendHeader(CSByteBuffer *buffer);
+
+/**
+ *  Appends add record. Nothing is appended if string is too long or memory couldn't be allocated.
+ *
+ *  @return true if record was appended.
+ */
+bool CSScheduleJournalAppendAdd(CSByteBuffer *buffer, CSScheduleJournalBytes name, const CSScheduleJournalNotification *notification);
+
+bool CSScheduleJournalAppendUpdate(CSByteBuffer *buffer, CSScheduleJournalBytes name, double fireDate, double lastFireDate);
+
+bool CSScheduleJournalAppendRemove(CSByteBuffer *buffer, CSScheduleJournalBytes name);
+
+#pragma mark - Reading
+
+/**
+ *  Checks header and positions reader at first record.
+ *
+ *  @return false if journal is too short or has unknown magic or version.
+ */
+bool CSScheduleJournalReaderInit(CSScheduleJournalReader *reader, const uint8_t *bytes, size_t length);
+
+/**
+ *  Reads next record. Record cut off by crash while it was written or otherwise malformed ends the journal, reader offset isn't moved then so it is the length of valid part.
+ *
+ *  @return false at the end of valid part of journal.
+ */
+bool CSScheduleJournalReadRecord(CSScheduleJournalReader *reader, CSScheduleJournalRecord *record);
+
+/**
+ *  Decodes body of add record. Records written before tolerance was saved decode with zero tolerance.
+ *
+ *  @return false if body is malformed, rule is unknown or invalid or tolerance is negative.
+ */
+bool CSScheduleJournalDecodeAdd(CSScheduleJournalBytes body, CSScheduleJournalNotification *notification);
+
+/**
+ *  Decodes body of update record.
+ */
+bool CSScheduleJournalDecodeUpdate(CSScheduleJournalBytes body, double *fireDate, double *lastFireDate);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
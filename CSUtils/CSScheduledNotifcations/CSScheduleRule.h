@@ -0,0 +1,104 @@
+//
+//  CSScheduleRule.h
+//  CSUtils
+//
+//  Created by Josip Bernat on 17/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ *  Error domain of invalid cron expressions.
+ */
+extern NSString * const CSScheduleRuleErrorDomain;
+
+/**
+ *  Error code of expression which can't be parsed. Offset of invalid character is stored in userInfo under CSScheduleRuleErrorOffsetKey.
+ */
+extern NSInteger const CSScheduleRuleErrorCodeInvalidExpression;
+
+extern NSString * const CSScheduleRuleErrorOffsetKey;
+
+typedef NS_ENUM(NSInteger, CSScheduleRuleType) {
+    CSScheduleRuleTypeInterval = 0,     //fires every interval counting from start date
+    CSScheduleRuleTypeCalendar          //fires at minutes matching cron expression in time zone
+};
+
+/**
+ *  Rule describing when repeating notification fires. Fire dates are always computed from the rule, never from moment previous fire happened, so they don't drift. Immutable and thread safe.
+ */
+@interface CSScheduleRule : NSObject
+
+@property (nonatomic, readonly) CSScheduleRuleType type;
+
+/**
+ *  Interval between fire dates of CSScheduleRuleTypeInterval rule.
+ */
+@property (nonatomic, readonly) NSTimeInterval interval;
+
+/**
+ *  First fire date of CSScheduleRuleTypeInterval rule.
+ */
+@property (nonatomic, readonly, strong) NSDate *startDate;
+
+/**
+ *  Cron expression of CSScheduleRuleTypeCalendar rule. Rules created from date components have expression generated from them.
+ */
+@property (nonatomic, readonly, copy) NSString *cronExpression;
+
+/**
+ *  Time zone in which cron expression is evaluated. Default is local time zone.
+ */
+@property (nonatomic, readonly, strong) NSTimeZone *timeZone;
+
+#pragma mark - Class Methods
+
+/**
+ *  Creates rule firing every interval counting from start date.
+ *
+ *  @param interval  Interval in seconds. NSInvalidArgumentException is raised if it isn't greater than 0.
+ *  @param startDate First fire date. It can be in the past, rule fires at next multiple of interval then. NSInvalidArgumentException is raised if nil.
+ */
++ (instancetype)ruleWithInterval:(NSTimeInterval)interval startDate:(NSDate *)startDate;
+
+/**
+ *  Creates rule firing whenever date matches given components in local time zone. Supported components are minute, hour, day, month and weekday. Components smaller than the smallest given one are matched at their lowest value so {hour = 9} fires daily at 9:00, unspecified bigger components match any value. NSInvalidArgumentException is raised if no supported component is set or if any of them is out of range.
+ */
++ (instancetype)ruleWithDateComponents:(NSDateComponents *)components;
+
+/**
+ *  Creates rule from cron expression "minute hour day-of-month month day-of-week" evaluated in local time zone. Fields accept '*', numbers, ranges "a-b", lists "a,b" and steps "x/n". Months and days of week can be given by English three letter names. Macros @yearly, @monthly, @weekly, @daily and @hourly are supported.
+ *
+ *  @param error Set if expression can't be parsed.
+ *
+ *  @return New rule or nil if expression is invalid.
+ */
++ (instancetype)ruleWithCronExpression:(NSString *)expression error:(NSError **)error;
+
+#pragma mark - Initialization
+
+/**
+ *  Creates calendar rule evaluated in given time zone.
+ *
+ *  @param timeZone Time zone. Local time zone is used if nil.
+ */
+- (instancetype)initWithCronExpression:(NSString *)expression
+                              timeZone:(NSTimeZone *)timeZone
+                                 error:(NSError **)error;
+
+#pragma mark - Fire Dates
+
+/**
+ *  Computes first fire date strictly after given date. Calendar rule whose local time is skipped by daylight saving transition fires once, right after the transition. Local time repeated when clock moves back fires only the first time, except for rules matching every hour, which fire in both passes of the repeated hour.
+ *
+ *  @return Fire date or nil if rule never fires again, for example cron expression for February 30.
+ */
+- (NSDate *)nextFireDateAfterDate:(NSDate *)date;
+
+/**
+ *  Counts fire dates after date up to and including end date. Used to find out how many fires were missed and coalesced. Counting calendar rules stops at 10000.
+ */
+- (NSUInteger)fireDatesCountAfterDate:(NSDate *)date untilDate:(NSDate *)endDate;
+
+@end
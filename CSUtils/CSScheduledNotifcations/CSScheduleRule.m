@@ -0,0 +1,200 @@
+//
+//  CSScheduleRule.m
+//  CSUtils
+//
+//  Created by Josip Bernat on 17/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import "CSScheduleRule.h"
+#import "CSCronExpression.h"
+
+NSString * const CSScheduleRuleErrorDomain                  = @"CSScheduleRuleErrorDomain";
+NSInteger const CSScheduleRuleErrorCodeInvalidExpression    = 1001;
+NSString * const CSScheduleRuleErrorOffsetKey               = @"CSScheduleRuleErrorOffsetKey";
+
+static NSUInteger const CSScheduleRuleMaximumCountedFireDates = 10000;
+
+static int64_t CSScheduleRuleOffset(int64_t time, void *context) {
+    return [(__bridge NSTimeZone *)context secondsFromGMTForDate:[NSDate dateWithTimeIntervalSince1970:time]];
+}
+
+@interface CSScheduleRule () {
+
+    CSCronExpression _expression;
+}
+
+@property (nonatomic, readwrite) CSScheduleRuleType type;
+@property (nonatomic, readwrite) NSTimeInterval interval;
+@property (nonatomic, readwrite, strong) NSDate *startDate;
+@property (nonatomic, readwrite, copy) NSString *cronExpression;
+@property (nonatomic, readwrite, strong) NSTimeZone *timeZone;
+
+@end
+
+@implementation CSScheduleRule
+
+#pragma mark - Class Methods
+
++ (instancetype)ruleWithInterval:(NSTimeInterval)interval startDate:(NSDate *)startDate {
+
+    if (!(interval > 0.0)) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"interval must be greater than 0"
+                               userInfo:nil] raise];
+    }
+    if (!startDate) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"startDate can't be nil"
+                               userInfo:nil] raise];
+    }
+
+    CSScheduleRule *rule = [[self alloc] init];
+    rule.type = CSScheduleRuleTypeInterval;
+    rule.interval = interval;
+    rule.startDate = startDate;
+    return rule;
+}
+
++ (instancetype)ruleWithDateComponents:(NSDateComponents *)components {
+
+    NSInteger minute = components.minute;
+    NSInteger hour = components.hour;
+    NSInteger day = components.day;
+    NSInteger month = components.month;
+    NSInteger weekday = components.weekday;
+
+    BOOL hasMinute = (minute != NSUndefinedDateComponent);
+    BOOL hasHour = (hour != NSUndefinedDateComponent);
+    BOOL hasDay = (day != NSUndefinedDateComponent);
+    BOOL hasMonth = (month != NSUndefinedDateComponent);
+    BOOL hasWeekday = (weekday != NSUndefinedDateComponent);
+
+    if (!(hasMinute || hasHour || hasDay || hasMonth || hasWeekday) ||
+        (hasMinute && (minute < 0 || minute > 59)) ||
+        (hasHour && (hour < 0 || hour > 23)) ||
+        (hasDay && (day < 1 || day > 31)) ||
+        (hasMonth && (month < 1 || month > 12)) ||
+        (hasWeekday && (weekday < 1 || weekday > 7))) {
+
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"components must contain minute, hour, day, month or weekday within their ranges"
+                               userInfo:nil] raise];
+    }
+
+    //components finer than the finest given one match only their lowest value
+    BOOL hasDayOrCoarser = (hasDay || hasMonth || hasWeekday);
+    NSString *minuteField = (hasMinute ? [@(minute) stringValue] : @"0");
+    NSString *hourField = (hasHour ? [@(hour) stringValue] : (hasDayOrCoarser ? @"0" : @"*"));
+    NSString *dayField = (hasDay ? [@(day) stringValue] : (hasMonth && !hasWeekday ? @"1" : @"*"));
+    NSString *monthField = (hasMonth ? [@(month) stringValue] : @"*");
+    NSString *weekdayField = (hasWeekday ? [@(weekday - 1) stringValue] : @"*");
+
+    NSString *expression = [NSString stringWithFormat:@"%@ %@ %@ %@ %@", minuteField, hourField, dayField, monthField, weekdayField];
+    return [[self alloc] initWithCronExpression:expression timeZone:nil error:NULL];
+}
+
++ (instancetype)ruleWithCronExpression:(NSString *)expression error:(NSError **)error {
+    return [[self alloc] initWithCronExpression:expression timeZone:nil error:error];
+}
+
+#pragma mark - Initialization
+
+- (instancetype)initWithCronExpression:(NSString *)expression
+                              timeZone:(NSTimeZone *)timeZone
+                                 error:(NSError **)error {
+
+    if (!expression) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"expression can't be nil"
+                               userInfo:nil] raise];
+    }
+
+    if (self = [super init]) {
+
+        size_t errorOffset = 0;
+        if (!CSCronExpressionParse(&_expression, [expression UTF8String], &errorOffset)) {
+
+            if (error) {
+                *error = [NSError errorWithDomain:CSScheduleRuleErrorDomain
+                                             code:CSScheduleRuleErrorCodeInvalidExpression
+                                         userInfo:@{NSLocalizedDescriptionKey : [NSString stringWithFormat:@"Invalid cron expression \"%@\" at offset %lu", expression, (unsigned long)errorOffset],
+                                                    CSScheduleRuleErrorOffsetKey : @(errorOffset)}];
+            }
+            return nil;
+        }
+
+        self.type = CSScheduleRuleTypeCalendar;
+        self.cronExpression = expression;
+        self.timeZone = (timeZone ? timeZone : [NSTimeZone localTimeZone]);
+    }
+    return self;
+}
+
+#pragma mark - Fire Dates
+
+- (NSDate *)nextFireDateAfterDate:(NSDate *)date {
+
+    if (!date) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"date can't be nil"
+                               userInfo:nil] raise];
+    }
+
+    if (self.type == CSScheduleRuleTypeInterval) {
+
+        NSTimeInterval elapsed = [date timeIntervalSinceDate:self.startDate];
+        if (elapsed < 0.0) {
+            return self.startDate;
+        }
+        return [self.startDate dateByAddingTimeInterval:(floor(elapsed / self.interval) + 1.0) * self.interval];
+    }
+
+    //fire times are whole seconds, so first one after whole second before date is also after date
+    int64_t fireTime = 0;
+    if (!CSCronExpressionNextFireTime(&_expression, (int64_t)floor([date timeIntervalSince1970]), CSScheduleRuleOffset, (__bridge void *)self.timeZone, &fireTime)) {
+        return nil;
+    }
+    return [NSDate dateWithTimeIntervalSince1970:fireTime];
+}
+
+- (NSUInteger)fireDatesCountAfterDate:(NSDate *)date untilDate:(NSDate *)endDate {
+
+    if (!date || !endDate || [endDate compare:date] != NSOrderedDescending) {
+        return 0;
+    }
+
+    if (self.type == CSScheduleRuleTypeInterval) {
+
+        NSTimeInterval firstElapsed = [date timeIntervalSinceDate:self.startDate];
+        NSTimeInterval lastElapsed = [endDate timeIntervalSinceDate:self.startDate];
+        if (lastElapsed < 0.0) {
+            return 0;
+        }
+
+        double first = (firstElapsed < 0.0 ? 0.0 : floor(firstElapsed / self.interval) + 1.0);
+        double last = floor(lastElapsed / self.interval);
+        return (last >= first ? (NSUInteger)(last - first + 1.0) : 0);
+    }
+
+    NSUInteger count = 0;
+    NSDate *fireDate = [self nextFireDateAfterDate:date];
+
+    while (fireDate && [fireDate compare:endDate] != NSOrderedDescending && count < CSScheduleRuleMaximumCountedFireDates) {
+        count++;
+        fireDate = [self nextFireDateAfterDate:fireDate];
+    }
+    return count;
+}
+
+#pragma mark - Description
+
+- (NSString *)description {
+
+    if (self.type == CSScheduleRuleTypeInterval) {
+        return [NSString stringWithFormat:@"every %g seconds from %@", self.interval, self.startDate];
+    }
+    return [NSString stringWithFormat:@"cron \"%@\" in %@", self.cronExpression, self.timeZone.name];
+}
+
+@end
@@ -0,0 +1,85 @@
+//
+//  CSScheduleStore.h
+//  CSUtils
+//
+//  Created by Josip Bernat on 18/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class CSScheduledNotification;
+@class CSScheduleRule;
+
+/**
+ *  Block called for each notification restored from store.
+ *
+ *  @param lastFireDate Fire date at which repeating notification fired last time or nil.
+ *  @param rule         Repeat rule or nil. Equal rules are restored as one shared instance.
+ *  @param userInfo     User info or nil.
+ *  @param tolerance    Tolerance of fire date.
+ */
+typedef void (^CSScheduleStoreRestoreBlock)(NSString *name, NSDate *fireDate, NSDate *lastFireDate, CSScheduleRule *rule, NSDictionary *userInfo, NSTimeInterval tolerance);
+
+/**
+ *  CSScheduleStore keeps scheduled notifications in append-only binary journal so they survive application restart. Every change is one small record, records added within commitInterval are written and synced to disk together. Journal is memory mapped and replayed in single pass while restoring and compacted when it grows to twice the size it had after last restore or compaction.
+ *
+ *  Name, fire date, last fire date, repeat rule, user info and tolerance are saved. User info must be property list.
+ */
+@interface CSScheduleStore : NSObject
+
+/**
+ *  Time during which journal records are collected before they are written and synced to disk. Default is 0.01 seconds.
+ */
+@property (nonatomic, readwrite) NSTimeInterval commitInterval;
+
+/**
+ *  Path of journal file.
+ */
+@property (nonatomic, strong, readonly) NSString *path;
+
+/**
+ *  Returns notifications which are scheduled at the moment. Called on store queue when journal is compacted.
+ */
+@property (nonatomic, copy) NSArray *(^notificationsBlock)(void);
+
+#pragma mark - Initialization
+
+/**
+ *  Creates new store. Nothing is read until notifications are restored.
+ *
+ *  @param path Path of journal file. NSInvalidArgumentException is raised if path is nil.
+ */
+- (instancetype)initWithPath:(NSString *)path; //designated initializer
+
+#pragma mark - Restoring
+
+/**
+ *  Replays journal and calls block for each saved notification. Incomplete record at the end, left by crash while writing, is cut off. Must be called once, before any change is saved.
+ *
+ *  @return Number of restored notifications.
+ */
+- (NSUInteger)restoreNotificationsUsingBlock:(CSScheduleStoreRestoreBlock)block;
+
+#pragma mark - Saving Changes
+
+/**
+ *  Saves notification. Notification saved earlier with the same name is replaced.
+ *
+ *  @return NO if notification can't be encoded, for example because user info isn't property list.
+ */
+- (BOOL)addNotification:(CSScheduledNotification *)notification;
+
+/**
+ *  Saves new fire date and last fire date of repeating notification.
+ */
+- (void)updateNotification:(CSScheduledNotification *)notification;
+
+- (void)removeNotificationWithName:(NSString *)name;
+
+/**
+ *  Writes and syncs all collected journal records. Returns when they are on disk.
+ */
+- (void)synchronize;
+
+@end
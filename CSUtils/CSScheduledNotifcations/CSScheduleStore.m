@@ -0,0 +1,540 @@
+//
+//  CSScheduleStore.m
+//  CSUtils
+//
+//  Created by Josip Bernat on 18/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#import "CSScheduleStore.h"
+#import "CSScheduledNotification.h"
+#import "CSScheduleRule.h"
+
+#include "CSScheduleJournal.h"
+#include <fcntl.h>
+#include <math.h>
+#include <unistd.h>
+
+/**
+ *  Journal isn't compacted while it has fewer records than this.
+ */
+static NSUInteger const CSScheduleStoreCompactionThreshold = 256;
+
+/**
+ *  Latest add and update record of notification name found while replaying journal. Bodies point into mapped journal, add body without bytes means there is no such record.
+ */
+typedef struct CSScheduleStoreSlot {
+    CSScheduleJournalBytes add;
+    CSScheduleJournalBytes update;
+} CSScheduleStoreSlot;
+
+#pragma mark - Encoding
+
+static inline NSData *CSScheduleStoreUTF8Data(NSString *string) {
+    return [string dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+static inline CSScheduleJournalBytes CSScheduleStoreBytesOfData(NSData *data) {
+    return (CSScheduleJournalBytes){data.bytes, data.length};
+}
+
+static inline double CSScheduleStoreIntervalOfDate(NSDate *date) {
+    return (date ? [date timeIntervalSinceReferenceDate] : NAN);
+}
+
+/**
+ *  Moves encoded bytes out of buffer into data object.
+ */
+static NSData *CSScheduleStoreDataOfBuffer(CSByteBuffer *buffer) {
+
+    size_t length = 0;
+    uint8_t *bytes = CSByteBufferDetach(buffer, &length);
+    if (!length) {
+        free(bytes);
+        return [NSData data];
+    }
+    return [NSData dataWithBytesNoCopy:bytes length:length freeWhenDone:YES];
+}
+
+static BOOL CSScheduleStoreAppendAddRecord(CSByteBuffer *buffer, CSScheduledNotification *notification) {
+
+    CSScheduleJournalNotification content;
+    memset(&content, 0, sizeof(content));
+    content.fireDate = CSScheduleStoreIntervalOfDate(notification.fireDate);
+    content.lastFireDate = CSScheduleStoreIntervalOfDate(notification.lastFireDate);
+    content.tolerance = notification.tolerance;
+
+    NSData *expression = nil;
+    NSData *timeZoneName = nil;
+    CSScheduleRule *rule = notification.repeatRule;
+    if (!rule) {
+        content.ruleType = CSScheduleJournalRuleTypeNone;
+    }
+    else if (rule.type == CSScheduleRuleTypeInterval) {
+        content.ruleType = CSScheduleJournalRuleTypeInterval;
+        content.ruleInterval = rule.interval;
+        content.ruleStartDate = CSScheduleStoreIntervalOfDate(rule.startDate);
+    }
+    else {
+        expression = CSScheduleStoreUTF8Data(rule.cronExpression);
+        timeZoneName = CSScheduleStoreUTF8Data(rule.timeZone.name);
+        content.ruleType = CSScheduleJournalRuleTypeCalendar;
+        content.ruleExpression = CSScheduleStoreBytesOfData(expression);
+        content.ruleTimeZoneName = CSScheduleStoreBytesOfData(timeZoneName);
+    }
+
+    NSData *userInfoData = nil;
+    if (notification.userInfo) {
+        userInfoData = [NSPropertyListSerialization dataWithPropertyList:notification.userInfo
+                                                                  format:NSPropertyListBinaryFormat_v1_0
+                                                                 options:0
+                                                                   error:nil];
+        if (!userInfoData) {
+            return NO;
+        }
+    }
+    content.userInfo = CSScheduleStoreBytesOfData(userInfoData);
+
+    NSData *name = CSScheduleStoreUTF8Data(notification.name);
+    return CSScheduleJournalAppendAdd(buffer, CSScheduleStoreBytesOfData(name), &content);
+}
+
+#pragma mark - Decoding
+
+static inline NSString *CSScheduleStoreStringOfBytes(CSScheduleJournalBytes bytes) {
+    return [[NSString alloc] initWithBytes:bytes.bytes length:bytes.length encoding:NSUTF8StringEncoding];
+}
+
+/**
+ *  Creates rule of decoded add record. Rules are cached by their encoded bytes so notifications sharing a rule don't create it again.
+ */
+static CSScheduleRule *CSScheduleStoreRuleOfNotification(const CSScheduleJournalNotification *content, NSMutableDictionary *rules) {
+
+    NSData *key = [NSData dataWithBytesNoCopy:(void *)content->rule.bytes
+                                       length:content->rule.length
+                                 freeWhenDone:NO];
+    CSScheduleRule *rule = rules[key];
+    if (rule) {
+        return rule;
+    }
+
+    if (content->ruleType == CSScheduleJournalRuleTypeInterval) {
+        rule = [CSScheduleRule ruleWithInterval:content->ruleInterval
+                                      startDate:[NSDate dateWithTimeIntervalSinceReferenceDate:content->ruleStartDate]];
+    }
+    else {
+
+        NSString *expression = CSScheduleStoreStringOfBytes(content->ruleExpression);
+        NSString *timeZoneName = CSScheduleStoreStringOfBytes(content->ruleTimeZoneName);
+        if (!expression || !timeZoneName) {
+            return nil;
+        }
+        rule = [[CSScheduleRule alloc] initWithCronExpression:expression
+                                                     timeZone:[NSTimeZone timeZoneWithName:timeZoneName]
+                                                        error:NULL];
+    }
+
+    if (rule) {
+        rules[key] = rule;
+    }
+    return rule;
+}
+
+#pragma mark - Implementation CSScheduleStore
+
+@interface CSScheduleStore () {
+
+    int _fileDescriptor;
+    dispatch_queue_t _queue;
+
+    NSMutableData *_uncommittedData;
+    BOOL _commitScheduled;
+
+    NSUInteger _recordsCount;
+    NSUInteger _compactedRecordsCount;
+}
+
+@property (nonatomic, strong, readwrite) NSString *path;
+
+@end
+
+@implementation CSScheduleStore
+
+#pragma mark - Memory Management
+
+- (void)dealloc {
+
+    if (_fileDescriptor >= 0) {
+        close(_fileDescriptor);
+    }
+}
+
+#pragma mark - Initialization
+
+- (instancetype)init {
+    return [self initWithPath:nil];
+}
+
+- (instancetype)initWithPath:(NSString *)path {
+
+    if (!path) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"path can't be nil"
+                               userInfo:nil] raise];
+    }
+
+    if (self = [super init]) {
+
+        self.path = path;
+        self.commitInterval = 0.01;
+
+        _fileDescriptor = -1;
+        _queue = dispatch_queue_create("com.clover-studio.CSScheduleStore", DISPATCH_QUEUE_SERIAL);
+        _uncommittedData = [[NSMutableData alloc] init];
+
+        [[NSFileManager defaultManager] createDirectoryAtPath:[path stringByDeletingLastPathComponent]
+                                  withIntermediateDirectories:YES
+                                                   attributes:nil
+                                                        error:nil];
+    }
+    return self;
+}
+
+#pragma mark - Restoring
+
+- (NSUInteger)restoreNotificationsUsingBlock:(CSScheduleStoreRestoreBlock)block {
+
+    __block NSUInteger count = 0;
+    dispatch_sync(_queue, ^{
+
+        size_t validLength = 0;
+        size_t length = 0;
+        count = [self replayJournalUsingBlock:block validLength:&validLength length:&length];
+
+        _fileDescriptor = open([self.path fileSystemRepresentation], O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (_fileDescriptor < 0) {
+            CSLog(@"Unable to open schedule store: %s", strerror(errno));
+            return;
+        }
+        if (validLength < length) {
+            ftruncate(_fileDescriptor, (off_t)validLength);
+        }
+        if (!validLength) {
+
+            CSByteBuffer header;
+            CSByteBufferInit(&header, CSScheduleJournalHeaderLength);
+            CSScheduleJournalAppendHeader(&header);
+            [self writeData:CSScheduleStoreDataOfBuffer(&header) toFileDescriptor:_fileDescriptor];
+        }
+    });
+    return count;
+}
+
+/**
+ *  First pass goes through mapped journal once and remembers only where latest records of each name are. Second pass decodes notifications which weren't removed, so replaced and removed records cost only reading their names. Must be called on queue.
+ */
+- (NSUInteger)replayJournalUsingBlock:(CSScheduleStoreRestoreBlock)block
+                          validLength:(size_t *)validLength
+                               length:(size_t *)length {
+
+    NSData *journal = [NSData dataWithContentsOfFile:self.path options:NSDataReadingMappedIfSafe error:nil];
+    *length = journal.length;
+    *validLength = 0;
+
+    CSScheduleJournalReader reader;
+    if (!CSScheduleJournalReaderInit(&reader, journal.bytes, journal.length)) {
+        //journal of unknown format is started over
+        return 0;
+    }
+    *validLength = reader.offset;
+
+    NSMutableDictionary *slotIndexes = [[NSMutableDictionary alloc] init];
+    NSMutableArray *names = [[NSMutableArray alloc] init];
+    CSScheduleStoreSlot *slots = NULL;
+    size_t slotsCapacity = 0;
+    NSUInteger recordsCount = 0;
+
+    CSScheduleJournalRecord record;
+    while (CSScheduleJournalReadRecord(&reader, &record)) {
+
+        NSString *name = CSScheduleStoreStringOfBytes(record.name);
+        if (!name) {
+            break;
+        }
+
+        NSNumber *index = slotIndexes[name];
+        if (!index) {
+
+            if (record.type != CSScheduleJournalRecordTypeAdd) {
+                *validLength = reader.offset;
+                recordsCount++;
+                continue;
+            }
+
+            if (names.count == slotsCapacity) {
+                slotsCapacity = MAX(slotsCapacity * 2, 1024);
+                slots = reallocf(slots, slotsCapacity * sizeof(CSScheduleStoreSlot));
+                if (!slots) {
+                    break;
+                }
+            }
+            index = @(names.count);
+            slotIndexes[name] = index;
+            [names addObject:name];
+            memset(&slots[names.count - 1], 0, sizeof(CSScheduleStoreSlot));
+        }
+
+        CSScheduleStoreSlot *slot = &slots[[index unsignedIntegerValue]];
+        switch (record.type) {
+            case CSScheduleJournalRecordTypeAdd:
+                slot->add = record.body;
+                slot->update = (CSScheduleJournalBytes){NULL, 0};
+                break;
+
+            case CSScheduleJournalRecordTypeUpdate:
+                if (slot->add.bytes) {
+                    slot->update = record.body;
+                }
+                break;
+
+            default:
+                memset(slot, 0, sizeof(CSScheduleStoreSlot));
+                break;
+        }
+
+        *validLength = reader.offset;
+        recordsCount++;
+    }
+
+    NSMutableDictionary *rules = [[NSMutableDictionary alloc] init];
+    NSUInteger count = 0;
+
+    for (NSUInteger i = 0; slots && i < names.count; i++) {
+
+        CSScheduleStoreSlot slot = slots[i];
+        CSScheduleJournalNotification content;
+        if (!slot.add.bytes || !CSScheduleJournalDecodeAdd(slot.add, &content)) {
+            continue;
+        }
+
+        double fireInterval = content.fireDate;
+        double lastFireInterval = content.lastFireDate;
+        if (slot.update.bytes && !CSScheduleJournalDecodeUpdate(slot.update, &fireInterval, &lastFireInterval)) {
+            continue;
+        }
+        if (isnan(fireInterval)) {
+            continue;
+        }
+
+        CSScheduleRule *rule = nil;
+        if (content.ruleType != CSScheduleJournalRuleTypeNone && !(rule = CSScheduleStoreRuleOfNotification(&content, rules))) {
+            continue;
+        }
+
+        NSDictionary *userInfo = nil;
+        if (content.userInfo.length) {
+
+            NSData *data = [NSData dataWithBytesNoCopy:(void *)content.userInfo.bytes length:content.userInfo.length freeWhenDone:NO];
+            userInfo = [NSPropertyListSerialization propertyListWithData:data
+                                                                 options:NSPropertyListImmutable
+                                                                  format:NULL
+                                                                   error:nil];
+            if (![userInfo isKindOfClass:[NSDictionary class]]) {
+                continue;
+            }
+        }
+
+        NSDate *lastFireDate = (isnan(lastFireInterval) ? nil : [NSDate dateWithTimeIntervalSinceReferenceDate:lastFireInterval]);
+        block(names[i], [NSDate dateWithTimeIntervalSinceReferenceDate:fireInterval], lastFireDate, rule, userInfo, content.tolerance);
+        count++;
+    }
+    free(slots);
+
+    _recordsCount = recordsCount;
+    _compactedRecordsCount = count;
+    return count;
+}
+
+#pragma mark - Saving Changes
+
+- (BOOL)addNotification:(CSScheduledNotification *)notification {
+
+    CSByteBuffer record;
+    CSByteBufferInit(&record, 0);
+    if (!CSScheduleStoreAppendAddRecord(&record, notification)) {
+
+        CSByteBufferFree(&record);
+
+        //saved notification with the same name mustn't come back after restart
+        CSLog(@"Unable to save scheduled notification %@", notification.name);
+        [self removeNotificationWithName:notification.name];
+        return NO;
+    }
+
+    [self appendRecord:CSScheduleStoreDataOfBuffer(&record)];
+    return YES;
+}
+
+- (void)updateNotification:(CSScheduledNotification *)notification {
+
+    CSByteBuffer record;
+    CSByteBufferInit(&record, 0);
+    NSData *name = CSScheduleStoreUTF8Data(notification.name);
+
+    if (CSScheduleJournalAppendUpdate(&record, CSScheduleStoreBytesOfData(name),
+                                      CSScheduleStoreIntervalOfDate(notification.fireDate),
+                                      CSScheduleStoreIntervalOfDate(notification.lastFireDate))) {
+        [self appendRecord:CSScheduleStoreDataOfBuffer(&record)];
+    }
+    else {
+        CSByteBufferFree(&record);
+    }
+}
+
+- (void)removeNotificationWithName:(NSString *)name {
+
+    CSByteBuffer record;
+    CSByteBufferInit(&record, 0);
+
+    if (CSScheduleJournalAppendRemove(&record, CSScheduleStoreBytesOfData(CSScheduleStoreUTF8Data(name)))) {
+        [self appendRecord:CSScheduleStoreDataOfBuffer(&record)];
+    }
+    else {
+        CSByteBufferFree(&record);
+    }
+}
+
+#pragma mark - Journal
+
+/**
+ *  Adds record to uncommitted data and schedules commit.
+ */
+- (void)appendRecord:(NSData *)record {
+
+    __weak CSScheduleStore *this = self;
+    dispatch_async(_queue, ^{
+
+        CSScheduleStore *strongThis = this;
+        if (!strongThis) {
+            return;
+        }
+
+        [strongThis->_uncommittedData appendData:record];
+        strongThis->_recordsCount++;
+
+        if (!strongThis->_commitScheduled) {
+
+            strongThis->_commitScheduled = YES;
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(strongThis.commitInterval * NSEC_PER_SEC)), strongThis->_queue, ^{
+                [this commit];
+            });
+        }
+    });
+}
+
+/**
+ *  Writes all uncommitted records with single sync. Must be called on queue.
+ */
+- (void)commit {
+
+    _commitScheduled = NO;
+    if (!_uncommittedData.length || _fileDescriptor < 0) {
+        return;
+    }
+
+    if (![self writeData:_uncommittedData toFileDescriptor:_fileDescriptor]) {
+        CSLog(@"Unable to write schedule store: %s", strerror(errno));
+    }
+    [_uncommittedData setLength:0];
+    [self syncFileDescriptor:_fileDescriptor];
+
+    //journal at most doubles between compactions so each change costs amortized constant time
+    if (_recordsCount > CSScheduleStoreCompactionThreshold && _recordsCount > 2 * _compactedRecordsCount) {
+        [self compact];
+    }
+}
+
+/**
+ *  Rewrites journal so it contains only add records of scheduled notifications. Changes queued while notifications are collected are applied again after compaction, replaying them twice gives the same result. New journal replaces old one atomically.
+ */
+- (void)compact {
+
+    NSArray *notifications = (self.notificationsBlock ? self.notificationsBlock() : nil);
+    if (!notifications) {
+        return;
+    }
+
+    CSByteBuffer buffer;
+    CSByteBufferInit(&buffer, 0);
+    if (!CSScheduleJournalAppendHeader(&buffer)) {
+        CSByteBufferFree(&buffer);
+        return;
+    }
+
+    NSUInteger count = 0;
+    for (CSScheduledNotification *notification in notifications) {
+        if (CSScheduleStoreAppendAddRecord(&buffer, notification)) {
+            count++;
+        }
+    }
+    NSData *data = CSScheduleStoreDataOfBuffer(&buffer);
+
+    NSString *temporaryPath = [self.path stringByAppendingPathExtension:@"tmp"];
+    int fileDescriptor = open([temporaryPath fileSystemRepresentation], O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fileDescriptor < 0) {
+        return;
+    }
+
+    if (![self writeData:data toFileDescriptor:fileDescriptor] || ![self syncFileDescriptor:fileDescriptor] ||
+        rename([temporaryPath fileSystemRepresentation], [self.path fileSystemRepresentation]) != 0) {
+
+        close(fileDescriptor);
+        unlink([temporaryPath fileSystemRepresentation]);
+        return;
+    }
+
+    close(_fileDescriptor);
+    _fileDescriptor = fileDescriptor;
+    _recordsCount = count;
+    _compactedRecordsCount = count;
+}
+
+- (BOOL)writeData:(NSData *)data toFileDescriptor:(int)fileDescriptor {
+
+    const uint8_t *bytes = data.bytes;
+    size_t remaining = data.length;
+
+    while (remaining) {
+
+        ssize_t written = write(fileDescriptor, bytes, remaining);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return NO;
+        }
+        bytes += written;
+        remaining -= (size_t)written;
+    }
+    return YES;
+}
+
+- (BOOL)syncFileDescriptor:(int)fileDescriptor {
+
+#ifdef F_FULLFSYNC
+    //fsync on Darwin doesn't flush drive cache
+    if (fcntl(fileDescriptor, F_FULLFSYNC) == 0) {
+        return YES;
+    }
+#endif
+    return (fsync(fileDescriptor) == 0);
+}
+
+- (void)synchronize {
+
+    dispatch_sync(_queue, ^{
+        [self commit];
+    });
+}
+
+@end
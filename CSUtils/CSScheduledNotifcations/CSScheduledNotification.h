@@ -8,6 +8,8 @@
 
 #import <Foundation/Foundation.h>
 
+@class CSScheduleRule;
+
 /**
  *  CSSCheduledNotification object contains notification data such as notification name, user info and fire data.
  */
@@ -24,9 +26,29 @@
 @property (nonatomic, strong) NSDictionary *userInfo;
 
 /**
- *  The date at which the notification will fire. The date must be greather that current date using compare: method with [NSDate date] date.
+ *  The date at which the notification will fire. The date must be greather that current date using compare: method with [NSDate date] date. For repeating notification it's moved to next fire date of repeatRule each time notification fires.
+ */
+@property (strong) NSDate *fireDate;
+
+/**
+ *  Time after fireDate within which notification may fire. CSScheduledNotificationCenter fires notifications whose tolerance windows overlap together, with one wakeup and one batch of observer calls, which saves battery and interrupts main run loop less often. Default is 0. Change takes effect next time notification is scheduled. NSInvalidArgumentException is raised if it's less than 0.
+ */
+@property (nonatomic, readwrite) NSTimeInterval tolerance;
+
+/**
+ *  Rule which computes fire dates of repeating notification. Nil for notification which fires once.
+ */
+@property (nonatomic, readonly, strong) CSScheduleRule *repeatRule;
+
+/**
+ *  Fire date at which repeating notification fired last time. Nil until it fires.
+ */
+@property (readonly, strong) NSDate *lastFireDate;
+
+/**
+ *  Number of fire dates after lastFireDate which already passed when notification fired, for example while device was asleep. They are coalesced into one fire instead of firing in a burst.
  */
-@property (nonatomic, strong) NSDate *fireDate;
+@property (readonly) NSUInteger missedOccurrencesCount;
 
 
 #pragma mark - Class Methods
@@ -55,6 +77,19 @@
                            fireDate:(NSDate *)fireDate
                            userInfo:(NSDictionary *)userInfo;
 
+/**
+ *  Creates and returns a new repeating CSScheduledNotification object.
+ *
+ *  @param name     The name of the notification.
+ *  @param rule     The rule computing fire dates. NSInvalidArgumentException is raised if nil or if it never fires.
+ *  @param userInfo The user information dictionary.
+ *
+ *  @return A new CSScheduledNotification object with fireDate set to first fire date of the rule.
+ */
++ (id)scheduledNotificationWithName:(NSString *)name
+                               rule:(CSScheduleRule *)rule
+                           userInfo:(NSDictionary *)userInfo;
+
 #pragma mark - Instance Methods
 /**
  *  Initializes a new CSScheduledNotification object with given parameters.
@@ -69,6 +104,19 @@
           fireDate:(NSDate *)fireDate
           userInfo:(NSDictionary *)userInfo;
 
+/**
+ *  Initializes a new repeating CSScheduledNotification object. First fire date is computed from rule.
+ *
+ *  @param name     The name of the notification.
+ *  @param rule     The rule computing fire dates. NSInvalidArgumentException is raised if nil or if it never fires.
+ *  @param userInfo The user information dictionary.
+ *
+ *  @return The scheduled notification object with properties configured with given parameters.
+ */
+- (id)initWithName:(NSString *)name
+              rule:(CSScheduleRule *)rule
+          userInfo:(NSDictionary *)userInfo;
+
 /**
  *  Inspects if fire date is in future comparing to [NSDate date]
  *
@@ -7,9 +7,20 @@
 //
 
 #import "CSScheduledNotification.h"
+#import "CSScheduleRule.h"
+
+@interface CSScheduledNotification ()
+
+@property (nonatomic, readwrite, strong) CSScheduleRule *repeatRule;
+@property (readwrite, strong) NSDate *lastFireDate;
+@property (readwrite) NSUInteger missedOccurrencesCount;
+
+@end
 
 @implementation CSScheduledNotification
 
+@synthesize fireDate = _fireDate;
+
 #pragma mark - Class Methods
 
 + (id)scheduledNotificationWithName:(NSString *)name
@@ -31,6 +42,15 @@
     return note;
 }
 
++ (id)scheduledNotificationWithName:(NSString *)name
+                               rule:(CSScheduleRule *)rule
+                           userInfo:(NSDictionary *)userInfo {
+    
+    return [[self alloc] initWithName:name
+                                 rule:rule
+                             userInfo:userInfo];
+}
+
 #pragma mark - Initialization
 
 - (id)initWithName:(NSString *)name
@@ -47,6 +67,51 @@
     return self;
 }
 
+- (id)initWithName:(NSString *)name
+              rule:(CSScheduleRule *)rule
+          userInfo:(NSDictionary *)userInfo {
+    
+    if (!rule) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"A rule can't be nil!"
+                               userInfo:nil] raise];
+    }
+    
+    NSDate *fireDate = [rule nextFireDateAfterDate:[NSDate date]];
+    if (!fireDate) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"A rule never fires!"
+                               userInfo:nil] raise];
+    }
+    
+    if (self = [super init]) {
+        
+        self.name = name;
+        self.userInfo = userInfo;
+        self.repeatRule = rule;
+        //computed date is in future, it just skips validation against a later [NSDate date]
+        _fireDate = fireDate;
+    }
+    
+    return self;
+}
+
+#pragma mark - Repeating
+
+/**
+ *  Called by CSScheduledNotificationCenter when repeating notification fires.
+ */
+- (void)moveToFireDate:(NSDate *)fireDate
+          lastFireDate:(NSDate *)lastFireDate
+missedOccurrencesCount:(NSUInteger)missedOccurrencesCount {
+    
+    @synchronized(self) {
+        self.lastFireDate = lastFireDate;
+        self.missedOccurrencesCount = missedOccurrencesCount;
+        _fireDate = fireDate;
+    }
+}
+
 #pragma mark - Setters 
 
 - (void)setName:(NSString *)name {
@@ -68,7 +133,29 @@
                                userInfo:nil] raise];
     }
 
-    _fireDate = fireDate;
+    @synchronized(self) {
+        _fireDate = fireDate;
+    }
+}
+
+- (void)setTolerance:(NSTimeInterval)tolerance {
+    
+    if (!(tolerance >= 0.0)) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"Tolerance can't be less than 0!"
+                               userInfo:nil] raise];
+    }
+    
+    _tolerance = tolerance;
+}
+
+#pragma mark - Getters
+
+- (NSDate *)fireDate {
+    
+    @synchronized(self) {
+        return _fireDate;
+    }
 }
 
 #pragma mark - Validate
@@ -86,9 +173,11 @@
     NSDateFormatter *dateFormatter = [[NSDateFormatter alloc] init];
     [dateFormatter setDateFormat:@"yyyy-MM-dd HH:mm:ss Z"];
     
-    return [NSString stringWithFormat:@"name: %@, fireDate: %@, userInfo: %@",
+    return [NSString stringWithFormat:@"name: %@, fireDate: %@, tolerance: %g, repeatRule: %@, userInfo: %@",
             _name,
-            [dateFormatter stringFromDate:_fireDate],
+            [dateFormatter stringFromDate:self.fireDate],
+            _tolerance,
+            _repeatRule,
             _userInfo];
 }
 
@@ -11,10 +11,35 @@
 @class CSScheduledNotification;
 
 /**
- *  CSScheduledNotificationCenter handles scheduling notifications for fire.
+ *  CSScheduledNotificationCenter handles scheduling notifications for fire. All notifications are kept in hierarchical timing wheels driven by single dispatch timer, so scheduling and removing notification is O(1) no matter how many of them are scheduled. Timer wakes up when the first tolerance window closes and fires every notification whose window already opened, observers of all of them are notified in one batch. Thread safe.
  */
 @interface CSScheduledNotificationCenter : NSObject
 
+/**
+ *  Resolution of scheduler in seconds. Fire dates are rounded up to whole ticks so notification never fires early but can fire up to one tick late. Default is 0.1. NSInvalidArgumentException is raised if it isn't greater than 0.
+ */
+@property (nonatomic, readwrite) NSTimeInterval tickInterval;
+
+/**
+ *  Number of notifications waiting to fire.
+ */
+@property (nonatomic, readonly) NSUInteger scheduledNotificationsCount;
+
+/**
+ *  Number of timer wakeups at which notifications fired.
+ */
+@property (nonatomic, readonly) NSUInteger wakeupsCount;
+
+/**
+ *  Number of wakeups saved by firing notifications with overlapping tolerance windows together. Notifications fired by one wakeup would otherwise wake up once for each distinct tick of their fire dates.
+ */
+@property (nonatomic, readonly) NSUInteger savedWakeupsCount;
+
+/**
+ *  Path of store in which notifications are saved. Nil until center is started with startWithStorePath:.
+ */
+@property (nonatomic, readonly, strong) NSString *storePath;
+
 #pragma mark - Class Methods
 
 /**
@@ -29,22 +54,49 @@
  */
 + (void)start;
 
+/**
+ *  Starts CSScheduledNotificationCenter and restores notifications saved in store at given path. Notifications added, removed or fired afterwards are saved to the store, so schedules survive application restart and don't have to be added again. Store is memory mapped and restored in single pass. Only first call has effect.
+ *
+ *  Add observers before calling this method, notifications which became due while application wasn't running fire right after restore. Repeating notifications fire once for all occurrences they missed. User info of saved notifications must be property list.
+ *
+ *  @param path Path of store file. If nil store is kept in application's Library/Application Support directory.
+ */
++ (void)startWithStorePath:(NSString *)path;
+
+/**
+ *  Writes and syncs store changes which are still collected in memory. Returns when they are on disk. Changes are written within 0.01 seconds anyway, call it when application is about to terminate.
+ */
++ (void)synchronizeStore;
+
 /**
  *  Adds an entry to the receiver’s dispatch table with an observer, a notification selector, notification name and sender.
  *
  *  @param notificationObserver Object registering as an observer. This value must not be nil.
- *  @param selector             Selector that specifies the message the receiver sends notificationObserver to notify it of the notification posting. The method specified by notificationSelector must have one and only one argument (an instance of CSScheduledNotification).
+ *  @param selector             Selector that specifies the message the receiver sends notificationObserver to notify it of the notification posting. The method specified by notificationSelector must have one and only one argument (an instance of CSScheduledNotification). Its implementation is looked up once here, observer is held weakly. NSInvalidArgumentException is raised if observer doesn't respond to it.
  *  @param notificationName     The name of the notification for which to register the observer; that is, only notifications with this name are delivered to the observer. This value must not be nil.
  */
 + (void)addObserver:(id)notificationObserver
            selector:(SEL)selector
                name:(NSString *)notificationName;
 
+/**
+ *  Adds an entry to the receiver’s dispatch table with an observer which is notified on given queue. Observers which don't need main thread should use it so firing doesn't interrupt main run loop.
+ *
+ *  @param notificationObserver Object registering as an observer. This value must not be nil.
+ *  @param selector             Selector that specifies the message the receiver sends notificationObserver to notify it of the notification posting. The method specified by notificationSelector must have one and only one argument (an instance of CSScheduledNotification).
+ *  @param notificationName     The name of the notification for which to register the observer. This value must not be nil.
+ *  @param queue                Queue on which observer is notified. If nil observer is notified on main thread.
+ */
++ (void)addObserver:(id)notificationObserver
+           selector:(SEL)selector
+               name:(NSString *)notificationName
+              queue:(dispatch_queue_t)queue;
+
 /**
  *  Removes matching entries from the receiver’s dispatch table.
  *
  *  @param notificationObserver Observer to remove from the dispatch table. Must not be nil, or message will have no effect.
- *  @param notificationName     Name of the notification to remove from dispatch table
+ *  @param notificationName     Name of the notification to remove from dispatch table. If nil observer is removed for all names.
  */
 + (void)removeObserver:(id)notificationObserver
                   name:(NSString *)notificationName;
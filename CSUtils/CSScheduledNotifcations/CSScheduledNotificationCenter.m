@@ -8,14 +8,136 @@
 
 #import "CSScheduledNotificationCenter.h"
 #import "CSScheduledNotification.h"
+#import "CSScheduleRule.h"
+#import "CSScheduleStore.h"
+#import "CSTimingWheel.h"
+#import <UIKit/UIKit.h>
+#include <mach/mach_time.h>
+
+/**
+ *  Monotonic time in nanoseconds. Like dispatch timers it doesn't advance while device sleeps.
+ */
+static uint64_t CSScheduledNotificationCenterNow(void) {
+    
+    static mach_timebase_info_data_t timebase;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        mach_timebase_info(&timebase);
+    });
+    return mach_absolute_time() * timebase.numer / timebase.denom;
+}
+
+@interface CSScheduledNotification (CSScheduledNotificationCenter)
+
+- (void)setRepeatRule:(CSScheduleRule *)repeatRule;
+- (void)moveToFireDate:(NSDate *)fireDate
+          lastFireDate:(NSDate *)lastFireDate
+missedOccurrencesCount:(NSUInteger)missedOccurrencesCount;
+
+@end
+
+#pragma mark - Interface CSScheduledNotificationObserver
+
+typedef void (*CSScheduledNotificationObserverIMP)(id, SEL, CSScheduledNotification *);
+typedef void (*CSScheduledNotificationObserverNoArgumentIMP)(id, SEL);
+
+/**
+ *  Observer registration. Method implementation is looked up once when observer is added and called directly on each fire. Observer is notified on queue or on main thread if queue is nil.
+ */
+@interface CSScheduledNotificationObserver : NSObject {
+    
+@public
+    __weak id _target;
+    SEL _selector;
+    IMP _implementation;
+    BOOL _passesNotification;
+    NSUInteger _index;
+}
 
-NSString * const kCSScheduledInternalNotificationKey = @"kCSScheduledInternalNotificationKey";
+@property (nonatomic, strong) NSString *name;
+@property (nonatomic, strong) dispatch_queue_t queue;
 
-@interface CSScheduledNotificationCenter ()
+- (void)notifyWithNotification:(CSScheduledNotification *)notification;
 
-@property (nonatomic, strong) NSMutableDictionary *timersDictionary;
+@end
+
+@implementation CSScheduledNotificationObserver
+
+- (void)notifyWithNotification:(CSScheduledNotification *)notification {
+    
+    id target = _target;
+    if (!target) {
+        return;
+    }
+    
+    if (_passesNotification) {
+        ((CSScheduledNotificationObserverIMP)_implementation)(target, _selector, notification);
+    }
+    else {
+        ((CSScheduledNotificationObserverNoArgumentIMP)_implementation)(target, _selector);
+    }
+}
+
+@end
+
+/**
+ *  Calls observers stored as pairs of observer and notification.
+ */
+static void CSScheduledNotificationObserversNotify(NSArray *calls) {
+    
+    for (NSUInteger i = 0; i + 1 < calls.count; i += 2) {
+        [(CSScheduledNotificationObserver *)calls[i] notifyWithNotification:calls[i + 1]];
+    }
+}
+
+#pragma mark - Entries
+
+/**
+ *  Scheduled notification in timing wheels. Deadline entry is placed at the last tick at which notification may fire and drives the timer. Notification with tolerance also has window entry placed at its first tick, so any wakeup within its window collects it. Contexts of both entries point to this struct, notification is retained.
+ */
+typedef struct CSScheduledNotificationEntry {
+    CSTimingWheelEntry deadlineEntry;
+    CSTimingWheelEntry windowEntry;
+    uint64_t firstTick;
+    void *notification;
+} CSScheduledNotificationEntry;
+
+static inline CSScheduledNotification *CSScheduledNotificationEntryGetNotification(CSScheduledNotificationEntry *entry) {
+    return (__bridge CSScheduledNotification *)entry->notification;
+}
+
+#pragma mark - Implementation CSScheduledNotificationCenter
+
+@interface CSScheduledNotificationCenter () {
+    
+    CSTimingWheel *_wheel;
+    CSTimingWheel *_windowWheel;
+    uint64_t _tickNanoseconds;
+    uint64_t _armedTick;
+    CSScheduleStore *_store;
+    NSUInteger _wakeupsCount;
+    NSUInteger _savedWakeupsCount;
+}
+
+@property (nonatomic, readwrite, strong) NSString *storePath;
+
+/**
+ *  Entries of scheduled notifications keyed by notification name.
+ */
+@property (nonatomic, strong) NSMutableDictionary *entriesDictionary;
+
+/**
+ *  Observer registrations of each notification name kept in array so fan-out is one pass. Every registration knows its index so it's removed by swapping with last one.
+ */
 @property (nonatomic, strong) NSMutableDictionary *observersDictionary;
 
+/**
+ *  Reverse index from observer to its registrations keyed by notification name. Observers are held weakly.
+ */
+@property (nonatomic, strong) NSMapTable *registrationsTable;
+@property (nonatomic, strong) dispatch_queue_t timerQueue;
+@property (nonatomic, strong) dispatch_source_t timerSource;
+
 @end
 
 @implementation CSScheduledNotificationCenter
@@ -37,19 +159,144 @@ NSString * const kCSScheduledInternalNotificationKey = @"kCSScheduledInternalNot
     [self defaultCenter];
 }
 
++ (void)startWithStorePath:(NSString *)path {
+    
+    if (!path) {
+        NSString *directory = [NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory, NSUserDomainMask, YES) firstObject];
+        path = [directory stringByAppendingPathComponent:@"CSScheduledNotificationCenter.store"];
+    }
+    [[self defaultCenter] openStoreAtPath:path];
+}
+
++ (void)synchronizeStore {
+    
+    CSScheduledNotificationCenter *center = [self defaultCenter];
+    CSScheduleStore *store = nil;
+    @synchronized(center) {
+        store = center->_store;
+    }
+    [store synchronize];
+}
+
+#pragma mark - Memory Management
+
+- (void)dealloc {
+    
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+    dispatch_source_cancel(_timerSource);
+    
+    for (NSValue *value in [_entriesDictionary allValues]) {
+        [self releaseEntry:[value pointerValue]];
+    }
+    free(_wheel);
+    free(_windowWheel);
+}
+
 #pragma mark - Initialization
 
 - (id)init {
     
     if (self = [super init]) {
         
-        self.timersDictionary = [[NSMutableDictionary alloc] init];
+        self.entriesDictionary = [[NSMutableDictionary alloc] init];
         self.observersDictionary = [[NSMutableDictionary alloc] init];
+        self.registrationsTable = [[NSMapTable alloc] initWithKeyOptions:NSPointerFunctionsWeakMemory | NSPointerFunctionsObjectPointerPersonality
+                                                            valueOptions:NSPointerFunctionsStrongMemory
+                                                                capacity:0];
+        
+        _tickInterval = 0.1;
+        _tickNanoseconds = (uint64_t)(_tickInterval * NSEC_PER_SEC);
+        _armedTick = UINT64_MAX;
+        
+        _wheel = malloc(sizeof(CSTimingWheel));
+        _windowWheel = malloc(sizeof(CSTimingWheel));
+        CSTimingWheelInit(_wheel, [self currentTick]);
+        CSTimingWheelInit(_windowWheel, _wheel->currentTick);
+        
+        self.timerQueue = dispatch_queue_create("com.clover-studio.CSScheduledNotificationCenter.timer", DISPATCH_QUEUE_SERIAL);
+        self.timerSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self.timerQueue);
+        
+        __weak id this = self;
+        dispatch_source_set_event_handler(self.timerSource, ^{
+            [this onWheelTimer];
+        });
+        dispatch_source_set_timer(self.timerSource, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+        dispatch_resume(self.timerSource);
+        
+        //wheel runs on time which stops while device sleeps, fire dates are wall clock dates
+        NSNotificationCenter *notificationCenter = [NSNotificationCenter defaultCenter];
+        [notificationCenter addObserver:self
+                               selector:@selector(onClockChange:)
+                                   name:NSSystemClockDidChangeNotification
+                                 object:nil];
+        [notificationCenter addObserver:self
+                               selector:@selector(onClockChange:)
+                                   name:UIApplicationSignificantTimeChangeNotification
+                                 object:nil];
+        [notificationCenter addObserver:self
+                               selector:@selector(onClockChange:)
+                                   name:UIApplicationDidBecomeActiveNotification
+                                 object:nil];
     }
     
     return self;
 }
 
+#pragma mark - Setters
+
+- (void)setTickInterval:(NSTimeInterval)tickInterval {
+    
+    if (!(tickInterval > 0.0)) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"tickInterval must be greater than 0"
+                               userInfo:nil] raise];
+    }
+    
+    @synchronized(self) {
+        
+        _tickInterval = tickInterval;
+        _tickNanoseconds = MAX((uint64_t)(tickInterval * NSEC_PER_SEC), 1);
+        
+        //ticks of scheduled entries are in old units
+        [self rescheduleEntries];
+    }
+}
+
+#pragma mark - Getters
+
+- (NSUInteger)scheduledNotificationsCount {
+    
+    @synchronized(self) {
+        return _entriesDictionary.count;
+    }
+}
+
+- (NSUInteger)wakeupsCount {
+    
+    @synchronized(self) {
+        return _wakeupsCount;
+    }
+}
+
+- (NSUInteger)savedWakeupsCount {
+    
+    @synchronized(self) {
+        return _savedWakeupsCount;
+    }
+}
+
+- (NSArray *)scheduledNotifications {
+    
+    @synchronized(self) {
+        
+        NSMutableArray *notifications = [[NSMutableArray alloc] initWithCapacity:_entriesDictionary.count];
+        for (NSValue *value in [_entriesDictionary allValues]) {
+            [notifications addObject:CSScheduledNotificationEntryGetNotification([value pointerValue])];
+        }
+        return notifications;
+    }
+}
+
 #pragma mark - Adding Schedule
 
 + (void)addObserver:(id)notificationObserver
@@ -58,24 +305,64 @@ NSString * const kCSScheduledInternalNotificationKey = @"kCSScheduledInternalNot
     
     [[CSScheduledNotificationCenter defaultCenter] addObserver:notificationObserver
                                                       selector:selector
-                                                          name:notificationName];
+                                                          name:notificationName
+                                                         queue:nil];
+}
+
++ (void)addObserver:(id)notificationObserver
+           selector:(SEL)selector
+               name:(NSString *)notificationName
+              queue:(dispatch_queue_t)queue {
+    
+    [[CSScheduledNotificationCenter defaultCenter] addObserver:notificationObserver
+                                                      selector:selector
+                                                          name:notificationName
+                                                         queue:queue];
 }
 
 - (void)addObserver:(id)notificationObserver
            selector:(SEL)selector
-               name:(NSString *)notificationName {
+               name:(NSString *)notificationName
+              queue:(dispatch_queue_t)queue {
     
-    NSMethodSignature *methodSignature = [[notificationObserver class] instanceMethodSignatureForSelector:selector];
-    NSInvocation *invocation = [NSInvocation invocationWithMethodSignature:methodSignature];
-    invocation.selector = selector;
-    invocation.target = notificationObserver;
+    if (!notificationObserver || !notificationName) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:@"Observer and notification name can't be nil!"
+                               userInfo:nil] raise];
+    }
     
-    if (methodSignature.numberOfArguments > 2) {
-        [invocation setArgument:&notificationName atIndex:2];
+    if (![notificationObserver respondsToSelector:selector]) {
+        [[NSException exceptionWithName:NSInvalidArgumentException
+                                 reason:[NSString stringWithFormat:@"Observer doesn't respond to %@", NSStringFromSelector(selector)]
+                               userInfo:nil] raise];
     }
     
-    NSMutableSet *observers = [self observersForName:notificationName];
-    [observers addObject:invocation];
+    CSScheduledNotificationObserver *observer = [[CSScheduledNotificationObserver alloc] init];
+    observer->_target = notificationObserver;
+    observer->_selector = selector;
+    observer->_implementation = [notificationObserver methodForSelector:selector];
+    observer->_passesNotification = ([[notificationObserver methodSignatureForSelector:selector] numberOfArguments] > 2);
+    observer.name = notificationName;
+    observer.queue = queue;
+    
+    @synchronized(self) {
+        
+        NSMutableArray *observers = [self observersForName:notificationName];
+        observer->_index = observers.count;
+        [observers addObject:observer];
+        
+        NSMutableDictionary *registrations = [_registrationsTable objectForKey:notificationObserver];
+        if (!registrations) {
+            registrations = [[NSMutableDictionary alloc] init];
+            [_registrationsTable setObject:registrations forKey:notificationObserver];
+        }
+        NSMutableArray *registrationsForName = registrations[notificationName];
+        if (!registrationsForName) {
+            registrationsForName = [[NSMutableArray alloc] initWithCapacity:1];
+            registrations[notificationName] = registrationsForName;
+        }
+        [registrationsForName addObject:observer];
+    }
 }
 
 #pragma mark - Removing Observers
@@ -94,74 +381,412 @@ NSString * const kCSScheduledInternalNotificationKey = @"kCSScheduledInternalNot
 - (void)removeObserver:(id)notificationObserver
                   name:(NSString *)notificationName {
 
-    NSMutableSet *observers = [self observersForName:notificationName];
-    [observers enumerateObjectsUsingBlock:^(id obj, BOOL *stop) {
-       
-        NSInvocation *invocation = (NSInvocation *)obj;
-        if ([invocation.target isEqual:notificationObserver]) {
-            [observers removeObject:invocation];
+    if (!notificationObserver) {
+        return;
+    }
+    
+    @synchronized(self) {
+        
+        NSMutableDictionary *registrations = [_registrationsTable objectForKey:notificationObserver];
+        NSArray *names = (notificationName ? @[notificationName] : [registrations allKeys]);
+        
+        for (NSString *name in names) {
+            
+            NSMutableArray *observers = _observersDictionary[name];
+            for (CSScheduledNotificationObserver *observer in registrations[name]) {
+                [self removeObserver:observer fromObservers:observers];
+            }
+            [registrations removeObjectForKey:name];
+            
+            if (observers.count == 0) {
+                [_observersDictionary removeObjectForKey:name];
+                [self removeEntryForName:name];
+            }
         }
-    }];
+        
+        if (registrations && registrations.count == 0) {
+            [_registrationsTable removeObjectForKey:notificationObserver];
+        }
+    }
+}
+
+/**
+ *  Removes registration in O(1) by moving last registration to its place.
+ */
+- (void)removeObserver:(CSScheduledNotificationObserver *)observer fromObservers:(NSMutableArray *)observers {
+    
+    NSUInteger index = observer->_index;
+    NSUInteger lastIndex = observers.count - 1;
+    if (index > lastIndex || observers[index] != observer) {
+        return;
+    }
     
-    if (observers.count == 0) {
-        [self invalidateNotificationTimer:notificationName];
+    if (index != lastIndex) {
+        CSScheduledNotificationObserver *lastObserver = observers[lastIndex];
+        observers[index] = lastObserver;
+        lastObserver->_index = index;
     }
+    [observers removeLastObject];
 }
 
-- (void)fireObserversForNotification:(CSScheduledNotification *)note {
+/**
+ *  Notifies observers of all notifications fired by one wakeup. Calls are batched by queue so each queue gets one block, observers without queue are notified in one pass on main thread.
+ */
+- (void)fireObserversForNotifications:(NSArray *)notifications {
+    
+    NSMutableArray *mainThreadCalls = [[NSMutableArray alloc] init];
+    NSMapTable *queueCalls = nil;
     
-    __weak id notification = note;
-    NSMutableSet *observers = [self observersForName:[note name]];
-    [observers enumerateObjectsUsingBlock:^(id obj, BOOL *stop) {
-       
-        NSInvocation *invocation = (NSInvocation *)obj;
-        if (invocation.methodSignature.numberOfArguments > 2) {
-            __strong id strongNote = notification;
-            [invocation setArgument:&strongNote atIndex:2];
+    @synchronized(self) {
+        
+        for (CSScheduledNotification *notification in notifications) {
+            for (CSScheduledNotificationObserver *observer in _observersDictionary[notification.name]) {
+                
+                NSMutableArray *calls = mainThreadCalls;
+                if (observer.queue) {
+                    
+                    if (!queueCalls) {
+                        queueCalls = [[NSMapTable alloc] initWithKeyOptions:NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPointerPersonality
+                                                               valueOptions:NSPointerFunctionsStrongMemory
+                                                                   capacity:0];
+                    }
+                    calls = [queueCalls objectForKey:observer.queue];
+                    if (!calls) {
+                        calls = [[NSMutableArray alloc] init];
+                        [queueCalls setObject:calls forKey:observer.queue];
+                    }
+                }
+                [calls addObject:observer];
+                [calls addObject:notification];
+            }
         }
-        [invocation invoke];
-    }];
+    }
+    
+    for (dispatch_queue_t queue in queueCalls) {
+        
+        NSArray *calls = [queueCalls objectForKey:queue];
+        dispatch_async(queue, ^{
+            CSScheduledNotificationObserversNotify(calls);
+        });
+    }
+    
+    if (mainThreadCalls.count) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            CSScheduledNotificationObserversNotify(mainThreadCalls);
+        });
+    }
 }
 
-#pragma mark - Timers
+#pragma mark - Timing Wheel
 
-- (void)invalidateNotificationTimer:(NSString *)notificationName {
+- (uint64_t)currentTick {
+    return CSScheduledNotificationCenterNow() / _tickNanoseconds;
+}
 
-    NSTimer *timer = _timersDictionary[notificationName];
-    [timer invalidate];
+/**
+ *  Tick at or after fire date, so notification never fires early. Current time is read once by caller which computes many deadlines.
+ */
+- (uint64_t)deadlineForFireDate:(NSDate *)fireDate currentTime:(uint64_t)time currentDate:(NSDate *)date {
+    
+    NSTimeInterval interval = MAX([fireDate timeIntervalSinceDate:date], 0.0);
+    uint64_t deadline = time + (uint64_t)(interval * NSEC_PER_SEC);
+    return (deadline + _tickNanoseconds - 1) / _tickNanoseconds;
 }
 
-- (void)addNotificationTimer:(CSScheduledNotification *)notification {
+/**
+ *  Builds wheels again from fire dates of all scheduled notifications. Must be called while holding lock.
+ */
+- (void)rescheduleEntries {
+    
+    uint64_t time = CSScheduledNotificationCenterNow();
+    NSDate *date = [NSDate date];
+    
+    CSTimingWheelInit(_wheel, time / _tickNanoseconds);
+    CSTimingWheelInit(_windowWheel, time / _tickNanoseconds);
+    for (NSValue *value in [_entriesDictionary allValues]) {
+        
+        CSScheduledNotificationEntry *entry = [value pointerValue];
+        entry->deadlineEntry.next = NULL;
+        entry->deadlineEntry.prev = NULL;
+        entry->windowEntry.next = NULL;
+        entry->windowEntry.prev = NULL;
+        
+        [self scheduleEntry:entry
+                   fireDate:CSScheduledNotificationEntryGetNotification(entry).fireDate
+                currentTime:time
+                currentDate:date];
+    }
+    
+    _armedTick = UINT64_MAX;
+    [self armTimer];
+}
 
-    [self invalidateNotificationTimer:[notification name]];
+/**
+ *  Places entry into wheels. Deadline entry goes to last tick within notification's tolerance, window entry to first tick if it's different. Must be called while holding lock.
+ */
+- (void)scheduleEntry:(CSScheduledNotificationEntry *)entry
+             fireDate:(NSDate *)fireDate
+          currentTime:(uint64_t)time
+          currentDate:(NSDate *)date {
+    
+    NSTimeInterval tolerance = CSScheduledNotificationEntryGetNotification(entry).tolerance;
     
-    NSTimer *timer = [NSTimer timerWithTimeInterval:[notification.fireDate timeIntervalSinceNow]
-                                             target:self
-                                           selector:@selector(onNotificationTimer:)
-                                           userInfo:@{kCSScheduledInternalNotificationKey: notification}
-                                            repeats:NO];
+    //wheels put past deadlines at next tick
+    uint64_t firstTick = MAX([self deadlineForFireDate:fireDate currentTime:time currentDate:date], _wheel->currentTick + 1);
+    uint64_t lastTick = firstTick;
+    if (tolerance > 0.0) {
+        lastTick = MAX([self deadlineForFireDate:[fireDate dateByAddingTimeInterval:tolerance] currentTime:time currentDate:date], firstTick);
+    }
     
-    NSRunLoop *runLoop = [NSRunLoop currentRunLoop];
-    [runLoop addTimer:timer
-              forMode:NSRunLoopCommonModes];
+    entry->firstTick = firstTick;
+    CSTimingWheelInsert(_wheel, &entry->deadlineEntry, lastTick);
+    if (lastTick > firstTick) {
+        CSTimingWheelInsert(_windowWheel, &entry->windowEntry, firstTick);
+    }
+}
+
+- (void)releaseEntry:(CSScheduledNotificationEntry *)entry {
     
-    _timersDictionary[[notification name]] = timer;
+    if (entry->notification) {
+        CFRelease(entry->notification);
+    }
+    free(entry);
+}
+
+/**
+ *  Takes entry out of wheels and releases it without touching store or timer. Must be called while holding lock.
+ *
+ *  @return NO if there is no entry with given name.
+ */
+- (BOOL)discardEntryForName:(NSString *)notificationName {
+    
+    NSValue *value = _entriesDictionary[notificationName];
+    if (!value) {
+        return NO;
+    }
+    
+    CSScheduledNotificationEntry *entry = [value pointerValue];
+    CSTimingWheelRemove(_wheel, &entry->deadlineEntry);
+    CSTimingWheelRemove(_windowWheel, &entry->windowEntry);
+    [self releaseEntry:entry];
+    [_entriesDictionary removeObjectForKey:notificationName];
+    return YES;
+}
+
+- (void)removeEntryForName:(NSString *)notificationName {
+
+    if ([self discardEntryForName:notificationName]) {
+        [_store removeNotificationWithName:notificationName];
+        [self armTimer];
+    }
+}
+
+- (void)insertEntryForNotification:(CSScheduledNotification *)notification
+                       currentTime:(uint64_t)time
+                       currentDate:(NSDate *)date {
+    
+    CSScheduledNotificationEntry *entry = calloc(1, sizeof(CSScheduledNotificationEntry));
+    entry->notification = (__bridge_retained void *)notification;
+    entry->deadlineEntry.context = entry;
+    entry->windowEntry.context = entry;
+    [self scheduleEntry:entry fireDate:notification.fireDate currentTime:time currentDate:date];
+    
+    _entriesDictionary[[notification name]] = [NSValue valueWithPointer:entry];
+}
+
+- (void)addEntryForNotification:(CSScheduledNotification *)notification {
+
+    //add record replaces saved notification with the same name
+    [self discardEntryForName:[notification name]];
+    [self insertEntryForNotification:notification currentTime:CSScheduledNotificationCenterNow() currentDate:[NSDate date]];
+    [_store addNotification:notification];
+    
+    [self armTimer];
+}
+
+/**
+ *  Sets single timer source to tick at which wheel has work next. Must be called while holding lock.
+ */
+- (void)armTimer {
+    
+    uint64_t nextTick = 0;
+    if (!CSTimingWheelNextTick(_wheel, &nextTick)) {
+        
+        if (_armedTick != UINT64_MAX) {
+            dispatch_source_set_timer(_timerSource, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+            _armedTick = UINT64_MAX;
+        }
+        return;
+    }
+    
+    if (nextTick == _armedTick) {
+        return;
+    }
+    _armedTick = nextTick;
+    
+    uint64_t now = CSScheduledNotificationCenterNow();
+    uint64_t fireTime = nextTick * _tickNanoseconds;
+    int64_t delay = (fireTime > now ? (int64_t)(fireTime - now) : 0);
+    
+    dispatch_source_set_timer(_timerSource,
+                              dispatch_time(DISPATCH_TIME_NOW, delay),
+                              DISPATCH_TIME_FOREVER,
+                              _tickNanoseconds / 10);
 }
 
 #pragma mark - Timer Selectors
 
-- (void)onNotificationTimer:(NSTimer *)timer {
+- (void)onWheelTimer {
+
+    NSMutableArray *notifications = [[NSMutableArray alloc] init];
+    
+    @synchronized(self) {
+        
+        //timer fires once, it's armed again for whatever is left
+        _armedTick = UINT64_MAX;
+        
+        uint64_t time = CSScheduledNotificationCenterNow();
+        uint64_t tick = time / _tickNanoseconds;
+        NSDate *now = [NSDate date];
+        
+        //notifications which reached last tick of their window must fire, window entries are taken out before window wheel advances so nothing is collected twice
+        CSTimingWheelEntry *deadlineEntries = CSTimingWheelAdvance(_wheel, tick);
+        for (CSTimingWheelEntry *wheelEntry = deadlineEntries; wheelEntry; wheelEntry = wheelEntry->next) {
+            CSScheduledNotificationEntry *entry = wheelEntry->context;
+            CSTimingWheelRemove(_windowWheel, &entry->windowEntry);
+        }
+        
+        //notifications whose window already started join this wakeup instead of waking up later
+        CSTimingWheelEntry *windowEntries = CSTimingWheelAdvance(_windowWheel, tick);
+        for (CSTimingWheelEntry *wheelEntry = windowEntries; wheelEntry; wheelEntry = wheelEntry->next) {
+            CSScheduledNotificationEntry *entry = wheelEntry->context;
+            CSTimingWheelRemove(_wheel, &entry->deadlineEntry);
+        }
+        
+        //each distinct first tick would have been a wakeup of its own
+        NSMutableSet *firstTicks = [[NSMutableSet alloc] init];
+        CSTimingWheelEntry *expiredLists[2] = {deadlineEntries, windowEntries};
+        
+        for (NSUInteger i = 0; i < 2; i++) {
+            
+            CSTimingWheelEntry *wheelEntry = expiredLists[i];
+            while (wheelEntry) {
+                
+                CSTimingWheelEntry *next = wheelEntry->next;
+                CSScheduledNotificationEntry *entry = wheelEntry->context;
+                CSScheduledNotification *notification = CSScheduledNotificationEntryGetNotification(entry);
+                NSDate *fireDate = notification.fireDate;
+                
+                //wall clock moved back since notification was scheduled
+                if ([fireDate timeIntervalSinceDate:now] > _tickInterval) {
+                    [self scheduleEntry:entry fireDate:fireDate currentTime:time currentDate:now];
+                    wheelEntry = next;
+                    continue;
+                }
+                [notifications addObject:notification];
+                [firstTicks addObject:@(entry->firstTick)];
+                
+                //next fire date comes from the rule, occurrences missed meanwhile are coalesced into this fire
+                CSScheduleRule *rule = notification.repeatRule;
+                NSDate *nextFireDate = (rule ? [rule nextFireDateAfterDate:[now laterDate:fireDate]] : nil);
+                
+                if (nextFireDate) {
+                    [notification moveToFireDate:nextFireDate
+                                    lastFireDate:fireDate
+                          missedOccurrencesCount:[rule fireDatesCountAfterDate:fireDate untilDate:now]];
+                    [self scheduleEntry:entry fireDate:nextFireDate currentTime:time currentDate:now];
+                    [_store updateNotification:notification];
+                }
+                else {
+                    [_store removeNotificationWithName:notification.name];
+                    [_entriesDictionary removeObjectForKey:notification.name];
+                    [self releaseEntry:entry];
+                }
+                
+                wheelEntry = next;
+            }
+        }
+        
+        if (notifications.count) {
+            _wakeupsCount++;
+            _savedWakeupsCount += firstTicks.count - 1;
+        }
+        
+        [self armTimer];
+    }
+    
+    if (notifications.count) {
+        [self fireObserversForNotifications:notifications];
+    }
+}
+
+- (void)onClockChange:(NSNotification *)notification {
+    
+    @synchronized(self) {
+        [self rescheduleEntries];
+    }
+}
+
+#pragma mark - Store
 
-    [self fireObserversForNotification:timer.userInfo[kCSScheduledInternalNotificationKey]];
+- (void)openStoreAtPath:(NSString *)path {
+    
+    @synchronized(self) {
+        if (self.storePath) {
+            return;
+        }
+        self.storePath = path;
+    }
+    
+    //notifications are created outside of lock so scheduling isn't blocked while journal is read
+    NSMutableArray *notifications = [[NSMutableArray alloc] init];
+    CSScheduleStore *store = [[CSScheduleStore alloc] initWithPath:path];
+    [store restoreNotificationsUsingBlock:^(NSString *name, NSDate *fireDate, NSDate *lastFireDate, CSScheduleRule *rule, NSDictionary *userInfo, NSTimeInterval tolerance) {
+        
+        CSScheduledNotification *notification = [[CSScheduledNotification alloc] init];
+        notification.name = name;
+        notification.userInfo = userInfo;
+        notification.tolerance = tolerance;
+        [notification setRepeatRule:rule];
+        [notification moveToFireDate:fireDate lastFireDate:lastFireDate missedOccurrencesCount:0];
+        [notifications addObject:notification];
+    }];
+    
+    __weak CSScheduledNotificationCenter *this = self;
+    store.notificationsBlock = ^NSArray *{
+        return [this scheduledNotifications];
+    };
+    
+    @synchronized(self) {
+        
+        //notifications added before store was opened are newer than saved ones
+        for (NSValue *value in [_entriesDictionary allValues]) {
+            [store addNotification:CSScheduledNotificationEntryGetNotification([value pointerValue])];
+        }
+        
+        uint64_t time = CSScheduledNotificationCenterNow();
+        NSDate *date = [NSDate date];
+        
+        for (CSScheduledNotification *notification in notifications) {
+            
+            if (_entriesDictionary[notification.name]) {
+                continue;
+            }
+            [self insertEntryForNotification:notification currentTime:time currentDate:date];
+        }
+        
+        _store = store;
+        [self armTimer];
+    }
 }
 
 #pragma mark - Getting Observers
 
-- (NSMutableSet *)observersForName:(NSString *)notificationName {
+- (NSMutableArray *)observersForName:(NSString *)notificationName {
     
     id value = _observersDictionary[notificationName];
     if (!value) {
-        value = [[NSMutableSet alloc] init];
+        value = [[NSMutableArray alloc] init];
         _observersDictionary[notificationName] = value;
     }
     return value;
@@ -183,7 +808,9 @@ NSString * const kCSScheduledInternalNotificationKey = @"kCSScheduledInternalNot
                                userInfo:nil] raise];
     }
     
-    [self addNotificationTimer:notification];
+    @synchronized(self) {
+        [self addEntryForNotification:notification];
+    }
 }
 
 #pragma mark - Removing Notifications
@@ -202,7 +829,9 @@ NSString * const kCSScheduledInternalNotificationKey = @"kCSScheduledInternalNot
                                userInfo:nil] raise];
     }
     
-    [self invalidateNotificationTimer:notification.name];
+    @synchronized(self) {
+        [self removeEntryForName:notification.name];
+    }
 }
 
 @end
@@ -0,0 +1,206 @@
+//
+//  CSTimingWheel.c
+//  CSUtils
+//
+//  Created by Josip Bernat on 16/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#include "CSTimingWheel.h"
+
+#define CSTimingWheelSlotMask       ((uint64_t)CSTimingWheelSlotsCount - 1)
+#define CSTimingWheelOverflowSlot   ((uint32_t)(CSTimingWheelLevelsCount * CSTimingWheelSlotsCount))
+#define CSTimingWheelSpanBits       (CSTimingWheelLevelBits * CSTimingWheelLevelsCount)
+
+#pragma mark - Lists
+
+static inline void CSTimingWheelListInit(CSTimingWheelEntry *head) {
+    head->next = head;
+    head->prev = head;
+}
+
+static inline bool CSTimingWheelListIsEmpty(const CSTimingWheelEntry *head) {
+    return (head->next == head);
+}
+
+static inline void CSTimingWheelListAppend(CSTimingWheelEntry *head, CSTimingWheelEntry *entry) {
+
+    entry->prev = head->prev;
+    entry->next = head;
+    head->prev->next = entry;
+    head->prev = entry;
+}
+
+/**
+ *  Moves all entries of list to detached list and leaves head empty. Detached list is NULL terminated and linked through next pointer.
+ */
+static CSTimingWheelEntry *CSTimingWheelListDetach(CSTimingWheelEntry *head) {
+
+    if (CSTimingWheelListIsEmpty(head)) {
+        return NULL;
+    }
+
+    CSTimingWheelEntry *first = head->next;
+    head->prev->next = NULL;
+    CSTimingWheelListInit(head);
+    return first;
+}
+
+#pragma mark - Placing Entries
+
+static void CSTimingWheelPlace(CSTimingWheel *wheel, CSTimingWheelEntry *entry) {
+
+    uint64_t difference = entry->deadline ^ wheel->currentTick;
+    uint32_t slot = CSTimingWheelOverflowSlot;
+
+    if (!(difference >> CSTimingWheelSpanBits)) {
+
+        unsigned level = (difference ? (unsigned)(63 - __builtin_clzll(difference)) / CSTimingWheelLevelBits : 0);
+        unsigned index = (unsigned)((entry->deadline >> (level * CSTimingWheelLevelBits)) & CSTimingWheelSlotMask);
+
+        slot = level * CSTimingWheelSlotsCount + index;
+        wheel->occupied[level] |= (UINT64_C(1) << index);
+    }
+
+    entry->slot = slot;
+    CSTimingWheelListAppend(&wheel->slots[slot], entry);
+}
+
+static void CSTimingWheelClearSlot(CSTimingWheel *wheel, uint32_t slot) {
+
+    if (slot < CSTimingWheelOverflowSlot) {
+        wheel->occupied[slot / CSTimingWheelSlotsCount] &= ~(UINT64_C(1) << (slot % CSTimingWheelSlotsCount));
+    }
+}
+
+#pragma mark - Storage
+
+void CSTimingWheelInit(CSTimingWheel *wheel, uint64_t currentTick) {
+
+    wheel->currentTick = currentTick;
+    wheel->count = 0;
+
+    for (size_t i = 0; i < CSTimingWheelLevelsCount; i++) {
+        wheel->occupied[i] = 0;
+    }
+    for (size_t i = 0; i <= CSTimingWheelOverflowSlot; i++) {
+        CSTimingWheelListInit(&wheel->slots[i]);
+    }
+}
+
+void CSTimingWheelInsert(CSTimingWheel *wheel, CSTimingWheelEntry *entry, uint64_t deadline) {
+
+    //slot of current tick was already processed
+    entry->deadline = (deadline > wheel->currentTick ? deadline : wheel->currentTick + 1);
+    CSTimingWheelPlace(wheel, entry);
+    wheel->count++;
+}
+
+void CSTimingWheelRemove(CSTimingWheel *wheel, CSTimingWheelEntry *entry) {
+
+    if (!CSTimingWheelEntryIsScheduled(entry)) {
+        return;
+    }
+
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+
+    if (CSTimingWheelListIsEmpty(&wheel->slots[entry->slot])) {
+        CSTimingWheelClearSlot(wheel, entry->slot);
+    }
+
+    entry->next = NULL;
+    entry->prev = NULL;
+    wheel->count--;
+}
+
+#pragma mark - Advancing
+
+bool CSTimingWheelNextTick(const CSTimingWheel *wheel, uint64_t *tick) {
+
+    if (!wheel->count) {
+        return false;
+    }
+
+    //every occupied slot of lower level comes before any slot of higher level
+    for (unsigned level = 0; level < CSTimingWheelLevelsCount; level++) {
+
+        unsigned shift = level * CSTimingWheelLevelBits;
+        unsigned index = (unsigned)((wheel->currentTick >> shift) & CSTimingWheelSlotMask);
+        uint64_t following = wheel->occupied[level] & ~((UINT64_C(2) << index) - 1);
+
+        if (following) {
+
+            uint64_t base = (wheel->currentTick >> (shift + CSTimingWheelLevelBits)) << (shift + CSTimingWheelLevelBits);
+            *tick = base | ((uint64_t)__builtin_ctzll(following) << shift);
+            return true;
+        }
+    }
+
+    *tick = ((wheel->currentTick >> CSTimingWheelSpanBits) + 1) << CSTimingWheelSpanBits;
+    return true;
+}
+
+/**
+ *  Processes tick wheel was just moved to. Slots of higher levels entered at this tick are moved down first, then entries of level 0 slot expire.
+ */
+static void CSTimingWheelProcessTick(CSTimingWheel *wheel, CSTimingWheelEntry ***expiredTail) {
+
+    uint64_t tick = wheel->currentTick;
+
+    for (unsigned level = CSTimingWheelLevelsCount; level >= 1; level--) {
+
+        unsigned shift = level * CSTimingWheelLevelBits;
+        if (tick & ((UINT64_C(1) << shift) - 1)) {
+            continue;
+        }
+
+        uint32_t slot = CSTimingWheelOverflowSlot;
+        if (level < CSTimingWheelLevelsCount) {
+            slot = level * CSTimingWheelSlotsCount + (uint32_t)((tick >> shift) & CSTimingWheelSlotMask);
+        }
+        CSTimingWheelClearSlot(wheel, slot);
+
+        CSTimingWheelEntry *entry = CSTimingWheelListDetach(&wheel->slots[slot]);
+        while (entry) {
+            CSTimingWheelEntry *next = entry->next;
+            CSTimingWheelPlace(wheel, entry);
+            entry = next;
+        }
+    }
+
+    uint32_t slot = (uint32_t)(tick & CSTimingWheelSlotMask);
+    CSTimingWheelClearSlot(wheel, slot);
+
+    CSTimingWheelEntry *entry = CSTimingWheelListDetach(&wheel->slots[slot]);
+    while (entry) {
+
+        CSTimingWheelEntry *next = entry->next;
+        entry->next = NULL;
+        entry->prev = NULL;
+        wheel->count--;
+
+        **expiredTail = entry;
+        *expiredTail = &entry->next;
+        entry = next;
+    }
+}
+
+CSTimingWheelEntry *CSTimingWheelAdvance(CSTimingWheel *wheel, uint64_t tick) {
+
+    CSTimingWheelEntry *expired = NULL;
+    CSTimingWheelEntry **expiredTail = &expired;
+
+    uint64_t nextTick = 0;
+    while (CSTimingWheelNextTick(wheel, &nextTick) && nextTick <= tick) {
+
+        //ticks in between have nothing to do so wheel jumps over them
+        wheel->currentTick = nextTick;
+        CSTimingWheelProcessTick(wheel, &expiredTail);
+    }
+
+    if (tick > wheel->currentTick) {
+        wheel->currentTick = tick;
+    }
+    return expired;
+}
@@ -0,0 +1,82 @@
+//
+//  CSTimingWheel.h
+//  CSUtils
+//
+//  Created by Josip Bernat on 16/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#ifndef CSUtils_CSTimingWheel_h
+#define CSUtils_CSTimingWheel_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CSTimingWheelLevelBits      6
+#define CSTimingWheelSlotsCount     (1 << CSTimingWheelLevelBits)
+#define CSTimingWheelLevelsCount    6
+
+/**
+ *  Entry scheduled in the wheel. Entries are owned by caller and linked into slots intrusively so insert and remove don't allocate.
+ */
+typedef struct CSTimingWheelEntry {
+    struct CSTimingWheelEntry *next;
+    struct CSTimingWheelEntry *prev;
+    uint64_t deadline;
+    uint32_t slot;
+    void *context;
+} CSTimingWheelEntry;
+
+/**
+ *  Hierarchical timing wheel. Level 0 has one slot per tick, each next level has slots 64 times wider. Entry is kept at the level of the highest 6 bit group in which its deadline differs from current tick and moves to lower level when current tick enters its slot. Deadlines beyond the top level wait in overflow list. Insert and remove are O(1), advancing costs O(1) per processed slot. Not thread safe.
+ */
+typedef struct CSTimingWheel {
+    uint64_t currentTick;
+    size_t count;
+    uint64_t occupied[CSTimingWheelLevelsCount];
+    CSTimingWheelEntry slots[CSTimingWheelLevelsCount * CSTimingWheelSlotsCount + 1];
+} CSTimingWheel;
+
+/**
+ *  Initializes empty wheel positioned at given tick.
+ */
+void CSTimingWheelInit(CSTimingWheel *wheel, uint64_t currentTick);
+
+/**
+ *  Schedules entry to expire at given tick. Deadline which isn't after current tick expires on next advance. Entry must not be scheduled already.
+ */
+void CSTimingWheelInsert(CSTimingWheel *wheel, CSTimingWheelEntry *entry, uint64_t deadline);
+
+/**
+ *  Unschedules entry. Has no effect if entry isn't scheduled.
+ */
+void CSTimingWheelRemove(CSTimingWheel *wheel, CSTimingWheelEntry *entry);
+
+/**
+ *  Moves wheel to given tick and unschedules all entries which expired meanwhile.
+ *
+ *  @return List of expired entries linked through next pointer, in order of deadlines, or NULL.
+ */
+CSTimingWheelEntry *CSTimingWheelAdvance(CSTimingWheel *wheel, uint64_t tick);
+
+/**
+ *  Finds first tick at which wheel needs to advance, either because entry expires or because entries move to lower level.
+ *
+ *  @return false if wheel is empty.
+ */
+bool CSTimingWheelNextTick(const CSTimingWheel *wheel, uint64_t *tick);
+
+static inline bool CSTimingWheelEntryIsScheduled(const CSTimingWheelEntry *entry) {
+    return (entry->prev != NULL);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -15,13 +15,25 @@
 
 //Classes
 #import "CSGenericOperation.h"
+#import "CSOperationExecutor.h"
+#import "CSFuture.h"
 #import "CSCacheManager.h"
+#import "CSChunkedUpload.h"
 #import "CSHTTPAssistance.h"
+#import "CSJSONDocument.h"
 #import "CSLazyLoadController.h"
 #import "CSMessage.h"
+#import "CSMessageBatch.h"
 #import "CSMessageCenter.h"
+#import "CSMessageMetrics.h"
+#import "CSMessageOutbox.h"
+#import "CSMessageResponseCache.h"
+#import "CSMessageThrottle.h"
+#import "CSMultipartBody.h"
+#import "CSResponseBuffer.h"
 #import "CSScheduledNotification.h"
 #import "CSScheduledNotificationCenter.h"
+#import "CSScheduleRule.h"
 #import "CSURL.h"
 
 #endif
@@ -0,0 +1,617 @@
+//
+//  CSCronExpressionTests.c
+//  CSUtilsCoreTests
+//
+//  Created by Josip Bernat on 20/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#include "CSTest.h"
+#include "CSCronExpression.h"
+
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+static const char *const CSTestMonthNames[] = {
+    "JAN", "Feb", "mar", "apr", "MAY", "jun", "jul", "aug", "sep", "Oct", "nov", "dec"
+};
+
+static const char *const CSTestDayNames[] = {
+    "sun", "MON", "tue", "Wed", "thu", "fri", "SAT"
+};
+
+#pragma mark - Helpers
+
+static int64_t CSFloorDivide(int64_t value, int64_t divisor) {
+    return (value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor));
+}
+
+/**
+ *  Days since 1970-01-01 of proleptic Gregorian date, written independently of evaluator.
+ */
+static int64_t CSDaysFromCivil(int64_t year, unsigned month, unsigned day) {
+
+    static const unsigned daysBeforeMonth[12] = {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+    int64_t leapYears = CSFloorDivide(year - 1, 4) - CSFloorDivide(year - 1, 100) + CSFloorDivide(year - 1, 400);
+    bool isLeap = (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0));
+    int64_t days = (year - 1) * 365 + leapYears + daysBeforeMonth[month - 1] + (isLeap && month > 2 ? 1 : 0) + day - 1;
+    return days - 719162;
+}
+
+static int64_t CSTime(int64_t year, unsigned month, unsigned day, unsigned hour, unsigned minute) {
+    return ((CSDaysFromCivil(year, month, day) * 24 + hour) * 60 + minute) * 60;
+}
+
+static int64_t CSLastSunday(int64_t year, unsigned month) {
+
+    static const unsigned daysInMonth[13] = {0, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    int64_t days = CSDaysFromCivil(year, month, daysInMonth[month]);
+    return days - (days % 7 + 11) % 7;
+}
+
+/**
+ *  Europe/Berlin since 1996: CET, CEST from 01:00 UTC on last Sunday of March to 01:00 UTC on last Sunday of October.
+ */
+static int64_t CSBerlinOffset(int64_t time, void *context) {
+
+    (void)context;
+    time_t seconds = (time_t)time;
+    struct tm date;
+    gmtime_r(&seconds, &date);
+
+    int64_t year = (int64_t)date.tm_year + 1900;
+    int64_t start = CSLastSunday(year, 3) * 86400 + 3600;
+    int64_t end = CSLastSunday(year, 10) * 86400 + 3600;
+    return (time >= start && time < end ? 7200 : 3600);
+}
+
+static int64_t CSFixedOffset(int64_t time, void *context) {
+    (void)time;
+    return *(const int64_t *)context;
+}
+
+static CSCronExpression CSParse(const char *string) {
+
+    CSCronExpression expression;
+    memset(&expression, 0, sizeof(expression));
+    size_t errorOffset = 0;
+    bool isParsed = CSCronExpressionParse(&expression, string, &errorOffset);
+    CSTestAssert(isParsed, "\"%s\" not parsed, error at %zu", string, errorOffset);
+    return expression;
+}
+
+static bool CSSameExpression(const CSCronExpression *expression, const CSCronExpression *otherExpression) {
+
+    return (expression->minutes == otherExpression->minutes && expression->hours == otherExpression->hours &&
+            expression->daysOfMonth == otherExpression->daysOfMonth && expression->months == otherExpression->months &&
+            expression->daysOfWeek == otherExpression->daysOfWeek && expression->flags == otherExpression->flags);
+}
+
+static int64_t CSNextFireTime(const CSCronExpression *expression, int64_t time) {
+
+    int64_t fireTime = 0;
+    bool isFound = CSCronExpressionNextFireTime(expression, time, CSBerlinOffset, NULL, &fireTime);
+    CSTestAssert(isFound, "no fire time after %lld", (long long)time);
+    return (isFound ? fireTime : INT64_MAX);
+}
+
+/**
+ *  Random valid field mixing '*', values, ranges, steps, lists and names.
+ */
+static void CSRandomField(char *field, size_t size, uint64_t *state, unsigned minimum, unsigned maximum, const char *const *names, unsigned namesOffset) {
+
+    size_t length = 0;
+    unsigned itemsCount = 1 + (CSTestRandom(state) % 4 == 0 ? (unsigned)(CSTestRandom(state) % 3) : 0);
+    unsigned range = maximum - minimum + 1;
+
+    for (unsigned i = 0; i < itemsCount; i++) {
+
+        unsigned first = minimum + (unsigned)(CSTestRandom(state) % range);
+        unsigned last = first + (unsigned)(CSTestRandom(state) % (maximum - first + 1));
+        unsigned step = 1 + (unsigned)(CSTestRandom(state) % range);
+        const char *firstName = NULL;
+        if (names && first - namesOffset < 7 + 5 * namesOffset && CSTestRandom(state) % 2) {
+            firstName = names[first - namesOffset];
+        }
+
+        char item[32];
+        switch (CSTestRandom(state) % 6) {
+            case 0: snprintf(item, sizeof(item), "*"); break;
+            case 1: snprintf(item, sizeof(item), "*/%u", step); break;
+            case 2: firstName ? snprintf(item, sizeof(item), "%s", firstName) : snprintf(item, sizeof(item), "%u", first); break;
+            case 3: snprintf(item, sizeof(item), "%u-%u", first, last); break;
+            case 4: snprintf(item, sizeof(item), "%u-%u/%u", first, last, step); break;
+            default: snprintf(item, sizeof(item), "%u/%u", first, step); break;
+        }
+        length += (size_t)snprintf(field + length, size - length, "%s%s", (i ? "," : ""), item);
+    }
+}
+
+static void CSRandomExpression(char *string, size_t size, uint64_t *state) {
+
+    char fields[5][128];
+    CSRandomField(fields[0], sizeof(fields[0]), state, 0, 59, NULL, 0);
+    CSRandomField(fields[1], sizeof(fields[1]), state, 0, 23, NULL, 0);
+    CSRandomField(fields[2], sizeof(fields[2]), state, 1, 31, NULL, 0);
+    CSRandomField(fields[3], sizeof(fields[3]), state, 1, 12, CSTestMonthNames, 1);
+    CSRandomField(fields[4], sizeof(fields[4]), state, 0, 7, CSTestDayNames, 0);
+    snprintf(string, size, "%s %s %s %s %s", fields[0], fields[1], fields[2], fields[3], fields[4]);
+}
+
+/**
+ *  Matches local time against expression fields the way cron does.
+ */
+static bool CSOracleDayMatches(const CSCronExpression *expression, const struct tm *date) {
+
+    if (!((expression->months >> (date->tm_mon + 1)) & 1)) {
+        return false;
+    }
+    bool dayOfMonthMatches = ((expression->daysOfMonth >> date->tm_mday) & 1);
+    bool dayOfWeekMatches = ((expression->daysOfWeek >> date->tm_wday) & 1);
+    if (expression->flags & (CSCronExpressionFlagAnyDayOfMonth | CSCronExpressionFlagAnyDayOfWeek)) {
+        return (dayOfMonthMatches && dayOfWeekMatches);
+    }
+    return (dayOfMonthMatches || dayOfWeekMatches);
+}
+
+static bool CSOracleMatches(const CSCronExpression *expression, int64_t localTime) {
+
+    time_t seconds = (time_t)localTime;
+    struct tm date;
+    gmtime_r(&seconds, &date);
+    return (CSOracleDayMatches(expression, &date) && ((expression->hours >> date.tm_hour) & 1) &&
+            ((expression->minutes >> date.tm_min) & 1));
+}
+
+/**
+ *  Scans minutes after time, skipping whole days and hours which can't match.
+ */
+static bool CSOracleNextTime(const CSCronExpression *expression, int64_t time, int64_t limit, int64_t *nextTime) {
+
+    int64_t minute = CSFloorDivide(time, 60) + 1;
+    while (minute * 60 <= limit) {
+
+        time_t seconds = (time_t)(minute * 60);
+        struct tm date;
+        gmtime_r(&seconds, &date);
+
+        if (!CSOracleDayMatches(expression, &date)) {
+            minute = (CSFloorDivide(minute, 1440) + 1) * 1440;
+        }
+        else if (!((expression->hours >> date.tm_hour) & 1)) {
+            minute = (CSFloorDivide(minute, 60) + 1) * 60;
+        }
+        else if (!((expression->minutes >> date.tm_min) & 1)) {
+            minute++;
+        }
+        else {
+            *nextTime = minute * 60;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ *  Scans UTC minutes after time in Berlin time. Transition instant fires if any skipped local minute or the first one after gap matches, instants in second pass of repeated hour fire only for expressions matching every hour.
+ */
+static bool CSOracleFireTime(const CSCronExpression *expression, int64_t time, int64_t limit, int64_t *fireTime) {
+
+    bool firesEveryHour = ((expression->hours & 0xffffff) == 0xffffff);
+
+    for (int64_t instant = (CSFloorDivide(time, 60) + 1) * 60; instant <= limit; instant += 60) {
+
+        int64_t offset = CSBerlinOffset(instant, NULL);
+        int64_t previousOffset = CSBerlinOffset(instant - 60, NULL);
+        bool matches = CSOracleMatches(expression, instant + offset);
+
+        for (int64_t localTime = instant + previousOffset; localTime < instant + offset && !matches; localTime += 60) {
+            matches = CSOracleMatches(expression, localTime);
+        }
+        if (!matches) {
+            continue;
+        }
+
+        int64_t earlierOffset = CSBerlinOffset(instant - 86400, NULL);
+        int64_t earlierInstant = instant + offset - earlierOffset;
+        bool isRepeated = (earlierOffset > offset && CSBerlinOffset(earlierInstant, NULL) == earlierOffset);
+        if (isRepeated && !firesEveryHour) {
+            continue;
+        }
+
+        *fireTime = instant;
+        return true;
+    }
+    return false;
+}
+
+#pragma mark - Tests
+
+static void testParseErrors(void) {
+
+    static const struct {
+        const char *string;
+        size_t errorOffset;
+    } cases[] = {
+        {"", 0},
+        {"   ", 3},
+        {"* * * *", 7},
+        {"* * * * * *", 10},
+        {"60 * * * *", 2},
+        {"* 24 * * *", 4},
+        {"* * 0 * *", 5},
+        {"* * 32 * *", 6},
+        {"* * * 13 *", 8},
+        {"* * * * 8", 9},
+        {"5-1 * * * *", 3},
+        {"*/0 * * * *", 3},
+        {"1/ * * * *", 2},
+        {"1,,2 * * * *", 2},
+        {"1000 * * * *", 3},
+        {"* * * foo *", 6},
+        {"* * * janu *", 6},
+        {"* * * * mon-", 12},
+        {"1x * * * *", 1},
+        {"@fortnightly", 0},
+        {"  @weekly x", 10},
+        {"@", 0}
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+
+        CSCronExpression expression;
+        size_t errorOffset = SIZE_MAX;
+        CSTestAssert(!CSCronExpressionParse(&expression, cases[i].string, &errorOffset), "\"%s\" parsed", cases[i].string);
+        CSTestAssert(errorOffset == cases[i].errorOffset, "\"%s\" error at %zu, expected %zu", cases[i].string, errorOffset, cases[i].errorOffset);
+    }
+
+    CSCronExpression expression;
+    CSTestAssert(!CSCronExpressionParse(&expression, "61 * * * *", NULL), "parsed without error offset");
+}
+
+static void testMacros(void) {
+
+    static const struct {
+        const char *macro;
+        const char *expression;
+    } cases[] = {
+        {"@yearly", "0 0 1 1 *"},
+        {"@annually", "0 0 1 1 *"},
+        {"@monthly", "0 0 1 * *"},
+        {"@weekly", "0 0 * * 0"},
+        {"@daily", "0 0 * * *"},
+        {"@midnight", "0 0 * * *"},
+        {"@hourly", "0 * * * *"},
+        {"  @HOURLY  ", "0 * * * *"},
+        {"@Weekly", "0 0 * * sun"}
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        CSCronExpression macro = CSParse(cases[i].macro);
+        CSCronExpression expression = CSParse(cases[i].expression);
+        CSTestAssert(CSSameExpression(&macro, &expression), "%s differs from %s", cases[i].macro, cases[i].expression);
+    }
+}
+
+static void testFields(void) {
+
+    CSCronExpression expression = CSParse("0 0 * JAN-mar mon,FRI");
+    CSTestAssert(expression.months == ((1 << 1) | (1 << 2) | (1 << 3)), "months %#x", expression.months);
+    CSTestAssert(expression.daysOfWeek == ((1 << 1) | (1 << 5)), "days of week %#x", expression.daysOfWeek);
+    CSTestAssert(expression.flags == CSCronExpressionFlagAnyDayOfMonth, "flags %#x", expression.flags);
+
+    expression = CSParse("5/15 */20 10-30/10 nov/1 *");
+    CSTestAssert(expression.minutes == ((UINT64_C(1) << 5) | (UINT64_C(1) << 20) | (UINT64_C(1) << 35) | (UINT64_C(1) << 50)), "minutes %#llx", (unsigned long long)expression.minutes);
+    CSTestAssert(expression.hours == ((1 << 0) | (1 << 20)), "hours %#x", expression.hours);
+    CSTestAssert(expression.daysOfMonth == ((1 << 10) | (1 << 20) | (1 << 30)), "days of month %#x", expression.daysOfMonth);
+    CSTestAssert(expression.months == ((1 << 11) | (1 << 12)), "months %#x", expression.months);
+    CSTestAssert(expression.daysOfWeek == 0x7f, "days of week %#x", expression.daysOfWeek);
+
+    expression = CSParse("\t1,2  *\t* * *  ");
+    CSTestAssert(expression.minutes == 6, "minutes %#llx", (unsigned long long)expression.minutes);
+    CSTestAssert(!CSCronExpressionParse(&expression, "1, 2 * * * *", NULL), "space inside list parsed");
+
+    expression = CSParse("* * * * 7");
+    CSTestAssert(expression.daysOfWeek == 1, "day of week 7 is %#x", expression.daysOfWeek);
+    expression = CSParse("* * * * 5-7");
+    CSTestAssert(expression.daysOfWeek == ((1 << 0) | (1 << 5) | (1 << 6)), "days 5-7 are %#x", expression.daysOfWeek);
+    expression = CSParse("* * * * 0,7");
+    CSTestAssert(expression.daysOfWeek == 1, "days 0,7 are %#x", expression.daysOfWeek);
+}
+
+static void testDayOfMonthOrDayOfWeek(void) {
+
+    //both fields restricted: Fridays and 13th of month
+    CSCronExpression expression = CSParse("0 0 13 * fri");
+    int64_t time = 0;
+    CSTestAssert(CSCronExpressionNextTime(&expression, CSTime(2024, 1, 1, 0, 0), &time) && time == CSTime(2024, 1, 5, 0, 0), "first Friday");
+    CSTestAssert(CSCronExpressionNextTime(&expression, time, &time) && time == CSTime(2024, 1, 12, 0, 0), "second Friday");
+    CSTestAssert(CSCronExpressionNextTime(&expression, time, &time) && time == CSTime(2024, 1, 13, 0, 0), "13th on Saturday");
+
+    //field starting with '*' restricts together with the other one: odd days which are Mondays
+    expression = CSParse("0 0 */2 * mon");
+    CSTestAssert(CSCronExpressionNextTime(&expression, CSTime(2024, 1, 1, 0, 0), &time) && time == CSTime(2024, 1, 15, 0, 0), "odd Monday at %lld", (long long)time);
+
+    expression = CSParse("0 0 13 * *");
+    CSTestAssert(CSCronExpressionNextTime(&expression, CSTime(2024, 1, 1, 0, 0), &time) && time == CSTime(2024, 1, 13, 0, 0), "13th");
+
+    expression = CSParse("0 0 * * 5");
+    CSTestAssert(CSCronExpressionNextTime(&expression, CSTime(2024, 1, 5, 0, 0), &time) && time == CSTime(2024, 1, 12, 0, 0), "Friday");
+}
+
+static void testNoMatch(void) {
+
+    CSCronExpression expression = CSParse("0 0 30 feb *");
+    int64_t time = 0;
+    CSTestAssert(!CSCronExpressionNextTime(&expression, CSTime(2024, 1, 1, 0, 0), &time), "February 30 matched");
+    CSTestAssert(!CSCronExpressionNextFireTime(&expression, CSTime(2024, 1, 1, 0, 0), CSBerlinOffset, NULL, &time), "February 30 fired");
+
+    //2100 isn't leap year
+    expression = CSParse("0 0 29 2 *");
+    CSTestAssert(CSCronExpressionNextTime(&expression, CSTime(2097, 3, 1, 0, 0), &time) && time == CSTime(2104, 2, 29, 0, 0), "February 29 after 2096");
+}
+
+static void testOracle(void) {
+
+    uint64_t state = 0x9e3779b97f4a7c15;
+    char string[700];
+
+    for (unsigned i = 0; i < 3000; i++) {
+
+        CSRandomExpression(string, sizeof(string), &state);
+        CSCronExpression expression;
+        size_t errorOffset = 0;
+        if (!CSCronExpressionParse(&expression, string, &errorOffset)) {
+            CSTestAssert(false, "\"%s\" not parsed, error at %zu", string, errorOffset);
+            continue;
+        }
+
+        //from 1900 to 2100, starts before 1970 have negative times
+        int64_t time = -2208988800 + (int64_t)(CSTestRandom(&state) % UINT64_C(6311433600));
+        if (i % 3 == 0) {
+            time -= time % 60;
+        }
+
+        for (unsigned j = 0; j < 4; j++) {
+
+            int64_t expectedTime = 0;
+            int64_t nextTime = 0;
+            bool isExpected = CSOracleNextTime(&expression, time, time + 9 * 366 * 86400LL, &expectedTime);
+            bool isFound = CSCronExpressionNextTime(&expression, time, &nextTime);
+
+            if (isFound && (!isExpected || nextTime != expectedTime)) {
+                CSTestAssert(false, "\"%s\" after %lld: %lld, expected %lld", string, (long long)time, (long long)nextTime, (long long)(isExpected ? expectedTime : -1));
+                break;
+            }
+            //evaluator gives up after 8 years
+            if (!isFound) {
+                CSTestAssert(!isExpected || expectedTime - time > 8 * 365 * 86400LL, "\"%s\" after %lld: none, expected %lld", string, (long long)time, (long long)expectedTime);
+                break;
+            }
+            time = nextTime;
+        }
+    }
+}
+
+static void testSpringForward(void) {
+
+    //02:00 CET jumps to 03:00 CEST at 2024-03-31 01:00 UTC, 02:30 doesn't exist that day
+    CSCronExpression expression = CSParse("30 2 * * *");
+    int64_t time = CSNextFireTime(&expression, CSTime(2024, 3, 30, 23, 0));
+    CSTestAssert(time == CSTime(2024, 3, 31, 1, 0), "skipped 02:30 at %lld", (long long)time);
+    time = CSNextFireTime(&expression, time);
+    CSTestAssert(time == CSTime(2024, 4, 1, 0, 30), "02:30 CEST at %lld", (long long)time);
+
+    //skipped minutes fire once at transition, not once for each of them
+    expression = CSParse("* * * * *");
+    time = CSTime(2024, 3, 31, 0, 58) + 30;
+    int64_t expectedTimes[] = {CSTime(2024, 3, 31, 0, 59), CSTime(2024, 3, 31, 1, 0), CSTime(2024, 3, 31, 1, 1)};
+    for (size_t i = 0; i < 3; i++) {
+        time = CSNextFireTime(&expression, time);
+        CSTestAssert(time == expectedTimes[i], "minute %zu at %lld", i, (long long)time);
+    }
+
+    expression = CSParse("0 3 * * *");
+    time = CSNextFireTime(&expression, CSTime(2024, 3, 30, 23, 0));
+    CSTestAssert(time == CSTime(2024, 3, 31, 1, 0), "03:00 CEST at %lld", (long long)time);
+    time = CSNextFireTime(&expression, time);
+    CSTestAssert(time == CSTime(2024, 4, 1, 1, 0), "next 03:00 CEST at %lld", (long long)time);
+}
+
+static void testFallBack(void) {
+
+    //03:00 CEST goes back to 02:00 CET at 2024-10-27 01:00 UTC, 02:00-02:59 happens twice
+    CSCronExpression expression = CSParse("0 * * * *");
+    int64_t time = CSTime(2024, 10, 26, 22, 30);
+    int64_t expectedTimes[] = {CSTime(2024, 10, 26, 23, 0), CSTime(2024, 10, 27, 0, 0), CSTime(2024, 10, 27, 1, 0), CSTime(2024, 10, 27, 2, 0)};
+    for (size_t i = 0; i < 4; i++) {
+        time = CSNextFireTime(&expression, time);
+        CSTestAssert(time == expectedTimes[i], "hour %zu at %lld", i, (long long)time);
+    }
+
+    expression = CSParse("15 * * * *");
+    time = CSNextFireTime(&expression, CSTime(2024, 10, 27, 0, 20));
+    CSTestAssert(time == CSTime(2024, 10, 27, 1, 15), "02:15 CET at %lld", (long long)time);
+
+    //fixed hour fires only in the first pass
+    expression = CSParse("30 2 * * *");
+    time = CSNextFireTime(&expression, CSTime(2024, 10, 26, 22, 30));
+    CSTestAssert(time == CSTime(2024, 10, 27, 0, 30), "02:30 CEST at %lld", (long long)time);
+    time = CSNextFireTime(&expression, time);
+    CSTestAssert(time == CSTime(2024, 10, 28, 1, 30), "next 02:30 CET at %lld", (long long)time);
+
+    time = CSNextFireTime(&expression, CSTime(2024, 10, 27, 1, 10));
+    CSTestAssert(time == CSTime(2024, 10, 28, 1, 30), "02:30 during second pass at %lld", (long long)time);
+
+    expression = CSParse("* * * * *");
+    time = CSTime(2024, 10, 27, 0, 0);
+    while (time < CSTime(2024, 10, 27, 2, 0)) {
+        int64_t nextTime = CSNextFireTime(&expression, time);
+        CSTestAssert(nextTime == time + 60, "minute after %lld at %lld", (long long)time, (long long)nextTime);
+        time = nextTime;
+    }
+}
+
+static void testYearInBerlin(void) {
+
+    CSCronExpression hourly = CSParse("0 * * * *");
+    CSCronExpression daily = CSParse("30 2 * * *");
+    int64_t start = CSTime(2023, 12, 31, 22, 30);
+    int64_t end = CSTime(2024, 12, 31, 22, 30);
+
+    unsigned count = 0;
+    bool isEven = true;
+    for (int64_t time = CSNextFireTime(&hourly, start); time <= end; time = CSNextFireTime(&hourly, time)) {
+        int64_t nextTime = CSNextFireTime(&hourly, time);
+        isEven = isEven && (nextTime - time == 3600);
+        count++;
+    }
+    CSTestAssert(count == 8784, "hourly fired %u times in 2024", count);
+    CSTestAssert(isEven, "hourly fires aren't hour apart");
+
+    count = 0;
+    for (int64_t time = CSNextFireTime(&daily, start); time <= end; time = CSNextFireTime(&daily, time)) {
+        count++;
+    }
+    CSTestAssert(count == 366, "daily fired %u times in 2024", count);
+}
+
+static void testFixedOffset(void) {
+
+    //without transitions fire time is local time shifted by offset
+    uint64_t state = 0x2545f4914f6cdd1d;
+    char string[700];
+    int64_t offsets[] = {0, 3600, -5 * 3600, 5 * 3600 + 1800, 14 * 3600};
+
+    for (unsigned i = 0; i < 500; i++) {
+
+        CSRandomExpression(string, sizeof(string), &state);
+        CSCronExpression expression = CSParse(string);
+        int64_t offset = offsets[i % 5];
+        int64_t time = (int64_t)(CSTestRandom(&state) % UINT64_C(4102444800));
+
+        int64_t localTime = 0;
+        int64_t fireTime = 0;
+        bool isFound = CSCronExpressionNextTime(&expression, time + offset, &localTime);
+        bool isFired = CSCronExpressionNextFireTime(&expression, time, CSFixedOffset, &offset, &fireTime);
+        CSTestAssert(isFound == isFired && (!isFound || fireTime == localTime - offset), "\"%s\" with offset %lld", string, (long long)offset);
+    }
+}
+
+static void testTransitionOracle(void) {
+
+    uint64_t state = 0xd1b54a32d192ed03;
+    char string[700];
+
+    for (unsigned i = 0; i < 300; i++) {
+
+        //every month so most expressions fire near transition, every third one fires every hour through repeated hour
+        CSRandomExpression(string, sizeof(string), &state);
+        CSCronExpression expression = CSParse(string);
+        expression.months = 0x1ffe;
+        if (i % 3 == 0) {
+            expression.hours = 0xffffff;
+        }
+
+        int64_t year = 2020 + (int64_t)(CSTestRandom(&state) % 10);
+        int64_t transition = 86400 * CSLastSunday(year, (i % 2 ? 10 : 3)) + 3600;
+        int64_t time = transition - 3 * 86400 + (int64_t)(CSTestRandom(&state) % (6 * 86400));
+        if (i % 4 < 2) {
+            time = transition - 7200 + (int64_t)(CSTestRandom(&state) % (3 * 3600));
+        }
+        int64_t limit = time + 10 * 86400;
+
+        for (unsigned j = 0; j < 10 && time <= limit; j++) {
+
+            int64_t expectedTime = 0;
+            int64_t fireTime = 0;
+            bool isExpected = CSOracleFireTime(&expression, time, limit, &expectedTime);
+            bool isFired = CSCronExpressionNextFireTime(&expression, time, CSBerlinOffset, NULL, &fireTime);
+
+            if (isExpected ? (!isFired || fireTime != expectedTime) : (isFired && fireTime <= limit)) {
+                CSTestAssert(false, "\"%s\" after %lld: %lld, expected %lld", string, (long long)time, (long long)(isFired ? fireTime : -1), (long long)(isExpected ? expectedTime : -1));
+                break;
+            }
+            if (!isExpected) {
+                break;
+            }
+            time = fireTime;
+        }
+    }
+}
+
+#pragma mark - Benchmark
+
+static void benchmark(void) {
+
+    enum { rulesCount = 100000 };
+    uint64_t state = 0x853c49e6748fea9b;
+    char (*strings)[700] = malloc(rulesCount * sizeof(*strings));
+    CSCronExpression *expressions = malloc(rulesCount * sizeof(CSCronExpression));
+
+    for (size_t i = 0; i < rulesCount; i++) {
+        CSRandomExpression(strings[i], sizeof(strings[i]), &state);
+    }
+
+    double start = CSTestTime();
+    size_t parsedCount = 0;
+    for (size_t i = 0; i < rulesCount; i++) {
+        parsedCount += CSCronExpressionParse(&expressions[i], strings[i], NULL);
+    }
+    double parseTime = CSTestTime() - start;
+
+    int64_t time = CSTime(2024, 3, 30, 12, 0);
+    int64_t offset = 3600;
+    int64_t checksum = 0;
+
+    start = CSTestTime();
+    for (size_t i = 0; i < rulesCount; i++) {
+        int64_t nextTime = 0;
+        checksum += (CSCronExpressionNextTime(&expressions[i], time, &nextTime) ? nextTime : 0);
+    }
+    double localTime = CSTestTime() - start;
+
+    start = CSTestTime();
+    for (size_t i = 0; i < rulesCount; i++) {
+        int64_t fireTime = 0;
+        checksum += (CSCronExpressionNextFireTime(&expressions[i], time, CSFixedOffset, &offset, &fireTime) ? fireTime : 0);
+    }
+    double fixedTime = CSTestTime() - start;
+
+    //day before spring forward, offset function is called for every candidate
+    start = CSTestTime();
+    for (size_t i = 0; i < rulesCount; i++) {
+        int64_t fireTime = 0;
+        checksum += (CSCronExpressionNextFireTime(&expressions[i], time, CSBerlinOffset, NULL, &fireTime) ? fireTime : 0);
+    }
+    double transitionTime = CSTestTime() - start;
+
+    printf("CSCronExpression %zu rules: parse %.0f ns, next local time %.0f ns, next fire time %.0f ns with fixed offset, %.0f ns around DST (checksum %lld)\n",
+           parsedCount, parseTime / rulesCount * 1e9, localTime / rulesCount * 1e9, fixedTime / rulesCount * 1e9,
+           transitionTime / rulesCount * 1e9, (long long)checksum);
+
+    free(strings);
+    free(expressions);
+}
+
+int main(int argc, char *argv[]) {
+
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        benchmark();
+        return EXIT_SUCCESS;
+    }
+
+    CSTestRun(testParseErrors);
+    CSTestRun(testMacros);
+    CSTestRun(testFields);
+    CSTestRun(testDayOfMonthOrDayOfWeek);
+    CSTestRun(testNoMatch);
+    CSTestRun(testOracle);
+    CSTestRun(testSpringForward);
+    CSTestRun(testFallBack);
+    CSTestRun(testYearInBerlin);
+    CSTestRun(testFixedOffset);
+    CSTestRun(testTransitionOracle);
+    return CSTestFinish();
+}
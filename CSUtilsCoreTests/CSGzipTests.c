@@ -0,0 +1,250 @@
+//
+//  CSGzipTests.c
+//  CSUtilsCoreTests
+//
+//  Created by Josip Bernat on 19/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#include "CSTest.h"
+#include "CSGzip.h"
+
+#include <math.h>
+#include <string.h>
+#include <zlib.h>
+
+#pragma mark - Helpers
+
+/**
+ *  Inflates gzip stream with zlib so compressed output is checked by independent decoder, including gzip header and CRC trailer.
+ */
+static bool CSGunzip(const uint8_t *bytes, size_t length, uint8_t **output, size_t *outputLength) {
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, 15 + 16) != Z_OK) {
+        return false;
+    }
+
+    CSByteBuffer buffer;
+    CSByteBufferInit(&buffer, 4096);
+
+    stream.next_in = (Bytef *)bytes;
+    stream.avail_in = (uInt)length;
+
+    int result = Z_OK;
+    while (result == Z_OK) {
+        CSByteBufferReserve(&buffer, 4096);
+        stream.next_out = buffer.bytes + buffer.length;
+        stream.avail_out = 4096;
+        result = inflate(&stream, Z_NO_FLUSH);
+        buffer.length = (size_t)stream.total_out;
+    }
+
+    // whole input must be one complete gzip member
+    bool complete = (result == Z_STREAM_END && stream.avail_in == 0);
+    inflateEnd(&stream);
+
+    *output = CSByteBufferDetach(&buffer, outputLength);
+    return complete;
+}
+
+static void CSFillCompressible(uint8_t *bytes, size_t length, uint64_t *state) {
+
+    static const char *words[] = {"\"id\":", "\"name\":", "\"value\":", "null", "true", "false", ",", "{", "}", "[", "]"};
+    size_t position = 0;
+    while (position < length) {
+        const char *word = words[CSTestRandom(state) % (sizeof(words) / sizeof(words[0]))];
+        size_t wordLength = strlen(word);
+        if (position + wordLength > length) {
+            wordLength = length - position;
+        }
+        memcpy(bytes + position, word, wordLength);
+        position += wordLength;
+    }
+}
+
+static void CSFillRandom(uint8_t *bytes, size_t length, uint64_t *state) {
+    for (size_t i = 0; i < length; i++) {
+        bytes[i] = (uint8_t)(CSTestRandom(state) >> 24);
+    }
+}
+
+static bool CSRoundTrips(const uint8_t *bytes, size_t length, int level, size_t *compressedLength) {
+
+    CSByteBuffer buffer;
+    CSByteBufferInit(&buffer, 0);
+
+    // compressed bytes are appended after existing content
+    CSByteBufferAppend(&buffer, "prefix", 6);
+    bool compressed = CSGzipCompressBytes(&buffer, bytes, length, level);
+
+    uint8_t *output = NULL;
+    size_t outputLength = 0;
+    bool equal = (compressed &&
+                  memcmp(buffer.bytes, "prefix", 6) == 0 &&
+                  CSGunzip(buffer.bytes + 6, buffer.length - 6, &output, &outputLength) &&
+                  outputLength == length &&
+                  (length == 0 || memcmp(output, bytes, length) == 0));
+
+    if (compressedLength) {
+        *compressedLength = buffer.length - 6;
+    }
+    free(output);
+    CSByteBufferFree(&buffer);
+    return equal;
+}
+
+#pragma mark - Tests
+
+static void testRoundTrip(void) {
+
+    uint64_t state = 1234;
+    size_t lengths[] = {0, 1, 17, 1024, 65535, 65536, 1000003};
+    uint8_t *bytes = malloc(lengths[sizeof(lengths) / sizeof(lengths[0]) - 1]);
+
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        for (int level = 1; level <= 9; level += 4) {
+
+            CSFillCompressible(bytes, lengths[i], &state);
+            CSTestAssert(CSRoundTrips(bytes, lengths[i], level, NULL), "compressible length %zu level %d", lengths[i], level);
+
+            CSFillRandom(bytes, lengths[i], &state);
+            CSTestAssert(CSRoundTrips(bytes, lengths[i], level, NULL), "random length %zu level %d", lengths[i], level);
+        }
+    }
+    free(bytes);
+}
+
+static void testCompressionRatio(void) {
+
+    uint64_t state = 99;
+    size_t length = 64 * 1024;
+    uint8_t *bytes = malloc(length);
+
+    size_t compressedLength = 0;
+    CSFillCompressible(bytes, length, &state);
+    CSTestAssert(CSRoundTrips(bytes, length, CSGzipDefaultCompressionLevel, &compressedLength), "compressible");
+    CSTestAssert(compressedLength < length / 3, "compressible text shrinks, got %zu", compressedLength);
+
+    // incompressible data stays within bound reserved up front
+    CSFillRandom(bytes, length, &state);
+    CSTestAssert(CSRoundTrips(bytes, length, CSGzipDefaultCompressionLevel, &compressedLength), "random");
+    CSTestAssert(compressedLength < length + 128, "random data grows only slightly, got %zu", compressedLength);
+
+    free(bytes);
+}
+
+static void testInvalidLevel(void) {
+
+    CSByteBuffer buffer;
+    CSByteBufferInit(&buffer, 0);
+    CSByteBufferAppend(&buffer, "abc", 3);
+
+    CSTestAssert(!CSGzipCompressBytes(&buffer, (const uint8_t *)"abc", 3, 0), "level 0");
+    CSTestAssert(!CSGzipCompressBytes(&buffer, (const uint8_t *)"abc", 3, 10), "level 10");
+    CSTestAssert(buffer.length == 3, "length unchanged on failure");
+
+    CSByteBufferFree(&buffer);
+}
+
+#pragma mark - Benchmark
+
+/**
+ *  JSON body shaped like our feed downloads and batch uploads: array of records with ids, timestamps, URLs, text and numbers.
+ */
+static void CSBenchAppendJSONBody(CSByteBuffer *buffer, size_t minimumLength, uint64_t *state) {
+
+    static const char *words[] = {"lorem", "ipsum", "dolor", "sit", "amet", "zagreb", "photo", "sunset", "coffee", "street", "friends", "weekend"};
+    char text[512];
+
+    CSByteBufferAppend(buffer, "{\"status\":\"ok\",\"items\":[", 24);
+    for (unsigned item = 0; buffer->length < minimumLength; item++) {
+
+        int length = snprintf(text, sizeof(text),
+                              "%s{\"id\":%u,\"created_at\":\"2014-03-%02uT%02u:%02u:%02uZ\",\"user\":{\"id\":%u,\"avatar_url\":\"https://cdn.example.com/avatars/%u.jpg\"},"
+                              "\"likes\":%u,\"score\":%.5f,\"is_public\":%s,\"title\":\"",
+                              (item ? "," : ""), 1000000 + item, 1 + item % 28, item % 24, item % 60, (item * 7) % 60,
+                              (unsigned)(CSTestRandom(state) % 100000), (unsigned)(CSTestRandom(state) % 100000),
+                              (unsigned)(CSTestRandom(state) % 5000), (double)(CSTestRandom(state) % 100000) / 100000.0,
+                              (item % 3 ? "true" : "false"));
+        CSByteBufferAppend(buffer, text, (size_t)length);
+
+        unsigned wordsCount = 3 + (unsigned)(CSTestRandom(state) % 12);
+        for (unsigned i = 0; i < wordsCount; i++) {
+            const char *word = words[CSTestRandom(state) % (sizeof(words) / sizeof(words[0]))];
+            if (i) {
+                CSByteBufferAppend(buffer, " ", 1);
+            }
+            CSByteBufferAppend(buffer, word, strlen(word));
+        }
+        CSByteBufferAppend(buffer, "\"}", 2);
+    }
+    CSByteBufferAppend(buffer, "]}", 2);
+}
+
+static void benchmark(void) {
+
+    const size_t lengths[] = {64 * 1024, 1024 * 1024, 8 * 1024 * 1024};
+    const int levels[] = {1, CSGzipDefaultCompressionLevel, 9};
+
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+
+        uint64_t state = 9;
+        CSByteBuffer body;
+        CSByteBufferInit(&body, lengths[i] + 1024);
+        CSBenchAppendJSONBody(&body, lengths[i], &state);
+        double megabytes = (double)body.length / (1024.0 * 1024.0);
+        unsigned runsCount = (unsigned)(32.0 / megabytes) + 2;
+
+        for (size_t j = 0; j < sizeof(levels) / sizeof(levels[0]); j++) {
+
+            double compressTime = INFINITY;
+            double inflateTime = INFINITY;
+            size_t compressedLength = 0;
+            for (unsigned run = 0; run < runsCount; run++) {
+
+                CSByteBuffer compressed;
+                CSByteBufferInit(&compressed, 0);
+                double start = CSTestTime();
+                bool result = CSGzipCompressBytes(&compressed, body.bytes, body.length, levels[j]);
+                double time = CSTestTime() - start;
+                compressTime = (time < compressTime ? time : compressTime);
+                compressedLength = compressed.length;
+
+                //response side is inflated by zlib in 4 KB steps as it arrives
+                uint8_t *output = NULL;
+                size_t outputLength = 0;
+                start = CSTestTime();
+                result = (result && CSGunzip(compressed.bytes, compressed.length, &output, &outputLength) && outputLength == body.length);
+                time = CSTestTime() - start;
+                inflateTime = (time < inflateTime ? time : inflateTime);
+
+                free(output);
+                CSByteBufferFree(&compressed);
+                if (!result) {
+                    fprintf(stderr, "gzip round trip failed\n");
+                    break;
+                }
+            }
+
+            printf("gzip, %8zu byte JSON body, level %d: %8zu bytes on the wire (ratio %.1fx), compress %6.2f ms/MB, inflate %5.2f ms/MB\n",
+                   body.length, levels[j], compressedLength, (double)body.length / (double)compressedLength,
+                   compressTime * 1e3 / megabytes, inflateTime * 1e3 / megabytes);
+        }
+        CSByteBufferFree(&body);
+    }
+}
+
+int main(int argc, char *argv[]) {
+
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        benchmark();
+        return EXIT_SUCCESS;
+    }
+
+    CSTestRun(testRoundTrip);
+    CSTestRun(testCompressionRatio);
+    CSTestRun(testInvalidLevel);
+    return CSTestFinish();
+}
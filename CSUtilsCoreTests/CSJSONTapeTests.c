@@ -0,0 +1,487 @@
+//
+//  CSJSONTapeTests.c
+//  CSUtilsCoreTests
+//
+//  Created by Josip Bernat on 19/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#include "CSTest.h"
+#include "CSJSONTape.h"
+#include "CSPercentEncoding.h"
+
+#include <math.h>
+#include <string.h>
+
+#pragma mark - Helpers
+
+static CSJSONTapeError CSParse(CSJSONTape *tape, const char *text) {
+    return CSJSONTapeParse(tape, (const uint8_t *)text, strlen(text), NULL);
+}
+
+static void CSAppendString(CSByteBuffer *buffer, const char *string) {
+    CSByteBufferAppend(buffer, string, strlen(string));
+}
+
+/**
+ *  Writes value at index back as compact JSON so parsing can be checked by round trip.
+ */
+static size_t CSSerialize(const CSJSONTape *tape, size_t index, CSByteBuffer *buffer) {
+
+    char number[64];
+    switch (CSJSONTapeTypeAtIndex(tape, index)) {
+
+        case CSJSONTapeTypeObjectStart:
+        case CSJSONTapeTypeArrayStart: {
+
+            bool isObject = (CSJSONTapeTypeAtIndex(tape, index) == CSJSONTapeTypeObjectStart);
+            size_t endIndex = CSJSONTapePayloadAtIndex(tape, index) - 1;
+            CSAppendString(buffer, isObject ? "{" : "[");
+
+            size_t child = index + 1;
+            bool first = true;
+            while (child < endIndex) {
+                if (!first) {
+                    CSAppendString(buffer, ",");
+                }
+                first = false;
+                child = CSSerialize(tape, child, buffer);
+                if (isObject) {
+                    CSAppendString(buffer, ":");
+                    child = CSSerialize(tape, child, buffer);
+                }
+            }
+            CSAppendString(buffer, isObject ? "}" : "]");
+            return endIndex + 1;
+        }
+        case CSJSONTapeTypeString: {
+
+            size_t length = 0;
+            const char *string = CSJSONTapeStringAtIndex(tape, index, &length);
+            CSAppendString(buffer, "\"");
+            for (size_t i = 0; i < length; i++) {
+                uint8_t c = (uint8_t)string[i];
+                if (c == '"' || c == '\\') {
+                    char escape[2] = {'\\', (char)c};
+                    CSByteBufferAppend(buffer, escape, 2);
+                }
+                else if (c < 0x20) {
+                    snprintf(number, sizeof(number), "\\u%04x", c);
+                    CSAppendString(buffer, number);
+                }
+                else {
+                    CSByteBufferAppend(buffer, &c, 1);
+                }
+            }
+            CSAppendString(buffer, "\"");
+            break;
+        }
+        case CSJSONTapeTypeInteger:
+            snprintf(number, sizeof(number), "%lld", (long long)CSJSONTapeIntegerAtIndex(tape, index));
+            CSAppendString(buffer, number);
+            break;
+        case CSJSONTapeTypeDouble:
+            snprintf(number, sizeof(number), "%.17g", CSJSONTapeDoubleAtIndex(tape, index));
+            CSAppendString(buffer, number);
+            break;
+        case CSJSONTapeTypeTrue:
+            CSAppendString(buffer, "true");
+            break;
+        case CSJSONTapeTypeFalse:
+            CSAppendString(buffer, "false");
+            break;
+        default:
+            CSAppendString(buffer, "null");
+            break;
+    }
+    return CSJSONTapeNextIndex(tape, index);
+}
+
+static bool CSRoundTrips(CSJSONTape *tape, const char *text, const char *expected) {
+
+    if (CSParse(tape, text) != CSJSONTapeErrorNone) {
+        return false;
+    }
+    CSByteBuffer buffer;
+    CSByteBufferInit(&buffer, 64);
+    CSSerialize(tape, 1, &buffer);
+    bool equal = (buffer.length == strlen(expected) && memcmp(buffer.bytes, expected, buffer.length) == 0);
+    if (!equal) {
+        fprintf(stderr, "got %.*s\n", (int)buffer.length, (const char *)buffer.bytes);
+    }
+    CSByteBufferFree(&buffer);
+    return equal;
+}
+
+#pragma mark - Tests
+
+static void testRoundTrip(void) {
+
+    CSJSONTape tape;
+    CSJSONTapeInit(&tape);
+
+    const char *documents[][2] = {
+        {"{}", "{}"},
+        {"[]", "[]"},
+        {" [ 1 , -2 , true , false , null ] ", "[1,-2,true,false,null]"},
+        {"{\"a\":{\"b\":[{\"c\":\"d\"},[],{}]},\"e\":\"\"}", "{\"a\":{\"b\":[{\"c\":\"d\"},[],{}]},\"e\":\"\"}"},
+        {"\"\\\"\\\\\\/\\b\\f\\n\\r\\t\"", "\"\\\"\\\\/\\u0008\\u000c\\u000a\\u000d\\u0009\""},
+        {"[0.5,-0.25,1e2,1.5E-3]", "[0.5,-0.25,100,0.0015]"},
+        {"\"\\u00e9\\u4e2d\\ud83d\\ude00\"", "\"\xC3\xA9\xE4\xB8\xAD\xF0\x9F\x98\x80\""},
+    };
+    for (size_t i = 0; i < sizeof(documents) / sizeof(documents[0]); i++) {
+        CSTestAssert(CSRoundTrips(&tape, documents[i][0], documents[i][1]), "document %s", documents[i][0]);
+    }
+
+    // parsed tape survives second pass through serializer unchanged
+    const char *nested = "{\"list\":[1,2,{\"deep\":[[[\"x\"]]]}],\"count\":3,\"ratio\":0.75,\"ok\":true}";
+    CSTestAssert(CSRoundTrips(&tape, nested, nested), "nested document");
+    CSTestAssert(CSJSONTapeContainerCount(&tape, 1) == 4, "object count");
+
+    CSJSONTapeFree(&tape);
+}
+
+static void testIntegers(void) {
+
+    CSJSONTape tape;
+    CSJSONTapeInit(&tape);
+
+    struct { const char *text; int64_t value; } integers[] = {
+        {"0", 0},
+        {"-0", 0},
+        {"999999999999999999", INT64_C(999999999999999999)},
+        {"1000000000000000000", INT64_C(1000000000000000000)},
+        {"1989337815729576645", INT64_C(1989337815729576645)},
+        {"9223372036854775807", INT64_MAX},
+        {"-9223372036854775807", -INT64_MAX},
+        {"-9223372036854775808", INT64_MIN},
+    };
+    for (size_t i = 0; i < sizeof(integers) / sizeof(integers[0]); i++) {
+        CSTestAssert(CSParse(&tape, integers[i].text) == CSJSONTapeErrorNone, "%s", integers[i].text);
+        CSTestAssert(CSJSONTapeTypeAtIndex(&tape, 1) == CSJSONTapeTypeInteger, "%s is integer", integers[i].text);
+        CSTestAssert(CSJSONTapeIntegerAtIndex(&tape, 1) == integers[i].value, "%s", integers[i].text);
+    }
+
+    // integers out of int64_t range become doubles
+    struct { const char *text; double value; } doubles[] = {
+        {"9223372036854775808", 9223372036854775808.0},
+        {"-9223372036854775809", -9223372036854775809.0},
+        {"18446744073709551616", 18446744073709551616.0},
+        {"123456789012345678901234567890", 123456789012345678901234567890.0},
+    };
+    for (size_t i = 0; i < sizeof(doubles) / sizeof(doubles[0]); i++) {
+        CSTestAssert(CSParse(&tape, doubles[i].text) == CSJSONTapeErrorNone, "%s", doubles[i].text);
+        CSTestAssert(CSJSONTapeTypeAtIndex(&tape, 1) == CSJSONTapeTypeDouble, "%s is double", doubles[i].text);
+        CSTestAssert(CSJSONTapeDoubleAtIndex(&tape, 1) == doubles[i].value, "%s", doubles[i].text);
+    }
+
+    CSJSONTapeFree(&tape);
+}
+
+static void testDoubles(void) {
+
+    CSJSONTape tape;
+    CSJSONTapeInit(&tape);
+
+    CSTestAssert(CSParse(&tape, "1.7976931348623157e308") == CSJSONTapeErrorNone, "largest double");
+    CSTestAssert(CSJSONTapeDoubleAtIndex(&tape, 1) == 1.7976931348623157e308, "largest double");
+    CSTestAssert(CSParse(&tape, "4.9e-324") == CSJSONTapeErrorNone, "smallest double");
+    CSTestAssert(CSParse(&tape, "1e-400") == CSJSONTapeErrorNone, "underflow");
+    CSTestAssert(CSJSONTapeDoubleAtIndex(&tape, 1) == 0.0, "underflow is zero");
+
+    const char *overflows[] = {"1e400", "-1e400", "[1.8e308]", "{\"a\":1e309}"};
+    for (size_t i = 0; i < sizeof(overflows) / sizeof(overflows[0]); i++) {
+        CSTestAssert(CSParse(&tape, overflows[i]) == CSJSONTapeErrorNumber, "%s", overflows[i]);
+    }
+
+    const char *malformed[] = {"01", "-", "1.", ".5", "1e", "+1", "1e+", "--1"};
+    for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++) {
+        CSTestAssert(CSParse(&tape, malformed[i]) != CSJSONTapeErrorNone, "%s", malformed[i]);
+    }
+
+    CSJSONTapeFree(&tape);
+}
+
+static void testEncoding(void) {
+
+    CSJSONTape tape;
+    CSJSONTapeInit(&tape);
+
+    const char *valid[] = {
+        "\"\xC2\x80\"",                 // U+0080
+        "\"\xDF\xBF\"",                 // U+07FF
+        "\"\xE0\xA0\x80\"",             // U+0800
+        "\"\xED\x9F\xBF\"",             // U+D7FF
+        "\"\xEE\x80\x80\"",             // U+E000
+        "\"\xEF\xBF\xBF\"",             // U+FFFF
+        "\"\xF0\x90\x80\x80\"",         // U+10000
+        "\"\xF4\x8F\xBF\xBF\"",         // U+10FFFF
+        "{\"k\xC3\xA9y\":\"v\xE2\x82\xAC\"}",
+    };
+    for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); i++) {
+        CSTestAssert(CSParse(&tape, valid[i]) == CSJSONTapeErrorNone, "valid %zu", i);
+    }
+
+    const char *invalid[] = {
+        "\"\xFF\xFE\"",                 // bytes never used in UTF-8
+        "\"\x80\"",                     // lone continuation byte
+        "\"\xC0\xAF\"",                 // overlong '/'
+        "\"\xC1\xBF\"",                 // overlong
+        "\"\xE0\x9F\xBF\"",             // overlong 3 byte form
+        "\"\xF0\x8F\xBF\xBF\"",         // overlong 4 byte form
+        "\"\xED\xA0\x80\"",             // high surrogate
+        "\"\xED\xBF\xBF\"",             // low surrogate
+        "\"\xF4\x90\x80\x80\"",         // above U+10FFFF
+        "\"\xF5\x80\x80\x80\"",
+        "\"\xC3\"",                     // truncated before closing quote
+        "\"\xE2\x82\"",
+        "\"\xE2\x28\xA1\"",             // bad continuation
+        "[\"ok\",\"\xC3\x28\"]",
+        "{\"\xFF\":1}",                 // invalid key
+    };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        CSTestAssert(CSParse(&tape, invalid[i]) == CSJSONTapeErrorEncoding, "invalid %zu", i);
+    }
+
+    // escaped lone surrogates are rejected as well
+    CSTestAssert(CSParse(&tape, "\"\\ud800\"") == CSJSONTapeErrorString, "lone high surrogate");
+    CSTestAssert(CSParse(&tape, "\"\\udc00\"") == CSJSONTapeErrorString, "lone low surrogate");
+
+    size_t errorOffset = 0;
+    const char *text = "[\"abc\xFF\"]";
+    CSTestAssert(CSJSONTapeParse(&tape, (const uint8_t *)text, strlen(text), &errorOffset) == CSJSONTapeErrorEncoding, "offset");
+    CSTestAssert(errorOffset == 5, "error offset is %zu", errorOffset);
+
+    CSJSONTapeFree(&tape);
+}
+
+static void testErrors(void) {
+
+    CSJSONTape tape;
+    CSJSONTapeInit(&tape);
+
+    CSTestAssert(CSParse(&tape, "") == CSJSONTapeErrorEmpty, "empty");
+    CSTestAssert(CSParse(&tape, "   ") == CSJSONTapeErrorEmpty, "whitespace");
+
+    const char *syntax[] = {"[1,]", "{\"a\"}", "{\"a\":1,}", "[1 2]", "tru", "nul", "[", "{", "]", "1 2"};
+    for (size_t i = 0; i < sizeof(syntax) / sizeof(syntax[0]); i++) {
+        CSTestAssert(CSParse(&tape, syntax[i]) != CSJSONTapeErrorNone, "%s", syntax[i]);
+    }
+    CSTestAssert(CSParse(&tape, "\"abc") == CSJSONTapeErrorString, "unterminated string");
+    CSTestAssert(CSParse(&tape, "\"a\nb\"") == CSJSONTapeErrorString, "control character");
+    CSTestAssert(CSParse(&tape, "\"\\x\"") == CSJSONTapeErrorString, "unknown escape");
+
+    char deep[2 * CSJSONTapeMaximumDepth + 3];
+    size_t length = 0;
+    for (size_t i = 0; i <= CSJSONTapeMaximumDepth; i++) deep[length++] = '[';
+    for (size_t i = 0; i <= CSJSONTapeMaximumDepth; i++) deep[length++] = ']';
+    CSTestAssert(CSJSONTapeParse(&tape, (const uint8_t *)deep, length, NULL) == CSJSONTapeErrorDepth, "depth");
+    CSTestAssert(CSJSONTapeParse(&tape, (const uint8_t *)deep + 1, length - 2, NULL) == CSJSONTapeErrorNone, "maximum depth");
+
+    CSJSONTapeFree(&tape);
+}
+
+#pragma mark - Benchmark
+
+static const char *CSBenchWords[] = {"lorem", "ipsum", "dolor", "sit", "amet", "zagreb", "photo", "sunset", "coffee", "čevapi", "street", "friends"};
+
+static void CSBenchAppendText(CSByteBuffer *buffer, uint64_t *state, unsigned wordsCount) {
+
+    CSAppendString(buffer, "\"");
+    for (unsigned i = 0; i < wordsCount; i++) {
+        if (i) {
+            CSAppendString(buffer, (CSTestRandom(state) % 10 == 0 ? "\\n" : " "));
+        }
+        CSAppendString(buffer, CSBenchWords[CSTestRandom(state) % (sizeof(CSBenchWords) / sizeof(CSBenchWords[0]))]);
+    }
+    CSAppendString(buffer, "\"");
+}
+
+/**
+ *  Feed response as returned by our API: page of posts with nested author, image, tags and latest comments.
+ */
+static void CSBenchAppendFeed(CSByteBuffer *buffer, size_t minimumLength) {
+
+    uint64_t state = 5;
+    char text[256];
+    CSAppendString(buffer, "{\"status\":\"ok\",\"page\":1,\"next_page_url\":\"https://api.example.com/v2/feed?page=2\",\"items\":[");
+
+    for (unsigned item = 0; buffer->length < minimumLength; item++) {
+
+        unsigned userId = (unsigned)(CSTestRandom(&state) % 100000);
+        snprintf(text, sizeof(text),
+                 "%s{\"id\":%u,\"type\":\"photo\",\"created_at\":\"2014-03-%02uT%02u:%02u:%02uZ\",\"likes\":%u,\"score\":%.4f,\"is_public\":%s,\"location\":null,"
+                 "\"author\":{\"id\":%u,\"name\":\"User %u\",\"avatar_url\":\"https://cdn.example.com/avatars/%u.jpg\",\"verified\":%s},\"title\":",
+                 (item ? "," : ""), 1000000 + item, 1 + item % 28, item % 24, item % 60, (item * 7) % 60, (unsigned)(CSTestRandom(&state) % 5000),
+                 (double)(CSTestRandom(&state) % 100000) / 100000.0, (item % 3 ? "true" : "false"),
+                 userId, userId, userId, (userId % 10 ? "false" : "true"));
+        CSAppendString(buffer, text);
+        CSBenchAppendText(buffer, &state, 3 + (unsigned)(CSTestRandom(&state) % 6));
+
+        snprintf(text, sizeof(text), ",\"image\":{\"url\":\"https://cdn.example.com/photos/%u.jpg\",\"width\":%u,\"height\":%u},\"tags\":[",
+                 1000000 + item, 640 + (unsigned)(CSTestRandom(&state) % 1400), 480 + (unsigned)(CSTestRandom(&state) % 1000));
+        CSAppendString(buffer, text);
+        unsigned tagsCount = (unsigned)(CSTestRandom(&state) % 5);
+        for (unsigned i = 0; i < tagsCount; i++) {
+            if (i) {
+                CSAppendString(buffer, ",");
+            }
+            CSBenchAppendText(buffer, &state, 1);
+        }
+
+        CSAppendString(buffer, "],\"comments\":[");
+        unsigned commentsCount = (unsigned)(CSTestRandom(&state) % 4);
+        for (unsigned i = 0; i < commentsCount; i++) {
+            snprintf(text, sizeof(text), "%s{\"id\":%u,\"user_id\":%u,\"text\":", (i ? "," : ""), (unsigned)(CSTestRandom(&state) % 10000000), (unsigned)(CSTestRandom(&state) % 100000));
+            CSAppendString(buffer, text);
+            CSBenchAppendText(buffer, &state, 2 + (unsigned)(CSTestRandom(&state) % 12));
+            CSAppendString(buffer, "}");
+        }
+        CSAppendString(buffer, "]}");
+    }
+    CSAppendString(buffer, "]}");
+}
+
+/**
+ *  Index of value of key in object at given index or 0.
+ */
+static size_t CSBenchValueIndex(const CSJSONTape *tape, size_t objectIndex, const char *key) {
+
+    size_t endIndex = CSJSONTapePayloadAtIndex(tape, objectIndex) - 1;
+    size_t keyLength = strlen(key);
+    for (size_t index = objectIndex + 1; index < endIndex; index = CSJSONTapeNextIndex(tape, index + 1)) {
+        size_t length = 0;
+        const char *string = CSJSONTapeStringAtIndex(tape, index, &length);
+        if (length == keyLength && memcmp(string, key, length) == 0) {
+            return index + 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ *  What list screen reads through lazy document: id, title and author name of every item.
+ */
+static uint64_t CSBenchReadListFields(const CSJSONTape *tape) {
+
+    uint64_t checksum = 0;
+    size_t itemsIndex = CSBenchValueIndex(tape, 1, "items");
+    size_t endIndex = CSJSONTapePayloadAtIndex(tape, itemsIndex) - 1;
+    for (size_t item = itemsIndex + 1; item < endIndex; item = CSJSONTapeNextIndex(tape, item)) {
+
+        size_t length = 0;
+        checksum += (uint64_t)CSJSONTapeIntegerAtIndex(tape, CSBenchValueIndex(tape, item, "id"));
+        CSJSONTapeStringAtIndex(tape, CSBenchValueIndex(tape, item, "title"), &length);
+        checksum += length;
+        CSJSONTapeStringAtIndex(tape, CSBenchValueIndex(tape, CSBenchValueIndex(tape, item, "author"), "name"), &length);
+        checksum += length;
+    }
+    return checksum;
+}
+
+/**
+ *  Materializes every value as document does when whole response is converted, strings are copied as object would copy them.
+ */
+static uint64_t CSBenchMaterialize(const CSJSONTape *tape, size_t index, size_t *nextIndex) {
+
+    uint64_t checksum = 0;
+    switch (CSJSONTapeTypeAtIndex(tape, index)) {
+
+        case CSJSONTapeTypeObjectStart:
+        case CSJSONTapeTypeArrayStart: {
+
+            size_t endIndex = CSJSONTapePayloadAtIndex(tape, index) - 1;
+            size_t child = index + 1;
+            while (child < endIndex) {
+                checksum += CSBenchMaterialize(tape, child, &child);
+            }
+            *nextIndex = endIndex + 1;
+            return checksum + CSJSONTapeContainerCount(tape, index);
+        }
+        case CSJSONTapeTypeString: {
+
+            size_t length = 0;
+            const char *string = CSJSONTapeStringAtIndex(tape, index, &length);
+            char *copy = malloc(length + 1);
+            memcpy(copy, string, length + 1);
+            checksum += (uint8_t)copy[length / 2];
+            free(copy);
+            break;
+        }
+        case CSJSONTapeTypeInteger:
+            checksum += (uint64_t)CSJSONTapeIntegerAtIndex(tape, index);
+            break;
+        case CSJSONTapeTypeDouble:
+            checksum += (uint64_t)(CSJSONTapeDoubleAtIndex(tape, index) * 1000.0);
+            break;
+        default:
+            checksum++;
+            break;
+    }
+    *nextIndex = CSJSONTapeNextIndex(tape, index);
+    return checksum;
+}
+
+static void benchmark(void) {
+
+    const size_t lengths[] = {256 * 1024, 4 * 1024 * 1024, 16 * 1024 * 1024};
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+
+        CSByteBuffer payload;
+        CSByteBufferInit(&payload, lengths[i] + 4096);
+        CSBenchAppendFeed(&payload, lengths[i]);
+        double megabytes = (double)payload.length / (1024.0 * 1024.0);
+        unsigned runsCount = (unsigned)(64.0 / megabytes) + 3;
+
+        //tape storage is reused between parses as document reuses it for same sized responses
+        CSJSONTape tape;
+        CSJSONTapeInit(&tape);
+        double parseTime = INFINITY;
+        double listTime = INFINITY;
+        double materializeTime = INFINITY;
+        uint64_t checksum = 0;
+        for (unsigned run = 0; run < runsCount; run++) {
+
+            double start = CSTestTime();
+            CSJSONTapeError result = CSJSONTapeParse(&tape, payload.bytes, payload.length, NULL);
+            double time = CSTestTime() - start;
+            parseTime = (time < parseTime ? time : parseTime);
+            if (result != CSJSONTapeErrorNone) {
+                fprintf(stderr, "feed payload didn't parse: %d\n", result);
+                break;
+            }
+
+            start = CSTestTime();
+            checksum += CSBenchReadListFields(&tape);
+            time = CSTestTime() - start;
+            listTime = (time < listTime ? time : listTime);
+
+            size_t nextIndex = 0;
+            start = CSTestTime();
+            checksum += CSBenchMaterialize(&tape, 1, &nextIndex);
+            time = CSTestTime() - start;
+            materializeTime = (time < materializeTime ? time : materializeTime);
+        }
+
+        printf("JSON tape, %.2f MB feed: tape build %.0f MB/s, list fields %.0f MB/s, full materialization %.0f MB/s (checksum %llu)\n",
+               megabytes, megabytes / parseTime, megabytes / listTime, megabytes / materializeTime, (unsigned long long)checksum);
+
+        CSJSONTapeFree(&tape);
+        CSByteBufferFree(&payload);
+    }
+}
+
+int main(int argc, char *argv[]) {
+
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        benchmark();
+        return EXIT_SUCCESS;
+    }
+
+    CSTestRun(testRoundTrip);
+    CSTestRun(testIntegers);
+    CSTestRun(testDoubles);
+    CSTestRun(testEncoding);
+    CSTestRun(testErrors);
+    return CSTestFinish();
+}
@@ -0,0 +1,313 @@
+//
+//  CSOperationStateTests.c
+//  CSUtilsCoreTests
+//
+//  Created by Josip Bernat on 20/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#include "CSTest.h"
+#include "CSOperationState.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+/**
+ *  Operation driven the way CSGenericOperation drives its state, counting every action so races show up as wrong counts.
+ */
+typedef struct CSTestOperation {
+    CSOperationState state;
+    _Atomic(uint32_t) startsCount;
+    _Atomic(uint32_t) finishesCount;
+    _Atomic(uint32_t) cancelFinishesCount;
+    _Atomic(uint32_t) handlerCallsCount;
+    _Atomic(uint32_t) isCancelledAtStart;
+    uint32_t pendingHandlersCount;
+} CSTestOperation;
+
+typedef enum {
+    CSTestRoleStart = 0,
+    CSTestRoleCancel,
+    CSTestRoleFinish,
+    CSTestRoleAddHandlers,
+    CSTestRolesCount
+} CSTestRole;
+
+typedef struct CSTestWorker {
+    CSTestRole role;
+    CSTestOperation *operations;
+    size_t operationsCount;
+} CSTestWorker;
+
+/**
+ *  Striped locks guarding completion handlers, like @synchronized which hashes objects to shared locks.
+ */
+#define CSTestLocksCount 256
+static pthread_mutex_t CSTestLocks[CSTestLocksCount];
+
+#pragma mark - Helpers
+
+static void CSTestOperationFinish(CSTestOperation *operation, size_t index) {
+
+    if (!CSOperationStateBeginFinishing(&operation->state)) {
+        return;
+    }
+    CSOperationStateEndExecuting(&operation->state);
+    CSOperationStateSetFinished(&operation->state);
+    atomic_fetch_add_explicit(&operation->finishesCount, 1, memory_order_relaxed);
+
+    pthread_mutex_t *lock = &CSTestLocks[index % CSTestLocksCount];
+    pthread_mutex_lock(lock);
+    uint32_t handlersCount = operation->pendingHandlersCount;
+    operation->pendingHandlersCount = 0;
+    pthread_mutex_unlock(lock);
+
+    atomic_fetch_add_explicit(&operation->handlerCallsCount, handlersCount, memory_order_relaxed);
+}
+
+static void CSTestOperationAddHandler(CSTestOperation *operation, size_t index) {
+
+    //finished flag is checked under lock handlers are taken under, same as in addCompletionHandler:
+    pthread_mutex_t *lock = &CSTestLocks[index % CSTestLocksCount];
+    pthread_mutex_lock(lock);
+    if (!(CSOperationStateLoad(&operation->state) & CSOperationStateFinished)) {
+        operation->pendingHandlersCount++;
+        pthread_mutex_unlock(lock);
+        return;
+    }
+    pthread_mutex_unlock(lock);
+    atomic_fetch_add_explicit(&operation->handlerCallsCount, 1, memory_order_relaxed);
+}
+
+static void CSTestOperationStart(CSTestOperation *operation, size_t index) {
+
+    CSOperationStartAction action = CSOperationStateStart(&operation->state);
+    if (action == CSOperationStartActionNone) {
+        return;
+    }
+    atomic_fetch_add_explicit(&operation->startsCount, 1, memory_order_relaxed);
+    if (action == CSOperationStartActionFinishCancelled) {
+        atomic_store_explicit(&operation->isCancelledAtStart, 1, memory_order_relaxed);
+    }
+    //short operation, job finishes right away
+    CSTestOperationFinish(operation, index);
+}
+
+static void CSTestOperationCancel(CSTestOperation *operation, size_t index) {
+
+    if (CSOperationStateCancel(&operation->state)) {
+        atomic_fetch_add_explicit(&operation->cancelFinishesCount, 1, memory_order_relaxed);
+        CSTestOperationFinish(operation, index);
+    }
+}
+
+static void *CSTestWorkerMain(void *context) {
+
+    CSTestWorker *worker = context;
+    for (size_t i = 0; i < worker->operationsCount; i++) {
+
+        CSTestOperation *operation = &worker->operations[i];
+        switch (worker->role) {
+            case CSTestRoleStart:
+                CSTestOperationStart(operation, i);
+                break;
+            case CSTestRoleCancel:
+                if (i % 3 == 0) {
+                    CSTestOperationCancel(operation, i);
+                    CSTestOperationCancel(operation, i);
+                }
+                break;
+            case CSTestRoleFinish:
+                //finish from another thread, e.g. job completing asynchronously, races with job finishing itself
+                CSTestOperationFinish(operation, i);
+                break;
+            default:
+                CSTestOperationAddHandler(operation, i);
+                CSTestOperationStart(operation, i);
+                CSTestOperationAddHandler(operation, i);
+                break;
+        }
+
+        //lets other roles catch up on machines with fewer cores than threads
+        if (i % 64 == 0) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+/**
+ *  Runs all roles concurrently over fresh operations and checks every operation was started, finished and called its handlers exactly once.
+ *
+ *  @return Time in seconds.
+ */
+static double CSTestStress(CSTestOperation *operations, size_t operationsCount) {
+
+    memset(operations, 0, operationsCount * sizeof(CSTestOperation));
+    for (size_t i = 0; i < operationsCount; i++) {
+        CSOperationStateInit(&operations[i].state);
+    }
+
+    CSTestWorker workers[CSTestRolesCount];
+    pthread_t threads[CSTestRolesCount];
+
+    double start = CSTestTime();
+    for (unsigned i = 0; i < CSTestRolesCount; i++) {
+        workers[i] = (CSTestWorker){(CSTestRole)i, operations, operationsCount};
+        pthread_create(&threads[i], NULL, CSTestWorkerMain, &workers[i]);
+    }
+    for (unsigned i = 0; i < CSTestRolesCount; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double time = CSTestTime() - start;
+
+    size_t failuresCount = 0;
+    size_t firstFailure = 0;
+    size_t cancelledCount = 0;
+    for (size_t i = 0; i < operationsCount; i++) {
+
+        CSTestOperation *operation = &operations[i];
+        uint32_t state = CSOperationStateLoad(&operation->state);
+        uint32_t finishedState = CSOperationStateStarted | CSOperationStateFinishing | CSOperationStateFinished;
+        bool isCancelled = ((state & CSOperationStateCancelled) != 0);
+
+        bool isValid = ((state & ~(uint32_t)CSOperationStateCancelled) == finishedState &&
+                        operation->startsCount == 1 && operation->finishesCount == 1 &&
+                        operation->handlerCallsCount == 2 && operation->pendingHandlersCount == 0 &&
+                        operation->cancelFinishesCount <= 1 &&
+                        (!operation->cancelFinishesCount || isCancelled) &&
+                        (!operation->isCancelledAtStart || isCancelled) &&
+                        (!isCancelled || i % 3 == 0));
+        if (!isValid && failuresCount++ == 0) {
+            firstFailure = i;
+        }
+        cancelledCount += isCancelled;
+    }
+
+    CSTestAssert(failuresCount == 0, "%zu operations in wrong state, first %zu: state %#x, starts %u, finishes %u, handler calls %u, cancel finishes %u",
+                 failuresCount, firstFailure, CSOperationStateLoad(&operations[firstFailure].state),
+                 operations[firstFailure].startsCount, operations[firstFailure].finishesCount,
+                 operations[firstFailure].handlerCallsCount, operations[firstFailure].cancelFinishesCount);
+    CSTestAssert(cancelledCount <= (operationsCount + 2) / 3, "%zu operations cancelled", cancelledCount);
+    return time;
+}
+
+#pragma mark - Tests
+
+static void testLifecycle(void) {
+
+    CSOperationState state;
+    CSOperationStateInit(&state);
+
+    CSTestAssert(!CSOperationStateBeginFinishing(&state), "finished before start");
+    CSTestAssert(CSOperationStateStart(&state) == CSOperationStartActionRun, "not started");
+    CSTestAssert(CSOperationStateLoad(&state) == (CSOperationStateStarted | CSOperationStateExecuting), "state %#x", CSOperationStateLoad(&state));
+    CSTestAssert(CSOperationStateStart(&state) == CSOperationStartActionNone, "started twice");
+
+    CSTestAssert(CSOperationStateBeginFinishing(&state), "not finishing");
+    CSTestAssert(!CSOperationStateBeginFinishing(&state), "finishing twice");
+    CSTestAssert(!CSOperationStateCancel(&state), "cancelled while finishing");
+
+    CSOperationStateEndExecuting(&state);
+    CSOperationStateSetFinished(&state);
+    CSTestAssert(CSOperationStateLoad(&state) == (CSOperationStateStarted | CSOperationStateFinishing | CSOperationStateFinished), "state %#x", CSOperationStateLoad(&state));
+    CSTestAssert(!CSOperationStateCancel(&state), "cancelled after finish");
+    CSTestAssert(!(CSOperationStateLoad(&state) & CSOperationStateCancelled), "finished operation marked cancelled");
+}
+
+static void testCancel(void) {
+
+    //canceled before start, start finishes it
+    CSOperationState state;
+    CSOperationStateInit(&state);
+    CSTestAssert(!CSOperationStateCancel(&state), "cancel before start must not finish");
+    CSTestAssert(!CSOperationStateCancel(&state), "cancelled twice");
+    CSTestAssert(CSOperationStateStart(&state) == CSOperationStartActionFinishCancelled, "cancelled operation started");
+    CSTestAssert(CSOperationStateStart(&state) == CSOperationStartActionNone, "started twice");
+    CSTestAssert(CSOperationStateBeginFinishing(&state), "cancelled operation not finishing");
+
+    //canceled while executing, cancel finishes it
+    CSOperationStateInit(&state);
+    CSTestAssert(CSOperationStateStart(&state) == CSOperationStartActionRun, "not started");
+    CSTestAssert(CSOperationStateCancel(&state), "cancel while executing must finish");
+    CSTestAssert(!CSOperationStateCancel(&state), "cancelled twice");
+    CSTestAssert(CSOperationStateBeginFinishing(&state), "cancelled operation not finishing");
+    CSTestAssert(!CSOperationStateBeginFinishing(&state), "finishing twice");
+}
+
+static void testTransition(void) {
+
+    CSOperationState state;
+    CSOperationStateInit(&state);
+
+    uint32_t previousState = UINT32_MAX;
+    CSTestAssert(!CSOperationStateTransition(&state, CSOperationStateStarted, 0, CSOperationStateFinished, &previousState), "required bit missing");
+    CSTestAssert(previousState == 0, "previous state %#x", previousState);
+    CSTestAssert(CSOperationStateTransition(&state, 0, CSOperationStateCancelled, CSOperationStateStarted, &previousState), "not set");
+    CSTestAssert(!CSOperationStateTransition(&state, 0, CSOperationStateStarted, CSOperationStateCancelled, &previousState), "forbidden bit set");
+    CSTestAssert(previousState == CSOperationStateStarted, "previous state %#x", previousState);
+    CSTestAssert(CSOperationStateTransition(&state, CSOperationStateStarted, 0, CSOperationStateCancelled, NULL), "not set without previous state");
+    CSTestAssert(CSOperationStateLoad(&state) == (CSOperationStateStarted | CSOperationStateCancelled), "state %#x", CSOperationStateLoad(&state));
+}
+
+static void testConcurrentLifecycle(void) {
+
+    //four threads start, cancel, finish and add handlers to same operations at the same time
+    enum { operationsCount = 1 << 20, roundsCount = 4 };
+    CSTestOperation *operations = malloc(operationsCount * sizeof(CSTestOperation));
+
+    double time = 0.0;
+    for (unsigned round = 0; round < roundsCount; round++) {
+        time += CSTestStress(operations, operationsCount);
+    }
+    printf("CSOperationState %u operations with %d racing threads: %.2f Mops/s\n",
+           operationsCount * roundsCount, CSTestRolesCount, operationsCount * roundsCount / time / 1e6);
+
+    free(operations);
+}
+
+#pragma mark - Benchmark
+
+static void benchmark(void) {
+
+    //uncontended lifecycle as operation queue runs it: add handler, start, finish
+    enum { operationsCount = 1 << 22 };
+    CSTestOperation *operations = calloc(operationsCount, sizeof(CSTestOperation));
+
+    double start = CSTestTime();
+    for (size_t i = 0; i < operationsCount; i++) {
+        CSOperationStateInit(&operations[i].state);
+        CSTestOperationAddHandler(&operations[i], i);
+        CSTestOperationStart(&operations[i], i);
+    }
+    double time = CSTestTime() - start;
+    printf("CSOperationState uncontended lifecycle: %.1f ns per operation\n", time / operationsCount * 1e9);
+
+    double stressTime = 0.0;
+    for (unsigned round = 0; round < 4; round++) {
+        stressTime += CSTestStress(operations, operationsCount);
+    }
+    printf("CSOperationState %d operations with %d racing threads: %.2f Mops/s\n",
+           4 * operationsCount, CSTestRolesCount, 4 * operationsCount / stressTime / 1e6);
+
+    free(operations);
+}
+
+int main(int argc, char *argv[]) {
+
+    for (unsigned i = 0; i < CSTestLocksCount; i++) {
+        pthread_mutex_init(&CSTestLocks[i], NULL);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        benchmark();
+        return EXIT_SUCCESS;
+    }
+
+    CSTestRun(testLifecycle);
+    CSTestRun(testCancel);
+    CSTestRun(testTransition);
+    CSTestRun(testConcurrentLifecycle);
+    return CSTestFinish();
+}
@@ -0,0 +1,210 @@
+//
+//  CSPercentEncodingTests.c
+//  CSUtilsCoreTests
+//
+//  Created by Josip Bernat on 19/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#include "CSTest.h"
+#include "CSPercentEncoding.h"
+
+#include <string.h>
+
+#pragma mark - Reference
+
+static bool CSReferenceIsUnreserved(uint8_t c) {
+    return ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+            c == '-' || c == '.' || c == '_');
+}
+
+/**
+ *  Byte at a time encoder used to check the vectorized one.
+ */
+static size_t CSReferenceEncode(uint8_t *output, const uint8_t *bytes, size_t length) {
+
+    static const char hex[] = "0123456789ABCDEF";
+    size_t outputLength = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (CSReferenceIsUnreserved(bytes[i])) {
+            output[outputLength++] = bytes[i];
+        }
+        else {
+            output[outputLength++] = '%';
+            output[outputLength++] = (uint8_t)hex[bytes[i] >> 4];
+            output[outputLength++] = (uint8_t)hex[bytes[i] & 0x0F];
+        }
+    }
+    return outputLength;
+}
+
+static int CSReferenceHexValue(uint8_t c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static size_t CSReferenceDecode(uint8_t *output, const uint8_t *bytes, size_t length) {
+
+    size_t outputLength = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (bytes[i] == '%' && i + 2 < length && CSReferenceHexValue(bytes[i + 1]) >= 0 && CSReferenceHexValue(bytes[i + 2]) >= 0) {
+            output[outputLength++] = (uint8_t)(CSReferenceHexValue(bytes[i + 1]) << 4 | CSReferenceHexValue(bytes[i + 2]));
+            i += 2;
+        }
+        else {
+            output[outputLength++] = bytes[i];
+        }
+    }
+    return outputLength;
+}
+
+static void CSFillText(uint8_t *bytes, size_t length, uint64_t *state, unsigned reservedPercent) {
+    static const char unreserved[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-._";
+    for (size_t i = 0; i < length; i++) {
+        uint64_t random = CSTestRandom(state);
+        if (random % 100 < reservedPercent) {
+            bytes[i] = (uint8_t)(random >> 8);
+        }
+        else {
+            bytes[i] = (uint8_t)unreserved[(random >> 8) % (sizeof(unreserved) - 1)];
+        }
+    }
+}
+
+#pragma mark - Tests
+
+static void testEveryByte(void) {
+
+    for (unsigned c = 0; c < 256; c++) {
+
+        uint8_t byte = (uint8_t)c;
+        uint8_t expected[3];
+        size_t expectedLength = CSReferenceEncode(expected, &byte, 1);
+
+        CSByteBuffer buffer;
+        CSByteBufferInit(&buffer, 0);
+        CSTestAssert(CSPercentEncodeBytes(&buffer, &byte, 1), "byte %u", c);
+        CSTestAssert(buffer.length == expectedLength && memcmp(buffer.bytes, expected, expectedLength) == 0, "byte %u", c);
+        CSTestAssert(CSPercentEncodingUnreservedPrefixLength(&byte, 1) == (CSReferenceIsUnreserved(byte) ? 1 : 0), "byte %u", c);
+        CSByteBufferFree(&buffer);
+    }
+}
+
+static void testUnreservedPrefixAtEveryAlignment(void) {
+
+    uint8_t storage[256 + 32];
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+
+    for (size_t offset = 0; offset < 32; offset++) {
+        for (size_t length = 0; length <= 256; length++) {
+
+            uint8_t *bytes = storage + offset;
+            CSFillText(bytes, length, &state, 0);
+
+            // no reserved byte, whole text is prefix
+            CSTestAssert(CSPercentEncodingUnreservedPrefixLength(bytes, length) == length, "offset %zu length %zu", offset, length);
+
+            // reserved byte at every position
+            for (size_t position = 0; position < length; position++) {
+                uint8_t saved = bytes[position];
+                bytes[position] = (position & 1 ? 0x80 | (uint8_t)position : '/');
+                CSTestAssert(CSPercentEncodingUnreservedPrefixLength(bytes, length) == position, "offset %zu length %zu position %zu", offset, length, position);
+                bytes[position] = saved;
+            }
+        }
+    }
+}
+
+static void testRoundTrip(void) {
+
+    uint64_t state = 42;
+    uint8_t text[4096];
+    uint8_t expected[3 * sizeof(text)];
+    uint8_t decoded[sizeof(text)];
+
+    CSByteBuffer buffer;
+    CSByteBufferInit(&buffer, 16);
+
+    for (unsigned iteration = 0; iteration < 2000; iteration++) {
+
+        size_t length = CSTestRandom(&state) % sizeof(text);
+        unsigned reservedPercent = (unsigned)(CSTestRandom(&state) % 101);
+        CSFillText(text, length, &state, reservedPercent);
+
+        // buffer is reused, encoded text is appended after prefix
+        CSByteBufferReset(&buffer);
+        CSByteBufferAppend(&buffer, "q=", 2);
+        CSTestAssert(CSPercentEncodeBytes(&buffer, text, length), "iteration %u", iteration);
+
+        size_t expectedLength = CSReferenceEncode(expected, text, length);
+        CSTestAssert(buffer.length == expectedLength + 2, "iteration %u", iteration);
+        CSTestAssert(memcmp(buffer.bytes, "q=", 2) == 0 && memcmp(buffer.bytes + 2, expected, expectedLength) == 0, "iteration %u", iteration);
+
+        size_t decodedLength = CSReferenceDecode(decoded, buffer.bytes + 2, buffer.length - 2);
+        CSTestAssert(decodedLength == length && memcmp(decoded, text, length) == 0, "iteration %u", iteration);
+    }
+
+    size_t detachedLength = 0;
+    uint8_t *detached = CSByteBufferDetach(&buffer, &detachedLength);
+    CSTestAssert(detached != NULL && detachedLength > 0, "detach");
+    CSTestAssert(buffer.bytes == NULL && buffer.length == 0 && buffer.capacity == 0, "detach leaves empty buffer");
+    free(detached);
+    CSByteBufferFree(&buffer);
+}
+
+#pragma mark - Benchmark
+
+static void benchmark(void) {
+
+    size_t length = 16 * 1024 * 1024;
+    uint8_t *text = malloc(length);
+    uint8_t *output = malloc(3 * length);
+    unsigned reservedPercents[] = {0, 5, 50};
+
+    for (size_t i = 0; i < sizeof(reservedPercents) / sizeof(reservedPercents[0]); i++) {
+
+        uint64_t state = 7;
+        CSFillText(text, length, &state, reservedPercents[i]);
+
+        double start = CSTestTime();
+        size_t referenceLength = 0;
+        for (int repeat = 0; repeat < 4; repeat++) {
+            referenceLength += CSReferenceEncode(output, text, length);
+        }
+        double referenceTime = CSTestTime() - start;
+
+        CSByteBuffer buffer;
+        CSByteBufferInit(&buffer, 3 * length);
+        start = CSTestTime();
+        size_t encodedLength = 0;
+        for (int repeat = 0; repeat < 4; repeat++) {
+            CSByteBufferReset(&buffer);
+            CSPercentEncodeBytes(&buffer, text, length);
+            encodedLength += buffer.length;
+        }
+        double encodeTime = CSTestTime() - start;
+        CSByteBufferFree(&buffer);
+
+        double megabytes = 4.0 * (double)length / (1024.0 * 1024.0);
+        printf("percent encoding, %2u%% reserved: byte at a time %7.1f MB/s, CSPercentEncodeBytes %7.1f MB/s%s\n",
+               reservedPercents[i], megabytes / referenceTime, megabytes / encodeTime,
+               (referenceLength == encodedLength ? "" : " (length mismatch)"));
+    }
+
+    free(text);
+    free(output);
+}
+
+int main(int argc, char *argv[]) {
+
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        benchmark();
+        return EXIT_SUCCESS;
+    }
+
+    CSTestRun(testEveryByte);
+    CSTestRun(testUnreservedPrefixAtEveryAlignment);
+    CSTestRun(testRoundTrip);
+    return CSTestFinish();
+}
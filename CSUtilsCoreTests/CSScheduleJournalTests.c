@@ -0,0 +1,576 @@
+//
+//  CSScheduleJournalTests.c
+//  CSUtilsCoreTests
+//
+//  Created by Josip Bernat on 19/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#include "CSTest.h"
+#include "CSScheduleJournal.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#pragma mark - Helpers
+
+static CSScheduleJournalBytes CSBytesOfString(const char *string) {
+    return (CSScheduleJournalBytes){(const uint8_t *)string, strlen(string)};
+}
+
+static int CSBytesEqualString(CSScheduleJournalBytes bytes, const char *string) {
+    return (bytes.length == strlen(string) && (!bytes.length || memcmp(bytes.bytes, string, bytes.length) == 0));
+}
+
+static CSScheduleJournalNotification CSCalendarNotification(void) {
+
+    CSScheduleJournalNotification notification;
+    memset(&notification, 0, sizeof(notification));
+    notification.fireDate = 416000000.5;
+    notification.lastFireDate = NAN;
+    notification.ruleType = CSScheduleJournalRuleTypeCalendar;
+    notification.ruleExpression = CSBytesOfString("0 9 * * 1-5");
+    notification.ruleTimeZoneName = CSBytesOfString("Europe/Zagreb");
+    notification.userInfo = CSBytesOfString("bplist00");
+    notification.tolerance = 30.0;
+    return notification;
+}
+
+static CSScheduleJournalNotification CSIntervalNotification(void) {
+
+    CSScheduleJournalNotification notification;
+    memset(&notification, 0, sizeof(notification));
+    notification.fireDate = 416003600.0;
+    notification.lastFireDate = 416000000.0;
+    notification.ruleType = CSScheduleJournalRuleTypeInterval;
+    notification.ruleInterval = 3600.0;
+    notification.ruleStartDate = 415000000.0;
+    return notification;
+}
+
+/**
+ *  Journal with header followed by add, update, add and remove record.
+ *
+ *  @param ends Receives offset at which each record ends.
+ */
+static void CSBuildJournal(CSByteBuffer *buffer, size_t ends[4]) {
+
+    CSScheduleJournalNotification calendar = CSCalendarNotification();
+    CSScheduleJournalNotification interval = CSIntervalNotification();
+
+    CSByteBufferInit(buffer, 0);
+    CSTestAssert(CSScheduleJournalAppendHeader(buffer), "header appended");
+    CSTestAssert(CSScheduleJournalAppendAdd(buffer, CSBytesOfString("standup"), &calendar), "add appended");
+    ends[0] = buffer->length;
+    CSTestAssert(CSScheduleJournalAppendUpdate(buffer, CSBytesOfString("standup"), 416086400.5, 416000000.5), "update appended");
+    ends[1] = buffer->length;
+    CSTestAssert(CSScheduleJournalAppendAdd(buffer, CSBytesOfString("backup"), &interval), "add appended");
+    ends[2] = buffer->length;
+    CSTestAssert(CSScheduleJournalAppendRemove(buffer, CSBytesOfString("backup")), "remove appended");
+    ends[3] = buffer->length;
+}
+
+#pragma mark - Tests
+
+static void testRoundTrip(void) {
+
+    CSByteBuffer buffer;
+    size_t ends[4];
+    CSBuildJournal(&buffer, ends);
+
+    CSScheduleJournalReader reader;
+    CSScheduleJournalRecord record;
+    CSScheduleJournalNotification notification;
+    CSTestAssert(CSScheduleJournalReaderInit(&reader, buffer.bytes, buffer.length), "header is valid");
+    CSTestAssert(reader.offset == CSScheduleJournalHeaderLength, "offset %zu", reader.offset);
+
+    CSTestAssert(CSScheduleJournalReadRecord(&reader, &record), "add read");
+    CSTestAssert(record.type == CSScheduleJournalRecordTypeAdd && CSBytesEqualString(record.name, "standup"), "add record");
+    CSTestAssert(CSScheduleJournalDecodeAdd(record.body, &notification), "add decoded");
+    CSTestAssert(notification.fireDate == 416000000.5 && isnan(notification.lastFireDate), "dates %f %f", notification.fireDate, notification.lastFireDate);
+    CSTestAssert(notification.ruleType == CSScheduleJournalRuleTypeCalendar, "rule type %d", notification.ruleType);
+    CSTestAssert(CSBytesEqualString(notification.ruleExpression, "0 9 * * 1-5"), "expression");
+    CSTestAssert(CSBytesEqualString(notification.ruleTimeZoneName, "Europe/Zagreb"), "time zone");
+    CSTestAssert(CSBytesEqualString(notification.userInfo, "bplist00"), "user info");
+    CSTestAssert(notification.tolerance == 30.0, "tolerance %f", notification.tolerance);
+
+    double fireDate = 0.0;
+    double lastFireDate = 0.0;
+    CSTestAssert(CSScheduleJournalReadRecord(&reader, &record), "update read");
+    CSTestAssert(record.type == CSScheduleJournalRecordTypeUpdate && CSBytesEqualString(record.name, "standup"), "update record");
+    CSTestAssert(CSScheduleJournalDecodeUpdate(record.body, &fireDate, &lastFireDate), "update decoded");
+    CSTestAssert(fireDate == 416086400.5 && lastFireDate == 416000000.5, "dates %f %f", fireDate, lastFireDate);
+
+    CSTestAssert(CSScheduleJournalReadRecord(&reader, &record), "add read");
+    CSTestAssert(record.type == CSScheduleJournalRecordTypeAdd && CSBytesEqualString(record.name, "backup"), "add record");
+    CSTestAssert(CSScheduleJournalDecodeAdd(record.body, &notification), "add decoded");
+    CSTestAssert(notification.fireDate == 416003600.0 && notification.lastFireDate == 416000000.0, "dates %f %f", notification.fireDate, notification.lastFireDate);
+    CSTestAssert(notification.ruleType == CSScheduleJournalRuleTypeInterval, "rule type %d", notification.ruleType);
+    CSTestAssert(notification.ruleInterval == 3600.0 && notification.ruleStartDate == 415000000.0, "interval rule");
+    CSTestAssert(notification.userInfo.length == 0 && notification.tolerance == 0.0, "no user info and tolerance");
+
+    CSTestAssert(CSScheduleJournalReadRecord(&reader, &record), "remove read");
+    CSTestAssert(record.type == CSScheduleJournalRecordTypeRemove && CSBytesEqualString(record.name, "backup") && record.body.length == 0, "remove record");
+
+    CSTestAssert(!CSScheduleJournalReadRecord(&reader, &record), "journal ended");
+    CSTestAssert(reader.offset == buffer.length, "offset %zu of %zu", reader.offset, buffer.length);
+
+    CSByteBufferFree(&buffer);
+}
+
+/**
+ *  Format is read back by older and newer app versions so its bytes must not change by accident.
+ */
+static void testGoldenBytes(void) {
+
+    static const uint8_t expected[] = {
+        0x43, 0x53, 0x53, 0x4e, 0x01, 0x00, 0x00, 0x00,
+        //update "a", fire date 1.0, last fire date 2.0
+        0x14, 0x00, 0x00, 0x00, 0x02, 0x01, 0x00, 'a',
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf0, 0x3f,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40,
+        //remove "bc"
+        0x05, 0x00, 0x00, 0x00, 0x03, 0x02, 0x00, 'b', 'c',
+        //add "d", fire date 1.0, no last fire date, no rule, no user info, tolerance 0.5
+        0x21, 0x00, 0x00, 0x00, 0x01, 0x01, 0x00, 'd',
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf0, 0x3f,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf8, 0x7f,
+        0x00,
+        0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xe0, 0x3f
+    };
+
+    CSScheduleJournalNotification notification;
+    memset(&notification, 0, sizeof(notification));
+    notification.fireDate = 1.0;
+    notification.lastFireDate = NAN;
+    notification.tolerance = 0.5;
+
+    CSByteBuffer buffer;
+    CSByteBufferInit(&buffer, 0);
+    CSScheduleJournalAppendHeader(&buffer);
+    CSScheduleJournalAppendUpdate(&buffer, CSBytesOfString("a"), 1.0, 2.0);
+    CSScheduleJournalAppendRemove(&buffer, CSBytesOfString("bc"));
+    CSScheduleJournalAppendAdd(&buffer, CSBytesOfString("d"), &notification);
+
+    CSTestAssert(buffer.length == sizeof(expected), "length %zu, expected %zu", buffer.length, sizeof(expected));
+    for (size_t i = 0; i < buffer.length && i < sizeof(expected); i++) {
+        CSTestAssert(buffer.bytes[i] == expected[i], "byte %zu is 0x%02x, expected 0x%02x", i, buffer.bytes[i], expected[i]);
+    }
+    CSByteBufferFree(&buffer);
+}
+
+/**
+ *  Journal cut off at any length, as after crash during write, reads exactly records which were completely written.
+ */
+static void testTruncation(void) {
+
+    CSByteBuffer buffer;
+    size_t ends[4];
+    CSBuildJournal(&buffer, ends);
+
+    for (size_t length = 0; length <= buffer.length; length++) {
+
+        CSScheduleJournalReader reader;
+        if (length < CSScheduleJournalHeaderLength) {
+            CSTestAssert(!CSScheduleJournalReaderInit(&reader, buffer.bytes, length), "length %zu: short header accepted", length);
+            CSTestAssert(reader.offset == 0, "length %zu: offset %zu", length, reader.offset);
+            continue;
+        }
+        CSTestAssert(CSScheduleJournalReaderInit(&reader, buffer.bytes, length), "length %zu: header rejected", length);
+
+        size_t expectedCount = 0;
+        size_t expectedOffset = CSScheduleJournalHeaderLength;
+        while (expectedCount < 4 && ends[expectedCount] <= length) {
+            expectedOffset = ends[expectedCount++];
+        }
+
+        size_t count = 0;
+        CSScheduleJournalRecord record;
+        while (CSScheduleJournalReadRecord(&reader, &record)) {
+            CSTestAssert(record.body.bytes + record.body.length <= buffer.bytes + length, "length %zu: body past end", length);
+            count++;
+        }
+        CSTestAssert(count == expectedCount, "length %zu: read %zu records, expected %zu", length, count, expectedCount);
+        CSTestAssert(reader.offset == expectedOffset, "length %zu: offset %zu, expected %zu", length, reader.offset, expectedOffset);
+    }
+    CSByteBufferFree(&buffer);
+}
+
+static void testBadHeader(void) {
+
+    CSByteBuffer buffer;
+    size_t ends[4];
+    CSBuildJournal(&buffer, ends);
+
+    CSScheduleJournalReader reader;
+    buffer.bytes[0] ^= 0xff;
+    CSTestAssert(!CSScheduleJournalReaderInit(&reader, buffer.bytes, buffer.length), "unknown magic accepted");
+    CSTestAssert(reader.offset == 0, "offset %zu", reader.offset);
+    buffer.bytes[0] ^= 0xff;
+
+    buffer.bytes[4] = 2;
+    CSTestAssert(!CSScheduleJournalReaderInit(&reader, buffer.bytes, buffer.length), "unknown version accepted");
+    CSTestAssert(reader.offset == 0, "offset %zu", reader.offset);
+
+    CSByteBufferFree(&buffer);
+}
+
+static void testMalformedRecord(void) {
+
+    CSByteBuffer buffer;
+    size_t ends[4];
+    CSBuildJournal(&buffer, ends);
+
+    //unknown type of second record ends valid part of journal after first one
+    CSScheduleJournalReader reader;
+    CSScheduleJournalRecord record;
+    uint8_t *type = buffer.bytes + ends[0] + sizeof(uint32_t);
+    const uint8_t types[] = {0, 4, 0xff};
+    for (size_t i = 0; i < sizeof(types); i++) {
+
+        *type = types[i];
+        CSScheduleJournalReaderInit(&reader, buffer.bytes, buffer.length);
+        CSTestAssert(CSScheduleJournalReadRecord(&reader, &record), "first record read");
+        CSTestAssert(!CSScheduleJournalReadRecord(&reader, &record), "record of type %u read", types[i]);
+        CSTestAssert(reader.offset == ends[0], "offset %zu", reader.offset);
+    }
+    *type = CSScheduleJournalRecordTypeUpdate;
+
+    //name longer than record
+    uint8_t *nameLength = type + 1;
+    nameLength[0] = 0xff;
+    CSScheduleJournalReaderInit(&reader, buffer.bytes, buffer.length);
+    CSScheduleJournalReadRecord(&reader, &record);
+    CSTestAssert(!CSScheduleJournalReadRecord(&reader, &record), "name past record end read");
+    CSTestAssert(reader.offset == ends[0], "offset %zu", reader.offset);
+
+    CSByteBufferFree(&buffer);
+}
+
+/**
+ *  Decodes add record of given notification after its body is changed by given function.
+ */
+static bool CSDecodeChangedAdd(const CSScheduleJournalNotification *notification, void (*change)(CSScheduleJournalBytes *body, uint8_t *bytes), CSScheduleJournalNotification *decoded) {
+
+    CSByteBuffer buffer;
+    CSByteBufferInit(&buffer, 0);
+    CSScheduleJournalAppendHeader(&buffer);
+    CSScheduleJournalAppendAdd(&buffer, CSBytesOfString("n"), notification);
+
+    CSScheduleJournalReader reader;
+    CSScheduleJournalRecord record;
+    CSScheduleJournalReaderInit(&reader, buffer.bytes, buffer.length);
+    CSTestAssert(CSScheduleJournalReadRecord(&reader, &record), "record read");
+
+    CSScheduleJournalBytes body = record.body;
+    if (change) {
+        change(&body, buffer.bytes + (body.bytes - buffer.bytes));
+    }
+    bool result = CSScheduleJournalDecodeAdd(body, decoded);
+    CSByteBufferFree(&buffer);
+    return result;
+}
+
+static void CSDropTolerance(CSScheduleJournalBytes *body, uint8_t *bytes) {
+    (void)bytes;
+    body->length -= sizeof(double);
+}
+
+static void CSCutTolerance(CSScheduleJournalBytes *body, uint8_t *bytes) {
+    (void)bytes;
+    body->length -= 3;
+}
+
+static void CSUnknownRule(CSScheduleJournalBytes *body, uint8_t *bytes) {
+    (void)body;
+    bytes[2 * sizeof(double)] = 3;
+}
+
+static void testDecodeAdd(void) {
+
+    CSScheduleJournalNotification notification = CSCalendarNotification();
+    CSScheduleJournalNotification decoded;
+
+    //records written before tolerance was saved
+    CSTestAssert(CSDecodeChangedAdd(&notification, CSDropTolerance, &decoded), "record without tolerance rejected");
+    CSTestAssert(decoded.tolerance == 0.0 && decoded.userInfo.length == 8, "tolerance %f", decoded.tolerance);
+    CSTestAssert(!CSDecodeChangedAdd(&notification, CSCutTolerance, &decoded), "partial tolerance accepted");
+    CSTestAssert(!CSDecodeChangedAdd(&notification, CSUnknownRule, &decoded), "unknown rule accepted");
+
+    notification.tolerance = -1.0;
+    CSTestAssert(!CSDecodeChangedAdd(&notification, NULL, &decoded), "negative tolerance accepted");
+    notification.tolerance = NAN;
+    CSTestAssert(!CSDecodeChangedAdd(&notification, NULL, &decoded), "NaN tolerance accepted");
+
+    notification = CSIntervalNotification();
+    notification.ruleInterval = 0.0;
+    CSTestAssert(!CSDecodeChangedAdd(&notification, NULL, &decoded), "zero interval accepted");
+    notification.ruleInterval = 60.0;
+    notification.ruleStartDate = NAN;
+    CSTestAssert(!CSDecodeChangedAdd(&notification, NULL, &decoded), "missing start date accepted");
+
+    //missing fire date is decoded, it's up to store to skip such notification
+    notification = CSIntervalNotification();
+    notification.fireDate = NAN;
+    CSTestAssert(CSDecodeChangedAdd(&notification, NULL, &decoded) && isnan(decoded.fireDate), "missing fire date");
+}
+
+/**
+ *  Store caches created rules by their encoded bytes.
+ */
+static void testRuleBytes(void) {
+
+    CSScheduleJournalNotification first = CSCalendarNotification();
+    CSScheduleJournalNotification second = CSCalendarNotification();
+    second.fireDate += 86400.0;
+    second.userInfo.length = 0;
+
+    CSByteBuffer buffer;
+    CSByteBufferInit(&buffer, 0);
+    CSScheduleJournalAppendHeader(&buffer);
+    CSScheduleJournalAppendAdd(&buffer, CSBytesOfString("first"), &first);
+    CSScheduleJournalAppendAdd(&buffer, CSBytesOfString("second"), &second);
+
+    CSScheduleJournalReader reader;
+    CSScheduleJournalRecord record;
+    CSScheduleJournalNotification decoded[2];
+    CSScheduleJournalReaderInit(&reader, buffer.bytes, buffer.length);
+    for (size_t i = 0; i < 2; i++) {
+        CSScheduleJournalReadRecord(&reader, &record);
+        CSTestAssert(CSScheduleJournalDecodeAdd(record.body, &decoded[i]), "add decoded");
+    }
+
+    CSTestAssert(decoded[0].rule.length == decoded[1].rule.length && decoded[0].rule.length > 1 &&
+                 memcmp(decoded[0].rule.bytes, decoded[1].rule.bytes, decoded[0].rule.length) == 0, "equal rules have different bytes");
+    CSByteBufferFree(&buffer);
+}
+
+static void testOversizedStrings(void) {
+
+    size_t length = (size_t)UINT16_MAX + 1;
+    char *string = malloc(length + 1);
+    memset(string, 'x', length);
+    string[length] = '\0';
+
+    CSByteBuffer buffer;
+    CSByteBufferInit(&buffer, 0);
+    CSScheduleJournalAppendHeader(&buffer);
+
+    CSTestAssert(!CSScheduleJournalAppendRemove(&buffer, CSBytesOfString(string)), "oversized name appended");
+    CSTestAssert(buffer.length == CSScheduleJournalHeaderLength, "length %zu", buffer.length);
+
+    CSScheduleJournalNotification notification = CSCalendarNotification();
+    notification.ruleExpression = CSBytesOfString(string);
+    CSTestAssert(!CSScheduleJournalAppendAdd(&buffer, CSBytesOfString("n"), &notification), "oversized expression appended");
+    CSTestAssert(buffer.length == CSScheduleJournalHeaderLength, "length %zu", buffer.length);
+
+    //longest allowed name still fits
+    string[UINT16_MAX] = '\0';
+    CSTestAssert(CSScheduleJournalAppendRemove(&buffer, CSBytesOfString(string)), "longest name not appended");
+
+    CSScheduleJournalReader reader;
+    CSScheduleJournalRecord record;
+    CSScheduleJournalReaderInit(&reader, buffer.bytes, buffer.length);
+    CSTestAssert(CSScheduleJournalReadRecord(&reader, &record) && record.name.length == UINT16_MAX, "longest name read");
+
+    CSByteBufferFree(&buffer);
+    free(string);
+}
+
+#pragma mark - Benchmark
+
+enum { CSBenchmarkCount = 100000 };
+
+/**
+ *  Latest add and update record of name, what store keeps for each name while replaying.
+ */
+typedef struct CSBenchmarkSlot {
+    CSScheduleJournalBytes name;
+    CSScheduleJournalBytes add;
+    CSScheduleJournalBytes update;
+} CSBenchmarkSlot;
+
+/**
+ *  Open addressing index from name to slot, stands in for dictionary used by store. Index holds slot number plus one so zero is empty.
+ */
+typedef struct CSBenchmarkIndex {
+    uint32_t *entries;
+    size_t mask;
+    CSBenchmarkSlot *slots;
+    size_t slotsCount;
+} CSBenchmarkIndex;
+
+static uint64_t CSBenchmarkHash(CSScheduleJournalBytes name) {
+
+    uint64_t hash = UINT64_C(14695981039346656037);
+    for (size_t i = 0; i < name.length; i++) {
+        hash = (hash ^ name.bytes[i]) * UINT64_C(1099511628211);
+    }
+    return hash;
+}
+
+/**
+ *  Replays mapped journal in the same two passes as store does.
+ *
+ *  @return Number of restored notifications.
+ */
+static size_t CSBenchmarkRestore(const uint8_t *bytes, size_t length, CSBenchmarkIndex *index) {
+
+    memset(index->entries, 0, (index->mask + 1) * sizeof(uint32_t));
+    index->slotsCount = 0;
+
+    CSScheduleJournalReader reader;
+    if (!CSScheduleJournalReaderInit(&reader, bytes, length)) {
+        return 0;
+    }
+
+    CSScheduleJournalRecord record;
+    while (CSScheduleJournalReadRecord(&reader, &record)) {
+
+        size_t position = (size_t)(CSBenchmarkHash(record.name) & index->mask);
+        CSBenchmarkSlot *slot = NULL;
+        while (index->entries[position]) {
+
+            CSBenchmarkSlot *candidate = &index->slots[index->entries[position] - 1];
+            if (candidate->name.length == record.name.length && memcmp(candidate->name.bytes, record.name.bytes, record.name.length) == 0) {
+                slot = candidate;
+                break;
+            }
+            position = (position + 1) & index->mask;
+        }
+
+        if (!slot) {
+            if (record.type != CSScheduleJournalRecordTypeAdd) {
+                continue;
+            }
+            slot = &index->slots[index->slotsCount++];
+            index->entries[position] = (uint32_t)index->slotsCount;
+            slot->name = record.name;
+        }
+
+        switch (record.type) {
+            case CSScheduleJournalRecordTypeAdd:
+                slot->add = record.body;
+                slot->update = (CSScheduleJournalBytes){NULL, 0};
+                break;
+            case CSScheduleJournalRecordTypeUpdate:
+                if (slot->add.bytes) {
+                    slot->update = record.body;
+                }
+                break;
+            default:
+                slot->add = slot->update = (CSScheduleJournalBytes){NULL, 0};
+                break;
+        }
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < index->slotsCount; i++) {
+
+        CSBenchmarkSlot *slot = &index->slots[i];
+        CSScheduleJournalNotification notification;
+        if (!slot->add.bytes || !CSScheduleJournalDecodeAdd(slot->add, &notification)) {
+            continue;
+        }
+        if (slot->update.bytes && !CSScheduleJournalDecodeUpdate(slot->update, &notification.fireDate, &notification.lastFireDate)) {
+            continue;
+        }
+        count += !isnan(notification.fireDate);
+    }
+    return count;
+}
+
+static void benchmark(void) {
+
+    //100k schedules with mix of rules, every fourth fired once and every tenth removed and added again
+    CSByteBuffer buffer;
+    CSByteBufferInit(&buffer, 0);
+    CSScheduleJournalAppendHeader(&buffer);
+
+    char name[32];
+    for (size_t i = 0; i < CSBenchmarkCount; i++) {
+
+        CSScheduleJournalNotification notification = (i % 2 ? CSCalendarNotification() : CSIntervalNotification());
+        notification.fireDate += (double)i;
+        snprintf(name, sizeof(name), "com.example.reminder.%zu", i);
+        CSScheduleJournalAppendAdd(&buffer, CSBytesOfString(name), &notification);
+
+        if (i % 4 == 0) {
+            CSScheduleJournalAppendUpdate(&buffer, CSBytesOfString(name), notification.fireDate + 3600.0, notification.fireDate);
+        }
+        if (i % 10 == 0) {
+            CSScheduleJournalAppendRemove(&buffer, CSBytesOfString(name));
+            CSScheduleJournalAppendAdd(&buffer, CSBytesOfString(name), &notification);
+        }
+    }
+
+    char path[] = "/tmp/CSScheduleJournalTests.XXXXXX";
+    int fileDescriptor = mkstemp(path);
+    if (fileDescriptor < 0 || write(fileDescriptor, buffer.bytes, buffer.length) != (ssize_t)buffer.length) {
+        fprintf(stderr, "Unable to write journal\n");
+        CSByteBufferFree(&buffer);
+        return;
+    }
+    size_t length = buffer.length;
+    CSByteBufferFree(&buffer);
+
+    CSBenchmarkIndex index;
+    index.mask = 1;
+    while (index.mask < 2 * CSBenchmarkCount) {
+        index.mask <<= 1;
+    }
+    index.entries = malloc(index.mask * sizeof(uint32_t));
+    index.mask -= 1;
+    index.slots = malloc(CSBenchmarkCount * sizeof(CSBenchmarkSlot));
+
+    enum { runsCount = 10 };
+    double best = INFINITY;
+    double total = 0.0;
+    size_t count = 0;
+    for (unsigned run = 0; run < runsCount; run++) {
+
+        //mapping is part of measured time, pages stay in page cache as they would for journal read at every launch
+        double start = CSTestTime();
+        const uint8_t *bytes = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+        if (bytes == MAP_FAILED) {
+            fprintf(stderr, "Unable to map journal\n");
+            break;
+        }
+        count = CSBenchmarkRestore(bytes, length, &index);
+        munmap((void *)bytes, length);
+
+        double time = CSTestTime() - start;
+        total += time;
+        best = (time < best ? time : best);
+    }
+
+    printf("CSScheduleJournal restore of %zu schedules from %.1f MB journal: best %.2f ms, mean %.2f ms\n",
+           count, (double)length / 1e6, best * 1e3, total / runsCount * 1e3);
+
+    free(index.entries);
+    free(index.slots);
+    close(fileDescriptor);
+    unlink(path);
+}
+
+int main(int argc, char *argv[]) {
+
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        benchmark();
+        return EXIT_SUCCESS;
+    }
+
+    CSTestRun(testRoundTrip);
+    CSTestRun(testGoldenBytes);
+    CSTestRun(testTruncation);
+    CSTestRun(testBadHeader);
+    CSTestRun(testMalformedRecord);
+    CSTestRun(testDecodeAdd);
+    CSTestRun(testRuleBytes);
+    CSTestRun(testOversizedStrings);
+    return CSTestFinish();
+}
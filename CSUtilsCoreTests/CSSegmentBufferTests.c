@@ -0,0 +1,321 @@
+//
+//  CSSegmentBufferTests.c
+//  CSUtilsCoreTests
+//
+//  Created by Josip Bernat on 19/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#include "CSTest.h"
+#include "CSSegmentBuffer.h"
+
+#include <string.h>
+
+#pragma mark - Helpers
+
+static size_t CSReleasedOwnersCount = 0;
+
+static void CSCountRelease(void *owner) {
+    (void)owner;
+    CSReleasedOwnersCount++;
+}
+
+/**
+ *  Owner token, buffer only passes it back to release function.
+ */
+static int CSOwner;
+
+static void CSFillBytes(uint8_t *bytes, size_t length, uint64_t *state) {
+    for (size_t i = 0; i < length; i++) {
+        bytes[i] = (uint8_t)(CSTestRandom(state) >> 32);
+    }
+}
+
+/**
+ *  Appends body in chunks of random length up to maximumChunkLength.
+ *
+ *  @return Number of appended chunks.
+ */
+static size_t CSAppendChunks(CSSegmentBuffer *buffer, const uint8_t *body, size_t length, size_t maximumChunkLength, uint64_t *state) {
+
+    size_t count = 0;
+    for (size_t offset = 0; offset < length; count++) {
+
+        size_t chunkLength = 1 + (size_t)(CSTestRandom(state) % maximumChunkLength);
+        if (chunkLength > length - offset) {
+            chunkLength = length - offset;
+        }
+        CSTestAssert(CSSegmentBufferAppend(buffer, body + offset, chunkLength, &CSOwner), "chunk appended");
+        offset += chunkLength;
+    }
+    return count;
+}
+
+/**
+ *  Compares buffer content with body by walking segments or contiguous storage, as parser would.
+ */
+static bool CSBufferEquals(const CSSegmentBuffer *buffer, const uint8_t *body, size_t length) {
+
+    if (buffer->length != length) {
+        return false;
+    }
+    if (buffer->isContiguous) {
+        return (buffer->contiguous.length == length && (!length || memcmp(buffer->contiguous.bytes, body, length) == 0));
+    }
+
+    size_t offset = 0;
+    for (size_t i = 0; i < buffer->segmentsCount; i++) {
+        const CSSegmentBufferSegment *segment = &buffer->segments[i];
+        if (segment->length > length - offset || memcmp(segment->bytes, body + offset, segment->length) != 0) {
+            return false;
+        }
+        offset += segment->length;
+    }
+    return (offset == length);
+}
+
+#pragma mark - Tests
+
+static void testPreallocated(void) {
+
+    enum { length = 100000 };
+    static uint8_t body[length];
+    uint64_t state = 1;
+    CSFillBytes(body, length, &state);
+
+    CSReleasedOwnersCount = 0;
+    CSSegmentBuffer buffer;
+    CSSegmentBufferInit(&buffer, CSCountRelease);
+    CSSegmentBufferReset(&buffer, length);
+    CSTestAssert(buffer.isContiguous && buffer.allocatedLength == length, "allocated %llu", (unsigned long long)buffer.allocatedLength);
+
+    size_t chunksCount = CSAppendChunks(&buffer, body, length, 5000, &state);
+    CSTestAssert(CSBufferEquals(&buffer, body, length), "content");
+    CSTestAssert(buffer.copiedLength == length, "each byte copied once, copied %llu", (unsigned long long)buffer.copiedLength);
+    CSTestAssert(buffer.allocatedLength == length, "no reallocation, allocated %llu", (unsigned long long)buffer.allocatedLength);
+    CSTestAssert(CSReleasedOwnersCount == chunksCount, "copied chunks released, %zu of %zu", CSReleasedOwnersCount, chunksCount);
+
+    //joining contiguous storage does nothing and detaching hands it over
+    CSTestAssert(CSSegmentBufferJoin(&buffer) && buffer.copiedLength == length, "join of contiguous storage copies nothing");
+    size_t detachedLength = 0;
+    uint8_t *bytes = CSSegmentBufferDetach(&buffer, &detachedLength);
+    CSTestAssert(bytes && detachedLength == length && memcmp(bytes, body, length) == 0, "detached content");
+    CSTestAssert(buffer.length == 0 && !buffer.isContiguous, "buffer is empty after detach");
+    free(bytes);
+
+    CSSegmentBufferFree(&buffer);
+}
+
+static void testLongerThanExpected(void) {
+
+    enum { length = 50000 };
+    static uint8_t body[length];
+    uint64_t state = 2;
+    CSFillBytes(body, length, &state);
+
+    CSSegmentBuffer buffer;
+    CSSegmentBufferInit(&buffer, NULL);
+    CSSegmentBufferReset(&buffer, 1000);
+    CSAppendChunks(&buffer, body, length, 3000, &state);
+
+    CSTestAssert(buffer.isContiguous && CSBufferEquals(&buffer, body, length), "grown storage keeps content");
+    CSTestAssert(buffer.copiedLength > length && buffer.allocatedLength > length, "growth is counted, copied %llu, allocated %llu",
+                 (unsigned long long)buffer.copiedLength, (unsigned long long)buffer.allocatedLength);
+    CSSegmentBufferFree(&buffer);
+}
+
+static void testSegments(void) {
+
+    enum { length = 200000 };
+    static uint8_t body[length];
+    uint64_t state = 3;
+    CSFillBytes(body, length, &state);
+
+    const long long expectedLengths[] = {-1, 0, (long long)CSSegmentBufferMaximumPreallocatedLength + 1};
+    for (size_t i = 0; i < sizeof(expectedLengths) / sizeof(expectedLengths[0]); i++) {
+
+        CSReleasedOwnersCount = 0;
+        CSSegmentBuffer buffer;
+        CSSegmentBufferInit(&buffer, CSCountRelease);
+        CSSegmentBufferReset(&buffer, expectedLengths[i]);
+        CSTestAssert(!buffer.isContiguous, "expected length %lld isn't preallocated", expectedLengths[i]);
+
+        size_t chunksCount = CSAppendChunks(&buffer, body, length, 16384, &state);
+        CSTestAssert(buffer.segmentsCount == chunksCount && CSBufferEquals(&buffer, body, length), "segments kept");
+        CSTestAssert(buffer.copiedLength == 0, "nothing copied before join, copied %llu", (unsigned long long)buffer.copiedLength);
+        CSTestAssert(CSReleasedOwnersCount == 0, "segments are retained");
+
+        unsigned long long allocatedLength = buffer.allocatedLength;
+        CSTestAssert(CSSegmentBufferJoin(&buffer), "joined");
+        CSTestAssert(buffer.isContiguous && buffer.segmentsCount == 0 && CSBufferEquals(&buffer, body, length), "joined content");
+        CSTestAssert(buffer.copiedLength == length && buffer.allocatedLength == allocatedLength + length, "join copies once, copied %llu",
+                     (unsigned long long)buffer.copiedLength);
+        CSTestAssert(CSReleasedOwnersCount == chunksCount, "joined segments released, %zu of %zu", CSReleasedOwnersCount, chunksCount);
+
+        CSSegmentBufferFree(&buffer);
+    }
+}
+
+static void testSingleSegment(void) {
+
+    CSReleasedOwnersCount = 0;
+    CSSegmentBuffer buffer;
+    CSSegmentBufferInit(&buffer, CSCountRelease);
+    CSSegmentBufferReset(&buffer, -1);
+
+    CSTestAssert(CSSegmentBufferAppend(&buffer, (const uint8_t *)"", 0, &CSOwner), "empty chunk");
+    CSTestAssert(CSReleasedOwnersCount == 1 && buffer.segmentsCount == 0, "empty chunk released right away");
+
+    CSTestAssert(CSSegmentBufferAppend(&buffer, (const uint8_t *)"abc", 3, &CSOwner), "chunk appended");
+    CSTestAssert(CSSegmentBufferJoin(&buffer) && !buffer.isContiguous && buffer.segmentsCount == 1, "single segment isn't joined");
+    CSTestAssert(buffer.copiedLength == 0, "nothing copied");
+
+    size_t length = 0;
+    CSTestAssert(CSSegmentBufferDetach(&buffer, &length) == NULL && length == 0, "segments can't be detached");
+
+    //reset releases segments and counters keep counting
+    CSSegmentBufferReset(&buffer, 3);
+    CSTestAssert(CSReleasedOwnersCount == 2 && buffer.length == 0 && buffer.isContiguous, "reset released segment");
+    CSTestAssert(CSSegmentBufferDetach(&buffer, &length) == NULL && length == 0, "empty storage isn't detached");
+
+    CSSegmentBufferFree(&buffer);
+}
+
+static void testReuse(void) {
+
+    enum { length = 30000 };
+    static uint8_t body[length];
+    uint64_t state = 4;
+    CSFillBytes(body, length, &state);
+
+    CSSegmentBuffer buffer;
+    CSSegmentBufferInit(&buffer, NULL);
+
+    //storage of previous response is reused when it is large enough
+    CSSegmentBufferReset(&buffer, length);
+    CSAppendChunks(&buffer, body, length, 1000, &state);
+    CSSegmentBufferReset(&buffer, length / 2);
+    CSAppendChunks(&buffer, body, length / 2, 1000, &state);
+    CSTestAssert(CSBufferEquals(&buffer, body, length / 2), "content of second response");
+    CSTestAssert(buffer.allocatedLength == length, "allocated %llu", (unsigned long long)buffer.allocatedLength);
+
+    CSSegmentBufferFree(&buffer);
+}
+
+#pragma mark - Benchmark
+
+/**
+ *  Keeps compiler from dropping reads of buffered bytes.
+ */
+static volatile uint64_t CSBenchChecksum = 0;
+
+typedef struct CSBenchResult {
+    double time;
+    unsigned long long copiedLength;
+    unsigned long long allocatedLength;
+} CSBenchResult;
+
+/**
+ *  What NSMutableData growing from empty does with received chunks. Copies made by reallocation are counted as if storage always moved.
+ */
+static CSBenchResult CSBenchGrowingBuffer(const uint8_t *body, size_t length, size_t chunkLength) {
+
+    CSBenchResult result = {0.0, 0, 0};
+    double start = CSTestTime();
+
+    CSByteBuffer buffer;
+    CSByteBufferInit(&buffer, 0);
+    for (size_t offset = 0; offset < length; offset += chunkLength) {
+
+        size_t capacity = buffer.capacity;
+        size_t appendedLength = (chunkLength < length - offset ? chunkLength : length - offset);
+        if (buffer.capacity - buffer.length < appendedLength) {
+            result.copiedLength += buffer.length;
+        }
+        CSByteBufferAppend(&buffer, body + offset, appendedLength);
+        CSBenchChecksum += buffer.bytes[offset];
+        if (buffer.capacity != capacity) {
+            result.allocatedLength += buffer.capacity;
+        }
+        result.copiedLength += appendedLength;
+    }
+    CSByteBufferFree(&buffer);
+
+    result.time = CSTestTime() - start;
+    return result;
+}
+
+/**
+ *  Receives body into segment buffer, then either joins it or only walks segments as incremental parser does.
+ */
+static CSBenchResult CSBenchSegmentBuffer(const uint8_t *body, size_t length, size_t chunkLength, long long expectedLength, bool join) {
+
+    double start = CSTestTime();
+
+    CSSegmentBuffer buffer;
+    CSSegmentBufferInit(&buffer, NULL);
+    CSSegmentBufferReset(&buffer, expectedLength);
+    for (size_t offset = 0; offset < length; offset += chunkLength) {
+        CSSegmentBufferAppend(&buffer, body + offset, (chunkLength < length - offset ? chunkLength : length - offset), NULL);
+    }
+
+    uint64_t checksum = 0;
+    if (join) {
+        CSSegmentBufferJoin(&buffer);
+        checksum += buffer.contiguous.bytes[length / 2];
+    }
+    else {
+        for (size_t i = 0; i < buffer.segmentsCount; i++) {
+            checksum += buffer.segments[i].bytes[0];
+        }
+    }
+
+    CSBenchChecksum += checksum;
+    CSBenchResult result = {0.0, buffer.copiedLength, buffer.allocatedLength};
+    CSSegmentBufferFree(&buffer);
+    result.time = CSTestTime() - start;
+    return result;
+}
+
+static void CSBenchPrint(const char *name, CSBenchResult result, size_t length) {
+
+    printf("  %-28s copied %5.2fx body, allocated %6.2f MB, %6.2f ms\n",
+           name, (double)result.copiedLength / (double)length, (double)result.allocatedLength / (1024.0 * 1024.0), result.time * 1e3);
+}
+
+static void benchmark(void) {
+
+    //NSURLConnection delivers bodies in chunks of few to few tens of kilobytes
+    const size_t chunkLength = 16 * 1024;
+    const size_t lengths[] = {1024 * 1024, 8 * 1024 * 1024, 32 * 1024 * 1024, 64 * 1024 * 1024};
+
+    uint8_t *body = malloc(lengths[sizeof(lengths) / sizeof(lengths[0]) - 1]);
+    uint64_t state = 5;
+    CSFillBytes(body, lengths[sizeof(lengths) / sizeof(lengths[0]) - 1], &state);
+
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+
+        size_t length = lengths[i];
+        printf("response buffer, %zu MB body in %zu KB chunks:\n", length / (1024 * 1024), chunkLength / 1024);
+        CSBenchPrint("growing buffer", CSBenchGrowingBuffer(body, length, chunkLength), length);
+        CSBenchPrint("known length", CSBenchSegmentBuffer(body, length, chunkLength, (long long)length, true), length);
+        CSBenchPrint("unknown length, joined", CSBenchSegmentBuffer(body, length, chunkLength, -1, true), length);
+        CSBenchPrint("unknown length, segments", CSBenchSegmentBuffer(body, length, chunkLength, -1, false), length);
+    }
+    free(body);
+}
+
+int main(int argc, char *argv[]) {
+
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        benchmark();
+        return EXIT_SUCCESS;
+    }
+
+    CSTestRun(testPreallocated);
+    CSTestRun(testLongerThanExpected);
+    CSTestRun(testSegments);
+    CSTestRun(testSingleSegment);
+    CSTestRun(testReuse);
+    return CSTestFinish();
+}
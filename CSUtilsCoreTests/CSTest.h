@@ -0,0 +1,60 @@
+//
+//  CSTest.h
+//  CSUtilsCoreTests
+//
+//  Created by Josip Bernat on 19/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#ifndef CSUtilsCoreTests_CSTest_h
+#define CSUtilsCoreTests_CSTest_h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ *  Minimal assertion helpers for tests of portable C cores. Tests run on any POSIX system, failed assertion prints its location and counts as failure. Test program returns non zero status if any assertion failed.
+ */
+static unsigned CSTestFailuresCount = 0;
+
+#define CSTestAssert(condition, ...) do { \
+    if (!(condition)) { \
+        CSTestFailuresCount++; \
+        fprintf(stderr, "%s:%d: assertion failed: %s: ", __FILE__, __LINE__, #condition); \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+    } \
+} while (0)
+
+#define CSTestRun(test) do { \
+    unsigned failuresCount = CSTestFailuresCount; \
+    test(); \
+    printf("%s %s\n", (failuresCount == CSTestFailuresCount ? "passed" : "FAILED"), #test); \
+} while (0)
+
+#define CSTestFinish() ((CSTestFailuresCount == 0) ? EXIT_SUCCESS : EXIT_FAILURE)
+
+/**
+ *  Returns monotonic time in seconds, used by benchmarks.
+ */
+static inline double CSTestTime(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+/**
+ *  Small deterministic xorshift generator so failures can be reproduced.
+ */
+static inline uint64_t CSTestRandom(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+#endif
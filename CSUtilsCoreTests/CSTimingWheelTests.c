@@ -0,0 +1,311 @@
+//
+//  CSTimingWheelTests.c
+//  CSUtilsCoreTests
+//
+//  Created by Josip Bernat on 19/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#include "CSTest.h"
+#include "CSTimingWheel.h"
+
+#include <string.h>
+
+static CSTimingWheel CSTestWheel;
+
+#pragma mark - Helpers
+
+/**
+ *  Checks list returned by advance: entries are unscheduled, sorted by deadline and not after tick.
+ *
+ *  @return Number of entries in list.
+ */
+static size_t CSCheckExpiredList(CSTimingWheelEntry *expired, uint64_t tick) {
+
+    size_t count = 0;
+    uint64_t previousDeadline = 0;
+    for (CSTimingWheelEntry *entry = expired; entry; entry = entry->next) {
+
+        CSTestAssert(!CSTimingWheelEntryIsScheduled(entry), "expired entry is still scheduled");
+        CSTestAssert(entry->deadline <= tick, "deadline %llu after tick %llu", (unsigned long long)entry->deadline, (unsigned long long)tick);
+        CSTestAssert(entry->deadline >= previousDeadline, "deadline %llu before %llu", (unsigned long long)entry->deadline, (unsigned long long)previousDeadline);
+        previousDeadline = entry->deadline;
+        count++;
+    }
+    return count;
+}
+
+/**
+ *  Deadline at distance which lands in random level of wheel or beyond it.
+ */
+static uint64_t CSRandomDistance(uint64_t *state) {
+
+    switch (CSTestRandom(state) % 4) {
+        case 0:  return CSTestRandom(state) % 64;
+        case 1:  return CSTestRandom(state) % 5000;
+        case 2:  return CSTestRandom(state) % (UINT64_C(1) << 24);
+        default: return CSTestRandom(state) % (UINT64_C(1) << 40);
+    }
+}
+
+#pragma mark - Tests
+
+static void testExpiresExactlyAtDeadline(void) {
+
+    //wheel starts at unaligned tick so slots of every level are entered part way through
+    uint64_t start = (UINT64_C(1) << 30) + 12345;
+    CSTimingWheelInit(&CSTestWheel, start);
+
+    enum { count = 3000 };
+    static CSTimingWheelEntry entries[count];
+    memset(entries, 0, sizeof(entries));
+
+    uint64_t state = 11;
+    for (size_t i = 0; i < count; i++) {
+        CSTimingWheelInsert(&CSTestWheel, &entries[i], start + 1 + CSTestRandom(&state) % 20000);
+    }
+    CSTestAssert(CSTestWheel.count == count, "count %zu", CSTestWheel.count);
+
+    size_t expiredCount = 0;
+    for (uint64_t tick = start + 1; tick <= start + 20000; tick++) {
+
+        CSTimingWheelEntry *expired = CSTimingWheelAdvance(&CSTestWheel, tick);
+        for (CSTimingWheelEntry *entry = expired; entry; entry = entry->next) {
+            CSTestAssert(entry->deadline == tick, "entry with deadline %llu expired at %llu", (unsigned long long)entry->deadline, (unsigned long long)tick);
+        }
+        expiredCount += CSCheckExpiredList(expired, tick);
+    }
+    CSTestAssert(expiredCount == count, "expired %zu", expiredCount);
+    CSTestAssert(CSTestWheel.count == 0, "count %zu", CSTestWheel.count);
+
+    uint64_t nextTick = 0;
+    CSTestAssert(!CSTimingWheelNextTick(&CSTestWheel, &nextTick), "empty wheel has no next tick");
+}
+
+static void testPastDeadline(void) {
+
+    CSTimingWheelInit(&CSTestWheel, 1000);
+
+    CSTimingWheelEntry past, current;
+    memset(&past, 0, sizeof(past));
+    memset(&current, 0, sizeof(current));
+
+    //slot of current tick was already processed so both expire on next advance
+    CSTimingWheelInsert(&CSTestWheel, &past, 10);
+    CSTimingWheelInsert(&CSTestWheel, &current, 1000);
+    CSTestAssert(past.deadline == 1001 && current.deadline == 1001, "deadlines %llu %llu", (unsigned long long)past.deadline, (unsigned long long)current.deadline);
+
+    uint64_t nextTick = 0;
+    CSTestAssert(CSTimingWheelNextTick(&CSTestWheel, &nextTick) && nextTick == 1001, "next tick %llu", (unsigned long long)nextTick);
+
+    CSTimingWheelEntry *expired = CSTimingWheelAdvance(&CSTestWheel, 1001);
+    CSTestAssert(CSCheckExpiredList(expired, 1001) == 2, "both expired");
+    CSTestAssert(expired == &past && expired->next == &current, "expired in insertion order");
+}
+
+static void testRemove(void) {
+
+    CSTimingWheelInit(&CSTestWheel, 0);
+
+    CSTimingWheelEntry entries[4];
+    memset(entries, 0, sizeof(entries));
+
+    //unscheduled entry is ignored
+    CSTimingWheelRemove(&CSTestWheel, &entries[0]);
+    CSTestAssert(CSTestWheel.count == 0, "count %zu", CSTestWheel.count);
+
+    for (size_t i = 0; i < 4; i++) {
+        CSTimingWheelInsert(&CSTestWheel, &entries[i], 100);
+    }
+    CSTimingWheelRemove(&CSTestWheel, &entries[1]);
+    CSTimingWheelRemove(&CSTestWheel, &entries[1]);
+    CSTestAssert(!CSTimingWheelEntryIsScheduled(&entries[1]), "removed entry is unscheduled");
+    CSTestAssert(CSTestWheel.count == 3, "count %zu", CSTestWheel.count);
+
+    CSTimingWheelEntry *expired = CSTimingWheelAdvance(&CSTestWheel, 100);
+    CSTestAssert(expired == &entries[0] && expired->next == &entries[2] && expired->next->next == &entries[3] && !entries[3].next, "remaining entries expired");
+
+    //removing last entry of slot clears it so next tick doesn't point at empty slot
+    CSTimingWheelInsert(&CSTestWheel, &entries[0], 5000);
+    CSTimingWheelInsert(&CSTestWheel, &entries[1], 300000);
+    CSTimingWheelRemove(&CSTestWheel, &entries[0]);
+
+    uint64_t nextTick = 0;
+    CSTestAssert(CSTimingWheelNextTick(&CSTestWheel, &nextTick), "wheel isn't empty");
+    CSTestAssert(nextTick > 5000 && nextTick <= 300000, "next tick %llu", (unsigned long long)nextTick);
+
+    CSTimingWheelRemove(&CSTestWheel, &entries[1]);
+    CSTestAssert(!CSTimingWheelNextTick(&CSTestWheel, &nextTick), "empty wheel has no next tick");
+    CSTestAssert(CSTimingWheelAdvance(&CSTestWheel, 1000000) == NULL, "nothing expires");
+}
+
+static void testOverflow(void) {
+
+    uint64_t start = 77;
+    CSTimingWheelInit(&CSTestWheel, start);
+
+    //beyond 2^36 ticks covered by levels
+    CSTimingWheelEntry far, farther;
+    memset(&far, 0, sizeof(far));
+    memset(&farther, 0, sizeof(farther));
+    uint64_t farDeadline = start + (UINT64_C(1) << 40) + 5;
+    uint64_t fartherDeadline = start + (UINT64_C(1) << 50) + 3;
+    CSTimingWheelInsert(&CSTestWheel, &farther, fartherDeadline);
+    CSTimingWheelInsert(&CSTestWheel, &far, farDeadline);
+
+    CSTestAssert(CSTimingWheelAdvance(&CSTestWheel, farDeadline - 1) == NULL, "nothing expires before deadline");
+    CSTestAssert(CSTestWheel.currentTick == farDeadline - 1, "current tick %llu", (unsigned long long)CSTestWheel.currentTick);
+
+    CSTimingWheelEntry *expired = CSTimingWheelAdvance(&CSTestWheel, farDeadline);
+    CSTestAssert(expired == &far && !far.next, "far entry expired");
+
+    expired = CSTimingWheelAdvance(&CSTestWheel, UINT64_MAX - 1);
+    CSTestAssert(expired == &farther && !farther.next, "farther entry expired");
+    CSTestAssert(CSTestWheel.count == 0, "count %zu", CSTestWheel.count);
+}
+
+/**
+ *  Random inserts, removes and advances of random length compared against plain array of deadlines.
+ */
+static void testAgainstModel(void) {
+
+    enum { count = 2000 };
+    static CSTimingWheelEntry entries[count];
+    static uint64_t deadlines[count];
+    memset(entries, 0, sizeof(entries));
+
+    uint64_t state = 3;
+    uint64_t tick = 5;
+    CSTimingWheelInit(&CSTestWheel, tick);
+
+    for (unsigned round = 0; round < 20000; round++) {
+
+        size_t index = (size_t)(CSTestRandom(&state) % count);
+        CSTimingWheelEntry *entry = &entries[index];
+
+        switch (CSTestRandom(&state) % 4) {
+            case 0:
+            case 1:
+                if (!CSTimingWheelEntryIsScheduled(entry)) {
+                    uint64_t deadline = tick + CSRandomDistance(&state);
+                    CSTimingWheelInsert(&CSTestWheel, entry, deadline);
+                    deadlines[index] = (deadline > tick ? deadline : tick + 1);
+                }
+                break;
+            case 2:
+                CSTimingWheelRemove(&CSTestWheel, entry);
+                break;
+            default: {
+
+                //advance either to next tick reported by wheel, as scheduler does, or by random distance
+                uint64_t target = tick + CSRandomDistance(&state);
+                uint64_t nextTick = 0;
+                if (CSTestRandom(&state) % 2 && CSTimingWheelNextTick(&CSTestWheel, &nextTick)) {
+                    CSTestAssert(nextTick > tick, "next tick %llu isn't after %llu", (unsigned long long)nextTick, (unsigned long long)tick);
+                    target = nextTick;
+                }
+
+                size_t expectedCount = 0;
+                uint64_t earliestRemaining = UINT64_MAX;
+                for (size_t i = 0; i < count; i++) {
+                    if (CSTimingWheelEntryIsScheduled(&entries[i])) {
+                        if (deadlines[i] <= target) {
+                            expectedCount++;
+                        }
+                        else if (deadlines[i] < earliestRemaining) {
+                            earliestRemaining = deadlines[i];
+                        }
+                    }
+                }
+
+                CSTimingWheelEntry *expired = CSTimingWheelAdvance(&CSTestWheel, target);
+                size_t expiredCount = CSCheckExpiredList(expired, target);
+                CSTestAssert(expiredCount == expectedCount, "round %u: expired %zu, expected %zu", round, expiredCount, expectedCount);
+                tick = target;
+
+                //wheel must not skip over earliest deadline
+                if (CSTimingWheelNextTick(&CSTestWheel, &nextTick)) {
+                    CSTestAssert(nextTick <= earliestRemaining, "round %u: next tick %llu after deadline %llu", round, (unsigned long long)nextTick, (unsigned long long)earliestRemaining);
+                }
+                break;
+            }
+        }
+    }
+
+    size_t scheduledCount = 0;
+    for (size_t i = 0; i < count; i++) {
+        scheduledCount += CSTimingWheelEntryIsScheduled(&entries[i]);
+    }
+    CSTestAssert(scheduledCount == CSTestWheel.count, "scheduled %zu, count %zu", scheduledCount, CSTestWheel.count);
+}
+
+#pragma mark - Benchmark
+
+/**
+ *  Schedules, cancels and fires 1M notifications spread over 30 days at tick of 0.1 s which scheduled notification center uses. Wheel is advanced from one next tick to another, as center does with its timer.
+ */
+static void benchmark(void) {
+
+    enum { count = 1000000 };
+    uint64_t span = UINT64_C(30) * 24 * 3600 * 10;
+    uint64_t start = UINT64_C(1) << 33;
+
+    CSTimingWheelEntry *entries = calloc(count, sizeof(CSTimingWheelEntry));
+    uint64_t *deadlines = malloc(count * sizeof(uint64_t));
+    uint64_t state = 7;
+    for (size_t i = 0; i < count; i++) {
+        deadlines[i] = start + 1 + CSTestRandom(&state) % span;
+    }
+
+    CSTimingWheelInit(&CSTestWheel, start);
+    double time = CSTestTime();
+    for (size_t i = 0; i < count; i++) {
+        CSTimingWheelInsert(&CSTestWheel, &entries[i], deadlines[i]);
+    }
+    double insertTime = CSTestTime() - time;
+
+    //cancel in different order than scheduled so removes touch cold slots
+    time = CSTestTime();
+    for (size_t i = 0; i < count; i++) {
+        CSTimingWheelRemove(&CSTestWheel, &entries[(i * 7919) % count]);
+    }
+    double removeTime = CSTestTime() - time;
+
+    for (size_t i = 0; i < count; i++) {
+        CSTimingWheelInsert(&CSTestWheel, &entries[i], deadlines[i]);
+    }
+
+    time = CSTestTime();
+    size_t expiredCount = 0;
+    size_t advancesCount = 0;
+    uint64_t tick = 0;
+    while (CSTimingWheelNextTick(&CSTestWheel, &tick)) {
+        for (CSTimingWheelEntry *entry = CSTimingWheelAdvance(&CSTestWheel, tick); entry; entry = entry->next) {
+            expiredCount++;
+        }
+        advancesCount++;
+    }
+    double advanceTime = CSTestTime() - time;
+
+    printf("timing wheel, %d entries over 30 days of 0.1 s ticks: insert %.1f ns, remove %.1f ns, fire %.1f ns per entry (%zu fired in %zu advances, %.1f ms total)\n",
+           count, insertTime / count * 1e9, removeTime / count * 1e9, advanceTime / (double)expiredCount * 1e9,
+           expiredCount, advancesCount, advanceTime * 1e3);
+
+    free(deadlines);
+    free(entries);
+}
+
+int main(int argc, char *argv[]) {
+
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        benchmark();
+        return EXIT_SUCCESS;
+    }
+
+    CSTestRun(testExpiresExactlyAtDeadline);
+    CSTestRun(testPastDeadline);
+    CSTestRun(testRemove);
+    CSTestRun(testOverflow);
+    CSTestRun(testAgainstModel);
+    return CSTestFinish();
+}
@@ -0,0 +1,502 @@
+//
+//  CSWorkStealingPoolTests.c
+//  CSUtilsCoreTests
+//
+//  Created by Josip Bernat on 19/03/14.
+//  Copyright (c) 2014 Clover-Studio. All rights reserved.
+//
+
+#include "CSTest.h"
+#include "CSWorkStealingPool.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+
+static CSWorkStealingPool *CSTestPool = NULL;
+
+#pragma mark - Every Task Runs Once
+
+#define CSEveryTaskCount 20000
+
+static _Atomic(unsigned) CSEveryTaskRuns[CSEveryTaskCount];
+
+static void CSEveryTaskFunction(void *context) {
+
+    uintptr_t index = (uintptr_t)context;
+    atomic_fetch_add(&CSEveryTaskRuns[index], 1);
+
+    //first half spawns second half from pool threads
+    if (index < CSEveryTaskCount / 2) {
+        CSWorkStealingPoolSubmit(CSTestPool, CSEveryTaskFunction, (void *)(index + CSEveryTaskCount / 2), (CSWorkStealingPriority)(index % 3));
+    }
+}
+
+static void testEveryTaskRunsOnce(void) {
+
+    for (unsigned i = 0; i < CSEveryTaskCount; i++) {
+        atomic_init(&CSEveryTaskRuns[i], 0);
+    }
+
+    CSTestPool = CSWorkStealingPoolCreate(4, "tests");
+    CSTestAssert(CSTestPool != NULL, "pool");
+    CSTestAssert(CSWorkStealingPoolThreadsCount(CSTestPool) == 4, "threads count");
+
+    for (uintptr_t i = 0; i < CSEveryTaskCount / 2; i++) {
+        CSTestAssert(CSWorkStealingPoolSubmit(CSTestPool, CSEveryTaskFunction, (void *)i, (CSWorkStealingPriority)(i % 3)), "submit %zu", (size_t)i);
+    }
+    CSWorkStealingPoolDestroy(CSTestPool);
+    CSTestPool = NULL;
+
+    for (unsigned i = 0; i < CSEveryTaskCount; i++) {
+        unsigned runs = atomic_load(&CSEveryTaskRuns[i]);
+        CSTestAssert(runs == 1, "task %u ran %u times", i, runs);
+    }
+}
+
+#pragma mark - Fork Join
+
+static _Atomic(uint64_t) CSForkJoinLeaves;
+
+static void CSForkJoinFunction(void *context) {
+
+    uintptr_t depth = (uintptr_t)context;
+    if (depth == 0) {
+        atomic_fetch_add_explicit(&CSForkJoinLeaves, 1, memory_order_relaxed);
+        return;
+    }
+    CSWorkStealingPoolSubmit(CSTestPool, CSForkJoinFunction, (void *)(depth - 1), CSWorkStealingPriorityNormal);
+    CSWorkStealingPoolSubmit(CSTestPool, CSForkJoinFunction, (void *)(depth - 1), CSWorkStealingPriorityNormal);
+}
+
+static void testForkJoin(void) {
+
+    unsigned threadsCounts[] = {1, 2, 8};
+    for (size_t i = 0; i < sizeof(threadsCounts) / sizeof(threadsCounts[0]); i++) {
+
+        atomic_store(&CSForkJoinLeaves, 0);
+        CSTestPool = CSWorkStealingPoolCreate(threadsCounts[i], "tests");
+        CSWorkStealingPoolSubmit(CSTestPool, CSForkJoinFunction, (void *)(uintptr_t)16, CSWorkStealingPriorityNormal);
+        CSWorkStealingPoolDestroy(CSTestPool);
+        CSTestPool = NULL;
+
+        uint64_t leaves = atomic_load(&CSForkJoinLeaves);
+        CSTestAssert(leaves == (UINT64_C(1) << 16), "%u threads: %llu leaves", threadsCounts[i], (unsigned long long)leaves);
+    }
+}
+
+#pragma mark - Deque Growth
+
+#define CSGrowthTasksCount 10000
+
+static _Atomic(unsigned) CSGrowthRuns;
+
+static void CSGrowthTaskFunction(void *context) {
+    (void)context;
+    atomic_fetch_add_explicit(&CSGrowthRuns, 1, memory_order_relaxed);
+}
+
+static void CSGrowthSpawnFunction(void *context) {
+
+    (void)context;
+    //pushes to own deque far past its initial capacity while other threads steal from it
+    for (unsigned i = 0; i < CSGrowthTasksCount; i++) {
+        CSWorkStealingPoolSubmit(CSTestPool, CSGrowthTaskFunction, NULL, CSWorkStealingPriorityLow);
+    }
+}
+
+static void testDequeGrowth(void) {
+
+    unsigned threadsCounts[] = {1, 4};
+    for (size_t i = 0; i < sizeof(threadsCounts) / sizeof(threadsCounts[0]); i++) {
+
+        atomic_store(&CSGrowthRuns, 0);
+        CSTestPool = CSWorkStealingPoolCreate(threadsCounts[i], "tests");
+        CSWorkStealingPoolSubmit(CSTestPool, CSGrowthSpawnFunction, NULL, CSWorkStealingPriorityNormal);
+        CSWorkStealingPoolDestroy(CSTestPool);
+        CSTestPool = NULL;
+
+        unsigned runs = atomic_load(&CSGrowthRuns);
+        CSTestAssert(runs == CSGrowthTasksCount, "%u threads: %u runs", threadsCounts[i], runs);
+    }
+}
+
+#pragma mark - Priorities
+
+#define CSPriorityTasksCount 100
+
+static _Atomic(bool) CSPriorityBlockerStarted;
+static _Atomic(bool) CSPriorityBlockerReleased;
+static _Atomic(unsigned) CSPriorityLogLength;
+static CSWorkStealingPriority CSPriorityLog[4 * CSPriorityTasksCount];
+
+static void CSPriorityLogFunction(void *context) {
+
+    unsigned index = atomic_fetch_add(&CSPriorityLogLength, 1);
+    CSPriorityLog[index] = (CSWorkStealingPriority)(uintptr_t)context;
+}
+
+static void CSPriorityBlockerFunction(void *context) {
+
+    (void)context;
+    atomic_store(&CSPriorityBlockerStarted, true);
+    while (!atomic_load(&CSPriorityBlockerReleased)) {
+        sched_yield();
+    }
+}
+
+static void CSPrioritySpawnFunction(void *context) {
+
+    (void)context;
+    for (uintptr_t i = 0; i < CSPriorityTasksCount; i++) {
+        CSWorkStealingPoolSubmit(CSTestPool, CSPriorityLogFunction, (void *)(uintptr_t)CSWorkStealingPriorityLow, CSWorkStealingPriorityLow);
+    }
+    for (uintptr_t i = 0; i < CSPriorityTasksCount; i++) {
+        CSWorkStealingPoolSubmit(CSTestPool, CSPriorityLogFunction, (void *)(uintptr_t)CSWorkStealingPriorityHigh, CSWorkStealingPriorityHigh);
+    }
+}
+
+static void testPriorities(void) {
+
+    //single thread is kept busy while tasks are queued so order of execution is determined by priorities only
+    atomic_store(&CSPriorityBlockerStarted, false);
+    atomic_store(&CSPriorityBlockerReleased, false);
+    atomic_store(&CSPriorityLogLength, 0);
+
+    CSTestPool = CSWorkStealingPoolCreate(1, "tests");
+    CSWorkStealingPoolSubmit(CSTestPool, CSPriorityBlockerFunction, NULL, CSWorkStealingPriorityNormal);
+    while (!atomic_load(&CSPriorityBlockerStarted)) {
+        sched_yield();
+    }
+
+    for (uintptr_t i = 0; i < CSPriorityTasksCount; i++) {
+        CSWorkStealingPoolSubmit(CSTestPool, CSPriorityLogFunction, (void *)(uintptr_t)CSWorkStealingPriorityLow, CSWorkStealingPriorityLow);
+    }
+    for (uintptr_t i = 0; i < CSPriorityTasksCount; i++) {
+        CSWorkStealingPoolSubmit(CSTestPool, CSPriorityLogFunction, (void *)(uintptr_t)CSWorkStealingPriorityHigh, CSWorkStealingPriorityHigh);
+    }
+    atomic_store(&CSPriorityBlockerReleased, true);
+    CSWorkStealingPoolDestroy(CSTestPool);
+
+    CSTestAssert(atomic_load(&CSPriorityLogLength) == 2 * CSPriorityTasksCount, "log length %u", atomic_load(&CSPriorityLogLength));
+    for (unsigned i = 0; i < 2 * CSPriorityTasksCount; i++) {
+        CSWorkStealingPriority expected = (i < CSPriorityTasksCount ? CSWorkStealingPriorityHigh : CSWorkStealingPriorityLow);
+        CSTestAssert(CSPriorityLog[i] == expected, "submitted from outside, task %u has priority %d", i, CSPriorityLog[i]);
+    }
+
+    //the same for tasks submitted to own deque
+    atomic_store(&CSPriorityLogLength, 0);
+    CSTestPool = CSWorkStealingPoolCreate(1, "tests");
+    CSWorkStealingPoolSubmit(CSTestPool, CSPrioritySpawnFunction, NULL, CSWorkStealingPriorityNormal);
+    CSWorkStealingPoolDestroy(CSTestPool);
+    CSTestPool = NULL;
+
+    CSTestAssert(atomic_load(&CSPriorityLogLength) == 2 * CSPriorityTasksCount, "log length %u", atomic_load(&CSPriorityLogLength));
+    for (unsigned i = 0; i < 2 * CSPriorityTasksCount; i++) {
+        CSWorkStealingPriority expected = (i < CSPriorityTasksCount ? CSWorkStealingPriorityHigh : CSWorkStealingPriorityLow);
+        CSTestAssert(CSPriorityLog[i] == expected, "submitted from pool thread, task %u has priority %d", i, CSPriorityLog[i]);
+    }
+}
+
+#pragma mark - Pool Lifecycle
+
+static _Atomic(unsigned) CSLifecycleRuns;
+static _Atomic(unsigned) CSLifecycleOnPoolThread;
+
+static void CSLifecycleFunction(void *context) {
+
+    (void)context;
+    struct timespec delay = {0, 10000};
+    nanosleep(&delay, NULL);
+
+    if (CSWorkStealingPoolIsCurrentThread(CSTestPool)) {
+        atomic_fetch_add(&CSLifecycleOnPoolThread, 1);
+    }
+    atomic_fetch_add(&CSLifecycleRuns, 1);
+}
+
+static void testLifecycle(void) {
+
+    CSTestAssert(CSWorkStealingPoolCreate(0, "tests") == NULL, "pool without threads");
+
+    atomic_store(&CSLifecycleRuns, 0);
+    atomic_store(&CSLifecycleOnPoolThread, 0);
+
+    CSTestPool = CSWorkStealingPoolCreate(3, NULL);
+    CSTestAssert(!CSWorkStealingPoolIsCurrentThread(CSTestPool), "main thread isn't pool thread");
+
+    //destroy is called while most tasks still wait and must run them all
+    for (unsigned i = 0; i < 1000; i++) {
+        CSWorkStealingPoolSubmit(CSTestPool, CSLifecycleFunction, NULL, (CSWorkStealingPriority)(i % 3));
+    }
+    CSWorkStealingPoolDestroy(CSTestPool);
+    CSTestPool = NULL;
+
+    CSTestAssert(atomic_load(&CSLifecycleRuns) == 1000, "runs %u", atomic_load(&CSLifecycleRuns));
+    CSTestAssert(atomic_load(&CSLifecycleOnPoolThread) == 1000, "on pool thread %u", atomic_load(&CSLifecycleOnPoolThread));
+
+    //pool which never got any task stops as well
+    CSWorkStealingPoolDestroy(CSWorkStealingPoolCreate(2, "tests"));
+    CSWorkStealingPoolDestroy(NULL);
+}
+
+#pragma mark - Benchmark
+
+/**
+ *  Reference pool: one FIFO queue under one lock, what NSOperationQueue and most thread pools boil down to. Priorities are ignored.
+ */
+typedef struct CSFIFOTask {
+    CSWorkStealingFunction function;
+    void *context;
+    struct CSFIFOTask *next;
+} CSFIFOTask;
+
+typedef struct CSFIFOPool {
+    pthread_mutex_t lock;
+    pthread_cond_t condition;
+    CSFIFOTask *head;
+    CSFIFOTask *tail;
+    bool stopping;
+    unsigned threadsCount;
+    pthread_t *threads;
+} CSFIFOPool;
+
+static void *CSFIFOPoolMain(void *argument) {
+
+    CSFIFOPool *pool = (CSFIFOPool *)argument;
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+
+        while (!pool->head && !pool->stopping) {
+            pthread_cond_wait(&pool->condition, &pool->lock);
+        }
+        CSFIFOTask *task = pool->head;
+        if (!task) {
+            break;
+        }
+        pool->head = task->next;
+        if (!pool->head) {
+            pool->tail = NULL;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        task->function(task->context);
+        free(task);
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static void *CSFIFOPoolCreate(unsigned threadsCount) {
+
+    CSFIFOPool *pool = calloc(1, sizeof(CSFIFOPool));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->condition, NULL);
+    pool->threadsCount = threadsCount;
+    pool->threads = calloc(threadsCount, sizeof(pthread_t));
+    for (unsigned i = 0; i < threadsCount; i++) {
+        pthread_create(&pool->threads[i], NULL, CSFIFOPoolMain, pool);
+    }
+    return pool;
+}
+
+static void CSFIFOPoolDestroy(void *argument) {
+
+    CSFIFOPool *pool = (CSFIFOPool *)argument;
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->condition);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (unsigned i = 0; i < pool->threadsCount; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->condition);
+    free(pool->threads);
+    free(pool);
+}
+
+static bool CSFIFOPoolSubmit(void *argument, CSWorkStealingFunction function, void *context, CSWorkStealingPriority priority) {
+
+    (void)priority;
+    CSFIFOPool *pool = (CSFIFOPool *)argument;
+    CSFIFOTask *task = malloc(sizeof(CSFIFOTask));
+    task->function = function;
+    task->context = context;
+    task->next = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail) {
+        pool->tail->next = task;
+    }
+    else {
+        pool->head = task;
+    }
+    pool->tail = task;
+    pthread_cond_signal(&pool->condition);
+    pthread_mutex_unlock(&pool->lock);
+    return true;
+}
+
+static void *CSStealingPoolCreate(unsigned threadsCount) {
+    return CSWorkStealingPoolCreate(threadsCount, "bench");
+}
+
+static void CSStealingPoolDestroy(void *pool) {
+    CSWorkStealingPoolDestroy((CSWorkStealingPool *)pool);
+}
+
+static bool CSStealingPoolSubmit(void *pool, CSWorkStealingFunction function, void *context, CSWorkStealingPriority priority) {
+    return CSWorkStealingPoolSubmit((CSWorkStealingPool *)pool, function, context, priority);
+}
+
+typedef struct CSBenchPoolType {
+    const char *name;
+    void *(*create)(unsigned threadsCount);
+    void (*destroy)(void *pool);
+    bool (*submit)(void *pool, CSWorkStealingFunction function, void *context, CSWorkStealingPriority priority);
+} CSBenchPoolType;
+
+static const CSBenchPoolType CSBenchPoolTypes[] = {
+    {"FIFO pool         ", CSFIFOPoolCreate, CSFIFOPoolDestroy, CSFIFOPoolSubmit},
+    {"CSWorkStealingPool", CSStealingPoolCreate, CSStealingPoolDestroy, CSStealingPoolSubmit},
+};
+
+static const CSBenchPoolType *CSBenchType = NULL;
+static void *CSBenchPool = NULL;
+static _Atomic(uint64_t) CSBenchCounter;
+
+static void CSBenchSpin(unsigned iterations) {
+
+    volatile unsigned sink = 0;
+    for (unsigned i = 0; i < iterations; i++) {
+        sink += i;
+    }
+}
+
+static void CSBenchTinyFunction(void *context) {
+
+    (void)context;
+    CSBenchSpin(50);
+    atomic_fetch_add_explicit(&CSBenchCounter, 1, memory_order_relaxed);
+}
+
+static void CSBenchForkFunction(void *context) {
+
+    uintptr_t depth = (uintptr_t)context;
+    CSBenchSpin(50);
+    if (depth == 0) {
+        atomic_fetch_add_explicit(&CSBenchCounter, 1, memory_order_relaxed);
+        return;
+    }
+    CSBenchType->submit(CSBenchPool, CSBenchForkFunction, (void *)(depth - 1), CSWorkStealingPriorityNormal);
+    CSBenchType->submit(CSBenchPool, CSBenchForkFunction, (void *)(depth - 1), CSWorkStealingPriorityNormal);
+}
+
+#define CSBenchProbesCount 2000
+
+static _Atomic(bool) CSBenchLoadStopped;
+static double CSBenchProbeSubmitTimes[CSBenchProbesCount];
+static double CSBenchProbeLatencies[CSBenchProbesCount];
+
+static void CSBenchLoadFunction(void *context) {
+
+    //background work which keeps resubmitting itself, like stream of parsing or decoding tasks
+    CSBenchSpin(20000);
+    if (!atomic_load_explicit(&CSBenchLoadStopped, memory_order_relaxed)) {
+        CSBenchType->submit(CSBenchPool, CSBenchLoadFunction, context, CSWorkStealingPriorityLow);
+    }
+}
+
+static void CSBenchProbeFunction(void *context) {
+
+    uintptr_t index = (uintptr_t)context;
+    CSBenchProbeLatencies[index] = CSTestTime() - CSBenchProbeSubmitTimes[index];
+    atomic_fetch_add(&CSBenchCounter, 1);
+}
+
+static int CSCompareDoubles(const void *first, const void *second) {
+
+    double a = *(const double *)first;
+    double b = *(const double *)second;
+    return (a > b) - (a < b);
+}
+
+static void benchmark(void) {
+
+    long processorsCount = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned threadsCount = (unsigned)(processorsCount > 1 ? processorsCount : 1);
+    printf("work-stealing pool, %u threads\n", threadsCount);
+
+    for (size_t i = 0; i < sizeof(CSBenchPoolTypes) / sizeof(CSBenchPoolTypes[0]); i++) {
+
+        CSBenchType = &CSBenchPoolTypes[i];
+
+        //tasks submitted from outside the pool
+        unsigned tasksCount = 1000000;
+        atomic_store(&CSBenchCounter, 0);
+        CSBenchPool = CSBenchType->create(threadsCount);
+        double start = CSTestTime();
+        for (unsigned j = 0; j < tasksCount; j++) {
+            CSBenchType->submit(CSBenchPool, CSBenchTinyFunction, NULL, CSWorkStealingPriorityNormal);
+        }
+        CSBenchType->destroy(CSBenchPool);
+        double externalTime = CSTestTime() - start;
+
+        //tasks spawning tasks, 2^21 - 1 tasks
+        atomic_store(&CSBenchCounter, 0);
+        CSBenchPool = CSBenchType->create(threadsCount);
+        start = CSTestTime();
+        CSBenchType->submit(CSBenchPool, CSBenchForkFunction, (void *)(uintptr_t)20, CSWorkStealingPriorityNormal);
+        CSBenchType->destroy(CSBenchPool);
+        double forkTime = CSTestTime() - start;
+        double forkTasksCount = (double)((UINT64_C(1) << 21) - 1);
+
+        //start latency of interactive tasks while pool is saturated by background tasks
+        atomic_store(&CSBenchCounter, 0);
+        atomic_store(&CSBenchLoadStopped, false);
+        CSBenchPool = CSBenchType->create(threadsCount);
+        for (unsigned j = 0; j < 4 * threadsCount; j++) {
+            CSBenchType->submit(CSBenchPool, CSBenchLoadFunction, NULL, CSWorkStealingPriorityLow);
+        }
+        for (uintptr_t j = 0; j < CSBenchProbesCount; j++) {
+
+            struct timespec delay = {0, 200000};
+            nanosleep(&delay, NULL);
+            CSBenchProbeSubmitTimes[j] = CSTestTime();
+            CSBenchType->submit(CSBenchPool, CSBenchProbeFunction, (void *)j, CSWorkStealingPriorityHigh);
+        }
+        while (atomic_load(&CSBenchCounter) < CSBenchProbesCount) {
+            sched_yield();
+        }
+        atomic_store(&CSBenchLoadStopped, true);
+        CSBenchType->destroy(CSBenchPool);
+
+        qsort(CSBenchProbeLatencies, CSBenchProbesCount, sizeof(double), CSCompareDoubles);
+        double p50 = CSBenchProbeLatencies[CSBenchProbesCount / 2] * 1e6;
+        double p99 = CSBenchProbeLatencies[CSBenchProbesCount * 99 / 100] * 1e6;
+        double p999 = CSBenchProbeLatencies[CSBenchProbesCount * 999 / 1000] * 1e6;
+
+        printf("%s: external %5.2f Mtasks/s, spawned %5.2f Mtasks/s, interactive start latency p50 %7.1f us, p99 %7.1f us, p99.9 %7.1f us\n",
+               CSBenchType->name, (double)tasksCount / externalTime / 1e6, forkTasksCount / forkTime / 1e6, p50, p99, p999);
+    }
+}
+
+int main(int argc, char *argv[]) {
+
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        benchmark();
+        return EXIT_SUCCESS;
+    }
+
+    CSTestRun(testEveryTaskRunsOnce);
+    CSTestRun(testForkJoin);
+    CSTestRun(testDequeGrowth);
+    CSTestRun(testPriorities);
+    CSTestRun(testLifecycle);
+    return CSTestFinish();
+}